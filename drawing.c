@@ -5,7 +5,9 @@
  * 
  * Mostly just looks up calls in a vtable and passes them through
  * unchanged. However, on the printing side it tracks print colours
- * so the front end API doesn't have to.
+ * so the front end API doesn't have to. It can also record a frame's
+ * drawing commands and replay them in bulk at end_draw (see
+ * drawing_set_batching).
  * 
  * FIXME:
  * 
@@ -28,6 +30,7 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <limits.h>
 
 #include "puzzles.h"
 
@@ -38,6 +41,34 @@ struct print_colour {
     float grey;
 };
 
+/*
+ * Recorded drawing commands. Each command keeps its arguments, the
+ * clip rectangle in force when it was issued and its bounding box
+ * (already clipped), which is what replay uses to decide what can
+ * be reordered and what is completely hidden.
+ */
+enum { CMD_RECT, CMD_LINE, CMD_POLYGON, CMD_CIRCLE, CMD_TEXT, NCMDTYPES };
+
+struct draw_area {
+    int x, y, w, h;
+};
+
+struct draw_command {
+    int type;
+    int clip;			       /* index into dr->clips, or -1 */
+    int x1, y1, x2, y2;		       /* bounding box, half-open */
+    int layer;
+    int args[6];
+    int data;			       /* offset into cmdints or cmdchars */
+};
+
+/*
+ * Commands are bucketed into square cells of this many pixels (or
+ * more, for a very large frame) when working out overlaps.
+ */
+#define CMD_CELL_SIZE 32
+#define CMD_MAX_CELLS 4096
+
 struct drawing {
     const drawing_api *api;
     void *handle;
@@ -48,6 +79,28 @@ struct drawing {
      * this may set it to NULL. */
     midend *me;
     char *laststatus;
+    /*
+     * Command recording. The buffers below are only ever grown, and
+     * are reused from one frame to the next.
+     */
+    int batching, recording;
+    struct draw_command *cmds;
+    int ncmds, cmdsize;
+    int *cmdints;
+    int nints, intsize;
+    char *cmdchars;
+    int nchars, charsize;
+    struct draw_area *clips;
+    int nclips, clipsize, curclip;
+    /*
+     * The clip rectangle the front end actually has in force: an
+     * index into clips[], -1 for none, or -2 if we don't know.
+     */
+    int apiclip;
+    struct draw_area *updates;
+    int nupdates, updatesize;
+    int *order, *cells, *nodes;
+    int ordersize, cellsize, nodesize;
 };
 
 drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
@@ -60,6 +113,21 @@ drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
     dr->scale = 1.0F;
     dr->me = me;
     dr->laststatus = NULL;
+    dr->batching = dr->recording = FALSE;
+    dr->cmds = NULL;
+    dr->ncmds = dr->cmdsize = 0;
+    dr->cmdints = NULL;
+    dr->nints = dr->intsize = 0;
+    dr->cmdchars = NULL;
+    dr->nchars = dr->charsize = 0;
+    dr->clips = NULL;
+    dr->nclips = dr->clipsize = 0;
+    dr->curclip = -1;
+    dr->apiclip = -2;
+    dr->updates = NULL;
+    dr->nupdates = dr->updatesize = 0;
+    dr->order = dr->cells = dr->nodes = NULL;
+    dr->ordersize = dr->cellsize = dr->nodesize = 0;
     return dr;
 }
 
@@ -67,29 +135,409 @@ void drawing_free(drawing *dr)
 {
     sfree(dr->laststatus);
     sfree(dr->colours);
+    sfree(dr->cmds);
+    sfree(dr->cmdints);
+    sfree(dr->cmdchars);
+    sfree(dr->clips);
+    sfree(dr->updates);
+    sfree(dr->order);
+    sfree(dr->cells);
+    sfree(dr->nodes);
     sfree(dr);
 }
 
+/* ----------------------------------------------------------------------
+ * Command recording.
+ *
+ * With batching switched on, everything drawn between start_draw and
+ * end_draw is appended to a buffer instead of going straight to the
+ * front end. At end_draw the buffer is replayed:
+ *
+ *  - commands whose visible area is entirely covered by a later
+ *    draw_rect are dropped (lots of games paint a background and
+ *    then tiles over all of it);
+ *  - the rest are grouped by primitive type, moving a command
+ *    ahead of earlier ones only where their bounding boxes don't
+ *    overlap, so the final picture is unchanged;
+ *  - then the draw_updates are passed on.
+ *
+ * Anything which reads back from or writes to the screen behind our
+ * back (blitters, the status bar) forces what we have so far to be
+ * replayed first.
+ */
+
+#define ENSURE(array, n, size, type) do { \
+    if ((n) > (size)) { \
+	(size) = (n) + (n) / 2 + 16; \
+	(array) = sresize((array), (size), type); \
+    } \
+} while (0)
+
+void drawing_set_batching(drawing *dr, int batching)
+{
+    /* Takes effect from the next start_draw. */
+    dr->batching = batching;
+}
+
+int drawing_get_batching(drawing *dr)
+{
+    return dr->batching;
+}
+
+/*
+ * Adds a command with the given (unclipped, half-open) bounding box.
+ * Returns NULL if the clip rectangle hides it completely.
+ */
+static struct draw_command *record_command(drawing *dr, int type,
+					   int x1, int y1, int x2, int y2)
+{
+    struct draw_command *cmd;
+
+    if (dr->curclip >= 0) {
+	struct draw_area *c = &dr->clips[dr->curclip];
+	x1 = max(x1, c->x);
+	y1 = max(y1, c->y);
+	x2 = min(x2, c->x + c->w);
+	y2 = min(y2, c->y + c->h);
+    }
+    if (x1 >= x2 || y1 >= y2)
+	return NULL;
+
+    ENSURE(dr->cmds, dr->ncmds + 1, dr->cmdsize, struct draw_command);
+    cmd = &dr->cmds[dr->ncmds++];
+    cmd->type = type;
+    cmd->clip = dr->curclip;
+    cmd->x1 = x1;
+    cmd->y1 = y1;
+    cmd->x2 = x2;
+    cmd->y2 = y2;
+    cmd->layer = 0;
+    cmd->data = -1;
+    return cmd;
+}
+
+static void set_api_clip(drawing *dr, int clipidx)
+{
+    if (clipidx >= 0) {
+	struct draw_area *c = &dr->clips[clipidx];
+	dr->api->clip(dr->handle, c->x, c->y, c->w, c->h);
+    } else
+	dr->api->unclip(dr->handle);
+    dr->apiclip = clipidx;
+}
+
+static void replay_command(drawing *dr, struct draw_command *cmd)
+{
+    int *a = cmd->args;
+
+    switch (cmd->type) {
+      case CMD_RECT:
+	dr->api->draw_rect(dr->handle, a[0], a[1], a[2], a[3], a[4]);
+	break;
+      case CMD_LINE:
+	dr->api->draw_line(dr->handle, a[0], a[1], a[2], a[3], a[4]);
+	break;
+      case CMD_POLYGON:
+	dr->api->draw_polygon(dr->handle, dr->cmdints + cmd->data,
+			      a[0], a[1], a[2]);
+	break;
+      case CMD_CIRCLE:
+	dr->api->draw_circle(dr->handle, a[0], a[1], a[2], a[3], a[4]);
+	break;
+      case CMD_TEXT:
+	dr->api->draw_text(dr->handle, a[0], a[1], a[2], a[3], a[4], a[5],
+			   dr->cmdchars + cmd->data);
+	break;
+    }
+}
+
+/*
+ * Works out the grid of cells covering every recorded command, and
+ * makes sure `cells' has room for `per_cell' ints per cell.
+ */
+static void command_grid(drawing *dr, int per_cell, int *gx, int *gy,
+			 int *gw, int *gh, int *cellsize)
+{
+    int i, x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+
+    for (i = 0; i < dr->ncmds; i++) {
+	x1 = min(x1, dr->cmds[i].x1);
+	y1 = min(y1, dr->cmds[i].y1);
+	x2 = max(x2, dr->cmds[i].x2);
+	y2 = max(y2, dr->cmds[i].y2);
+    }
+
+    *cellsize = CMD_CELL_SIZE;
+    while (((x2 - x1) / *cellsize + 1) * ((y2 - y1) / *cellsize + 1) >
+	   CMD_MAX_CELLS)
+	*cellsize *= 2;
+    *gx = x1;
+    *gy = y1;
+    *gw = (x2 - x1) / *cellsize + 1;
+    *gh = (y2 - y1) / *cellsize + 1;
+    ENSURE(dr->cells, *gw * *gh * per_cell, dr->cellsize, int);
+}
+
+/*
+ * Marks as dropped (layer -1) every command whose visible area is
+ * completely covered by a draw_rect issued after it.
+ *
+ * We walk backwards through the buffer, filing each rectangle under
+ * every grid cell it touches; a command can only be covered by a
+ * rectangle filed under the cell containing its top-left corner.
+ */
+static int drop_overdrawn_commands(drawing *dr)
+{
+    int gx, gy, gw, gh, cs;
+    int i, j, cx, cy, nnodes = 0, dropped = 0;
+    struct draw_command *cmd, *r;
+
+    command_grid(dr, 1, &gx, &gy, &gw, &gh, &cs);
+    for (i = 0; i < gw * gh; i++)
+	dr->cells[i] = -1;
+
+    for (i = dr->ncmds; i-- > 0 ;) {
+	cmd = &dr->cmds[i];
+
+	j = dr->cells[((cmd->y1 - gy) / cs) * gw + (cmd->x1 - gx) / cs];
+	for (; j >= 0; j = dr->nodes[j*2+1]) {
+	    r = &dr->cmds[dr->nodes[j*2]];
+	    if (r->x1 <= cmd->x1 && r->y1 <= cmd->y1 &&
+		r->x2 >= cmd->x2 && r->y2 >= cmd->y2)
+		break;
+	}
+	if (j >= 0) {
+	    cmd->layer = -1;
+	    dropped++;
+	    continue;
+	}
+
+	if (cmd->type == CMD_RECT) {
+	    for (cy = (cmd->y1 - gy) / cs; cy <= (cmd->y2 - 1 - gy) / cs; cy++)
+		for (cx = (cmd->x1 - gx) / cs; cx <= (cmd->x2 - 1 - gx) / cs;
+		     cx++) {
+		    ENSURE(dr->nodes, (nnodes + 1) * 2, dr->nodesize, int);
+		    dr->nodes[nnodes*2] = i;
+		    dr->nodes[nnodes*2+1] = dr->cells[cy * gw + cx];
+		    dr->cells[cy * gw + cx] = nnodes++;
+		}
+	}
+    }
+
+    return dropped;
+}
+
+/*
+ * Gives every surviving command a layer number such that, for any
+ * two overlapping commands, the later one has a higher layer if
+ * they are of different types and at least as high a layer if they
+ * are the same type. Drawing layer by layer, one type at a time and
+ * otherwise in the original order, then gives the same picture as
+ * drawing in the original order.
+ *
+ * Each grid cell remembers the highest layer used so far by each
+ * type of command touching it; overlap is judged by shared cells,
+ * which errs on the safe side.
+ */
+static void assign_command_layers(drawing *dr)
+{
+    int gx, gy, gw, gh, cs;
+    int i, t, cx, cy, layer, *cell;
+    struct draw_command *cmd;
+
+    command_grid(dr, NCMDTYPES, &gx, &gy, &gw, &gh, &cs);
+    for (i = 0; i < gw * gh * NCMDTYPES; i++)
+	dr->cells[i] = -1;
+
+    for (i = 0; i < dr->ncmds; i++) {
+	cmd = &dr->cmds[i];
+	if (cmd->layer < 0)
+	    continue;
+
+	layer = 0;
+	for (cy = (cmd->y1 - gy) / cs; cy <= (cmd->y2 - 1 - gy) / cs; cy++)
+	    for (cx = (cmd->x1 - gx) / cs; cx <= (cmd->x2 - 1 - gx) / cs; cx++) {
+		cell = dr->cells + (cy * gw + cx) * NCMDTYPES;
+		for (t = 0; t < NCMDTYPES; t++)
+		    if (cell[t] >= 0)
+			layer = max(layer, cell[t] + (t != cmd->type));
+	    }
+
+	cmd->layer = layer;
+	for (cy = (cmd->y1 - gy) / cs; cy <= (cmd->y2 - 1 - gy) / cs; cy++)
+	    for (cx = (cmd->x1 - gx) / cs; cx <= (cmd->x2 - 1 - gx) / cs; cx++) {
+		cell = dr->cells + (cy * gw + cx) * NCMDTYPES;
+		cell[cmd->type] = max(cell[cmd->type], layer);
+	    }
+    }
+}
+
+static drawing *sort_dr;		       /* for compare_commands */
+
+static int compare_commands(const void *av, const void *bv)
+{
+    int a = *(const int *)av, b = *(const int *)bv;
+    struct draw_command *ca = &sort_dr->cmds[a], *cb = &sort_dr->cmds[b];
+
+    if (ca->layer != cb->layer)
+	return ca->layer < cb->layer ? -1 : +1;
+    if (ca->type != cb->type)
+	return ca->type < cb->type ? -1 : +1;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+/*
+ * Replays everything recorded so far and empties the buffer,
+ * leaving the front end's clip rectangle as the game last set it.
+ */
+static void flush_commands(drawing *dr)
+{
+    int i, n;
+
+    if (dr->ncmds > 0) {
+	drop_overdrawn_commands(dr);
+	assign_command_layers(dr);
+
+	ENSURE(dr->order, dr->ncmds, dr->ordersize, int);
+	for (i = n = 0; i < dr->ncmds; i++)
+	    if (dr->cmds[i].layer >= 0)
+		dr->order[n++] = i;
+	sort_dr = dr;
+	qsort(dr->order, n, sizeof(int), compare_commands);
+
+	debug(("drawing: replaying %d commands, %d overdrawn\n",
+	       n, dr->ncmds - n));
+
+	for (i = 0; i < n; i++) {
+	    struct draw_command *cmd = &dr->cmds[dr->order[i]];
+	    if (cmd->clip != dr->apiclip)
+		set_api_clip(dr, cmd->clip);
+	    replay_command(dr, cmd);
+	}
+    }
+    if (dr->apiclip != dr->curclip)
+	set_api_clip(dr, dr->curclip);
+
+    if (dr->api->draw_update)
+	for (i = 0; i < dr->nupdates; i++)
+	    dr->api->draw_update(dr->handle, dr->updates[i].x, dr->updates[i].y,
+				 dr->updates[i].w, dr->updates[i].h);
+
+    /* Keep just the clip rectangle that's still in force. */
+    if (dr->curclip >= 0) {
+	dr->clips[0] = dr->clips[dr->curclip];
+	dr->curclip = dr->apiclip = 0;
+	dr->nclips = 1;
+    } else
+	dr->nclips = 0;
+    dr->ncmds = dr->nints = dr->nchars = dr->nupdates = 0;
+}
+
 void draw_text(drawing *dr, int x, int y, int fonttype, int fontsize,
                int align, int colour, char *text)
 {
+    if (dr->recording) {
+	/*
+	 * We've no way to ask the front end for the text extent, so
+	 * allow a generous two ems per byte and above the baseline.
+	 */
+	int len = strlen(text), w = 2 * fontsize * len;
+	int x1, y1, x2, y2;
+	struct draw_command *cmd;
+
+	if (align & ALIGN_HCENTRE)
+	    x1 = x - w/2 - fontsize, x2 = x + w/2 + fontsize;
+	else if (align & ALIGN_HRIGHT)
+	    x1 = x - w - fontsize, x2 = x + fontsize;
+	else
+	    x1 = x - fontsize, x2 = x + w;
+	y1 = y - 2 * fontsize;
+	y2 = y + 2 * fontsize;
+
+	cmd = record_command(dr, CMD_TEXT, x1, y1, x2, y2);
+	if (cmd) {
+	    cmd->args[0] = x;
+	    cmd->args[1] = y;
+	    cmd->args[2] = fonttype;
+	    cmd->args[3] = fontsize;
+	    cmd->args[4] = align;
+	    cmd->args[5] = colour;
+	    ENSURE(dr->cmdchars, dr->nchars + len + 1, dr->charsize, char);
+	    cmd->data = dr->nchars;
+	    memcpy(dr->cmdchars + dr->nchars, text, len + 1);
+	    dr->nchars += len + 1;
+	}
+	return;
+    }
+
     dr->api->draw_text(dr->handle, x, y, fonttype, fontsize, align,
 		       colour, text);
 }
 
 void draw_rect(drawing *dr, int x, int y, int w, int h, int colour)
 {
+    if (dr->recording) {
+	struct draw_command *cmd =
+	    record_command(dr, CMD_RECT, x, y, x + w, y + h);
+	if (cmd) {
+	    cmd->args[0] = x;
+	    cmd->args[1] = y;
+	    cmd->args[2] = w;
+	    cmd->args[3] = h;
+	    cmd->args[4] = colour;
+	}
+	return;
+    }
+
     dr->api->draw_rect(dr->handle, x, y, w, h, colour);
 }
 
 void draw_line(drawing *dr, int x1, int y1, int x2, int y2, int colour)
 {
+    if (dr->recording) {
+	/* Allow a pixel either side for anti-aliasing. */
+	struct draw_command *cmd =
+	    record_command(dr, CMD_LINE, min(x1, x2) - 1, min(y1, y2) - 1,
+			   max(x1, x2) + 2, max(y1, y2) + 2);
+	if (cmd) {
+	    cmd->args[0] = x1;
+	    cmd->args[1] = y1;
+	    cmd->args[2] = x2;
+	    cmd->args[3] = y2;
+	    cmd->args[4] = colour;
+	}
+	return;
+    }
+
     dr->api->draw_line(dr->handle, x1, y1, x2, y2, colour);
 }
 
 void draw_polygon(drawing *dr, int *coords, int npoints,
                   int fillcolour, int outlinecolour)
 {
+    if (dr->recording) {
+	int i, x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+	struct draw_command *cmd;
+
+	for (i = 0; i < npoints; i++) {
+	    x1 = min(x1, coords[i*2]);
+	    y1 = min(y1, coords[i*2+1]);
+	    x2 = max(x2, coords[i*2]);
+	    y2 = max(y2, coords[i*2+1]);
+	}
+	cmd = record_command(dr, CMD_POLYGON, x1 - 1, y1 - 1, x2 + 2, y2 + 2);
+	if (cmd) {
+	    cmd->args[0] = npoints;
+	    cmd->args[1] = fillcolour;
+	    cmd->args[2] = outlinecolour;
+	    ENSURE(dr->cmdints, dr->nints + npoints * 2, dr->intsize, int);
+	    cmd->data = dr->nints;
+	    memcpy(dr->cmdints + dr->nints, coords, npoints * 2 * sizeof(int));
+	    dr->nints += npoints * 2;
+	}
+	return;
+    }
+
     dr->api->draw_polygon(dr->handle, coords, npoints, fillcolour,
 			  outlinecolour);
 }
@@ -97,33 +545,87 @@ void draw_polygon(drawing *dr, int *coords, int npoints,
 void draw_circle(drawing *dr, int cx, int cy, int radius,
                  int fillcolour, int outlinecolour)
 {
+    if (dr->recording) {
+	struct draw_command *cmd =
+	    record_command(dr, CMD_CIRCLE, cx - radius - 1, cy - radius - 1,
+			   cx + radius + 2, cy + radius + 2);
+	if (cmd) {
+	    cmd->args[0] = cx;
+	    cmd->args[1] = cy;
+	    cmd->args[2] = radius;
+	    cmd->args[3] = fillcolour;
+	    cmd->args[4] = outlinecolour;
+	}
+	return;
+    }
+
     dr->api->draw_circle(dr->handle, cx, cy, radius, fillcolour,
 			 outlinecolour);
 }
 
 void draw_update(drawing *dr, int x, int y, int w, int h)
 {
+    if (dr->recording) {
+	ENSURE(dr->updates, dr->nupdates + 1, dr->updatesize,
+	       struct draw_area);
+	dr->updates[dr->nupdates].x = x;
+	dr->updates[dr->nupdates].y = y;
+	dr->updates[dr->nupdates].w = w;
+	dr->updates[dr->nupdates].h = h;
+	dr->nupdates++;
+	return;
+    }
+
     if (dr->api->draw_update)
 	dr->api->draw_update(dr->handle, x, y, w, h);
 }
 
 void clip(drawing *dr, int x, int y, int w, int h)
 {
+    if (dr->recording) {
+	ENSURE(dr->clips, dr->nclips + 1, dr->clipsize, struct draw_area);
+	dr->clips[dr->nclips].x = x;
+	dr->clips[dr->nclips].y = y;
+	dr->clips[dr->nclips].w = w;
+	dr->clips[dr->nclips].h = h;
+	dr->curclip = dr->nclips++;
+	return;
+    }
+
     dr->api->clip(dr->handle, x, y, w, h);
+    dr->apiclip = -2;
 }
 
 void unclip(drawing *dr)
 {
+    if (dr->recording) {
+	dr->curclip = -1;
+	return;
+    }
+
     dr->api->unclip(dr->handle);
+    dr->apiclip = -1;
 }
 
 void start_draw(drawing *dr)
 {
     dr->api->start_draw(dr->handle);
+
+    dr->recording = dr->batching;
+    dr->ncmds = dr->nints = dr->nchars = dr->nupdates = dr->nclips = 0;
+    dr->curclip = -1;
+    /* Any clip left over from last time no longer has an index. */
+    if (dr->apiclip >= 0)
+	dr->apiclip = -2;
 }
 
 void end_draw(drawing *dr)
 {
+    if (dr->recording) {
+	flush_commands(dr);
+	dr->recording = FALSE;
+    }
+
     dr->api->end_draw(dr->handle);
 }
 
@@ -134,6 +636,9 @@ void status_bar(drawing *dr, char *text)
     if (!dr->api->status_bar)
 	return;
 
+    if (dr->recording)
+	flush_commands(dr);
+
     assert(dr->me);
 
     rewritten = midend_rewrite_statusbar(dr->me, text);
@@ -158,11 +663,15 @@ void blitter_free(drawing *dr, blitter *bl)
 
 void blitter_save(drawing *dr, blitter *bl, int x, int y)
 {
+    if (dr->recording)
+	flush_commands(dr);
     dr->api->blitter_save(dr->handle, bl, x, y);
 }
 
 void blitter_load(drawing *dr, blitter *bl, int x, int y)
 {
+    if (dr->recording)
+	flush_commands(dr);
     dr->api->blitter_load(dr->handle, bl, x, y);
 }
 
@@ -381,6 +381,7 @@ static void make_board(int *board, int w, int h, random_state *rs) {
 	    }
 	} while (change);
 
+	dsf_canonify_all(dsf, sz);
 	for (i = 0; i < (int)sz; ++i) board[i] = dsf_size(dsf, i);
 
 	sfree(dsf);
@@ -819,6 +820,8 @@ static int *make_dsf(int *dsf, int *board, const int w, const int h) {
             if (board[i] == board[k]) dsf_merge(dsf, i, k);
         }
     }
+    /* Callers look up the size of every cell's region. */
+    dsf_canonify_all(dsf, sz);
     return dsf;
 }
 
@@ -834,10 +837,17 @@ static int filled(int *board, int *randomize, int k, int n) {
 }
 */
 
-static int *g_board;
+/*
+ * Sorting squares by the size of their region. The size travels
+ * with the index, rather than being looked up in a global board,
+ * because several generators may be running at once.
+ */
+struct sq_size {
+    int size, sq;
+};
 static int compare(const void *pa, const void *pb) {
-    if (!g_board) return 0;
-    return g_board[*(const int *)pb] - g_board[*(const int *)pa];
+    return ((const struct sq_size *)pb)->size -
+	((const struct sq_size *)pa)->size;
 }
 
 static void minimize_clue_set(int *board, int w, int h, int *randomize) {
@@ -874,20 +884,23 @@ static char *new_game_desc(game_params *params, random_state *rs,
     int *board = snewn(sz, int);
     int *randomize = snewn(sz, int);
     char *game_description = snewn(sz + 1, char);
+    struct sq_size *sizes = snewn(sz, struct sq_size);
     int i;
-    extern int max_digit_to_input;
-    extern int min_digit_to_input;
-    max_digit_to_input = 9;
-    min_digit_to_input = 1;
 
     for (i = 0; i < sz; ++i) {
         board[i] = EMPTY;
-        randomize[i] = i;
     }
 
     make_board(board, w, h, rs);
-    g_board = board;
-    qsort(randomize, sz, sizeof (int), compare);
+    for (i = 0; i < sz; ++i) {
+        sizes[i].size = board[i];
+        sizes[i].sq = i;
+    }
+    qsort(sizes, sz, sizeof (struct sq_size), compare);
+    for (i = 0; i < sz; ++i) {
+        randomize[i] = sizes[i].sq;
+    }
+    sfree(sizes);
     minimize_clue_set(board, w, h, randomize);
 
     for (i = 0; i < sz; ++i) {
@@ -938,6 +951,12 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     int sz = params->w * params->h;
     int i;
 
+    /* The on-screen keyboard only needs 1-9. */
+    extern int max_digit_to_input;
+    extern int min_digit_to_input;
+    max_digit_to_input = 9;
+    min_digit_to_input = 1;
+
     state->cheated = state->completed = FALSE;
     state->shared = snew(struct shared_state);
     state->shared->refcnt = 1;
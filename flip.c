@@ -8,6 +8,7 @@
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <math.h>
 
 #include "puzzles.h"
@@ -53,7 +54,11 @@ struct game_params {
  */
 struct matrix {
     int refcount;
-    unsigned char *matrix;             /* array of (w*h) by (w*h) */
+    /*
+     * (w*h) by (w*h) bits: row i is the set of squares toggled
+     * by clicking square i.
+     */
+    struct gf2mat *matrix;
 };
 
 struct game_state {
@@ -189,8 +194,133 @@ static char *validate_params(game_params *params, int full)
     return NULL;
 }
 
-static char *encode_bitmap(unsigned char *bmp, int len)
+/* ----------------------------------------------------------------------
+ * Bit-packed matrices over GF(2). Each row is stored as a whole
+ * number of machine words, so that adding one row to another is a
+ * word-wide XOR (which the compiler is free to vectorise). The bits
+ * beyond the last column are always zero, so rows can be compared
+ * with memcmp.
+ */
+
+typedef unsigned long gf2word;
+#define GF2_BITS ((int)(sizeof(gf2word) * CHAR_BIT))
+
+struct gf2mat {
+    int rows, cols;
+    int stride;                        /* words per row */
+    gf2word *bits;
+};
+
+#define GF2_ROW(m, r) ( (m)->bits + (r) * (m)->stride )
+#define GF2_GET(m, r, c) \
+    ( (int)((GF2_ROW(m, r)[(c) / GF2_BITS] >> ((c) % GF2_BITS)) & 1) )
+#define GF2_SET(m, r, c) \
+    ( GF2_ROW(m, r)[(c) / GF2_BITS] |= (gf2word)1 << ((c) % GF2_BITS) )
+
+static struct gf2mat *gf2_new(int rows, int cols)
+{
+    struct gf2mat *m = snew(struct gf2mat);
+
+    m->rows = rows;
+    m->cols = cols;
+    m->stride = (cols + GF2_BITS - 1) / GF2_BITS;
+    /* never ask for zero bytes: smalloc can't tell that from failure */
+    m->bits = snewn(max(rows * m->stride, 1), gf2word);
+    memset(m->bits, 0, rows * m->stride * sizeof(gf2word));
+
+    return m;
+}
+
+static void gf2_free(struct gf2mat *m)
+{
+    sfree(m->bits);
+    sfree(m);
+}
+
+/*
+ * row1 ^= row2, for the words from `from' up to but not including
+ * `to'.
+ */
+static void gf2_rowxor(gf2word *row1, const gf2word *row2, int from, int to)
+{
+    int i;
+    for (i = from; i < to; i++)
+	row1[i] ^= row2[i];
+}
+
+/*
+ * Count the set bits in a row.
+ */
+static int gf2_weight(const gf2word *row, int stride)
+{
+    int i, n = 0;
+
+    for (i = 0; i < stride; i++) {
+	gf2word x = row[i];
+	while (x) {
+	    x &= x - 1;
+	    n++;
+	}
+    }
+
+    return n;
+}
+
+/*
+ * Reduce the first `ncols' columns of a matrix to reduced row
+ * echelon form in place, applying the same row operations to any
+ * columns beyond them. Returns the rank, and fills in pivots[r]
+ * with the column of the leading 1 in each row r below the rank.
+ * The rows from the rank onwards are zero in the first `ncols'
+ * columns.
+ */
+static int gf2_eliminate(struct gf2mat *m, int ncols, int *pivots)
 {
+    int rank = 0, c, r, i;
+
+    for (c = 0; c < ncols && rank < m->rows; c++) {
+	int word = c / GF2_BITS;
+	gf2word bit = (gf2word)1 << (c % GF2_BITS);
+	gf2word *prow;
+
+	for (r = rank; r < m->rows; r++)
+	    if (GF2_ROW(m, r)[word] & bit)
+		break;
+	if (r == m->rows)
+	    continue;		       /* no pivot in this column */
+
+	prow = GF2_ROW(m, rank);
+	if (r != rank) {
+	    gf2word *row = GF2_ROW(m, r);
+	    for (i = word; i < m->stride; i++) {
+		gf2word t = row[i];
+		row[i] = prow[i];
+		prow[i] = t;
+	    }
+	}
+
+	/*
+	 * Clear the column everywhere else. The pivot row is zero
+	 * in every column before this one, so the XORs can start
+	 * at this column's word.
+	 */
+	for (r = 0; r < m->rows; r++)
+	    if (r != rank && (GF2_ROW(m, r)[word] & bit))
+		gf2_rowxor(GF2_ROW(m, r), prow, word, m->stride);
+
+	pivots[rank++] = c;
+    }
+
+    return rank;
+}
+
+/*
+ * Encode a matrix, row by row, as a hex bitmap with the first bit
+ * in the top bit of the first digit; and decode one again.
+ */
+static char *gf2_encode(struct gf2mat *m)
+{
+    int len = m->rows * m->cols;
     int slen = (len + 3) / 4;
     char *ret;
     int i;
@@ -200,7 +330,8 @@ static char *encode_bitmap(unsigned char *bmp, int len)
         int j, v;
         v = 0;
         for (j = 0; j < 4; j++)
-            if (i*4+j < len && bmp[i*4+j])
+            if (i*4+j < len && GF2_GET(m, (i*4+j) / m->cols,
+                                       (i*4+j) % m->cols))
                 v |= 8 >> j;
         ret[i] = "0123456789abcdef"[v];
     }
@@ -208,11 +339,13 @@ static char *encode_bitmap(unsigned char *bmp, int len)
     return ret;
 }
 
-static void decode_bitmap(unsigned char *bmp, int len, char *hex)
+static void gf2_decode(struct gf2mat *m, char *hex)
 {
+    int len = m->rows * m->cols;
     int slen = (len + 3) / 4;
     int i;
 
+    memset(m->bits, 0, m->rows * m->stride * sizeof(gf2word));
     for (i = 0; i < slen; i++) {
         int j, v, c = hex[i];
         if (c >= '0' && c <= '9')
@@ -223,14 +356,9 @@ static void decode_bitmap(unsigned char *bmp, int len, char *hex)
             v = c - 'a' + 10;
         else
             v = 0;                     /* shouldn't happen */
-        for (j = 0; j < 4; j++) {
-            if (i*4+j < len) {
-                if (v & (8 >> j))
-                    bmp[i*4+j] = 1;
-                else
-                    bmp[i*4+j] = 0;
-            }
-        }
+        for (j = 0; j < 4; j++)
+            if (i*4+j < len && (v & (8 >> j)))
+                GF2_SET(m, (i*4+j) / m->cols, (i*4+j) % m->cols);
     }
 }
 
@@ -309,7 +437,7 @@ static int sqcmp_osize(void *av, void *bv)
     return 0;
 }
 static void addsq(tree234 *t, int w, int h, int cx, int cy,
-                  int x, int y, unsigned char *matrix)
+                  int x, int y, struct gf2mat *matrix)
 {
     int wh = w * h;
     struct sq *sq;
@@ -319,7 +447,7 @@ static void addsq(tree234 *t, int w, int h, int cx, int cy,
         return;
     if (abs(x-cx) > 1 || abs(y-cy) > 1)
         return;
-    if (matrix[(cy*w+cx) * wh + y*w+x])
+    if (GF2_GET(matrix, cy*w+cx, y*w+x))
         return;
 
     sq = snew(struct sq);
@@ -328,18 +456,16 @@ static void addsq(tree234 *t, int w, int h, int cx, int cy,
     sq->x = x;
     sq->y = y;
     sq->coverage = sq->ominosize = 0;
-    for (i = 0; i < wh; i++) {
-        if (matrix[i * wh + y*w+x])
+    for (i = 0; i < wh; i++)
+        if (GF2_GET(matrix, i, y*w+x))
             sq->coverage++;
-        if (matrix[(cy*w+cx) * wh + i])
-            sq->ominosize++;
-    }
+    sq->ominosize = gf2_weight(GF2_ROW(matrix, cy*w+cx), matrix->stride);
 
     if (add234(t, sq) != sq)
         sfree(sq);                     /* already there */
 }
 static void addneighbours(tree234 *t, int w, int h, int cx, int cy,
-                          int x, int y, unsigned char *matrix)
+                          int x, int y, struct gf2mat *matrix)
 {
     addsq(t, w, h, cx, cy, x-1, y, matrix);
     addsq(t, w, h, cx, cy, x+1, y, matrix);
@@ -352,11 +478,11 @@ static char *new_game_desc(game_params *params, random_state *rs,
 {
     int w = params->w, h = params->h, wh = w * h;
     int i, j;
-    unsigned char *matrix, *grid;
+    struct gf2mat *matrix, *grid;
     char *mbmp, *gbmp, *ret;
 
-    matrix = snewn(wh * wh, unsigned char);
-    grid = snewn(wh, unsigned char);
+    matrix = gf2_new(wh, wh);
+    grid = gf2_new(1, wh);             /* a single row */
 
     /*
      * First set up the matrix.
@@ -368,9 +494,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
             for (j = 0; j < wh; j++) {
                 int jx = j % w, jy = j / w;
                 if (abs(jx - ix) + abs(jy - iy) <= 1)
-                    matrix[i*wh+j] = 1;
-                else
-                    matrix[i*wh+j] = 0;
+                    GF2_SET(matrix, i, j);
             }
         }
         break;
@@ -383,9 +507,10 @@ static char *new_game_desc(game_params *params, random_state *rs,
             cov = newtree234(sqcmp_cov);
             osize = newtree234(sqcmp_osize);
 
-            memset(matrix, 0, wh * wh);
+            memset(matrix->bits, 0,
+                   wh * matrix->stride * sizeof(gf2word));
             for (i = 0; i < wh; i++) {
-                matrix[i*wh+i] = 1;
+                GF2_SET(matrix, i, i);
             }
 
             for (i = 0; i < wh; i++) {
@@ -434,7 +559,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
                 /*
                  * Add this square to the matrix.
                  */
-                matrix[(sq->cy * w + sq->cx) * wh + (sq->y * w + sq->x)] = 1;
+                GF2_SET(matrix, sq->cy * w + sq->cx, sq->y * w + sq->x);
 
                 /*
                  * Correct the matrix coverage field of any sq
@@ -519,7 +644,8 @@ static char *new_game_desc(game_params *params, random_state *rs,
             for (i = 0; i < wh; i++) {
                 for (j = 0; j < wh; j++)
                     if (i != j &&
-                        !memcmp(matrix + i * wh, matrix + j * wh, wh))
+                        !memcmp(GF2_ROW(matrix, i), GF2_ROW(matrix, j),
+                                matrix->stride * sizeof(gf2word)))
                         break;
                 if (j < wh)
                     break;
@@ -562,21 +688,16 @@ static char *new_game_desc(game_params *params, random_state *rs,
      * all the output points. Phew!
      */
     while (1) {
-        memset(grid, 0, wh);
+        memset(grid->bits, 0, grid->stride * sizeof(gf2word));
         for (i = 0; i < wh; i++) {
             int v = random_upto(rs, 2);
-            if (v) {
-                for (j = 0; j < wh; j++)
-                    grid[j] ^= matrix[i*wh+j];
-            }
+            if (v)
+                gf2_rowxor(grid->bits, GF2_ROW(matrix, i), 0, grid->stride);
         }
         /*
          * Ensure we don't have the starting state already!
          */
-        for (i = 0; i < wh; i++)
-            if (grid[i])
-                break;
-        if (i < wh)
+        if (gf2_weight(grid->bits, grid->stride))
             break;
     }
 
@@ -585,14 +706,14 @@ static char *new_game_desc(game_params *params, random_state *rs,
      * description. We'll do this by concatenating two great big
      * hex bitmaps.
      */
-    mbmp = encode_bitmap(matrix, wh*wh);
-    gbmp = encode_bitmap(grid, wh);
+    mbmp = gf2_encode(matrix);
+    gbmp = gf2_encode(grid);
     ret = snewn(strlen(mbmp) + strlen(gbmp) + 2, char);
     sprintf(ret, "%s,%s", mbmp, gbmp);
     sfree(mbmp);
     sfree(gbmp);
-    sfree(matrix);
-    sfree(grid);
+    gf2_free(matrix);
+    gf2_free(grid);
     return ret;
 }
 
@@ -617,6 +738,8 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
 {
     int w = params->w, h = params->h, wh = w * h;
     int mlen = (wh*wh+3)/4;
+    struct gf2mat *grid;
+    int i;
 
     game_state *state = snew(game_state);
 
@@ -628,10 +751,14 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     state->moves = 0;
     state->matrix = snew(struct matrix);
     state->matrix->refcount = 1;
-    state->matrix->matrix = snewn(wh*wh, unsigned char);
-    decode_bitmap(state->matrix->matrix, wh*wh, desc);
+    state->matrix->matrix = gf2_new(wh, wh);
+    gf2_decode(state->matrix->matrix, desc);
+    grid = gf2_new(1, wh);
+    gf2_decode(grid, desc + mlen + 1);
     state->grid = snewn(wh, unsigned char);
-    decode_bitmap(state->grid, wh, desc + mlen + 1);
+    for (i = 0; i < wh; i++)
+        state->grid[i] = GF2_GET(grid, 0, i);
+    gf2_free(grid);
 
     return state;
 }
@@ -658,181 +785,135 @@ static void free_game(game_state *state)
 {
     sfree(state->grid);
     if (--state->matrix->refcount <= 0) {
-        sfree(state->matrix->matrix);
+        gf2_free(state->matrix->matrix);
         sfree(state->matrix);
     }
     sfree(state);
 }
 
-static void rowxor(unsigned char *row1, unsigned char *row2, int len)
-{
-    int i;
-    for (i = 0; i < len; i++)
-	row1[i] ^= row2[i];
-}
-
 static char *solve_game(game_state *state, game_state *currstate,
 			char *aux, char **error)
 {
     int w = state->w, h = state->h, wh = w * h;
-    unsigned char *equations, *solution, *shortest;
-    int *und, nund;
-    int rowsdone, colsdone;
-    int i, j, k, len, bestlen;
+    struct gf2mat *matrix = currstate->matrix->matrix;
+    struct gf2mat *equations, *basis, *solution;
+    gf2word *shortest;
+    unsigned char *counter;
+    int *pivots, *und, nund, rank;
+    int i, j, len, bestlen;
     char *ret;
 
     /*
      * Set up a list of simultaneous equations. Each one is of
-     * length (wh+1) and has wh coefficients followed by a value.
+     * length (wh+1) and has wh coefficients followed by a value:
+     * equation i says which clicks toggle square i, so it's column
+     * i of the click matrix.
      */
-    equations = snewn((wh + 1) * wh, unsigned char);
-    for (i = 0; i < wh; i++) {
-	for (j = 0; j < wh; j++)
-	    equations[i * (wh+1) + j] = currstate->matrix->matrix[j*wh+i];
-	equations[i * (wh+1) + wh] = currstate->grid[i] & 1;
-    }
+    equations = gf2_new(wh, wh + 1);
+    for (j = 0; j < wh; j++)
+	for (i = 0; i < wh; i++)
+	    if (GF2_GET(matrix, j, i))
+		GF2_SET(equations, i, j);
+    for (i = 0; i < wh; i++)
+	if (currstate->grid[i] & 1)
+	    GF2_SET(equations, i, wh);
 
     /*
-     * Perform Gaussian elimination over GF(2).
+     * Perform Gauss-Jordan elimination over GF(2).
      */
-    rowsdone = colsdone = 0;
-    nund = 0;
-    und = snewn(wh, int);
-    do {
-	/*
-	 * Find the leftmost column which has a 1 in it somewhere
-	 * outside the first `rowsdone' rows.
-	 */
-	j = -1;
-	for (i = colsdone; i < wh; i++) {
-	    for (j = rowsdone; j < wh; j++)
-		if (equations[j * (wh+1) + i])
-		    break;
-	    if (j < wh)
-		break;		       /* found one */
-	    /*
-	     * This is a column which will not have an equation
-	     * controlling it. Mark it as undetermined.
-	     */
-	    und[nund++] = i;
-	}
+    pivots = snewn(wh, int);
+    rank = gf2_eliminate(equations, wh, pivots);
 
-	/*
-	 * If there wasn't one, then we've finished: all remaining
-	 * equations are of the form 0 = constant. Check to see if
-	 * any of them wants 0 to be equal to 1; this is the
-	 * condition which indicates an insoluble problem
-	 * (therefore _hopefully_ one typed in by a user!).
-	 */
-	if (i == wh) {
-	    for (j = rowsdone; j < wh; j++)
-		if (equations[j * (wh+1) + wh]) {
-		    *error = "No solution exists for this position";
-		    sfree(equations);
-		    sfree(und);
-		    return NULL;
-		}
-	    break;
+    /*
+     * All the remaining equations are of the form 0 = constant.
+     * Check to see if any of them wants 0 to be equal to 1; this
+     * is the condition which indicates an insoluble problem
+     * (therefore _hopefully_ one typed in by a user!).
+     */
+    for (i = rank; i < wh; i++)
+	if (GF2_GET(equations, i, wh)) {
+	    *error = "No solution exists for this position";
+	    gf2_free(equations);
+	    sfree(pivots);
+	    return NULL;
 	}
 
-	/*
-	 * We've found a 1. It's in column i, and the topmost 1 in
-	 * that column is in row j. Do a row-XOR to move it up to
-	 * the topmost row if it isn't already there.
-	 */
-	assert(j != -1);
-	if (j > rowsdone)
-	    rowxor(equations + rowsdone*(wh+1), equations + j*(wh+1), wh+1);
-
-	/*
-	 * Do row-XORs to eliminate that 1 from all rows below the
-	 * topmost row.
-	 */
-	for (j = rowsdone + 1; j < wh; j++)
-	    if (equations[j*(wh+1) + i])
-		rowxor(equations + j*(wh+1),
-		       equations + rowsdone*(wh+1), wh+1);
-
-	/*
-	 * Mark this row and column as done.
-	 */
-	rowsdone++;
-	colsdone = i+1;
-
-	/*
-	 * If we've done all the rows, terminate.
-	 */
-    } while (rowsdone < wh);
+    /*
+     * The columns with no equation controlling them are the
+     * undetermined variables. Each one gives a vector in the
+     * nullspace of the click matrix: set that variable, and every
+     * determined variable whose equation mentions it.
+     */
+    und = snewn(wh, int);
+    nund = 0;
+    for (i = 0, j = 0; i < wh; i++) {
+	if (j < rank && pivots[j] == i)
+	    j++;
+	else
+	    und[nund++] = i;
+    }
+    basis = gf2_new(nund, wh);
+    for (i = 0; i < nund; i++) {
+	GF2_SET(basis, i, und[i]);
+	for (j = 0; j < rank; j++)
+	    if (GF2_GET(equations, j, und[i]))
+		GF2_SET(basis, i, pivots[j]);
+    }
 
     /*
-     * If we reach here, we have the ability to produce a solution.
-     * So we go through _all_ possible solutions (each
-     * corresponding to a set of arbitrary choices of those
-     * components not directly determined by an equation), and pick
-     * one requiring the smallest number of flips.
+     * Start from the solution with all the undetermined variables
+     * zero, and then go through _all_ the possible solutions by
+     * adding nullspace vectors in Gray-code order, picking one
+     * requiring the smallest number of flips. Gray code means each
+     * step is a single row XOR; ties are broken in favour of the
+     * solution whose undetermined variables form the smallest
+     * binary number (with und[0] least significant), so that we
+     * come up with the same answer as counting through them in
+     * binary would.
      */
-    solution = snewn(wh, unsigned char);
-    shortest = snewn(wh, unsigned char);
-    memset(solution, 0, wh);
+    solution = gf2_new(1, wh);
+    for (j = 0; j < rank; j++)
+	if (GF2_GET(equations, j, wh))
+	    GF2_SET(solution, 0, pivots[j]);
+    shortest = snewn(solution->stride, gf2word);
+    counter = snewn(nund + 1, unsigned char);
+    memset(counter, 0, nund + 1);
     bestlen = wh + 1;
     while (1) {
-	/*
-	 * Find a solution based on the current values of the
-	 * undetermined variables.
-	 */
-	for (j = rowsdone; j-- ;) {
-	    int v;
-
-	    /*
-	     * Find the leftmost set bit in this equation.
-	     */
-	    for (i = 0; i < wh; i++)
-		if (equations[j * (wh+1) + i])
-		    break;
-	    assert(i < wh);		       /* there must have been one! */
-
-	    /*
-	     * Compute this variable using the rest.
-	     */
-	    v = equations[j * (wh+1) + wh];
-	    for (k = i+1; k < wh; k++)
-		if (equations[j * (wh+1) + k])
-		    v ^= solution[k];
-
-	    solution[i] = v;
-	}
-
-	/*
-	 * Compare this solution to the current best one, and
-	 * replace the best one if this one is shorter.
-	 */
-	len = 0;
-	for (i = 0; i < wh; i++)
-	    if (solution[i])
-		len++;
-	if (len < bestlen) {
-	    bestlen = len;
-	    memcpy(shortest, solution, wh);
-	}
-
-	/*
-	 * Now increment the binary number given by the
-	 * undetermined variables: turn all 1s into 0s until we see
-	 * a 0, at which point we turn it into a 1.
-	 */
-	for (i = 0; i < nund; i++) {
-	    solution[und[i]] = !solution[und[i]];
-	    if (solution[und[i]])
-		break;
+	len = gf2_weight(solution->bits, solution->stride);
+	if (len <= bestlen) {
+	    int better = (len < bestlen);
+	    if (!better) {
+		for (i = nund; i-- > 0 ;) {
+		    int a = GF2_GET(solution, 0, und[i]);
+		    int b = (int)((shortest[und[i] / GF2_BITS] >>
+				   (und[i] % GF2_BITS)) & 1);
+		    if (a != b) {
+			better = (a < b);
+			break;
+		    }
+		}
+	    }
+	    if (better) {
+		bestlen = len;
+		memcpy(shortest, solution->bits,
+		       solution->stride * sizeof(gf2word));
+	    }
 	}
 
 	/*
-	 * If we didn't find a 0 at any point, we have wrapped
-	 * round and are back at the start, i.e. we have enumerated
-	 * all solutions.
+	 * Now increment a binary counter: turn all 1s into 0s
+	 * until we see a 0, at which point we turn it into a 1. The
+	 * bit that becomes 1 is the one whose nullspace vector the
+	 * Gray code flips next. If we didn't find a 0 at any point,
+	 * we've wrapped round and enumerated all solutions.
 	 */
+	for (i = 0; i < nund && counter[i]; i++)
+	    counter[i] = 0;
 	if (i == nund)
 	    break;
+	counter[i] = 1;
+	gf2_rowxor(solution->bits, GF2_ROW(basis, i), 0, solution->stride);
     }
 
     /*
@@ -842,13 +923,17 @@ static char *solve_game(game_state *state, game_state *currstate,
     ret = snewn(wh + 2, char);
     ret[0] = 'S';
     for (i = 0; i < wh; i++)
-	ret[i+1] = shortest[i] ? '1' : '0';
+	ret[i+1] = ((shortest[i / GF2_BITS] >> (i % GF2_BITS)) & 1) ?
+	    '1' : '0';
     ret[wh+1] = '\0';
 
+    sfree(counter);
     sfree(shortest);
-    sfree(solution);
-    sfree(equations);
+    gf2_free(solution);
+    gf2_free(basis);
     sfree(und);
+    sfree(pivots);
+    gf2_free(equations);
 
     return ret;
 }
@@ -903,7 +988,7 @@ struct game_drawstate {
 static char *interpret_move(game_state *state, game_ui *ui, game_drawstate *ds,
 			    int x, int y, int button)
 {
-    int w = state->w, h = state->h, wh = w * h;
+    int w = state->w, h = state->h;
     char buf[80], *nullret = NULL;
 
     if (button == LEFT_BUTTON || IS_CURSOR_SELECT(button)) {
@@ -923,12 +1008,8 @@ static char *interpret_move(game_state *state, game_ui *ui, game_drawstate *ds,
              * will have at least one square do nothing whatsoever.
              * If so, we avoid encoding a move at all.
              */
-            int i = ty*w+tx, j, makemove = FALSE;
-            for (j = 0; j < wh; j++) {
-                if (state->matrix->matrix[i*wh+j])
-                    makemove = TRUE;
-            }
-            if (makemove) {
+            struct gf2mat *m = state->matrix->matrix;
+            if (gf2_weight(GF2_ROW(m, ty*w+tx), m->stride)) {
                 sprintf(buf, "M%d,%d", tx, ty);
                 return dupstr(buf);
             } else {
@@ -987,7 +1068,7 @@ static game_state *execute_move(game_state *from, char *move)
 
 	done = TRUE;
 	for (j = 0; j < wh; j++) {
-	    ret->grid[j] ^= ret->matrix->matrix[i*wh+j];
+	    ret->grid[j] ^= GF2_GET(ret->matrix->matrix, i, j);
 	    if (ret->grid[j] & 1)
 		done = FALSE;
 	}
@@ -1083,7 +1164,7 @@ static void draw_tile(drawing *dr, game_drawstate *ds,
 		      game_state *state, int x, int y, int tile, int anim,
 		      float animtime)
 {
-    int w = ds->w, h = ds->h, wh = w * h;
+    int w = ds->w, h = ds->h;
     int bx = x * TILE_SIZE + BORDER, by = y * TILE_SIZE + BORDER;
     int i, j, dcol = (tile & 4) ? COL_CURSOR : COL_DIAG;
 
@@ -1120,7 +1201,7 @@ static void draw_tile(drawing *dr, game_drawstate *ds,
      */
     for (i = 0; i < h; i++)
 	for (j = 0; j < w; j++)
-	    if (state->matrix->matrix[(y*w+x)*wh + i*w+j]) {
+	    if (GF2_GET(state->matrix->matrix, y*w+x, i*w+j)) {
 		int ox = j - x, oy = i - y;
 		int td = TILE_SIZE / 16;
 		int cx = (bx + TILE_SIZE/2) + (2 * ox - 1) * td;
@@ -1297,3 +1378,73 @@ const struct game thegame = {
     FALSE, game_timing_state,
     0,				       /* flags */
 };
+
+#ifdef STANDALONE_FLIP_BENCHMARK
+
+/*
+ * Solve latency and matrix storage: for each square size from 5x5
+ * to 20x20, generate a puzzle and time solve_game on it. Storage is
+ * given for the click matrix plus the equations solve_game builds,
+ * alongside what they'd take at one byte per coefficient.
+ * Usage: flip [-r] [-n reps]   (-r for random click patterns)
+ */
+
+#include <time.h>
+
+int main(int argc, char **argv)
+{
+    game_params params;
+    int reps = 20, size, r;
+
+    params.matrix_type = CROSSES;
+    while (--argc > 0) {
+	char *p = *++argv;
+	if (!strcmp(p, "-r"))
+	    params.matrix_type = RANDOM;
+	else if (!strcmp(p, "-n") && argc > 1) {
+	    reps = atoi(*++argv);
+	    argc--;
+	} else {
+	    fprintf(stderr, "usage: flip [-r] [-n reps]\n");
+	    return 1;
+	}
+    }
+
+    printf(" size   us per solve   packed bytes   byte-per-bit bytes\n");
+    for (size = 5; size <= 20; size++) {
+	random_state *rs = random_new("flip", 4);
+	int wh = size * size;
+	long packed, unpacked;
+	char *desc, *aux = NULL, *err = NULL, *sol;
+	game_state *state;
+	clock_t start;
+	double us;
+
+	params.w = params.h = size;
+	desc = new_game_desc(&params, rs, &aux, FALSE);
+	state = new_game(NULL, &params, desc);
+
+	start = clock();
+	for (r = 0; r < reps; r++) {
+	    sol = solve_game(state, state, aux, &err);
+	    assert(sol);
+	    sfree(sol);
+	}
+	us = (double)(clock() - start) / CLOCKS_PER_SEC * 1e6 / reps;
+
+	packed = (long)wh * state->matrix->matrix->stride * sizeof(gf2word) +
+	    (long)wh * ((wh + GF2_BITS) / GF2_BITS) * sizeof(gf2word);
+	unpacked = (long)wh * wh + (long)wh * (wh + 1);
+	printf("%2dx%-2d %14.1f %14ld %20ld\n", size, size, us,
+	       packed, unpacked);
+
+	free_game(state);
+	sfree(desc);
+	sfree(aux);
+	random_free(rs);
+    }
+
+    return 0;
+}
+
+#endif
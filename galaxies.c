@@ -140,7 +140,7 @@ struct game_state {
     int sx, sy;         /* allocated size, (2x-1)*(2y-1) */
     space *grid;
     int completed, used_solve;
-    int ndots;
+    int ndots, dotsize; /* dots[] has room for dotsize */
     space **dots;
 
     midend *me;         /* to call supersede_game_desc */
@@ -776,7 +776,7 @@ static game_state *blank_game(int w, int h)
         }
     }
 
-    state->ndots = 0;
+    state->ndots = state->dotsize = 0;
     state->dots = NULL;
 
     state->me = NULL; /* filled in by new_game. */
@@ -789,13 +789,17 @@ static void game_update_dots(game_state *state)
 {
     int i, n, sz = state->sx * state->sy;
 
-    if (state->dots) sfree(state->dots);
     state->ndots = 0;
 
     for (i = 0; i < sz; i++) {
         if (state->grid[i].flags & F_DOT) state->ndots++;
     }
-    state->dots = snewn(state->ndots, space *);
+    /* The generator calls this on every try; only grow the array. */
+    if (state->ndots > state->dotsize || !state->dots) {
+        sfree(state->dots);
+        state->dots = snewn(state->ndots, space *);
+        state->dotsize = state->ndots;
+    }
     n = 0;
     for (i = 0; i < sz; i++) {
         if (state->grid[i].flags & F_DOT)
@@ -819,9 +823,10 @@ static void clear_game(game_state *state, int cleardots)
     if (cleardots) game_update_dots(state);
 }
 
-static game_state *dup_game(game_state *state)
+/* Overwrite one state with another of the same size, reusing its storage. */
+static void copy_game(game_state *ret, game_state *state)
 {
-    game_state *ret = blank_game(state->w, state->h);
+    assert(ret->w == state->w && ret->h == state->h);
 
     ret->completed = state->completed;
     ret->used_solve = state->used_solve;
@@ -833,6 +838,13 @@ static game_state *dup_game(game_state *state)
 
     ret->me = state->me;
     ret->cdiff = state->cdiff;
+}
+
+static game_state *dup_game(game_state *state)
+{
+    game_state *ret = blank_game(state->w, state->h);
+
+    copy_game(ret, state);
 
     return ret;
 }
@@ -1230,13 +1242,18 @@ static void generate_pass(game_state *state, random_state *rs, int *scratch,
     dbg_state(state);
 }
 
-static int check_complete(game_state *state, int *dsf, int *colours);
+static int check_complete(game_state *state, int *dsf, int *colours,
+                          arena *a);
 static int solver_state(game_state *state, int maxdiff);
+static int solver_state_arena(game_state *state, int maxdiff, arena *a);
+static size_t solver_arena_size(game_state *state, int maxdiff);
 
 static char *new_game_desc(game_params *params, random_state *rs,
 			   char **aux, int interactive)
 {
-    game_state *state = blank_game(params->w, params->h), *copy;
+    game_state *state = blank_game(params->w, params->h);
+    game_state *trycopy = blank_game(params->w, params->h);
+    arena *solver_arena = arena_new(solver_arena_size(state, params->diff));
     char *desc;
     int *scratch, sz = state->sx*state->sy, i;
     int diff, ntries = 0, cc;
@@ -1245,9 +1262,14 @@ static char *new_game_desc(game_params *params, random_state *rs,
     scratch = snewn(sz, int);
     for (i = 0; i < sz; i++) scratch[i] = i;
 
+    /*
+     * Each try below solves a copy of the state; that copy and the
+     * solver's storage are made once, here, and reused every time.
+     */
 generate:
     clear_game(state, 1);
     ntries++;
+    arena_reset(solver_arena);
 
     /* generate_pass(state, rs, scratch, 10, GP_DOTS); */
     /* generate_pass(state, rs, scratch, 100, 0); */
@@ -1266,14 +1288,13 @@ generate:
     for (i = 0; i < state->sx*state->sy; i++)
         if (state->grid[i].type == s_tile)
             outline_tile_fordot(state, &state->grid[i], TRUE);
-    cc = check_complete(state, NULL, NULL);
+    cc = check_complete(state, NULL, NULL, solver_arena);
     assert(cc);
 
-    copy = dup_game(state);
-    clear_game(copy, 0);
-    dbg_state(copy);
-    diff = solver_state(copy, params->diff);
-    free_game(copy);
+    copy_game(trycopy, state);
+    clear_game(trycopy, 0);
+    dbg_state(trycopy);
+    diff = solver_state_arena(trycopy, params->diff, solver_arena);
 
     assert(diff != DIFF_IMPOSSIBLE);
     if (diff != params->diff) {
@@ -1304,7 +1325,7 @@ generate:
     {
 	int *posns, nposns;
 	int i, j, newdiff;
-	game_state *copy2;
+	game_state *copy, *copy2;
 
 	nposns = params->w * (params->h+1) + params->h * (params->w+1);
 	posns = snewn(nposns, int);
@@ -1439,7 +1460,7 @@ generate:
 	    copy = dup_game(state);
 	    clear_game(copy, 0);
 	    dbg_state(copy);
-	    newdiff = solver_state(copy, params->diff);
+	    newdiff = solver_state_arena(copy, params->diff, solver_arena);
 	    free_game(copy);
 	    if (diff == newdiff) {
 		/* Still just as soluble. Let the merge stand. */
@@ -1461,6 +1482,8 @@ generate:
 #endif
 
     free_game(state);
+    free_game(trycopy);
+    arena_free(solver_arena);
     sfree(scratch);
 
     return desc;
@@ -1566,21 +1589,20 @@ typedef struct solver_ctx {
 
 } solver_ctx;
 
-static solver_ctx *new_solver(game_state *state)
+/*
+ * The solver's working storage all comes from an arena, and is given
+ * back (by arena_release on the solver_ctx) when solver_state
+ * returns. A generator can hand the same arena to every try.
+ */
+static solver_ctx *new_solver(game_state *state, arena *a)
 {
-    solver_ctx *sctx = snew(solver_ctx);
+    solver_ctx *sctx = anew(a, solver_ctx);
     sctx->state = state;
     sctx->sz = state->sx*state->sy;
-    sctx->scratch = snewn(sctx->sz, space *);
+    sctx->scratch = anewn(a, sctx->sz, space *);
     return sctx;
 }
 
-static void free_solver(solver_ctx *sctx)
-{
-    sfree(sctx->scratch);
-    sfree(sctx);
-}
-
     /* Solver ideas so far:
      *
      * For any empty space, work out how many dots it could associate
@@ -2056,11 +2078,26 @@ static int solver_recurse_cb(game_state *state, space *tile, void *ctx)
     return 0;
 }
 
-static int solver_state(game_state *state, int maxdiff);
+static int solver_state_arena(game_state *state, int maxdiff, arena *a);
 
 #define MAXRECURSE 5
 
-static int solver_recurse(game_state *state, int maxdiff)
+/*
+ * How much arena a solver_state call needs: a solver_ctx and a
+ * completion check, plus two copies of the grid and another
+ * solver_ctx for each level of recursion.
+ */
+static size_t solver_arena_size(game_state *state, int maxdiff)
+{
+    int sz = state->sx*state->sy, wh = state->w*state->h;
+    size_t level = sizeof(solver_ctx) + sz * sizeof(space *) +
+        wh * 9 * sizeof(int);
+    if (maxdiff >= DIFF_UNREASONABLE)
+        level += 2 * sz * sizeof(struct space);
+    return level * (maxdiff >= DIFF_UNREASONABLE ? MAXRECURSE+1 : 1);
+}
+
+static int solver_recurse(game_state *state, int maxdiff, arena *a)
 {
     int diff = DIFF_IMPOSSIBLE, ret, n, gsz = state->sx * state->sy;
     space *ingrid, *outgrid = NULL, *bestopp;
@@ -2089,7 +2126,7 @@ static int solver_recurse(game_state *state, int maxdiff)
     solver_recurse_depth++;
 #endif
 
-    ingrid = snewn(gsz, struct space);
+    ingrid = anewn(a, gsz, struct space);
     memcpy(ingrid, state->grid, gsz * sizeof(struct space));
 
     for (n = 0; n < state->ndots; n++) {
@@ -2102,12 +2139,12 @@ static int solver_recurse(game_state *state, int maxdiff)
                          state->dots[n]->x, state->dots[n]->y,
                          "Attempting for recursion");
 
-        ret = solver_state(state, maxdiff);
+        ret = solver_state_arena(state, maxdiff, a);
 
         if (diff == DIFF_IMPOSSIBLE && ret != DIFF_IMPOSSIBLE) {
             /* we found our first solved grid; copy it away. */
             assert(!outgrid);
-            outgrid = snewn(gsz, struct space);
+            outgrid = anewn(a, gsz, struct space);
             memcpy(outgrid, state->grid, gsz * sizeof(struct space));
         }
         /* reset cell back to unassociated. */
@@ -2141,15 +2178,14 @@ static int solver_recurse(game_state *state, int maxdiff)
     if (outgrid) {
         /* we found (at least one) soln; copy it back to state */
         memcpy(state->grid, outgrid, gsz * sizeof(struct space));
-        sfree(outgrid);
     }
-    sfree(ingrid);
+    arena_release(a, ingrid);
     return diff;
 }
 
-static int solver_state(game_state *state, int maxdiff)
+static int solver_state_arena(game_state *state, int maxdiff, arena *a)
 {
-    solver_ctx *sctx = new_solver(state);
+    solver_ctx *sctx = new_solver(state, a);
     int ret, diff = DIFF_NORMAL;
 
 #ifdef STANDALONE_PICTURE_GENERATOR
@@ -2192,13 +2228,13 @@ cont:
         break;
     }
 
-    if (check_complete(state, NULL, NULL)) goto got_result;
+    if (check_complete(state, NULL, NULL, a)) goto got_result;
 
     diff = (maxdiff >= DIFF_UNREASONABLE) ?
-        solver_recurse(state, maxdiff) : DIFF_UNFINISHED;
+        solver_recurse(state, maxdiff, a) : DIFF_UNFINISHED;
 
 got_result:
-    free_solver(sctx);
+    arena_release(a, sctx);
 #ifndef STANDALONE_SOLVER
     debug(("solver_state ends, diff %s:\n", galaxies_diffnames[diff]));
     dbg_state(state);
@@ -2211,6 +2247,14 @@ got_result:
     return diff;
 }
 
+static int solver_state(game_state *state, int maxdiff)
+{
+    arena *a = arena_new(solver_arena_size(state, maxdiff));
+    int diff = solver_state_arena(state, maxdiff, a);
+    arena_free(a);
+    return diff;
+}
+
 #ifndef EDITOR
 static char *solve_game(game_state *state, game_state *currstate,
 			char *aux, char **error)
@@ -2611,7 +2655,12 @@ static char *interpret_move(game_state *state, game_ui *ui, game_drawstate *ds,
 }
 #endif
 
-static int check_complete(game_state *state, int *dsf, int *colours)
+/*
+ * If an arena is given, any scratch space check_complete needs comes
+ * from there, and is released again before it returns.
+ */
+static int check_complete(game_state *state, int *dsf, int *colours,
+                          arena *a)
 {
     int w = state->w, h = state->h;
     int x, y, i, ret;
@@ -2623,13 +2672,17 @@ static int check_complete(game_state *state, int *dsf, int *colours)
         int valid, colour;
     } *sqdata;
 
+    if (a)
+        sqdata = anewn(a, w*h, struct sqdata);
+    else
+        sqdata = snewn(w*h, struct sqdata);
+
     if (!dsf) {
-	dsf = snew_dsf(w*h);
-	free_dsf = TRUE;
-    } else {
-	dsf_init(dsf, w*h);
+	dsf = a ? anewn(a, w*h, int) : snewn(w*h, int);
+	free_dsf = !a;
+    } else
 	free_dsf = FALSE;
-    }
+    dsf_init(dsf, w*h);
 
     /*
      * During actual game play, completion checking is done on the
@@ -2662,7 +2715,6 @@ static int check_complete(game_state *state, int *dsf, int *colours)
      * First, go through the grid finding the bounding box of each
      * component.
      */
-    sqdata = snewn(w*h, struct sqdata);
     for (i = 0; i < w*h; i++) {
         sqdata[i].minx = w+1;
         sqdata[i].miny = h+1;
@@ -2781,7 +2833,10 @@ static int check_complete(game_state *state, int *dsf, int *colours)
         ret = ret && thisok;
     }
 
-    sfree(sqdata);
+    if (a)
+        arena_release(a, sqdata);
+    else
+        sfree(sqdata);
     if (free_dsf)
 	sfree(dsf);
 
@@ -2884,7 +2939,7 @@ static game_state *execute_move(game_state *state, char *move)
         else if (*move)
             goto badmove;
     }
-    if (check_complete(ret, NULL, NULL))
+    if (check_complete(ret, NULL, NULL, NULL))
     {
         ret->completed = 1;
 #ifdef ANDROID
@@ -3185,7 +3240,7 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
         ds->started = TRUE;
     }
 
-    check_complete(state, NULL, ds->colour_scratch);
+    check_complete(state, NULL, ds->colour_scratch, NULL);
 
     for (y = 0; y < h; y++)
         for (x = 0; x < w; x++) {
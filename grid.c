@@ -14,7 +14,6 @@
 #include <math.h>
 
 #include "puzzles.h"
-#include "tree234.h"
 #include "grid.h"
 
 /* Debugging options */
@@ -44,6 +43,9 @@ void grid_free(grid *g)
         sfree(g->faces);
         sfree(g->edges);
         sfree(g->dots);
+        sfree(g->bucket_start);
+        sfree(g->bucket_dots);
+        sfree(g->face_start);          /* and the rest of the index lists */
         sfree(g);
     }
 }
@@ -60,6 +62,12 @@ static grid *grid_new(void)
     g->middle_face = NULL;
     g->refcount = 1;
     g->lowest_x = g->lowest_y = g->highest_x = g->highest_y = 0;
+    g->bucket_size = g->bucket_w = g->bucket_h = 0;
+    g->bucket_start = NULL;
+    g->bucket_dots = NULL;
+    g->face_start = g->face_edges = g->face_dots = NULL;
+    g->dot_start = g->dot_edges = g->dot_faces = NULL;
+    g->edge_dots = g->edge_faces = NULL;
     return g;
 }
 
@@ -87,6 +95,67 @@ static double point_line_distance(long px, long py,
     return det / len;
 }
 
+/* Which bucket of the grid's spatial index a coordinate falls into, along
+ * one axis.  Coordinates off the grid are clamped to the outermost bucket. */
+static int grid_bucket_coord(int v, int lowest, int size, int n)
+{
+    int b;
+    if (v < lowest)
+        return 0;
+    b = (v - lowest) / size;
+    return min(b, n - 1);
+}
+
+/* Which bucket of the grid's spatial index a dot is stored in. */
+static int grid_dot_bucket(grid *g, grid_dot *d)
+{
+    return (grid_bucket_coord(d->y, g->lowest_y, g->bucket_size, g->bucket_h)
+            * g->bucket_w +
+            grid_bucket_coord(d->x, g->lowest_x, g->bucket_size, g->bucket_w));
+}
+
+/* Find the dot nearest to (x,y), by searching the buckets of the spatial
+ * index in square rings around the one (x,y) falls into.  Any dot in a
+ * bucket outside ring r is at least r bucket widths away, so once ring r
+ * has been searched we can stop if the best so far is that close. */
+static grid_dot *grid_nearest_dot(grid *g, int x, int y)
+{
+    int bx = grid_bucket_coord(x, g->lowest_x, g->bucket_size, g->bucket_w);
+    int by = grid_bucket_coord(y, g->lowest_y, g->bucket_size, g->bucket_h);
+    int maxr = max(g->bucket_w, g->bucket_h);
+    grid_dot *best = NULL;
+    long best_dist = 0;
+    int r;
+
+    for (r = 0; r <= maxr; r++) {
+        int i, j;
+        long bound = (long)r * g->bucket_size;
+
+        for (j = max(by - r, 0); j <= min(by + r, g->bucket_h - 1); j++) {
+            /* Only the buckets on the boundary of the ring are new. */
+            int step = (j == by - r || j == by + r) ? 1 : 2 * r;
+            for (i = bx - r; i <= bx + r; i += step) {
+                int b = j * g->bucket_w + i, k;
+                if (i < 0 || i >= g->bucket_w)
+                    continue;
+                for (k = g->bucket_start[b]; k < g->bucket_start[b+1]; k++) {
+                    grid_dot *d = g->bucket_dots[k];
+                    long dist = SQ((long)d->x - (long)x) +
+                        SQ((long)d->y - (long)y);
+                    if (!best || dist < best_dist) {
+                        best = d;
+                        best_dist = dist;
+                    }
+                }
+            }
+        }
+
+        if (best && best_dist <= SQ(bound))
+            break;
+    }
+    return best;
+}
+
 /* Determine nearest edge to where the user clicked.
  * (x, y) is the clicked location, converted to grid coordinates.
  * Returns the nearest edge, or NULL if no edge is reasonably
@@ -94,10 +163,8 @@ static double point_line_distance(long px, long py,
  *
  * This algorithm is nice and generic, and doesn't depend on any particular
  * geometric layout of the grid:
- *   Start at any dot (pick one next to middle_face).
- *   Walk along a path by choosing, from all nearby dots, the one that is
- *   nearest the target (x,y).  Hopefully end up at the dot which is closest
- *   to (x,y).  Should work, as long as faces aren't too badly shaped.
+ *   Find the dot nearest to (x,y), using the grid's spatial index, so
+ *   that the cost doesn't grow with the size of the grid.
  *   Then examine each edge around this dot, and pick whichever one is
  *   closest (perpendicular distance) to (x,y).
  *   Using perpendicular distance is not quite right - the edge might be
@@ -121,42 +188,10 @@ grid_edge *grid_nearest_edge(grid *g, int x, int y)
     double best_distance = 0;
     int i;
 
-    cur = g->middle_face->dots[0];
-
-    for (;;) {
-        /* Target to beat */
-        long dist = SQ((long)cur->x - (long)x) + SQ((long)cur->y - (long)y);
-        /* Look for nearer dot - if found, store in 'new'. */
-        grid_dot *new = cur;
-        int i;
-        /* Search all dots in all faces touching this dot.  Some shapes
-         * (such as in Cairo) don't quite work properly if we only search
-         * the dot's immediate neighbours. */
-        for (i = 0; i < cur->order; i++) {
-            grid_face *f = cur->faces[i];
-            int j;
-            if (!f) continue;
-            for (j = 0; j < f->order; j++) {
-		long new_dist;
-                grid_dot *d = f->dots[j];
-                if (d == cur) continue;
-                new_dist = SQ((long)d->x - (long)x) + SQ((long)d->y - (long)y);
-                if (new_dist < dist) {
-                    new = d;
-                    break; /* found closer dot */
-                }
-            }
-            if (new != cur)
-                break; /* found closer dot */
-        }
+    cur = grid_nearest_dot(g, x, y);
+    if (!cur)
+        return NULL;
 
-        if (new == cur) {
-            /* Didn't find a closer dot among the neighbours of 'cur' */
-            break;
-        } else {
-            cur = new;
-        }
-    }
     /* 'cur' is nearest dot, so find which of the dot's edges is closest. */
     best_edge = NULL;
 
@@ -271,31 +306,80 @@ static void grid_print_derived(grid *g)
 }
 #endif /* DEBUG_GRID */
 
-/* Helper function for building incomplete-edges list in
- * grid_make_consistent() */
-static int grid_edge_bydots_cmpfn(void *v1, void *v2)
+/* Hash function for the open-addressed tables used during grid
+ * generation, which are keyed on a pair of integers (a dot's coordinates,
+ * or the indices of an edge's two dots). */
+static unsigned grid_hash(int a, int b)
 {
-    grid_edge *a = v1;
-    grid_edge *b = v2;
-    grid_dot *da, *db;
-
-    /* Pointer subtraction is valid here, because all dots point into the
-     * same dot-list (g->dots).
-     * Edges are not "normalised" - the 2 dots could be stored in any order,
-     * so we need to take this into account when comparing edges. */
-
-    /* Compare first dots */
-    da = (a->dot1 < a->dot2) ? a->dot1 : a->dot2;
-    db = (b->dot1 < b->dot2) ? b->dot1 : b->dot2;
-    if (da != db)
-        return db - da;
-    /* Compare last dots */
-    da = (a->dot1 < a->dot2) ? a->dot2 : a->dot1;
-    db = (b->dot1 < b->dot2) ? b->dot2 : b->dot1;
-    if (da != db)
-        return db - da;
+    unsigned h = (unsigned)a * 0x9E3779B1U + (unsigned)b * 0x85EBCA77U;
+    return h ^ (h >> 15);
+}
 
-    return 0;
+/* Smallest power of 2 which is at least twice n, so that the hash tables
+ * are never more than half full. */
+static int grid_hash_size(int n)
+{
+    int size = 16;
+    while (size < 2 * n)
+        size *= 2;
+    return size;
+}
+
+/* Fill in the face_start, face_edges, ... lists (see grid.h) from the
+ * completed pointer lists, in one allocation. */
+static void grid_make_index_lists(grid *g)
+{
+    int i, j, nface_items = 0, ndot_items = 0;
+    int *p;
+
+    for (i = 0; i < g->num_faces; i++)
+        nface_items += g->faces[i].order;
+    for (i = 0; i < g->num_dots; i++)
+        ndot_items += g->dots[i].order;
+
+    p = snewn((g->num_faces + 1) + 2 * nface_items +
+              (g->num_dots + 1) + 2 * ndot_items +
+              4 * g->num_edges, int);
+    g->face_start = p;  p += g->num_faces + 1;
+    g->face_edges = p;  p += nface_items;
+    g->face_dots = p;   p += nface_items;
+    g->dot_start = p;   p += g->num_dots + 1;
+    g->dot_edges = p;   p += ndot_items;
+    g->dot_faces = p;   p += ndot_items;
+    g->edge_dots = p;   p += 2 * g->num_edges;
+    g->edge_faces = p;
+
+    g->face_start[0] = 0;
+    for (i = 0; i < g->num_faces; i++) {
+        grid_face *f = g->faces + i;
+        int *edges = g->face_edges + g->face_start[i];
+        int *dots = g->face_dots + g->face_start[i];
+        for (j = 0; j < f->order; j++) {
+            edges[j] = f->edges[j] - g->edges;
+            dots[j] = f->dots[j] - g->dots;
+        }
+        g->face_start[i+1] = g->face_start[i] + f->order;
+    }
+
+    g->dot_start[0] = 0;
+    for (i = 0; i < g->num_dots; i++) {
+        grid_dot *d = g->dots + i;
+        int *edges = g->dot_edges + g->dot_start[i];
+        int *faces = g->dot_faces + g->dot_start[i];
+        for (j = 0; j < d->order; j++) {
+            edges[j] = d->edges[j] - g->edges;
+            faces[j] = d->faces[j] ? d->faces[j] - g->faces : -1;
+        }
+        g->dot_start[i+1] = g->dot_start[i] + d->order;
+    }
+
+    for (i = 0; i < g->num_edges; i++) {
+        grid_edge *e = g->edges + i;
+        g->edge_dots[2*i] = e->dot1 - g->dots;
+        g->edge_dots[2*i+1] = e->dot2 - g->dots;
+        g->edge_faces[2*i] = e->face1 ? e->face1 - g->faces : -1;
+        g->edge_faces[2*i+1] = e->face2 ? e->face2 - g->faces : -1;
+    }
 }
 
 /* Input: grid has its dots and faces initialised:
@@ -310,7 +394,8 @@ static int grid_edge_bydots_cmpfn(void *v1, void *v2)
 static void grid_make_consistent(grid *g)
 {
     int i;
-    tree234 *incomplete_edges;
+    grid_edge **incomplete_edges;
+    int mask, nbuckets;
     grid_edge *next_new_edge; /* Where new edge will go into g->edges */
 
 #ifdef DEBUG_GRID
@@ -334,39 +419,49 @@ static void grid_make_consistent(grid *g)
      * dots, but only one of the edge's faces.  Later on in the iteration, we
      * will find the same edge again (unless it's on the border), but we will
      * know the other face.
-     * For efficiency, maintain a list of the incomplete edges, sorted by
-     * their dots. */
-    incomplete_edges = newtree234(grid_edge_bydots_cmpfn);
+     * For efficiency, keep a hash table of the edges found so far, keyed
+     * on their (unordered) pair of dots.  An edge never needs removing: a
+     * third face can't share it, so it won't be looked up again. */
+    mask = grid_hash_size(g->num_edges) - 1;
+    incomplete_edges = snewn(mask + 1, grid_edge *);
+    for (i = 0; i <= mask; i++)
+        incomplete_edges[i] = NULL;
     for (i = 0; i < g->num_faces; i++) {
         grid_face *f = g->faces + i;
         int j;
         for (j = 0; j < f->order; j++) {
-            grid_edge e; /* fake edge for searching */
+            grid_dot *d1, *d2;
             grid_edge *edge_found;
+            unsigned h;
             int j2 = j + 1;
             if (j2 == f->order)
                 j2 = 0;
-            e.dot1 = f->dots[j];
-            e.dot2 = f->dots[j2];
-            /* Use del234 instead of find234, because we always want to
-             * remove the edge if found */
-            edge_found = del234(incomplete_edges, &e);
+            d1 = f->dots[j];
+            d2 = f->dots[j2];
+            h = (d1 < d2 ? grid_hash(d1 - g->dots, d2 - g->dots) :
+                 grid_hash(d2 - g->dots, d1 - g->dots));
+            while ((edge_found = incomplete_edges[h & mask]) != NULL) {
+                if ((edge_found->dot1 == d1 && edge_found->dot2 == d2) ||
+                    (edge_found->dot1 == d2 && edge_found->dot2 == d1))
+                    break;
+                h++;
+            }
             if (edge_found) {
-                /* This edge already added, so fill out missing face.
-                 * Edge is already removed from incomplete_edges. */
+                /* This edge already added, so fill out missing face. */
+                assert(edge_found->face2 == NULL);
                 edge_found->face2 = f;
             } else {
                 assert(next_new_edge - g->edges < g->num_edges);
-                next_new_edge->dot1 = e.dot1;
-                next_new_edge->dot2 = e.dot2;
+                next_new_edge->dot1 = d1;
+                next_new_edge->dot2 = d2;
                 next_new_edge->face1 = f;
                 next_new_edge->face2 = NULL; /* potentially infinite face */
-                add234(incomplete_edges, next_new_edge);
+                incomplete_edges[h & mask] = next_new_edge;
                 ++next_new_edge;
             }
         }
     }
-    freetree234(incomplete_edges);
+    sfree(incomplete_edges);
     
     /* ====== Stage 2 ======
      * For each face, build its edge list.
@@ -593,7 +688,35 @@ static void grid_make_consistent(grid *g)
             g->highest_y = max(g->highest_y, d->y);
         }
     }
-    
+
+    /* Spatial index of the dots, for grid_nearest_edge: bucket the dots by
+     * which tile-sized square of the bounding rectangle they fall in, with
+     * each bucket's dots stored contiguously (a counting sort). */
+    g->bucket_size = max(g->tilesize, 1);
+    g->bucket_w = (g->highest_x - g->lowest_x) / g->bucket_size + 1;
+    g->bucket_h = (g->highest_y - g->lowest_y) / g->bucket_size + 1;
+    nbuckets = g->bucket_w * g->bucket_h;
+    g->bucket_start = snewn(nbuckets + 1, int);
+    g->bucket_dots = snewn(g->num_dots, grid_dot *);
+    for (i = 0; i < nbuckets; i++)
+        g->bucket_start[i] = 0;
+    for (i = 0; i < g->num_dots; i++)
+        g->bucket_start[grid_dot_bucket(g, g->dots + i)]++;
+    for (i = 1; i < nbuckets; i++)
+        g->bucket_start[i] += g->bucket_start[i-1];
+    g->bucket_start[nbuckets] = g->num_dots;
+    /* bucket_start[b] is now the end of bucket b; fill each bucket from
+     * its end, which leaves bucket_start[b] pointing at its start. */
+    for (i = g->num_dots; i-- > 0 ;) {
+        int b = grid_dot_bucket(g, g->dots + i);
+        g->bucket_dots[--g->bucket_start[b]] = g->dots + i;
+    }
+
+    /* ====== Stage 5 ======
+     * Build the index-based copy of the incidence lists.
+     */
+    grid_make_index_lists(g);
+
 #ifdef DEBUG_GRID
     grid_print_derived(g);
 #endif
@@ -602,15 +725,29 @@ static void grid_make_consistent(grid *g)
 /* Helpers for making grid-generation easier.  These functions are only
  * intended for use during grid generation. */
 
-/* Comparison function for the (tree234) sorted dot list */
-static int grid_point_cmp_fn(void *v1, void *v2)
+/* Hash table of the dots created so far, keyed on their coordinates, so
+ * that grid_get_dot() can spot a dot shared with an earlier face.  Open
+ * addressing with linear probing; dots are never removed. */
+typedef struct grid_dot_table {
+    int mask;                          /* table size minus 1 */
+    grid_dot **slots;
+} grid_dot_table;
+
+/* max_dots is an upper bound on the number of dots that will be added */
+static grid_dot_table *grid_dot_table_new(int max_dots)
 {
-    grid_dot *p1 = v1;
-    grid_dot *p2 = v2;
-    if (p1->y != p2->y)
-        return p2->y - p1->y;
-    else
-        return p2->x - p1->x;
+    grid_dot_table *t = snew(grid_dot_table);
+    int i;
+    t->mask = grid_hash_size(max_dots) - 1;
+    t->slots = snewn(t->mask + 1, grid_dot *);
+    for (i = 0; i <= t->mask; i++)
+        t->slots[i] = NULL;
+    return t;
+}
+static void grid_dot_table_free(grid_dot_table *t)
+{
+    sfree(t->slots);
+    sfree(t);
 }
 /* Add a new face to the grid, with its dot list allocated.
  * Assumes there's enough space allocated for the new face in grid->faces */
@@ -641,21 +778,19 @@ static grid_dot *grid_dot_add_new(grid *g, int x, int y)
  * in the dot_list, or add a new dot to the grid (and the dot_list) and
  * return that.
  * Assumes g->dots has enough capacity allocated */
-static grid_dot *grid_get_dot(grid *g, tree234 *dot_list, int x, int y)
+static grid_dot *grid_get_dot(grid *g, grid_dot_table *dot_list, int x, int y)
 {
-    grid_dot test, *ret;
+    unsigned h = grid_hash(x, y);
+    grid_dot *ret;
 
-    test.order = 0;
-    test.edges = NULL;
-    test.faces = NULL;
-    test.x = x;
-    test.y = y;
-    ret = find234(dot_list, &test, NULL);
-    if (ret)
-        return ret;
+    while ((ret = dot_list->slots[h & dot_list->mask]) != NULL) {
+        if (ret->x == x && ret->y == y)
+            return ret;
+        h++;
+    }
 
     ret = grid_dot_add_new(g, x, y);
-    add234(dot_list, ret);
+    dot_list->slots[h & dot_list->mask] = ret;
     return ret;
 }
 
@@ -675,10 +810,10 @@ static void grid_face_set_dot(grid *g, grid_dot *d, int position)
  * a new face reuses an existing dot.  For example, two squares touching at an
  * edge would generate six unique dots: four dots from the first face, then
  * two additional dots for the second face, because we detect the other two
- * dots have already been taken up.  This list is stored in a tree234
- * called "points".  No extra memory-allocation needed here - we store the
- * actual grid_dot* pointers, which all point into the g->dots list.
- * For this reason, we have to calculate coordinates in such a way as to
+ * dots have already been taken up.  This list is stored in a hash table
+ * called "points", keyed on the dot coordinates.  It holds the actual
+ * grid_dot* pointers, which all point into the g->dots list.
+ * Since dots are matched by exact coordinates, we have to calculate coordinates in such a way as to
  * eliminate any rounding errors, so we can detect when a dot on one
  * face precisely lands on a dot of a different face.  No floating-point
  * arithmetic here!
@@ -694,14 +829,14 @@ grid *grid_new_square(int width, int height)
     int max_faces = width * height;
     int max_dots = (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_dot_table *points;
 
     grid *g = grid_new();
     g->tilesize = a;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_dot_table_new(max_dots);
 
     /* generate square faces */
     for (y = 0; y < height; y++) {
@@ -723,7 +858,7 @@ grid *grid_new_square(int width, int height)
         }
     }
 
-    freetree234(points);
+    grid_dot_table_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
     g->middle_face = g->faces + (height/2) * width + (width/2);
@@ -743,14 +878,14 @@ grid *grid_new_honeycomb(int width, int height)
     int max_faces = width * height;
     int max_dots = 2 * (width + 1) * (height + 1);
     
-    tree234 *points;
+    grid_dot_table *points;
 
     grid *g = grid_new();
     g->tilesize = 3 * a;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_dot_table_new(max_dots);
 
     /* generate hexagonal faces */
     for (y = 0; y < height; y++) {
@@ -778,7 +913,7 @@ grid *grid_new_honeycomb(int width, int height)
         }
     }
 
-    freetree234(points);
+    grid_dot_table_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
     g->middle_face = g->faces + (height/2) * width + (width/2);
@@ -879,14 +1014,14 @@ grid *grid_new_snubsquare(int width, int height)
     int max_faces = 3 * width * height;
     int max_dots = 2 * (width + 1) * (height + 1);
     
-    tree234 *points;
+    grid_dot_table *points;
 
     grid *g = grid_new();
     g->tilesize = 18;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_dot_table_new(max_dots);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -959,7 +1094,7 @@ grid *grid_new_snubsquare(int width, int height)
         }
     }
 
-    freetree234(points);
+    grid_dot_table_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
     g->middle_face = g->faces + (height/2) * width + (width/2);
@@ -979,14 +1114,14 @@ grid *grid_new_cairo(int width, int height)
     int max_faces = 2 * width * height;
     int max_dots = 3 * (width + 1) * (height + 1);
     
-    tree234 *points;
+    grid_dot_table *points;
 
     grid *g = grid_new();
     g->tilesize = 40;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_dot_table_new(max_dots);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -1052,7 +1187,7 @@ grid *grid_new_cairo(int width, int height)
         }
     }
 
-    freetree234(points);
+    grid_dot_table_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
     g->middle_face = g->faces + (height/2) * width + (width/2);
@@ -1072,14 +1207,14 @@ grid *grid_new_greathexagonal(int width, int height)
     int max_faces = 6 * (width + 1) * (height + 1);
     int max_dots = 6 * width * height;
 
-    tree234 *points;
+    grid_dot_table *points;
 
     grid *g = grid_new();
     g->tilesize = 18;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_dot_table_new(max_dots);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -1168,7 +1303,7 @@ grid *grid_new_greathexagonal(int width, int height)
         }
     }
 
-    freetree234(points);
+    grid_dot_table_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
     g->middle_face = g->faces + (height/2) * width + (width/2);
@@ -1188,14 +1323,14 @@ grid *grid_new_octagonal(int width, int height)
     int max_faces = 2 * width * height;
     int max_dots = 4 * (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_dot_table *points;
 
     grid *g = grid_new();
     g->tilesize = 40;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_dot_table_new(max_dots);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -1237,7 +1372,7 @@ grid *grid_new_octagonal(int width, int height)
         }
     }
 
-    freetree234(points);
+    grid_dot_table_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
     g->middle_face = g->faces + (height/2) * width + (width/2);
@@ -1257,14 +1392,14 @@ grid *grid_new_kites(int width, int height)
     int max_faces = 6 * width * height;
     int max_dots = 6 * (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_dot_table *points;
 
     grid *g = grid_new();
     g->tilesize = 40;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_dot_table_new(max_dots);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -1343,7 +1478,7 @@ grid *grid_new_kites(int width, int height)
         }
     }
 
-    freetree234(points);
+    grid_dot_table_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
     g->middle_face = g->faces + 6 * ((height/2) * width + (width/2));
@@ -1353,3 +1488,87 @@ grid *grid_new_kites(int width, int height)
 }
 
 /* ----------- End of grid generators ------------- */
+
+#ifdef STANDALONE_GRID_BENCHMARK
+
+#include <time.h>
+
+static const struct {
+    const char *name;
+    grid *(*new)(int width, int height);
+} gridtypes[] = {
+    {"square", grid_new_square},
+    {"triangular", grid_new_triangular},
+    {"honeycomb", grid_new_honeycomb},
+    {"snubsquare", grid_new_snubsquare},
+    {"cairo", grid_new_cairo},
+    {"greathexagonal", grid_new_greathexagonal},
+    {"octagonal", grid_new_octagonal},
+    {"kites", grid_new_kites},
+};
+
+/*
+ * Time construction of each type of grid at the given size, and then
+ * a batch of nearest-edge queries at random points over its bounding
+ * box (plus a tile's margin, so that some miss the grid altogether).
+ */
+int main(int argc, char **argv)
+{
+    const char *quis = argv[0];
+    int w = 40, h = 40, nbuilds = 20, nqueries = 100000;
+    int type, i;
+
+    while (--argc > 0) {
+        char *p = *++argv;
+        if (!strcmp(p, "-b") && argc > 1) {
+            nbuilds = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(p, "-q") && argc > 1) {
+            nqueries = atoi(*++argv);
+            argc--;
+        } else if (*p != '-' && sscanf(p, "%dx%d", &w, &h) == 2) {
+            /* size parsed */
+        } else {
+            fprintf(stderr, "usage: %s [-b builds] [-q queries] [WxH]\n",
+                    quis);
+            return 1;
+        }
+    }
+
+    for (type = 0; type < lenof(gridtypes); type++) {
+        random_state *rs = random_new("grid", 4);
+        grid *g;
+        clock_t start;
+        double tbuild, tquery;
+        int hits = 0, xmin, ymin, xrange, yrange;
+
+        start = clock();
+        for (i = 0; i < nbuilds; i++)
+            grid_free(gridtypes[type].new(w, h));
+        tbuild = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        g = gridtypes[type].new(w, h);
+        xmin = g->lowest_x - g->tilesize;
+        ymin = g->lowest_y - g->tilesize;
+        xrange = g->highest_x - g->lowest_x + 2 * g->tilesize;
+        yrange = g->highest_y - g->lowest_y + 2 * g->tilesize;
+        start = clock();
+        for (i = 0; i < nqueries; i++) {
+            int x = xmin + random_upto(rs, xrange);
+            int y = ymin + random_upto(rs, yrange);
+            if (grid_nearest_edge(g, x, y))
+                hits++;
+        }
+        tquery = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        printf("%-16s %6d dots %10.3f ms per build %8.3f us per query"
+               " (%d hits)\n", gridtypes[type].name, g->num_dots,
+               tbuild * 1000.0 / nbuilds, tquery * 1e6 / nqueries, hits);
+        grid_free(g);
+        random_free(rs);
+    }
+
+    return 0;
+}
+
+#endif
@@ -58,8 +58,7 @@ typedef struct grid {
   int num_dots;  grid_dot *dots;
 
   /* Should be a face roughly near the middle of the grid.
-   * Used to seed path-generation, and also for nearest-edge
-   * detection. */
+   * Used to seed path-generation. */
   grid_face *middle_face;
 
   /* Cache the bounding-box of the grid, so the drawing-code can quickly
@@ -72,12 +71,51 @@ typedef struct grid {
    * of a square cell. */
   int tilesize;
 
+  /* Spatial index of the dots, used for nearest-edge detection.  The
+   * bounding-box is cut into square buckets of side bucket_size (the
+   * tilesize), bucket_w across and bucket_h down.  The dots in bucket
+   * number (by * bucket_w + bx) are bucket_dots[bucket_start[b]] up to,
+   * but not including, bucket_dots[bucket_start[b+1]]. */
+  int bucket_size, bucket_w, bucket_h;
+  int *bucket_start;
+  grid_dot **bucket_dots;
+
+  /* Index-based copy of the incidence lists, for solvers which walk
+   * them in their inner loops (the pointer lists above are kept for
+   * everything else).  Faces, edges and dots are numbered by their
+   * position in the lists above.  The edges and dots of face f are
+   * face_edges[] and face_dots[] from face_start[f] up to, but not
+   * including, face_start[f+1], in the same order as f->edges and
+   * f->dots.  Likewise the edges and faces of dot d are in dot_edges[]
+   * and dot_faces[] from dot_start[d], with -1 for the infinite face.
+   * Edge e joins dots edge_dots[2e] and edge_dots[2e+1], and lies
+   * between faces edge_faces[2e] and edge_faces[2e+1].
+   * All of these share a single allocation, starting at face_start.
+   * Use the GRID_* macros below to read them. */
+  int *face_start, *face_edges, *face_dots;
+  int *dot_start, *dot_edges, *dot_faces;
+  int *edge_dots, *edge_faces;
+
   /* We really don't want to copy this monstrosity!
    * A grid is immutable once generated.
    */
   int refcount;
 } grid;
 
+/* Accessors for the index-based incidence lists.  f, e and d are face,
+ * edge and dot numbers; the _EDGES, _DOTS and _FACES macros give an int
+ * array of length _ORDER. */
+#define GRID_FACE_ORDER(g, f) ((g)->face_start[(f)+1] - (g)->face_start[f])
+#define GRID_FACE_EDGES(g, f) ((g)->face_edges + (g)->face_start[f])
+#define GRID_FACE_DOTS(g, f)  ((g)->face_dots + (g)->face_start[f])
+#define GRID_DOT_ORDER(g, d)  ((g)->dot_start[(d)+1] - (g)->dot_start[d])
+#define GRID_DOT_EDGES(g, d)  ((g)->dot_edges + (g)->dot_start[d])
+#define GRID_DOT_FACES(g, d)  ((g)->dot_faces + (g)->dot_start[d])
+#define GRID_EDGE_DOT1(g, e)  ((g)->edge_dots[2*(e)])
+#define GRID_EDGE_DOT2(g, e)  ((g)->edge_dots[2*(e)+1])
+#define GRID_EDGE_FACE1(g, e) ((g)->edge_faces[2*(e)])
+#define GRID_EDGE_FACE2(g, e) ((g)->edge_faces[2*(e)+1])
+
 grid *grid_new_square(int width, int height);
 grid *grid_new_honeycomb(int width, int height);
 grid *grid_new_triangular(int width, int height);
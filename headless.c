@@ -0,0 +1,1226 @@
+/*
+ * headless.c: a drawing API which renders into a plain RGB565
+ * frame buffer in memory, so that games' redraw functions can be
+ * run and profiled on a workstation without SDL or libogc.
+ *
+ * Build everything with -DHEADLESS to leave the platform headers
+ * out of puzzles.h. Building this file with
+ * -DSTANDALONE_DRAWING_BENCHMARK as well gives a program which
+ * redraws every game in gamelist[] repeatedly and reports frames
+ * per second and the time spent in each kind of drawing operation.
+ * -DSTANDALONE_UNDO_BENCHMARK instead gives a program which plays a
+ * long scripted session of one game and reports how much memory
+ * the undo chain cost. -DSTANDALONE_GENERATION_BENCHMARK gives one
+ * which times each game's generator using each of random.c's
+ * random number generators, and -DSTANDALONE_RACE_BENCHMARK one
+ * which measures new-game latency with different numbers of racing
+ * generator threads (see midend.c). All of them need linking with
+ * -lpthread.
+ *
+ * The rendering is deliberately simple: no anti-aliasing, and text
+ * comes from a small built-in bitmap font scaled up to roughly the
+ * requested size. It's meant to cost about what a software
+ * renderer on the real hardware costs, not to look nice.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include "puzzles.h"
+#include "headless.h"
+
+/*
+ * 5x7 font covering printable ASCII, five column bytes per glyph
+ * with the top row in bit 0. Glyphs sit in a 6x8 cell.
+ */
+#define FONT_FIRST 32
+#define FONT_LAST 126
+#define FONT_W 5
+#define FONT_H 7
+#define FONT_CELL_W 6
+#define FONT_CELL_H 8
+
+static const unsigned char font5x7[FONT_LAST - FONT_FIRST + 1][FONT_W] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00},
+    {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14},
+    {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62},
+    {0x36,0x49,0x56,0x20,0x50}, {0x00,0x05,0x03,0x00,0x00},
+    {0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00},
+    {0x14,0x08,0x3E,0x08,0x14}, {0x08,0x08,0x3E,0x08,0x08},
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08},
+    {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02},
+    {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00},
+    {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31},
+    {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39},
+    {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E},
+    {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00},
+    {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14},
+    {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06},
+    {0x32,0x49,0x79,0x41,0x3E}, {0x7E,0x11,0x11,0x11,0x7E},
+    {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22},
+    {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41},
+    {0x7F,0x09,0x09,0x09,0x01}, {0x3E,0x41,0x49,0x49,0x7A},
+    {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00},
+    {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41},
+    {0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x0C,0x02,0x7F},
+    {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E},
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E},
+    {0x7F,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31},
+    {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F},
+    {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F},
+    {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07},
+    {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00},
+    {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+    {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78},
+    {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20},
+    {0x38,0x44,0x44,0x48,0x7F}, {0x38,0x54,0x54,0x54,0x18},
+    {0x08,0x7E,0x09,0x01,0x02}, {0x0C,0x52,0x52,0x52,0x3E},
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00},
+    {0x20,0x40,0x44,0x3D,0x00}, {0x7F,0x10,0x28,0x44,0x00},
+    {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78},
+    {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38},
+    {0x7C,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7C},
+    {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20},
+    {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C},
+    {0x1C,0x20,0x40,0x20,0x1C}, {0x3C,0x40,0x30,0x40,0x3C},
+    {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C},
+    {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00},
+    {0x00,0x00,0x7F,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00},
+    {0x08,0x04,0x08,0x10,0x08},
+};
+
+struct blitter {
+    int w, h, x, y;
+    unsigned short *pixels;
+};
+
+struct headless {
+    int w, h;
+    unsigned short *pixels;
+    unsigned short *colours;
+    int ncolours;
+    int cx1, cy1, cx2, cy2;	       /* current clip rectangle, half-open */
+    double *xings;		       /* polygon scan-line scratch space */
+    int xingsize;
+    struct headless_stats stats;
+};
+
+static double headless_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+#define PRIM_START(hd) double prim_start = headless_time()
+#define PRIM_END(hd, prim) do { \
+    (hd)->stats.calls[prim]++; \
+    (hd)->stats.seconds[prim] += headless_time() - prim_start; \
+} while (0)
+
+headless *headless_new(int w, int h)
+{
+    headless *hd = snew(headless);
+
+    hd->w = w;
+    hd->h = h;
+    hd->pixels = snewn(w * h, unsigned short);
+    memset(hd->pixels, 0, w * h * sizeof(unsigned short));
+    hd->colours = NULL;
+    hd->ncolours = 0;
+    hd->cx1 = hd->cy1 = 0;
+    hd->cx2 = w;
+    hd->cy2 = h;
+    hd->xings = NULL;
+    hd->xingsize = 0;
+    headless_reset_stats(hd);
+
+    return hd;
+}
+
+void headless_free(headless *hd)
+{
+    sfree(hd->pixels);
+    sfree(hd->colours);
+    sfree(hd->xings);
+    sfree(hd);
+}
+
+void headless_set_colours(headless *hd, const float *colours, int ncolours)
+{
+    int i, r, g, b;
+
+    sfree(hd->colours);
+    hd->colours = snewn(ncolours, unsigned short);
+    hd->ncolours = ncolours;
+    for (i = 0; i < ncolours; i++) {
+	r = (int)(colours[i*3+0] * 31.0F + 0.5F);
+	g = (int)(colours[i*3+1] * 63.0F + 0.5F);
+	b = (int)(colours[i*3+2] * 31.0F + 0.5F);
+	hd->colours[i] = (unsigned short)((r << 11) | (g << 5) | b);
+    }
+}
+
+const unsigned short *headless_pixels(headless *hd, int *w, int *h)
+{
+    *w = hd->w;
+    *h = hd->h;
+    return hd->pixels;
+}
+
+const struct headless_stats *headless_get_stats(headless *hd)
+{
+    return &hd->stats;
+}
+
+void headless_reset_stats(headless *hd)
+{
+    memset(&hd->stats, 0, sizeof(hd->stats));
+}
+
+const char *headless_prim_name(int prim)
+{
+    static const char *const names[NHPRIMS] = {
+	"text", "rect", "line", "polygon", "circle", "blitter", "update"
+    };
+    assert(prim >= 0 && prim < NHPRIMS);
+    return names[prim];
+}
+
+/* ----------------------------------------------------------------------
+ * Rasterisation. Everything is built out of clipped horizontal
+ * spans and single pixels.
+ */
+
+static unsigned short headless_colour(headless *hd, int colour)
+{
+    assert(colour >= 0 && colour < hd->ncolours);
+    return hd->colours[colour];
+}
+
+/* Fills pixels x1 to x2 inclusive on row y. */
+static void hspan(headless *hd, int x1, int x2, int y, unsigned short c)
+{
+    unsigned short *p;
+
+    if (y < hd->cy1 || y >= hd->cy2)
+	return;
+    if (x1 < hd->cx1)
+	x1 = hd->cx1;
+    if (x2 >= hd->cx2)
+	x2 = hd->cx2 - 1;
+    for (p = hd->pixels + y * hd->w + x1; x1 <= x2; x1++)
+	*p++ = c;
+}
+
+static void plot(headless *hd, int x, int y, unsigned short c)
+{
+    if (x >= hd->cx1 && x < hd->cx2 && y >= hd->cy1 && y < hd->cy2)
+	hd->pixels[y * hd->w + x] = c;
+}
+
+static void raster_line(headless *hd, int x1, int y1, int x2, int y2,
+			unsigned short c)
+{
+    int dx = abs(x2 - x1), dy = -abs(y2 - y1);
+    int sx = x1 < x2 ? 1 : -1, sy = y1 < y2 ? 1 : -1;
+    int err = dx + dy, e2;
+
+    while (1) {
+	plot(hd, x1, y1, c);
+	if (x1 == x2 && y1 == y2)
+	    break;
+	e2 = 2 * err;
+	if (e2 >= dy) {
+	    err += dy;
+	    x1 += sx;
+	}
+	if (e2 <= dx) {
+	    err += dx;
+	    y1 += sy;
+	}
+    }
+}
+
+static int compare_doubles(const void *av, const void *bv)
+{
+    double a = *(const double *)av, b = *(const double *)bv;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+/*
+ * Even-odd scan-line fill, sampling at pixel centres.
+ */
+static void raster_polygon(headless *hd, const int *coords, int npoints,
+			   unsigned short c)
+{
+    int i, j, y, ymin = INT_MAX, ymax = INT_MIN, nxings;
+    double yc, x0, y0, x1, y1;
+
+    if (hd->xingsize < npoints) {
+	hd->xingsize = npoints;
+	hd->xings = sresize(hd->xings, hd->xingsize, double);
+    }
+
+    for (i = 0; i < npoints; i++) {
+	ymin = min(ymin, coords[i*2+1]);
+	ymax = max(ymax, coords[i*2+1]);
+    }
+    ymin = max(ymin, hd->cy1);
+    ymax = min(ymax, hd->cy2 - 1);
+
+    for (y = ymin; y <= ymax; y++) {
+	yc = y + 0.5;
+	nxings = 0;
+	for (i = 0, j = npoints - 1; i < npoints; j = i++) {
+	    x0 = coords[j*2];
+	    y0 = coords[j*2+1];
+	    x1 = coords[i*2];
+	    y1 = coords[i*2+1];
+	    if ((y0 <= yc && yc < y1) || (y1 <= yc && yc < y0))
+		hd->xings[nxings++] = x0 + (yc - y0) * (x1 - x0) / (y1 - y0);
+	}
+	qsort(hd->xings, nxings, sizeof(double), compare_doubles);
+	for (i = 0; i + 1 < nxings; i += 2)
+	    hspan(hd, (int)ceil(hd->xings[i] - 0.5),
+		  (int)floor(hd->xings[i+1] - 0.5), y, c);
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * The drawing API.
+ */
+
+static void headless_draw_text(void *handle, int x, int y, int fonttype,
+			       int fontsize, int align, int colour,
+			       char *text)
+{
+    headless *hd = (headless *)handle;
+    unsigned short c = headless_colour(hd, colour);
+    int scale = max(1, (fontsize + FONT_CELL_H / 2) / FONT_CELL_H);
+    int len = strlen(text), ch, col, row, bits;
+    PRIM_START(hd);
+
+    if (align & ALIGN_HCENTRE)
+	x -= len * FONT_CELL_W * scale / 2;
+    else if (align & ALIGN_HRIGHT)
+	x -= len * FONT_CELL_W * scale;
+    if (align & ALIGN_VCENTRE)
+	y -= FONT_H * scale / 2;
+    else
+	y -= FONT_H * scale;	       /* y was the baseline */
+
+    for (; *text; text++, x += FONT_CELL_W * scale) {
+	ch = (unsigned char)*text;
+	if (ch < FONT_FIRST || ch > FONT_LAST)
+	    ch = '?';
+	for (col = 0; col < FONT_W; col++) {
+	    bits = font5x7[ch - FONT_FIRST][col];
+	    for (row = 0; row < FONT_H; row++)
+		if (bits & (1 << row)) {
+		    int i;
+		    for (i = 0; i < scale; i++)
+			hspan(hd, x + col * scale, x + (col+1) * scale - 1,
+			      y + row * scale + i, c);
+		}
+	}
+    }
+
+    PRIM_END(hd, HPRIM_TEXT);
+}
+
+static void headless_draw_rect(void *handle, int x, int y, int w, int h,
+			       int colour)
+{
+    headless *hd = (headless *)handle;
+    unsigned short c = headless_colour(hd, colour);
+    int y2 = min(y + h, hd->cy2);
+    PRIM_START(hd);
+
+    for (y = max(y, hd->cy1); y < y2; y++)
+	hspan(hd, x, x + w - 1, y, c);
+
+    PRIM_END(hd, HPRIM_RECT);
+}
+
+static void headless_draw_line(void *handle, int x1, int y1, int x2, int y2,
+			       int colour)
+{
+    headless *hd = (headless *)handle;
+    PRIM_START(hd);
+
+    raster_line(hd, x1, y1, x2, y2, headless_colour(hd, colour));
+
+    PRIM_END(hd, HPRIM_LINE);
+}
+
+static void headless_draw_polygon(void *handle, int *coords, int npoints,
+				  int fillcolour, int outlinecolour)
+{
+    headless *hd = (headless *)handle;
+    unsigned short c;
+    int i, j;
+    PRIM_START(hd);
+
+    if (fillcolour >= 0)
+	raster_polygon(hd, coords, npoints, headless_colour(hd, fillcolour));
+
+    assert(outlinecolour >= 0);
+    c = headless_colour(hd, outlinecolour);
+    for (i = 0, j = npoints - 1; i < npoints; j = i++)
+	raster_line(hd, coords[j*2], coords[j*2+1], coords[i*2], coords[i*2+1],
+		    c);
+
+    PRIM_END(hd, HPRIM_POLYGON);
+}
+
+static void headless_draw_circle(void *handle, int cx, int cy, int radius,
+				 int fillcolour, int outlinecolour)
+{
+    headless *hd = (headless *)handle;
+    unsigned short c;
+    int x, y, err;
+    PRIM_START(hd);
+
+    if (fillcolour >= 0) {
+	c = headless_colour(hd, fillcolour);
+	for (y = -radius; y <= radius; y++) {
+	    x = (int)sqrt((double)(radius * radius - y * y));
+	    hspan(hd, cx - x, cx + x, cy + y, c);
+	}
+    }
+
+    /* Midpoint circle for the outline. */
+    assert(outlinecolour >= 0);
+    c = headless_colour(hd, outlinecolour);
+    x = radius;
+    y = 0;
+    err = 1 - radius;
+    while (x >= y) {
+	plot(hd, cx + x, cy + y, c); plot(hd, cx - x, cy + y, c);
+	plot(hd, cx + x, cy - y, c); plot(hd, cx - x, cy - y, c);
+	plot(hd, cx + y, cy + x, c); plot(hd, cx - y, cy + x, c);
+	plot(hd, cx + y, cy - x, c); plot(hd, cx - y, cy - x, c);
+	y++;
+	if (err < 0) {
+	    err += 2 * y + 1;
+	} else {
+	    x--;
+	    err += 2 * (y - x) + 1;
+	}
+    }
+
+    PRIM_END(hd, HPRIM_CIRCLE);
+}
+
+static void headless_draw_update(void *handle, int x, int y, int w, int h)
+{
+    headless *hd = (headless *)handle;
+
+    /* Nothing to send anywhere; just count them. */
+    hd->stats.calls[HPRIM_UPDATE]++;
+}
+
+static void headless_clip(void *handle, int x, int y, int w, int h)
+{
+    headless *hd = (headless *)handle;
+
+    hd->cx1 = max(x, 0);
+    hd->cy1 = max(y, 0);
+    hd->cx2 = min(x + w, hd->w);
+    hd->cy2 = min(y + h, hd->h);
+}
+
+static void headless_unclip(void *handle)
+{
+    headless *hd = (headless *)handle;
+
+    hd->cx1 = hd->cy1 = 0;
+    hd->cx2 = hd->w;
+    hd->cy2 = hd->h;
+}
+
+static void headless_start_draw(void *handle)
+{
+}
+
+static void headless_end_draw(void *handle)
+{
+    headless *hd = (headless *)handle;
+
+    hd->stats.frames++;
+}
+
+static void headless_status_bar(void *handle, char *text)
+{
+}
+
+static blitter *headless_blitter_new(void *handle, int w, int h)
+{
+    blitter *bl = snew(blitter);
+
+    bl->w = w;
+    bl->h = h;
+    bl->x = bl->y = 0;
+    bl->pixels = snewn(w * h, unsigned short);
+    memset(bl->pixels, 0, w * h * sizeof(unsigned short));
+
+    return bl;
+}
+
+static void headless_blitter_free(void *handle, blitter *bl)
+{
+    sfree(bl->pixels);
+    sfree(bl);
+}
+
+/*
+ * Copies the parts of a blitter-sized rectangle at (x,y) which lie
+ * on the frame buffer, in whichever direction. Blitters ignore the
+ * clip rectangle, as on the other front ends.
+ */
+static void blitter_copy(headless *hd, blitter *bl, int x, int y, int save)
+{
+    int row, x1 = max(x, 0), x2 = min(x + bl->w, hd->w);
+    unsigned short *screen, *saved;
+
+    if (x1 >= x2)
+	return;
+    for (row = max(y, 0); row < min(y + bl->h, hd->h); row++) {
+	screen = hd->pixels + row * hd->w + x1;
+	saved = bl->pixels + (row - y) * bl->w + (x1 - x);
+	if (save)
+	    memcpy(saved, screen, (x2 - x1) * sizeof(unsigned short));
+	else
+	    memcpy(screen, saved, (x2 - x1) * sizeof(unsigned short));
+    }
+}
+
+static void headless_blitter_save(void *handle, blitter *bl, int x, int y)
+{
+    headless *hd = (headless *)handle;
+    PRIM_START(hd);
+
+    bl->x = x;
+    bl->y = y;
+    blitter_copy(hd, bl, x, y, TRUE);
+
+    PRIM_END(hd, HPRIM_BLITTER);
+}
+
+static void headless_blitter_load(void *handle, blitter *bl, int x, int y)
+{
+    headless *hd = (headless *)handle;
+    PRIM_START(hd);
+
+    if (x == BLITTER_FROMSAVED && y == BLITTER_FROMSAVED) {
+	x = bl->x;
+	y = bl->y;
+    }
+    blitter_copy(hd, bl, x, y, FALSE);
+
+    PRIM_END(hd, HPRIM_BLITTER);
+}
+
+const struct drawing_api headless_drawing = {
+    headless_draw_text,
+    headless_draw_rect,
+    headless_draw_line,
+    headless_draw_polygon,
+    headless_draw_circle,
+    headless_draw_update,
+    headless_clip,
+    headless_unclip,
+    headless_start_draw,
+    headless_end_draw,
+    headless_status_bar,
+    headless_blitter_new,
+    headless_blitter_free,
+    headless_blitter_save,
+    headless_blitter_load,
+    NULL, NULL, NULL, NULL, NULL, NULL, /* {begin,end}_{doc,page,puzzle} */
+    NULL,			       /* line_width */
+};
+
+#if defined STANDALONE_DRAWING_BENCHMARK || defined STANDALONE_UNDO_BENCHMARK || \
+    defined STANDALONE_GENERATION_BENCHMARK || defined STANDALONE_RACE_BENCHMARK
+
+/*
+ * The benchmarks need to supply the handful of functions the midend
+ * expects a front end to provide.
+ */
+struct frontend {
+    int timer_active;
+};
+
+void fatal(char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal error: ");
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+#ifdef DEBUGGING
+void debug_printf(char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+#endif
+
+void frontend_default_colour(frontend *fe, float *output)
+{
+    /* Same as the SDL front end. */
+    output[0] = output[1] = output[2] = 0.75F;
+}
+
+void get_random_seed(void **randseed, int *randseedsize)
+{
+    /* A fixed seed, so that runs are comparable with each other. */
+    static const char seed[] = "headless";
+    *randseed = dupstr(seed);
+    *randseedsize = sizeof(seed) - 1;
+}
+
+void activate_timer(frontend *fe)
+{
+    fe->timer_active = TRUE;
+}
+
+void deactivate_timer(frontend *fe)
+{
+    fe->timer_active = FALSE;
+}
+
+void game_completed()
+{
+}
+
+/*
+ * Threads for background generation, on top of POSIX threads.
+ */
+#include <pthread.h>
+
+struct fe_thread {
+    pthread_t thread;
+    int (*fn)(void *ctx);
+    void *ctx;
+};
+
+static void *fe_thread_main(void *vt)
+{
+    fe_thread *t = (fe_thread *)vt;
+    t->fn(t->ctx);
+    return NULL;
+}
+
+fe_thread *fe_thread_start(int (*fn)(void *ctx), void *ctx)
+{
+    fe_thread *t = snew(fe_thread);
+
+    t->fn = fn;
+    t->ctx = ctx;
+    if (pthread_create(&t->thread, NULL, fe_thread_main, t)) {
+	sfree(t);
+	return NULL;
+    }
+    return t;
+}
+
+void fe_thread_wait(fe_thread *t)
+{
+    pthread_join(t->thread, NULL);
+    sfree(t);
+}
+
+struct fe_mutex {
+    pthread_mutex_t mutex;
+};
+
+fe_mutex *fe_mutex_new(void)
+{
+    fe_mutex *m = snew(fe_mutex);
+    pthread_mutex_init(&m->mutex, NULL);
+    return m;
+}
+
+void fe_mutex_free(fe_mutex *m)
+{
+    pthread_mutex_destroy(&m->mutex);
+    sfree(m);
+}
+
+void fe_mutex_lock(fe_mutex *m)
+{
+    pthread_mutex_lock(&m->mutex);
+}
+
+void fe_mutex_unlock(fe_mutex *m)
+{
+    pthread_mutex_unlock(&m->mutex);
+}
+
+struct fe_cond {
+    pthread_cond_t cond;
+};
+
+fe_cond *fe_cond_new(void)
+{
+    fe_cond *c = snew(fe_cond);
+    pthread_cond_init(&c->cond, NULL);
+    return c;
+}
+
+void fe_cond_free(fe_cond *c)
+{
+    pthread_cond_destroy(&c->cond);
+    sfree(c);
+}
+
+void fe_cond_wait(fe_cond *c, fe_mutex *m)
+{
+    pthread_cond_wait(&c->cond, &m->mutex);
+}
+
+void fe_cond_signal(fe_cond *c)
+{
+    pthread_cond_signal(&c->cond);
+}
+
+#ifdef STANDALONE_DRAWING_BENCHMARK
+
+static void usage(const char *quis)
+{
+    fprintf(stderr, "usage: %s [-b] [-n frames] [-s WxH] [game ...]\n"
+	    "  -b      record and replay each frame (see drawing.c)\n"
+	    "  -n N    number of full redraws per game (default 200)\n"
+	    "  -s WxH  frame buffer size (default 320x240)\n", quis);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *quis = argv[0];
+    char **games;
+    int ngames = 0, nframes = 200, w = 320, h = 240, batching = FALSE;
+    int i, j, k, prim;
+    struct headless_stats total;
+    double total_time = 0.0;
+
+    games = snewn(argc, char *);
+    while (--argc > 0) {
+	char *p = *++argv;
+	if (!strcmp(p, "-b")) {
+	    batching = TRUE;
+	} else if (!strcmp(p, "-n") && argc > 1) {
+	    nframes = atoi(*++argv);
+	    argc--;
+	} else if (!strcmp(p, "-s") && argc > 1) {
+	    if (sscanf(*++argv, "%dx%d", &w, &h) != 2)
+		usage(quis);
+	    argc--;
+	} else if (*p == '-') {
+	    usage(quis);
+	} else {
+	    games[ngames++] = p;
+	}
+    }
+    if (nframes <= 0 || w <= 0 || h <= 0)
+	usage(quis);
+
+    memset(&total, 0, sizeof(total));
+
+    printf("%-10s %7s", "game", "fps");
+    for (prim = 0; prim < NHPRIMS; prim++)
+	if (prim != HPRIM_UPDATE)
+	    printf(" %8s", headless_prim_name(prim));
+    printf("   (microseconds per frame)\n");
+
+    for (i = 0; i < gamecount; i++) {
+	const game *thegame = gamelist[i];
+	struct frontend fe;
+	const struct headless_stats *st;
+	headless *hd;
+	midend *me;
+	float *colours;
+	int ncolours, x, y;
+	double start, elapsed;
+
+	if (ngames) {
+	    for (j = 0; j < ngames; j++)
+		if (!strcmp(games[j], thegame->name) ||
+		    !strcmp(games[j], thegame->htmlhelp_topic))
+		    break;
+	    if (j == ngames)
+		continue;
+	}
+
+	fe.timer_active = FALSE;
+	hd = headless_new(w, h);
+	me = midend_new(&fe, thegame, &headless_drawing, hd);
+	midend_set_draw_batching(me, batching);
+	midend_new_game(me);
+	x = w;
+	y = h;
+	midend_size(me, &x, &y, FALSE);
+	colours = midend_colours(me, &ncolours);
+	headless_set_colours(hd, colours, ncolours);
+	sfree(colours);
+
+	/*
+	 * midend_force_redraw throws away the game's drawstate, so
+	 * every frame is a full redraw of the puzzle rather than
+	 * just the bits which changed.
+	 */
+	midend_force_redraw(me);
+	headless_reset_stats(hd);
+	start = headless_time();
+	for (k = 0; k < nframes; k++)
+	    midend_force_redraw(me);
+	elapsed = headless_time() - start;
+	total_time += elapsed;
+
+	st = headless_get_stats(hd);
+	printf("%-10s %7.1f", thegame->name, st->frames / elapsed);
+	for (prim = 0; prim < NHPRIMS; prim++) {
+	    total.calls[prim] += st->calls[prim];
+	    total.seconds[prim] += st->seconds[prim];
+	    if (prim != HPRIM_UPDATE)
+		printf(" %8.1f", st->seconds[prim] * 1.0e6 / st->frames);
+	}
+	printf("\n");
+	total.frames += st->frames;
+
+	midend_free(me);
+	headless_free(hd);
+    }
+
+    if (total.frames) {
+	printf("%-10s %7.1f", "all", total.frames / total_time);
+	for (prim = 0; prim < NHPRIMS; prim++)
+	    if (prim != HPRIM_UPDATE)
+		printf(" %8.1f", total.seconds[prim] * 1.0e6 / total.frames);
+	printf("\n\n%-10s", "calls");
+	for (prim = 0; prim < NHPRIMS; prim++)
+	    printf(" %s=%ld", headless_prim_name(prim), total.calls[prim]);
+	printf("\n");
+    }
+
+    sfree(games);
+    return 0;
+}
+
+#endif /* STANDALONE_DRAWING_BENCHMARK */
+
+#ifdef STANDALONE_UNDO_BENCHMARK
+
+#include <sys/resource.h>
+
+static void usage(const char *quis)
+{
+    fprintf(stderr, "usage: %s [-i interval] [-c clicks] [game [params]]\n"
+	    "  -i N    keep a full game state every N moves (default 16;\n"
+	    "          1 keeps them all)\n"
+	    "  -c N    number of random clicks to make (default 10000,\n"
+	    "          which is about 5000 moves in Net)\n"
+	    "  defaults to Net at 30x30\n", quis);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *quis = argv[0];
+    char *gamename = "Net", *params = "30x30", *err;
+    int interval = 16, nclicks = 10000, nargs = 0;
+    int i, x, y, ncolours, nmoves;
+    struct frontend fe;
+    const game *thegame = NULL;
+    headless *hd;
+    midend *me;
+    random_state *rs;
+    float *colours;
+    struct rusage ru;
+    double start, tplay, tundo, tredo;
+
+    while (--argc > 0) {
+	char *p = *++argv;
+	if (!strcmp(p, "-i") && argc > 1) {
+	    interval = atoi(*++argv);
+	    argc--;
+	} else if (!strcmp(p, "-c") && argc > 1) {
+	    nclicks = atoi(*++argv);
+	    argc--;
+	} else if (*p == '-') {
+	    usage(quis);
+	} else if (nargs == 0) {
+	    gamename = p;
+	    params = NULL;
+	    nargs++;
+	} else if (nargs == 1) {
+	    params = p;
+	    nargs++;
+	} else {
+	    usage(quis);
+	}
+    }
+    if (interval <= 0 || nclicks <= 0)
+	usage(quis);
+
+    for (i = 0; i < gamecount; i++)
+	if (!strcmp(gamename, gamelist[i]->name) ||
+	    !strcmp(gamename, gamelist[i]->htmlhelp_topic))
+	    thegame = gamelist[i];
+    if (!thegame) {
+	fprintf(stderr, "%s: unknown game '%s'\n", quis, gamename);
+	return 1;
+    }
+
+    fe.timer_active = FALSE;
+    hd = headless_new(320, 240);
+    me = midend_new(&fe, thegame, &headless_drawing, hd);
+    midend_set_undo_snapshot_interval(me, interval);
+    if (params && (err = midend_game_id(me, params)) != NULL) {
+	fprintf(stderr, "%s: %s\n", quis, err);
+	return 1;
+    }
+    midend_new_game(me);
+    x = 320;
+    y = 240;
+    midend_size(me, &x, &y, FALSE);
+    colours = midend_colours(me, &ncolours);
+    headless_set_colours(hd, colours, ncolours);
+    sfree(colours);
+    midend_force_redraw(me);
+
+    /*
+     * Click at random all over the puzzle. Not every click will be
+     * a move, but in most games most of them are.
+     */
+    rs = random_new("undo", 4);
+    start = headless_time();
+    for (i = 0; i < nclicks; i++) {
+	int cx = random_upto(rs, x), cy = random_upto(rs, y);
+	int button = random_upto(rs, 2) ? LEFT_BUTTON : RIGHT_BUTTON;
+	midend_process_key(me, cx, cy, button);
+	midend_process_key(me, cx, cy, button + (LEFT_RELEASE - LEFT_BUTTON));
+    }
+    tplay = headless_time() - start;
+    random_free(rs);
+
+    /*
+     * Then walk all the way back and forward again, which is where
+     * rebuilding states from the move list costs time.
+     */
+    start = headless_time();
+    for (nmoves = 0; midend_can_undo(me); nmoves++)
+	midend_process_key(me, 0, 0, 'u');
+    tundo = headless_time() - start;
+    start = headless_time();
+    while (midend_can_redo(me))
+	midend_process_key(me, 0, 0, 'r');
+    tredo = headless_time() - start;
+
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%s, %d moves from %d clicks, snapshot every %d moves\n",
+	   thegame->name, nmoves, nclicks, interval);
+    printf("play %.3fs, undo all %.3fs, redo all %.3fs\n",
+	   tplay, tundo, tredo);
+    printf("peak RSS %ld KB\n", (long)ru.ru_maxrss);
+
+    midend_free(me);
+    headless_free(hd);
+    return 0;
+}
+
+#endif /* STANDALONE_UNDO_BENCHMARK */
+
+#ifdef STANDALONE_GENERATION_BENCHMARK
+
+static void usage(const char *quis)
+{
+    fprintf(stderr, "usage: %s [-n games] [game[:params] ...]\n"
+	    "  -n N    number of games to generate per puzzle and random\n"
+	    "          number generator (default 20)\n", quis);
+    exit(1);
+}
+
+/*
+ * Generate `n' games from seeds "0", "1", ... (or "~0", "~1", ...
+ * for the fast random number generator), and return the average
+ * time per game in seconds.
+ */
+static double time_generation(const game *thegame, game_params *params,
+			      int n, int kind)
+{
+    char seed[32];
+    double start;
+    int i;
+
+    start = headless_time();
+    for (i = 0; i < n; i++) {
+	random_state *rs;
+	char *desc, *aux = NULL;
+
+	sprintf(seed, "%s%d", kind == RANDOM_FAST ? "~" : "", i);
+	assert(random_seed_kind(seed, strlen(seed)) == kind);
+	rs = random_new(seed, strlen(seed));
+	desc = thegame->new_desc(params, rs, &aux, TRUE);
+	random_free(rs);
+	sfree(desc);
+	sfree(aux);
+    }
+    return (headless_time() - start) / n;
+}
+
+int main(int argc, char **argv)
+{
+    const char *quis = argv[0];
+    char **games;
+    int ngames = 0, n = 20;
+    int i, j;
+    double total_sha = 0.0, total_fast = 0.0;
+
+    games = snewn(argc, char *);
+    while (--argc > 0) {
+	char *p = *++argv;
+	if (!strcmp(p, "-n") && argc > 1) {
+	    n = atoi(*++argv);
+	    argc--;
+	} else if (*p == '-') {
+	    usage(quis);
+	} else {
+	    games[ngames++] = p;
+	}
+    }
+    if (n <= 0)
+	usage(quis);
+
+    printf("%-10s %-12s %10s %10s %7s   (milliseconds per game)\n",
+	   "game", "params", "sha1", "fast", "ratio");
+
+    for (i = 0; i < gamecount; i++) {
+	const game *thegame = gamelist[i];
+	game_params *params;
+	const char *paramstr = NULL;
+	char *encoded, *err;
+	double tsha, tfast;
+
+	if (ngames) {
+	    for (j = 0; j < ngames; j++) {
+		const char *colon = strchr(games[j], ':');
+		int len = colon ? colon - games[j] : strlen(games[j]);
+		if ((strlen(thegame->name) == len &&
+		     !strncmp(games[j], thegame->name, len)) ||
+		    (strlen(thegame->htmlhelp_topic) == len &&
+		     !strncmp(games[j], thegame->htmlhelp_topic, len))) {
+		    paramstr = colon ? colon + 1 : NULL;
+		    break;
+		}
+	    }
+	    if (j == ngames)
+		continue;
+	}
+
+	params = thegame->default_params();
+	if (paramstr)
+	    thegame->decode_params(params, paramstr);
+	if ((err = thegame->validate_params(params, TRUE)) != NULL) {
+	    fprintf(stderr, "%s: %s: %s\n", quis, thegame->name, err);
+	    thegame->free_params(params);
+	    continue;
+	}
+
+	tsha = time_generation(thegame, params, n, RANDOM_SHA1);
+	tfast = time_generation(thegame, params, n, RANDOM_FAST);
+	total_sha += tsha;
+	total_fast += tfast;
+
+	encoded = thegame->encode_params(params, TRUE);
+	printf("%-10s %-12s %10.3f %10.3f %7.2f\n", thegame->name, encoded,
+	       tsha * 1000.0, tfast * 1000.0, tfast > 0 ? tsha / tfast : 0.0);
+	sfree(encoded);
+	thegame->free_params(params);
+    }
+
+    printf("%-10s %-12s %10.3f %10.3f %7.2f\n", "total", "",
+	   total_sha * 1000.0, total_fast * 1000.0,
+	   total_fast > 0 ? total_sha / total_fast : 0.0);
+
+    sfree(games);
+    return 0;
+}
+
+#endif /* STANDALONE_GENERATION_BENCHMARK */
+
+#ifdef STANDALONE_RACE_BENCHMARK
+
+static const int race_sizes[] = { 1, 2, 4, 8 };
+
+static void usage(const char *quis)
+{
+    fprintf(stderr, "usage: %s [-n games] [game[:params] ...]\n"
+	    "  -n N    number of new games per puzzle and number of\n"
+	    "          workers (default 50)\n", quis);
+    exit(1);
+}
+
+/*
+ * Checks that the seed form of the current game's ID makes the same
+ * game again when generated the ordinary way, with no race.
+ */
+static int race_reproducible(const game *thegame, midend *me)
+{
+    struct frontend fe;
+    config_item *cfg;
+    char *wintitle, *seedid, *id1, *id2, *err;
+    midend *me2;
+    headless *hd;
+
+    cfg = midend_get_config(me, CFG_SEED, &wintitle);
+    sfree(wintitle);
+    fe.timer_active = FALSE;
+    hd = headless_new(320, 240);
+    me2 = midend_new(&fe, thegame, &headless_drawing, hd);
+    seedid = dupstr(cfg[0].sval);     /* midend_game_id writes on it */
+    err = midend_game_id(me2, seedid);
+    sfree(seedid);
+    if (err) {
+	fprintf(stderr, "%s: %s\n", cfg[0].sval, err);
+	id2 = dupstr("");
+    } else {
+	midend_new_game(me2);
+	id2 = midend_get_game_id(me2);
+    }
+    id1 = midend_get_game_id(me);
+    err = strcmp(id1, id2) ? "" : NULL;
+    if (err)
+	fprintf(stderr, "%s: %s does not regenerate the same game\n",
+		thegame->name, cfg[0].sval);
+    sfree(id1);
+    sfree(id2);
+    free_cfg(cfg);
+    midend_free(me2);
+    headless_free(hd);
+    return err == NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *quis = argv[0];
+    char **games;
+    double *times;
+    int ngames = 0, n = 50, failures = 0;
+    int i, j, k, r;
+
+    games = snewn(argc, char *);
+    while (--argc > 0) {
+	char *p = *++argv;
+	if (!strcmp(p, "-n") && argc > 1) {
+	    n = atoi(*++argv);
+	    argc--;
+	} else if (*p == '-') {
+	    usage(quis);
+	} else {
+	    games[ngames++] = p;
+	}
+    }
+    if (n <= 0)
+	usage(quis);
+    times = snewn(n, double);
+
+    printf("%-10s %7s %10s %10s %10s   (milliseconds per new game)\n",
+	   "game", "workers", "median", "p99", "mean");
+
+    for (i = 0; i < gamecount; i++) {
+	const game *thegame = gamelist[i];
+	const char *paramstr = NULL;
+
+	if (ngames) {
+	    for (j = 0; j < ngames; j++) {
+		const char *colon = strchr(games[j], ':');
+		int len = colon ? colon - games[j] : strlen(games[j]);
+		if ((strlen(thegame->name) == len &&
+		     !strncmp(games[j], thegame->name, len)) ||
+		    (strlen(thegame->htmlhelp_topic) == len &&
+		     !strncmp(games[j], thegame->htmlhelp_topic, len))) {
+		    paramstr = colon ? colon + 1 : NULL;
+		    break;
+		}
+	    }
+	    if (j == ngames)
+		continue;
+	}
+
+	for (r = 0; r < lenof(race_sizes); r++) {
+	    struct frontend fe;
+	    headless *hd;
+	    midend *me;
+	    double total = 0.0, start;
+	    char *err;
+
+	    fe.timer_active = FALSE;
+	    hd = headless_new(320, 240);
+	    me = midend_new(&fe, thegame, &headless_drawing, hd);
+	    if (paramstr) {
+		char *tmp = dupstr(paramstr);
+		err = midend_game_id(me, tmp);
+		sfree(tmp);
+		if (err) {
+		    fprintf(stderr, "%s: %s: %s\n", quis, thegame->name, err);
+		    midend_free(me);
+		    headless_free(hd);
+		    break;
+		}
+	    }
+	    midend_set_race_workers(me, race_sizes[r]);
+
+	    for (k = 0; k < n; k++) {
+		start = headless_time();
+		midend_new_game(me);
+		times[k] = headless_time() - start;
+		total += times[k];
+		if (k == 0 && !race_reproducible(thegame, me))
+		    failures++;
+	    }
+	    qsort(times, n, sizeof(double), compare_doubles);
+
+	    printf("%-10s %7d %10.3f %10.3f %10.3f\n",
+		   r == 0 ? thegame->name : "", race_sizes[r],
+		   times[n/2] * 1000.0, times[(n * 99 + 99) / 100 - 1] * 1000.0,
+		   total * 1000.0 / n);
+
+	    /*
+	     * Losing generators still running are left to finish on
+	     * their own, and count against the workers for the next
+	     * size of race until they have.
+	     */
+	    midend_free(me);
+	    headless_free(hd);
+	}
+    }
+
+    sfree(times);
+    sfree(games);
+    return failures ? 1 : 0;
+}
+
+#endif /* STANDALONE_RACE_BENCHMARK */
+
+#endif
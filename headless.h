@@ -0,0 +1,46 @@
+/*
+ * headless.h: a drawing API which renders into an in-memory 16-bit
+ * (RGB565) frame buffer, for running games on a host machine with
+ * no display, SDL or libogc.
+ */
+
+#ifndef PUZZLES_HEADLESS_H
+#define PUZZLES_HEADLESS_H
+
+typedef struct headless headless;
+
+/*
+ * The kinds of drawing operation `headless_stats' reports on.
+ */
+enum {
+    HPRIM_TEXT, HPRIM_RECT, HPRIM_LINE, HPRIM_POLYGON, HPRIM_CIRCLE,
+    HPRIM_BLITTER, HPRIM_UPDATE, NHPRIMS
+};
+
+struct headless_stats {
+    long calls[NHPRIMS];
+    double seconds[NHPRIMS];	       /* wall-clock time inside each kind */
+    long frames;
+};
+
+extern const struct drawing_api headless_drawing;
+
+/*
+ * Create a frame buffer of the given size. Its contents start out
+ * black; the game's colours are supplied separately, once the
+ * midend has been asked for them.
+ */
+headless *headless_new(int w, int h);
+void headless_free(headless *hd);
+void headless_set_colours(headless *hd, const float *colours, int ncolours);
+
+/*
+ * Pixels are stored row by row, `w' to a row, with no padding.
+ */
+const unsigned short *headless_pixels(headless *hd, int *w, int *h);
+
+const struct headless_stats *headless_get_stats(headless *hd);
+void headless_reset_stats(headless *hd);
+const char *headless_prim_name(int prim);
+
+#endif /* PUZZLES_HEADLESS_H */
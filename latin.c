@@ -31,23 +31,21 @@ void latin_solver_place(struct latin_solver *solver, int x, int y, int n)
     /*
      * Rule out all other numbers in this square.
      */
-    for (i = 1; i <= o; i++)
-	if (i != n)
-            cube(x,y,i) = FALSE;
+    cubeword(x,y) = digitbit(n);
 
     /*
      * Rule out this number in all other positions in the row.
      */
     for (i = 0; i < o; i++)
 	if (i != y)
-            cube(x,i,n) = FALSE;
+            cube_clear(x,i,n);
 
     /*
      * Rule out this number in all other positions in the column.
      */
     for (i = 0; i < o; i++)
 	if (i != x)
-            cube(i,y,n) = FALSE;
+            cube_clear(i,y,n);
 
     /*
      * Enter the number in the result grid.
@@ -58,7 +56,8 @@ void latin_solver_place(struct latin_solver *solver, int x, int y, int n)
      * Cross out this number from the list of numbers left to place
      * in its row, its column and its block.
      */
-    solver->row[y*o+n-1] = solver->col[x*o+n-1] = TRUE;
+    solver->row[y] |= digitbit(n);
+    solver->col[x] |= digitbit(n);
 }
 
 int latin_solver_elim(struct latin_solver *solver, int start, int step
@@ -77,7 +76,7 @@ int latin_solver_elim(struct latin_solver *solver, int start, int step
     m = 0;
     fpos = -1;
     for (i = 0; i < o; i++)
-	if (solver->cube[start+i*step]) {
+	if (cubeat(start+i*step)) {
 	    fpos = start+i*step;
 	    m++;
 	}
@@ -124,8 +123,40 @@ int latin_solver_elim(struct latin_solver *solver, int start, int step
     return 0;
 }
 
+static int bitcount(unsigned int x)
+{
+    int count = 0;
+
+    while (x) {
+	x &= x - 1;
+	count++;
+    }
+    return count;
+}
+
+/*
+ * Return the digits which are possible in at most one of the o
+ * squares whose candidate words are at cube[start+i*step]. Positional
+ * elimination can't achieve anything for any other digit.
+ */
+static unsigned int latin_solver_rare_digits(struct latin_solver *solver,
+                                             int start, int step)
+{
+    unsigned int once = 0, twice = 0;
+    int i;
+
+    for (i = 0; i < solver->o; i++) {
+        unsigned int w = solver->cube[start+i*step];
+        twice |= once & w;
+        once |= w;
+    }
+
+    return ALL_DIGITS(solver->o) & ~twice;
+}
+
 struct latin_solver_scratch {
-    unsigned char *grid, *rowidx, *colidx, *set;
+    unsigned char *grid, *rowidx, *colidx;
+    unsigned int *rows, *rowbits;
     int *neighbours, *bfsqueue;
 #ifdef STANDALONE_SOLVER
     int *bfsprev;
@@ -142,28 +173,44 @@ int latin_solver_set(struct latin_solver *solver,
 {
     int o = solver->o;
     int i, j, n, count;
-    unsigned char *grid = scratch->grid;
+    unsigned int set, *rows = scratch->rows, *rowbits = scratch->rowbits;
     unsigned char *rowidx = scratch->rowidx;
     unsigned char *colidx = scratch->colidx;
-    unsigned char *set = scratch->set;
 
     /*
-     * We are passed a o-by-o matrix of booleans. Our first job
-     * is to winnow it by finding any definite placements - i.e.
-     * any row with a solitary 1 - and discarding that row and the
-     * column containing the 1.
+     * We are passed a o-by-o matrix of booleans, which we read
+     * into one word per row with column j as bit j. When each row
+     * is a single square's candidates (set elimination within a
+     * row or column), that word is already in the cube.
      */
-    memset(rowidx, TRUE, o);
-    memset(colidx, TRUE, o);
     for (i = 0; i < o; i++) {
-        int count = 0, first = -1;
-        for (j = 0; j < o; j++)
-            if (solver->cube[start+i*step1+j*step2])
-                first = j, count++;
+        int pos = start+i*step1;
+        if (step2 == 1 && pos % o == 0) {
+            rows[i] = solver->cube[pos / o];
+        } else {
+            rows[i] = 0;
+            for (j = 0; j < o; j++)
+                if (cubeat(pos+j*step2))
+                    rows[i] |= 1U << j;
+        }
+    }
+
+    /*
+     * Our first job is to winnow the matrix by finding any definite
+     * placements - i.e. any row with a solitary 1 - and discarding
+     * that row and the column containing the 1.
+     */
+    memset(rowidx, TRUE, (unsigned)o);
+    memset(colidx, TRUE, (unsigned)o);
+    for (i = 0; i < o; i++) {
+        int count = bitcount(rows[i]), first = 0;
 
 	if (count == 0) return -1;
-        if (count == 1)
+        if (count == 1) {
+            while (!(rows[i] & (1U << first)))
+                first++;
             rowidx[i] = colidx[first] = FALSE;
+        }
     }
 
     /*
@@ -180,11 +227,17 @@ int latin_solver_set(struct latin_solver *solver,
     assert(n == j);
 
     /*
-     * And create the smaller matrix.
+     * And create the smaller matrix, one word per row. Column j of
+     * the matrix is bit n-1-j, so that counting `set' upwards below
+     * tries the column subsets in the same order as always.
      */
-    for (i = 0; i < n; i++)
+#define COLBIT(j) (1U << (n-1-(j)))
+    for (i = 0; i < n; i++) {
+        rowbits[i] = 0;
         for (j = 0; j < n; j++)
-            grid[i*o+j] = solver->cube[start+rowidx[i]*step1+colidx[j]*step2];
+            if (rows[rowidx[i]] & (1U << colidx[j]))
+                rowbits[i] |= COLBIT(j);
+    }
 
     /*
      * Having done that, we now have a matrix in which every row
@@ -194,13 +247,14 @@ int latin_solver_set(struct latin_solver *solver,
      * columns) whose width and height add up to n.
      */
 
-    memset(set, 0, n);
-    count = 0;
-    while (1) {
+    if (n == 0)
+        return 0;                      /* every row was a definite placement */
+    for (set = 0; ; set++) {
         /*
          * We have a candidate set. If its size is <=1 or >=n-1
          * then we move on immediately.
          */
+        count = bitcount(set);
         if (count > 1 && count < n-1) {
             /*
              * The number of rows we need is n-count. See if we can
@@ -208,16 +262,9 @@ int latin_solver_set(struct latin_solver *solver,
              * the positions listed in `set'.
              */
             int rows = 0;
-            for (i = 0; i < n; i++) {
-                int ok = TRUE;
-                for (j = 0; j < n; j++)
-                    if (set[j] && grid[i*o+j]) {
-                        ok = FALSE;
-                        break;
-                    }
-                if (ok)
+            for (i = 0; i < n; i++)
+                if (!(rowbits[i] & set))
                     rows++;
-            }
 
             /*
              * We expect never to be able to get _more_ than
@@ -258,15 +305,9 @@ int latin_solver_set(struct latin_solver *solver,
                  * positions in the cube to meddle with.
                  */
                 for (i = 0; i < n; i++) {
-                    int ok = TRUE;
-                    for (j = 0; j < n; j++)
-                        if (set[j] && grid[i*o+j]) {
-                            ok = FALSE;
-                            break;
-                        }
-                    if (!ok) {
+                    if (rowbits[i] & set) {
                         for (j = 0; j < n; j++)
-                            if (!set[j] && grid[i*o+j]) {
+                            if (rowbits[i] & ~set & COLBIT(j)) {
                                 int fpos = (start+rowidx[i]*step1+
                                             colidx[j]*step2);
 #ifdef STANDALONE_SOLVER
@@ -294,7 +335,7 @@ int latin_solver_set(struct latin_solver *solver,
                                 }
 #endif
                                 progress = TRUE;
-                                solver->cube[fpos] = FALSE;
+                                cubeat_clear(fpos);
                             }
                     }
                 }
@@ -305,18 +346,10 @@ int latin_solver_set(struct latin_solver *solver,
             }
         }
 
-        /*
-         * Binary increment: change the rightmost 0 to a 1, and
-         * change all 1s to the right of it to 0s.
-         */
-        i = n;
-        while (i > 0 && set[i-1])
-            set[--i] = 0, count--;
-        if (i > 0)
-            set[--i] = 1, count++;
-        else
+        if (set == ALL_DIGITS(n))
             break;                     /* done */
     }
+#undef COLBIT
 
     return 0;
 }
@@ -371,7 +404,7 @@ int latin_solver_forcing(struct latin_solver *solver,
 
     for (y = 0; y < o; y++)
         for (x = 0; x < o; x++) {
-            int count, t, n;
+            int t, n;
 
             /*
              * If this square doesn't have exactly two candidate
@@ -382,11 +415,11 @@ int latin_solver_forcing(struct latin_solver *solver,
              * `the other one' (since we will shortly know there
              * are exactly two).
              */
-            for (count = t = 0, n = 1; n <= o; n++)
-                if (cube(x, y, n))
-                    count++, t += n;
-            if (count != 2)
+            if (bitcount(cubeword(x, y)) != 2)
                 continue;
+            for (t = 0, n = 1; n <= o; n++)
+                if (cube(x, y, n))
+                    t += n;
 
             /*
              * Now attempt a bfs for each candidate.
@@ -430,7 +463,7 @@ int latin_solver_forcing(struct latin_solver *solver,
                          * Try visiting each of those neighbours.
                          */
                         for (i = 0; i < nneighbours; i++) {
-                            int cc, tt, nn;
+                            int tt, nn;
 
                             xt = neighbours[i] % o;
                             yt = neighbours[i] / o;
@@ -457,10 +490,10 @@ int latin_solver_forcing(struct latin_solver *solver,
                              * this square to have exactly two
                              * possible numbers.
                              */
-                            for (cc = tt = 0, nn = 1; nn <= o; nn++)
-                                if (cube(xt, yt, nn))
-                                    cc++, tt += nn;
-                            if (cc == 2) {
+                            if (bitcount(cubeword(xt, yt)) == 2) {
+                                for (tt = 0, nn = 1; nn <= o; nn++)
+                                    if (cube(xt, yt, nn))
+                                        tt += nn;
                                 bfsqueue[tail++] = yt*o+xt;
 #ifdef STANDALONE_SOLVER
                                 bfsprev[yt*o+xt] = yy*o+xx;
@@ -500,7 +533,7 @@ int latin_solver_forcing(struct latin_solver *solver,
                                            orign, xt, YUNTRANS(yt));
                                 }
 #endif
-                                cube(xt, yt, orign) = FALSE;
+                                cube_clear(xt, yt, orign);
                                 return 1;
                             }
                         }
@@ -518,7 +551,8 @@ struct latin_solver_scratch *latin_solver_new_scratch(struct latin_solver *solve
     scratch->grid = snewn(o*o, unsigned char);
     scratch->rowidx = snewn(o, unsigned char);
     scratch->colidx = snewn(o, unsigned char);
-    scratch->set = snewn(o, unsigned char);
+    scratch->rows = snewn(o, unsigned int);
+    scratch->rowbits = snewn(o, unsigned int);
     scratch->neighbours = snewn(3*o, int);
     scratch->bfsqueue = snewn(o*o, int);
 #ifdef STANDALONE_SOLVER
@@ -534,7 +568,8 @@ void latin_solver_free_scratch(struct latin_solver_scratch *scratch)
 #endif
     sfree(scratch->bfsqueue);
     sfree(scratch->neighbours);
-    sfree(scratch->set);
+    sfree(scratch->rowbits);
+    sfree(scratch->rows);
     sfree(scratch->colidx);
     sfree(scratch->rowidx);
     sfree(scratch->grid);
@@ -545,15 +580,17 @@ void latin_solver_alloc(struct latin_solver *solver, digit *grid, int o)
 {
     int x, y;
 
+    assert(o <= 32);
     solver->o = o;
-    solver->cube = snewn(o*o*o, unsigned char);
+    solver->cube = snewn(o*o, unsigned int);
     solver->grid = grid;		/* write straight back to the input */
-    memset(solver->cube, TRUE, o*o*o);
+    for (x = 0; x < o*o; x++)
+        solver->cube[x] = ALL_DIGITS(o);
 
-    solver->row = snewn(o*o, unsigned char);
-    solver->col = snewn(o*o, unsigned char);
-    memset(solver->row, FALSE, o*o);
-    memset(solver->col, FALSE, o*o);
+    solver->row = snewn(o, unsigned int);
+    solver->col = snewn(o, unsigned int);
+    memset(solver->row, 0, o * sizeof(unsigned int));
+    memset(solver->col, 0, o * sizeof(unsigned int));
 
     for (x = 0; x < o; x++)
 	for (y = 0; y < o; y++)
@@ -568,15 +605,26 @@ void latin_solver_free(struct latin_solver *solver)
     sfree(solver->col);
 }
 
+void latin_solver_get_cube(struct latin_solver *solver, unsigned char *cube)
+{
+    int i, n, o = solver->o;
+
+    for (i = 0; i < o*o; i++)
+        for (n = 1; n <= o; n++)
+            cube[i*o+n-1] = (solver->cube[i] & digitbit(n)) != 0;
+}
+
 int latin_solver_diff_simple(struct latin_solver *solver)
 {
     int x, y, n, ret, o = solver->o;
+    unsigned int todo;
     /*
      * Row-wise positional elimination.
      */
-    for (y = 0; y < o; y++)
+    for (y = 0; y < o; y++) {
+        todo = latin_solver_rare_digits(solver, y, o) & ~solver->row[y];
         for (n = 1; n <= o; n++)
-            if (!solver->row[y*o+n-1]) {
+            if (todo & digitbit(n)) {
                 ret = latin_solver_elim(solver, cubepos(0,y,n), o*o
 #ifdef STANDALONE_SOLVER
 					, "positional elimination,"
@@ -585,12 +633,14 @@ int latin_solver_diff_simple(struct latin_solver *solver)
 					);
                 if (ret != 0) return ret;
             }
+    }
     /*
      * Column-wise positional elimination.
      */
-    for (x = 0; x < o; x++)
+    for (x = 0; x < o; x++) {
+        todo = latin_solver_rare_digits(solver, x*o, 1) & ~solver->col[x];
         for (n = 1; n <= o; n++)
-            if (!solver->col[x*o+n-1]) {
+            if (todo & digitbit(n)) {
                 ret = latin_solver_elim(solver, cubepos(x,0,n), o
 #ifdef STANDALONE_SOLVER
 					, "positional elimination,"
@@ -599,13 +649,16 @@ int latin_solver_diff_simple(struct latin_solver *solver)
 					);
                 if (ret != 0) return ret;
             }
+    }
 
     /*
-     * Numeric elimination.
+     * Numeric elimination. Only a square with at most one candidate
+     * left can give a result.
      */
     for (x = 0; x < o; x++)
         for (y = 0; y < o; y++)
-            if (!solver->grid[YUNTRANS(y)*o+x]) {
+            if (!solver->grid[YUNTRANS(y)*o+x] &&
+                !(cubeword(x,y) & (cubeword(x,y) - 1))) {
                 ret = latin_solver_elim(solver, cubepos(x,y,1), 1
 #ifdef STANDALONE_SOLVER
 					, "numeric elimination at (%d,%d)", x,
@@ -694,10 +747,7 @@ int latin_solver_recurse(struct latin_solver *solver, int recdiff,
                  * An unfilled square. Count the number of
                  * possible digits in it.
                  */
-                count = 0;
-                for (n = 1; n <= o; n++)
-                    if (cube(x,YTRANS(y),n))
-                        count++;
+                count = bitcount(cubeword(x,YTRANS(y)));
 
                 /*
                  * We should have found any impossibilities
@@ -823,6 +873,20 @@ int latin_solver_recurse(struct latin_solver *solver, int recdiff,
 
 enum { diff_simple = 1, diff_set, diff_extreme, diff_recursive };
 
+static void latin_solver_debug_cube(struct latin_solver *solver)
+{
+#ifdef STANDALONE_SOLVER
+    if (solver_show_working) {
+        int o = solver->o;
+        unsigned char *cube = snewn(o*o*o, unsigned char);
+
+        latin_solver_get_cube(solver, cube);
+        latin_solver_debug(cube, o);
+        sfree(cube);
+    }
+#endif
+}
+
 static int latin_solver_sub(struct latin_solver *solver, int maxdiff, void *ctx)
 {
     struct latin_solver_scratch *scratch = latin_solver_new_scratch(solver);
@@ -845,7 +909,7 @@ static int latin_solver_sub(struct latin_solver *solver, int maxdiff, void *ctx)
          * one, so I'm apologetically resorting to a goto.
          */
 	cont:
-        latin_solver_debug(solver->cube, solver->o);
+        latin_solver_debug_cube(solver);
 
         ret = latin_solver_diff_simple(solver);
         if (ret < 0) {
@@ -955,17 +1019,14 @@ void latin_solver_debug(unsigned char *cube, int o)
 {
 #ifdef STANDALONE_SOLVER
     if (solver_show_working) {
-        struct latin_solver ls, *solver = &ls;
         char *dbg;
         int x, y, i, c = 0;
 
-        ls.cube = cube; ls.o = o; /* for cube() to work */
-
         dbg = snewn(3*o*o*o, char);
         for (y = 0; y < o; y++) {
             for (x = 0; x < o; x++) {
                 for (i = 1; i <= o; i++) {
-                    if (cube(x,y,i))
+                    if (cube[(x*o+y)*o+i-1])
                         dbg[c++] = i + '0';
                     else
                         dbg[c++] = '.';
@@ -1007,9 +1068,9 @@ void latin_debug(digit *sq, int o)
 digit *latin_generate(int o, random_state *rs)
 {
     digit *sq;
-    int *edges, *backedges, *capacity, *flow;
-    void *scratch;
-    int ne, scratchsize;
+    int *edges, *capacity, *flow;
+    maxflow_graph *g;
+    int ne;
     int i, j, k;
     digit *row, *col, *numinv, *num;
 
@@ -1045,9 +1106,6 @@ digit *latin_generate(int o, random_state *rs)
     /*
      * Set up the infrastructure for the maxflow algorithm.
      */
-    scratchsize = maxflow_scratch_size(o * 2 + 2);
-    scratch = smalloc(scratchsize);
-    backedges = snewn(o*o + 2*o, int);
     edges = snewn((o*o + 2*o) * 2, int);
     capacity = snewn(o*o + 2*o, int);
     flow = snewn(o*o + 2*o, int);
@@ -1077,8 +1135,8 @@ digit *latin_generate(int o, random_state *rs)
 	ne++;
     }
     assert(ne == o*o + 2*o);
-    /* Now set up backedges. */
-    maxflow_setup_backedges(ne, edges, backedges);
+    /* The graph is the same for every row; only the capacities change. */
+    g = maxflow_graph_new(o*2+2, ne, edges);
     
     /*
      * Now generate each row of the latin square.
@@ -1112,8 +1170,8 @@ digit *latin_generate(int o, random_state *rs)
 	/*
 	 * Run maxflow.
 	 */
-	j = maxflow_with_scratch(scratch, o*2+2, 2*o, 2*o+1, ne,
-				 edges, backedges, capacity, flow, NULL);
+	j = maxflow_graph_run(g, MAXFLOW_EDMONDS_KARP, 2*o, 2*o+1,
+			      capacity, flow, NULL);
 	assert(j == o);   /* by the above theorem, this must have succeeded */
 
 	/*
@@ -1136,8 +1194,7 @@ digit *latin_generate(int o, random_state *rs)
     sfree(flow);
     sfree(capacity);
     sfree(edges);
-    sfree(backedges);
-    sfree(scratch);
+    maxflow_graph_free(g);
     sfree(numinv);
     sfree(num);
     sfree(col);
@@ -1252,40 +1309,97 @@ static void gen(int order, random_state *rs, int debug)
     sfree(sq);
 }
 
-void test_soak(int order, random_state *rs)
+/*
+ * Blank out half the squares of a latin square at random and hand
+ * what's left to the solver. A unique solution had better be the
+ * square we started from.
+ */
+static void soak_solve(digit *sq, int order, random_state *rs,
+                       digit *grid, int *cells)
+{
+    int i, diff;
+
+    memcpy(grid, sq, order*order);
+    for (i = 0; i < order*order; i++)
+        cells[i] = i;
+    shuffle(cells, order*order, sizeof(*cells), rs);
+    for (i = 0; i < order*order/2; i++)
+        grid[cells[i]] = 0;
+
+    diff = latin_solver(grid, order, diff_recursive, NULL);
+    if (diff == diff_impossible || diff == diff_unfinished) {
+        fprintf(stderr, "Solver failed on a square with half its clues!\n");
+        exit(1);
+    }
+    if (diff != diff_ambiguous && memcmp(grid, sq, order*order)) {
+        fprintf(stderr, "Solver found the wrong square!\n");
+        exit(1);
+    }
+}
+
+/*
+ * Generate squares of the given order, and solve a puzzle made from
+ * each. With count 0 this runs forever, reporting progress once a
+ * second; otherwise it stops after `count' squares and reports the
+ * generation and solving throughput.
+ */
+void test_soak(int order, random_state *rs, int count)
 {
-    digit *sq;
+    digit *sq, *grid;
+    int *cells;
     int n = 0;
     time_t tt_start, tt_now, tt_last;
+    clock_t gentime = 0, solvetime = 0, t;
 
     solver_show_working = 0;
     tt_now = tt_start = time(NULL);
+    grid = snewn(order*order, digit);
+    cells = snewn(order*order, int);
 
-    while(1) {
+    while (count == 0 || n < count) {
+        t = clock();
         sq = latin_generate(order, rs);
+        gentime += clock() - t;
+
+        t = clock();
+        soak_solve(sq, order, rs, grid, cells);
+        solvetime += clock() - t;
+
         sfree(sq);
         n++;
 
-        tt_last = time(NULL);
-        if (tt_last > tt_now) {
-            tt_now = tt_last;
-            printf("%d total, %3.1f/s\n", n,
-                   (double)n / (double)(tt_now - tt_start));
+        if (count == 0) {
+            tt_last = time(NULL);
+            if (tt_last > tt_now) {
+                tt_now = tt_last;
+                printf("%d total, %3.1f/s\n", n,
+                       (double)n / (double)(tt_now - tt_start));
+            }
         }
     }
+
+    printf("order %d: %d squares generated in %.3f seconds (%.1f/s), "
+           "solved in %.3f seconds (%.1f/s)\n", order, n,
+           (double)gentime / CLOCKS_PER_SEC,
+           n * (double)CLOCKS_PER_SEC / (gentime ? gentime : 1),
+           (double)solvetime / CLOCKS_PER_SEC,
+           n * (double)CLOCKS_PER_SEC / (solvetime ? solvetime : 1));
+
+    sfree(cells);
+    sfree(grid);
 }
 
 void usage_exit(const char *msg)
 {
     if (msg)
         fprintf(stderr, "%s: %s\n", quis, msg);
-    fprintf(stderr, "Usage: %s [--seed SEED] --soak <params> | [game_id [game_id ...]]\n", quis);
+    fprintf(stderr, "Usage: %s [--seed SEED] --soak <params> | --bench <count> | [game_id [game_id ...]]\n", quis);
     exit(1);
 }
 
 int main(int argc, char *argv[])
 {
-    int i, soak = 0;
+    int i, soak = 0, bench = 0;
     random_state *rs;
     time_t seed = time(NULL);
 
@@ -1299,6 +1413,13 @@ int main(int argc, char *argv[])
 		usage_exit("--seed needs an argument");
 	    seed = (time_t)atoi(*++argv);
 	    argc--;
+	} else if (!strcmp(p, "--bench")) {
+	    if (argc == 0)
+		usage_exit("--bench needs an argument");
+	    bench = atoi(*++argv);
+	    argc--;
+	    if (bench <= 0)
+		usage_exit("--bench needs a positive count");
 	} else if (*p == '-')
 		usage_exit("unrecognised option");
 	else
@@ -1307,9 +1428,13 @@ int main(int argc, char *argv[])
 
     rs = random_new((void*)&seed, sizeof(time_t));
 
-    if (soak == 1) {
+    if (bench) {
+	/* Throughput at the orders the games actually use. */
+	for (i = 4; i <= 9; i++)
+	    test_soak(i, rs, bench);
+    } else if (soak == 1) {
 	if (argc != 1) usage_exit("only one argument for --soak");
-	test_soak(atoi(*argv), rs);
+	test_soak(atoi(*argv), rs, 0);
     } else {
 	if (argc > 0) {
 	    for (i = 0; i < argc; i++) {
@@ -12,16 +12,30 @@ int solver_show_working, solver_recurse_depth;
 #endif
 
 struct latin_solver {
-  int o;                /* order of latin square */
-  unsigned char *cube;  /* o^3, indexed by x, y, and digit:
-                           TRUE in that position indicates a possibility */
+  int o;                /* order of latin square (at most 32) */
+  unsigned int *cube;   /* o^2, indexed by x and y: bit n-1 set in
+                           that word indicates n is a possibility */
   digit *grid;          /* o^2, indexed by x and y: for final deductions */
 
-  unsigned char *row;   /* o^2: row[y*cr+n-1] TRUE if n is in row y */
-  unsigned char *col;   /* o^2: col[x*cr+n-1] TRUE if n is in col x */
+  unsigned int *row;    /* o: bit n-1 of row[y] set if n is in row y */
+  unsigned int *col;    /* o: bit n-1 of col[x] set if n is in col x */
 };
+#define digitbit(n) (1U << ((n)-1))
+#define ALL_DIGITS(o) ((2U << ((o)-1)) - 1)    /* 1 <= o <= 32 */
+
+#define cubeword(x,y) (solver->cube[(x)*solver->o+(y)])
+#define cube(x,y,n) ((cubeword(x,y) & digitbit(n)) != 0)
+#define cube_clear(x,y,n) (cubeword(x,y) &= ~digitbit(n))
+
+/*
+ * Positions in the cube as if it were still an o^3 array of
+ * booleans. latin_solver_elim and latin_solver_set walk through the
+ * cube in these units.
+ */
 #define cubepos(x,y,n) (((x)*solver->o+(y))*solver->o+(n)-1)
-#define cube(x,y,n) (solver->cube[cubepos(x,y,n)])
+#define cubeat(pos) ((solver->cube[(pos)/solver->o] >> ((pos)%solver->o)) & 1)
+#define cubeat_clear(pos) \
+    (solver->cube[(pos)/solver->o] &= ~(1U << ((pos)%solver->o)))
 
 #define gridpos(x,y) ((y)*solver->o+(x))
 #define grid(x,y) (solver->grid[gridpos(x,y)])
@@ -71,6 +85,10 @@ int latin_solver_forcing(struct latin_solver *solver,
 void latin_solver_alloc(struct latin_solver *solver, digit *grid, int o);
 void latin_solver_free(struct latin_solver *solver);
 
+/* Expands the candidate words into an o^3 array of booleans, laid out
+ * as cubepos() indexes it, for games which keep their own copy. */
+void latin_solver_get_cube(struct latin_solver *solver, unsigned char *cube);
+
 /* Allocates scratch space (for _set and _forcing) */
 struct latin_solver_scratch *
   latin_solver_new_scratch(struct latin_solver *solver);
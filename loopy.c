@@ -154,6 +154,13 @@ typedef struct solver_state {
     char *dot_solved, *face_solved;
     int *dotdsf;
 
+    /* For each face and dot, which of the per-face/per-dot deduction
+     * passes still need to look at it (TODO_* bits). A bit is cleared when
+     * the pass visits it, and set again whenever anything that pass reads
+     * about it changes, so passes can skip the parts of the grid where
+     * nothing has happened since they last looked. */
+    unsigned char *face_todo, *dot_todo;
+
     /* Information for Normal level deductions:
      * For each dline, store a bitmask for whether we know:
      * (bit 0) at least one is YES
@@ -164,6 +171,12 @@ typedef struct solver_state {
     int *linedsf;
 } solver_state;
 
+enum {
+    TODO_TRIVIAL = 1,       /* trivial_deductions */
+    TODO_DLINE = 2,         /* dline_deductions */
+    TODO_ALL = TODO_TRIVIAL | TODO_DLINE
+};
+
 /*
  * Difficulty levels. I do some macro ickery here to ensure that my
  * enum and the various forms of my name list always match up.
@@ -249,6 +262,7 @@ static char *validate_desc(game_params *params, char *desc);
 static int dot_order(const game_state* state, int i, char line_type);
 static int face_order(const game_state* state, int i, char line_type);
 static solver_state *solve_game_rec(const solver_state *sstate);
+static void solve_game_in_place(solver_state *sstate);
 
 #ifdef DEBUG_CACHES
 static void check_caches(const solver_state* sstate);
@@ -352,51 +366,64 @@ static void free_game(game_state *state)
     }
 }
 
-static solver_state *new_solver_state(game_state *state, int diff) {
+/* Put a solver state back to knowing nothing but the clues (and any
+ * lines) in the given game_state, which must be for the same grid. */
+static void reset_solver_state(solver_state *ret, const game_state *state) {
     int i;
     int num_dots = state->game_grid->num_dots;
     int num_faces = state->game_grid->num_faces;
     int num_edges = state->game_grid->num_edges;
-    solver_state *ret = snew(solver_state);
 
-    ret->state = dup_game(state);
+    assert(ret->state->game_grid == state->game_grid);
 
-    ret->solver_status = SOLVER_INCOMPLETE;
-    ret->diff = diff;
+    memcpy(ret->state->clues, state->clues, num_faces);
+    memcpy(ret->state->lines, state->lines, num_edges);
 
-    ret->dotdsf = snew_dsf(num_dots);
-    ret->looplen = snewn(num_dots, int);
+    ret->solver_status = SOLVER_INCOMPLETE;
 
+    dsf_init(ret->dotdsf, num_dots);
     for (i = 0; i < num_dots; i++) {
         ret->looplen[i] = 1;
     }
 
-    ret->dot_solved = snewn(num_dots, char);
-    ret->face_solved = snewn(num_faces, char);
     memset(ret->dot_solved, FALSE, num_dots);
     memset(ret->face_solved, FALSE, num_faces);
-
-    ret->dot_yes_count = snewn(num_dots, char);
+    memset(ret->dot_todo, TODO_ALL, num_dots);
+    memset(ret->face_todo, TODO_ALL, num_faces);
     memset(ret->dot_yes_count, 0, num_dots);
-    ret->dot_no_count = snewn(num_dots, char);
     memset(ret->dot_no_count, 0, num_dots);
-    ret->face_yes_count = snewn(num_faces, char);
     memset(ret->face_yes_count, 0, num_faces);
-    ret->face_no_count = snewn(num_faces, char);
     memset(ret->face_no_count, 0, num_faces);
 
-    if (diff < DIFF_NORMAL) {
-        ret->dlines = NULL;
-    } else {
-        ret->dlines = snewn(2*num_edges, char);
+    if (ret->dlines)
         memset(ret->dlines, 0, 2*num_edges);
-    }
+    if (ret->linedsf)
+        dsf_init(ret->linedsf, num_edges);
+}
 
-    if (diff < DIFF_HARD) {
-        ret->linedsf = NULL;
-    } else {
-        ret->linedsf = snew_dsf(state->game_grid->num_edges);
-    }
+static solver_state *new_solver_state(game_state *state, int diff) {
+    int num_dots = state->game_grid->num_dots;
+    int num_faces = state->game_grid->num_faces;
+    int num_edges = state->game_grid->num_edges;
+    solver_state *ret = snew(solver_state);
+
+    ret->state = dup_game(state);
+    ret->diff = diff;
+
+    ret->dotdsf = snewn(num_dots, int);
+    ret->looplen = snewn(num_dots, int);
+    ret->dot_solved = snewn(num_dots, char);
+    ret->face_solved = snewn(num_faces, char);
+    ret->dot_todo = snewn(num_dots, unsigned char);
+    ret->face_todo = snewn(num_faces, unsigned char);
+    ret->dot_yes_count = snewn(num_dots, char);
+    ret->dot_no_count = snewn(num_dots, char);
+    ret->face_yes_count = snewn(num_faces, char);
+    ret->face_no_count = snewn(num_faces, char);
+    ret->dlines = (diff < DIFF_NORMAL) ? NULL : snewn(2*num_edges, char);
+    ret->linedsf = (diff < DIFF_HARD) ? NULL : snewn(num_edges, int);
+
+    reset_solver_state(ret, state);
 
     return ret;
 }
@@ -408,6 +435,8 @@ static void free_solver_state(solver_state *sstate) {
         sfree(sstate->looplen);
         sfree(sstate->dot_solved);
         sfree(sstate->face_solved);
+        sfree(sstate->dot_todo);
+        sfree(sstate->face_todo);
         sfree(sstate->dot_yes_count);
         sfree(sstate->dot_no_count);
         sfree(sstate->face_yes_count);
@@ -445,6 +474,11 @@ static solver_state *dup_solver_state(const solver_state *sstate) {
     memcpy(ret->dot_solved, sstate->dot_solved, num_dots);
     memcpy(ret->face_solved, sstate->face_solved, num_faces);
 
+    ret->dot_todo = snewn(num_dots, unsigned char);
+    ret->face_todo = snewn(num_faces, unsigned char);
+    memcpy(ret->dot_todo, sstate->dot_todo, num_dots);
+    memcpy(ret->face_todo, sstate->face_todo, num_faces);
+
     ret->dot_yes_count = snewn(num_dots, char);
     memcpy(ret->dot_yes_count, sstate->dot_yes_count, num_dots);
     ret->dot_no_count = snewn(num_dots, char);
@@ -1081,7 +1115,7 @@ static int solver_set_line(solver_state *sstate, int i,
 {
     game_state *state = sstate->state;
     grid *g;
-    grid_edge *e;
+    int d1, d2, f1, f2;
 
     assert(line_new != LINE_UNKNOWN);
 
@@ -1099,26 +1133,36 @@ static int solver_set_line(solver_state *sstate, int i,
 #endif
 
     g = state->game_grid;
-    e = g->edges + i;
+    d1 = GRID_EDGE_DOT1(g, i);
+    d2 = GRID_EDGE_DOT2(g, i);
+    f1 = GRID_EDGE_FACE1(g, i);
+    f2 = GRID_EDGE_FACE2(g, i);
+
+    sstate->dot_todo[d1] = TODO_ALL;
+    sstate->dot_todo[d2] = TODO_ALL;
+    if (f1 >= 0)
+        sstate->face_todo[f1] = TODO_ALL;
+    if (f2 >= 0)
+        sstate->face_todo[f2] = TODO_ALL;
 
     /* Update the cache for both dots and both faces affected by this. */
     if (line_new == LINE_YES) {
-        sstate->dot_yes_count[e->dot1 - g->dots]++;
-        sstate->dot_yes_count[e->dot2 - g->dots]++;
-        if (e->face1) {
-            sstate->face_yes_count[e->face1 - g->faces]++;
+        sstate->dot_yes_count[d1]++;
+        sstate->dot_yes_count[d2]++;
+        if (f1 >= 0) {
+            sstate->face_yes_count[f1]++;
         }
-        if (e->face2) {
-            sstate->face_yes_count[e->face2 - g->faces]++;
+        if (f2 >= 0) {
+            sstate->face_yes_count[f2]++;
         }
     } else {
-        sstate->dot_no_count[e->dot1 - g->dots]++;
-        sstate->dot_no_count[e->dot2 - g->dots]++;
-        if (e->face1) {
-            sstate->face_no_count[e->face1 - g->faces]++;
+        sstate->dot_no_count[d1]++;
+        sstate->dot_no_count[d2]++;
+        if (f1 >= 0) {
+            sstate->face_no_count[f1]++;
         }
-        if (e->face2) {
-            sstate->face_no_count[e->face2 - g->faces]++;
+        if (f2 >= 0) {
+            sstate->face_no_count[f2]++;
         }
     }
 
@@ -1142,10 +1186,9 @@ static int merge_dots(solver_state *sstate, int edge_index)
 {
     int i, j, len;
     grid *g = sstate->state->game_grid;
-    grid_edge *e = g->edges + edge_index;
 
-    i = e->dot1 - g->dots;
-    j = e->dot2 - g->dots;
+    i = GRID_EDGE_DOT1(g, edge_index);
+    j = GRID_EDGE_DOT2(g, edge_index);
 
     i = dsf_canonify(sstate->dotdsf, i);
     j = dsf_canonify(sstate->dotdsf, j);
@@ -1203,12 +1246,11 @@ static int dot_order(const game_state* state, int dot, char line_type)
 {
     int n = 0;
     grid *g = state->game_grid;
-    grid_dot *d = g->dots + dot;
-    int i;
+    const int *edges = GRID_DOT_EDGES(g, dot);
+    int i, order = GRID_DOT_ORDER(g, dot);
 
-    for (i = 0; i < d->order; i++) {
-        grid_edge *e = d->edges[i];
-        if (state->lines[e - g->edges] == line_type)
+    for (i = 0; i < order; i++) {
+        if (state->lines[edges[i]] == line_type)
             ++n;
     }
     return n;
@@ -1220,12 +1262,11 @@ static int face_order(const game_state* state, int face, char line_type)
 {
     int n = 0;
     grid *g = state->game_grid;
-    grid_face *f = g->faces + face;
-    int i;
+    const int *edges = GRID_FACE_EDGES(g, face);
+    int i, order = GRID_FACE_ORDER(g, face);
 
-    for (i = 0; i < f->order; i++) {
-        grid_edge *e = f->edges[i];
-        if (state->lines[e - g->edges] == line_type)
+    for (i = 0; i < order; i++) {
+        if (state->lines[edges[i]] == line_type)
             ++n;
     }
     return n;
@@ -1239,17 +1280,18 @@ static int dot_setall(solver_state *sstate, int dot,
     int retval = FALSE, r;
     game_state *state = sstate->state;
     grid *g;
-    grid_dot *d;
-    int i;
+    const int *edges;
+    int i, order;
 
     if (old_type == new_type)
         return FALSE;
 
     g = state->game_grid;
-    d = g->dots + dot;
+    edges = GRID_DOT_EDGES(g, dot);
+    order = GRID_DOT_ORDER(g, dot);
 
-    for (i = 0; i < d->order; i++) {
-        int line_index = d->edges[i] - g->edges;
+    for (i = 0; i < order; i++) {
+        int line_index = edges[i];
         if (state->lines[line_index] == old_type) {
             r = solver_set_line(sstate, line_index, new_type);
             assert(r == TRUE);
@@ -1266,17 +1308,18 @@ static int face_setall(solver_state *sstate, int face,
     int retval = FALSE, r;
     game_state *state = sstate->state;
     grid *g;
-    grid_face *f;
-    int i;
+    const int *edges;
+    int i, order;
 
     if (old_type == new_type)
         return FALSE;
 
     g = state->game_grid;
-    f = g->faces + face;
+    edges = GRID_FACE_EDGES(g, face);
+    order = GRID_FACE_ORDER(g, face);
 
-    for (i = 0; i < f->order; i++) {
-        int line_index = f->edges[i] - g->edges;
+    for (i = 0; i < order; i++) {
+        int line_index = edges[i];
         if (state->lines[line_index] == old_type) {
             r = solver_set_line(sstate, line_index, new_type);
             assert(r == TRUE);
@@ -1574,7 +1617,10 @@ static int face_score(grid *g, char *board, grid_face *face,
  * everything nice and connected, including that "tentative" GREY face which
  * acts as a gateway to the rest of the non-WHITE grid.
  */
-static void add_full_clues(game_state *state, random_state *rs)
+/* Any scratch space this needs comes from (and goes back to) the given
+ * arena. */
+static void add_full_clues(game_state *state, random_state *rs,
+                           arena *scratch)
 {
     signed char *clues = state->clues;
     char *board;
@@ -1589,13 +1635,13 @@ static void add_full_clues(game_state *state, random_state *rs)
     int *face_list;
     int do_random_pass;
 
-    board = snewn(num_faces, char);
+    board = anewn(scratch, num_faces, char);
 
     /* Make a board */
     memset(board, FACE_GREY, num_faces);
     
     /* Create and initialise the list of face_scores */
-    face_scores = snewn(num_faces, struct face_score);
+    face_scores = anewn(scratch, num_faces, struct face_score);
     for (i = 0; i < num_faces; i++) {
         face_scores[i].random = random_bits(rs, 31);
         face_scores[i].black_score = face_scores[i].white_score = 0;
@@ -1729,10 +1775,9 @@ static void add_full_clues(game_state *state, random_state *rs)
     /* Clean up */
     freetree234(lightable_faces_sorted);
     freetree234(darkable_faces_sorted);
-    sfree(face_scores);
 
     /* The next step requires a shuffled list of all faces */
-    face_list = snewn(num_faces, int);
+    face_list = anewn(scratch, num_faces, int);
     for (i = 0; i < num_faces; ++i) {
         face_list[i] = i;
     }
@@ -1784,8 +1829,6 @@ static void add_full_clues(game_state *state, random_state *rs)
         if (!flipped) do_random_pass = TRUE;
      }
 
-    sfree(face_list);
-
     /* Fill out all the clues by initialising to 0, then iterating over
      * all edges and incrementing each clue as we find edges that border
      * between BLACK/WHITE faces.  While we're at it, we verify that the
@@ -1805,42 +1848,36 @@ static void add_full_clues(game_state *state, random_state *rs)
         }
     }
 
-    sfree(board);
+    arena_release(scratch, board);
 }
 
 
-static int game_has_unique_soln(const game_state *state, int diff)
+/* The solver state passed in is scratch space: it's reset to match the
+ * game state and then solved in place, so the generator can make one for
+ * each difficulty it needs and use it for every check. */
+static int game_has_unique_soln(const game_state *state, solver_state *sstate)
 {
-    int ret;
-    solver_state *sstate_new;
-    solver_state *sstate = new_solver_state((game_state *)state, diff);
-
-    sstate_new = solve_game_rec(sstate);
-
-    assert(sstate_new->solver_status != SOLVER_MISTAKE);
-    ret = (sstate_new->solver_status == SOLVER_SOLVED);
-
-    free_solver_state(sstate_new);
-    free_solver_state(sstate);
+    reset_solver_state(sstate, state);
+    solve_game_in_place(sstate);
 
-    return ret;
+    assert(sstate->solver_status != SOLVER_MISTAKE);
+    return (sstate->solver_status == SOLVER_SOLVED);
 }
 
 
 /* Remove clues one at a time at random. */
-static game_state *remove_clues(game_state *state, random_state *rs,
-                                int diff)
+static void remove_clues(game_state *state, random_state *rs,
+                         solver_state *sstate, arena *scratch)
 {
     int *face_list;
     int num_faces = state->game_grid->num_faces;
-    game_state *ret = dup_game(state), *saved_ret;
     int n;
 
     /* We need to remove some clues.  We'll do this by forming a list of all
      * available clues, shuffling it, then going along one at a
      * time clearing each clue in turn for which doing so doesn't render the
      * board unsolvable. */
-    face_list = snewn(num_faces, int);
+    face_list = anewn(scratch, num_faces, int);
     for (n = 0; n < num_faces; ++n) {
         face_list[n] = n;
     }
@@ -1848,19 +1885,14 @@ static game_state *remove_clues(game_state *state, random_state *rs,
     shuffle(face_list, num_faces, sizeof(int), rs);
 
     for (n = 0; n < num_faces; ++n) {
-        saved_ret = dup_game(ret);
-        ret->clues[face_list[n]] = -1;
+        signed char clue = state->clues[face_list[n]];
+        state->clues[face_list[n]] = -1;
 
-        if (game_has_unique_soln(ret, diff)) {
-            free_game(saved_ret);
-        } else {
-            free_game(ret);
-            ret = saved_ret;
-        }
+        if (!game_has_unique_soln(state, sstate))
+            state->clues[face_list[n]] = clue;
     }
-    sfree(face_list);
 
-    return ret;
+    arena_release(scratch, face_list);
 }
 
 
@@ -1871,7 +1903,8 @@ static char *new_game_desc(game_params *params, random_state *rs,
     char *retval;
     grid *g;
     game_state *state = snew(game_state);
-    game_state *state_new;
+    solver_state *sstate, *sstate_easier;
+    arena *scratch;
     params_generate_grid(params);
     state->game_grid = g = params->game_grid;
     g->refcount++;
@@ -1881,26 +1914,32 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
     state->grid_type = params->type;
 
-    newboard_please:
-
+    memset(state->clues, -1, g->num_faces);
     memset(state->lines, LINE_UNKNOWN, g->num_edges);
     memset(state->line_errors, 0, g->num_edges);
 
     state->solved = state->cheated = FALSE;
 
+    /* Everything the attempts below need is made here, once, and reset
+     * in place for each attempt. */
+    sstate = new_solver_state(state, params->diff);
+    sstate_easier = params->diff > 0 ?
+        new_solver_state(state, params->diff-1) : NULL;
+    scratch = arena_new(g->num_faces * (sizeof(struct face_score) +
+                                        sizeof(int) + 1) + 64);
+
+    newboard_please:
+
     /* Get a new random solvable board with all its clues filled in.  Yes, this
      * can loop for ever if the params are suitably unfavourable, but
      * preventing games smaller than 4x4 seems to stop this happening */
     do {
-        add_full_clues(state, rs);
-    } while (!game_has_unique_soln(state, params->diff));
-
-    state_new = remove_clues(state, rs, params->diff);
-    free_game(state);
-    state = state_new;
+        add_full_clues(state, rs, scratch);
+    } while (!game_has_unique_soln(state, sstate));
 
+    remove_clues(state, rs, sstate, scratch);
 
-    if (params->diff > 0 && game_has_unique_soln(state, params->diff-1)) {
+    if (sstate_easier && game_has_unique_soln(state, sstate_easier)) {
 #ifdef SHOW_WORKING
         fprintf(stderr, "Rejecting board, it is too easy\n");
 #endif
@@ -1909,6 +1948,9 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
     retval = state_to_text(state);
 
+    free_solver_state(sstate);
+    free_solver_state(sstate_easier);
+    arena_free(scratch);
     free_game(state);
 
     assert(!validate_desc(params, retval));
@@ -2165,21 +2207,20 @@ static int check_completion(game_state *state)
 
 /* i points to the first edge of the dline pair, reading clockwise around
  * the dot. */
-static int dline_index_from_dot(grid *g, grid_dot *d, int i)
+static int dline_index_from_dot(grid *g, int d, int i)
 {
-    grid_edge *e = d->edges[i];
+    int e = GRID_DOT_EDGES(g, d)[i];
     int ret;
 #ifdef DEBUG_DLINES
-    grid_edge *e2;
+    int e2;
     int i2 = i+1;
-    if (i2 == d->order) i2 = 0;
-    e2 = d->edges[i2];
+    if (i2 == GRID_DOT_ORDER(g, d)) i2 = 0;
+    e2 = GRID_DOT_EDGES(g, d)[i2];
 #endif
-    ret = 2 * (e - g->edges) + ((e->dot1 == d) ? 1 : 0);
+    ret = 2 * e + ((GRID_EDGE_DOT1(g, e) == d) ? 1 : 0);
 #ifdef DEBUG_DLINES
     printf("dline_index_from_dot: d=%d,i=%d, edges [%d,%d] - %d\n",
-           (int)(d - g->dots), i, (int)(e - g->edges),
-           (int)(e2 - g->edges), ret);
+           d, i, e, e2, ret);
 #endif
     return ret;
 }
@@ -2187,22 +2228,21 @@ static int dline_index_from_dot(grid *g, grid_dot *d, int i)
  * the face.  That is, the edges of the dline, starting at edge{i}, read
  * anti-clockwise around the face.  By layout conventions, the common dot
  * of the dline will be f->dots[i] */
-static int dline_index_from_face(grid *g, grid_face *f, int i)
+static int dline_index_from_face(grid *g, int f, int i)
 {
-    grid_edge *e = f->edges[i];
-    grid_dot *d = f->dots[i];
+    int e = GRID_FACE_EDGES(g, f)[i];
+    int d = GRID_FACE_DOTS(g, f)[i];
     int ret;
 #ifdef DEBUG_DLINES
-    grid_edge *e2;
+    int e2;
     int i2 = i - 1;
-    if (i2 < 0) i2 += f->order;
-    e2 = f->edges[i2];
+    if (i2 < 0) i2 += GRID_FACE_ORDER(g, f);
+    e2 = GRID_FACE_EDGES(g, f)[i2];
 #endif
-    ret = 2 * (e - g->edges) + ((e->dot1 == d) ? 1 : 0);
+    ret = 2 * e + ((GRID_EDGE_DOT1(g, e) == d) ? 1 : 0);
 #ifdef DEBUG_DLINES
     printf("dline_index_from_face: f=%d,i=%d, edges [%d,%d] - %d\n",
-           (int)(f - g->faces), i, (int)(e - g->edges),
-           (int)(e2 - g->edges), ret);
+           f, i, e, e2, ret);
 #endif
     return ret;
 }
@@ -2210,17 +2250,38 @@ static int is_atleastone(const char *dline_array, int index)
 {
     return BIT_SET(dline_array[index], 0);
 }
-static int set_atleastone(char *dline_array, int index)
+/* A dline belongs to one dot, and is read by the deductions for that dot
+ * and for the faces around it. */
+static void dline_changed(solver_state *sstate, int index)
 {
-    return SET_BIT(dline_array[index], 0);
+    grid *g = sstate->state->game_grid;
+    int e = index / 2;
+    int d = (index & 1) ? GRID_EDGE_DOT1(g, e) : GRID_EDGE_DOT2(g, e);
+    const int *faces = GRID_DOT_FACES(g, d);
+    int i, order = GRID_DOT_ORDER(g, d);
+
+    sstate->dot_todo[d] = TODO_ALL;
+    for (i = 0; i < order; i++)
+        if (faces[i] >= 0)
+            sstate->face_todo[faces[i]] = TODO_ALL;
+}
+static int set_atleastone(solver_state *sstate, int index)
+{
+    if (!SET_BIT(sstate->dlines[index], 0))
+        return FALSE;
+    dline_changed(sstate, index);
+    return TRUE;
 }
 static int is_atmostone(const char *dline_array, int index)
 {
     return BIT_SET(dline_array[index], 1);
 }
-static int set_atmostone(char *dline_array, int index)
+static int set_atmostone(solver_state *sstate, int index)
 {
-    return SET_BIT(dline_array[index], 1);
+    if (!SET_BIT(sstate->dlines[index], 1))
+        return FALSE;
+    dline_changed(sstate, index);
+    return TRUE;
 }
 
 static void array_setall(char *array, char from, char to, int len)
@@ -2243,11 +2304,12 @@ static void array_setall(char *array, char from, char to, int len)
  * and set their corresponding dline to atleastone.  (Setting atmostone
  * already happens in earlier dline deductions) */
 static int dline_set_opp_atleastone(solver_state *sstate,
-                                    grid_dot *d, int edge)
+                                    int d, int edge)
 {
     game_state *state = sstate->state;
     grid *g = state->game_grid;
-    int N = d->order;
+    const int *edges = GRID_DOT_EDGES(g, d);
+    int N = GRID_DOT_ORDER(g, d);
     int opp, opp2;
     for (opp = 0; opp < N; opp++) {
         int opp_dline_index;
@@ -2260,13 +2322,13 @@ static int dline_set_opp_atleastone(solver_state *sstate,
         opp2 = opp + 1;
         if (opp2 == N) opp2 = 0;
         /* Check if opp, opp2 point to LINE_UNKNOWNs */
-        if (state->lines[d->edges[opp] - g->edges] != LINE_UNKNOWN)
+        if (state->lines[edges[opp]] != LINE_UNKNOWN)
             continue;
-        if (state->lines[d->edges[opp2] - g->edges] != LINE_UNKNOWN)
+        if (state->lines[edges[opp2]] != LINE_UNKNOWN)
             continue;
         /* Found opposite UNKNOWNS and they're next to each other */
         opp_dline_index = dline_index_from_dot(g, d, opp);
-        return set_atleastone(sstate->dlines, opp_dline_index);
+        return set_atleastone(sstate, opp_dline_index);
     }
     return FALSE;
 }
@@ -2284,17 +2346,17 @@ static int face_setall_identical(solver_state *sstate, int face_index,
     int retval = FALSE;
     game_state *state = sstate->state;
     grid *g = state->game_grid;
-    grid_face *f = g->faces + face_index;
-    int N = f->order;
+    const int *edges = GRID_FACE_EDGES(g, face_index);
+    int N = GRID_FACE_ORDER(g, face_index);
     int i, j;
     int can1, can2, inv1, inv2;
 
     for (i = 0; i < N; i++) {
-        int line1_index = f->edges[i] - g->edges;
+        int line1_index = edges[i];
         if (state->lines[line1_index] != LINE_UNKNOWN)
             continue;
         for (j = i + 1; j < N; j++) {
-            int line2_index = f->edges[j] - g->edges;
+            int line2_index = edges[j];
             if (state->lines[line2_index] != LINE_UNKNOWN)
                 continue;
 
@@ -2313,14 +2375,13 @@ static int face_setall_identical(solver_state *sstate, int face_index,
 /* Given a dot or face, and a count of LINE_UNKNOWNs, find them and
  * return the edge indices into e. */
 static void find_unknowns(game_state *state,
-    grid_edge **edge_list, /* Edge list to search (from a face or a dot) */
+    const int *edge_list, /* Edge list to search (from a face or a dot) */
     int expected_count, /* Number of UNKNOWNs (comes from solver's cache) */
     int *e /* Returned edge indices */)
 {
     int c = 0;
-    grid *g = state->game_grid;
     while (c < expected_count) {
-        int line_index = *edge_list - g->edges;
+        int line_index = *edge_list;
         if (state->lines[line_index] == LINE_UNKNOWN) {
             e[c] = line_index;
             c++;
@@ -2335,7 +2396,7 @@ static void find_unknowns(game_state *state,
  * Returns the difficulty level of the next solver that should be used,
  * or DIFF_MAX if no progress was made. */
 static int parity_deductions(solver_state *sstate,
-    grid_edge **edge_list, /* Edge list (from a face or a dot) */
+    const int *edge_list, /* Edge list (from a face or a dot) */
     int total_parity, /* Expected number of YESs modulo 2 (either 0 or 1) */
     int unknown_count)
 {
@@ -2449,7 +2510,11 @@ static int trivial_deductions(solver_state *sstate)
 
     /* Per-face deductions */
     for (i = 0; i < g->num_faces; i++) {
-        grid_face *f = g->faces + i;
+        int order = GRID_FACE_ORDER(g, i);
+
+        if (!(sstate->face_todo[i] & TODO_TRIVIAL))
+            continue;
+        sstate->face_todo[i] &= ~TODO_TRIVIAL;
 
         if (sstate->face_solved[i])
             continue;
@@ -2457,7 +2522,7 @@ static int trivial_deductions(solver_state *sstate)
         current_yes = sstate->face_yes_count[i];
         current_no  = sstate->face_no_count[i];
 
-        if (current_yes + current_no == f->order)  {
+        if (current_yes + current_no == order)  {
             sstate->face_solved[i] = TRUE;
             continue;
         }
@@ -2476,11 +2541,11 @@ static int trivial_deductions(solver_state *sstate)
             continue;
         }
 
-        if (f->order - state->clues[i] < current_no) {
+        if (order - state->clues[i] < current_no) {
             sstate->solver_status = SOLVER_MISTAKE;
             return DIFF_EASY;
         }
-        if (f->order - state->clues[i] == current_no) {
+        if (order - state->clues[i] == current_no) {
             if (face_setall(sstate, i, LINE_UNKNOWN, LINE_YES))
                 diff = min(diff, DIFF_EASY);
             sstate->face_solved[i] = TRUE;
@@ -2492,15 +2557,18 @@ static int trivial_deductions(solver_state *sstate)
 
     /* Per-dot deductions */
     for (i = 0; i < g->num_dots; i++) {
-        grid_dot *d = g->dots + i;
         int yes, no, unknown;
 
+        if (!(sstate->dot_todo[i] & TODO_TRIVIAL))
+            continue;
+        sstate->dot_todo[i] &= ~TODO_TRIVIAL;
+
         if (sstate->dot_solved[i])
             continue;
 
         yes = sstate->dot_yes_count[i];
         no = sstate->dot_no_count[i];
-        unknown = d->order - yes - no;
+        unknown = GRID_DOT_ORDER(g, i) - yes - no;
 
         if (yes == 0) {
             if (unknown == 0) {
@@ -2589,18 +2657,21 @@ static int dline_deductions(solver_state *sstate)
     for (i = 0; i < g->num_faces; i++) {
         int maxs[MAX_FACE_SIZE][MAX_FACE_SIZE];
         int mins[MAX_FACE_SIZE][MAX_FACE_SIZE];
-        grid_face *f = g->faces + i;
-        int N = f->order;
+        const int *edges = GRID_FACE_EDGES(g, i);
+        int N = GRID_FACE_ORDER(g, i);
         int j,m;
         int clue = state->clues[i];
         assert(N <= MAX_FACE_SIZE);
+        if (!(sstate->face_todo[i] & TODO_DLINE))
+            continue;
+        sstate->face_todo[i] &= ~TODO_DLINE;
         if (sstate->face_solved[i])
             continue;
         if (clue < 0) continue;
 
         /* Calculate the (j,j+1) entries */
         for (j = 0; j < N; j++) {
-            int edge_index = f->edges[j] - g->edges;
+            int edge_index = edges[j];
             int dline_index;
             enum line_state line1 = state->lines[edge_index];
             enum line_state line2;
@@ -2610,8 +2681,8 @@ static int dline_deductions(solver_state *sstate)
             maxs[j][k] = (line1 == LINE_NO) ? 0 : 1;
             mins[j][k] = (line1 == LINE_YES) ? 1 : 0;
             /* Calculate the (j,j+2) entries */
-            dline_index = dline_index_from_face(g, f, k);
-            edge_index = f->edges[k] - g->edges;
+            dline_index = dline_index_from_face(g, i, k);
+            edge_index = edges[k];
             line2 = state->lines[edge_index];
             k++;
             if (k >= N) k = 0;
@@ -2655,8 +2726,7 @@ static int dline_deductions(solver_state *sstate)
         /* See if we can make any deductions */
         for (j = 0; j < N; j++) {
             int k;
-            grid_edge *e = f->edges[j];
-            int line_index = e - g->edges;
+            int line_index = edges[j];
             int dline_index;
 
             if (state->lines[line_index] != LINE_UNKNOWN)
@@ -2690,27 +2760,26 @@ static int dline_deductions(solver_state *sstate)
              * in square grids. */
             if (sstate->diff >= DIFF_TRICKY) {
                 /* Now see if we can make dline deduction for edges{j,j+1} */
-                e = f->edges[k];
-                if (state->lines[e - g->edges] != LINE_UNKNOWN)
+                if (state->lines[edges[k]] != LINE_UNKNOWN)
                     /* Only worth doing this for an UNKNOWN,UNKNOWN pair.
                      * Dlines where one of the edges is known, are handled in the
                      * dot-deductions */
                     continue;
     
-                dline_index = dline_index_from_face(g, f, k);
+                dline_index = dline_index_from_face(g, i, k);
                 k++;
                 if (k >= N) k = 0;
     
                 /* minimum YESs in the complement of this dline */
                 if (mins[k][j] > clue - 2) {
                     /* Adding 2 YESs would break the clue */
-                    if (set_atmostone(dlines, dline_index))
+                    if (set_atmostone(sstate, dline_index))
                         diff = min(diff, DIFF_NORMAL);
                 }
                 /* maximum YESs in the complement of this dline */
                 if (maxs[k][j] < clue) {
                     /* Adding 2 NOs would mean not enough YESs */
-                    if (set_atleastone(dlines, dline_index))
+                    if (set_atleastone(sstate, dline_index))
                         diff = min(diff, DIFF_NORMAL);
                 }
             }
@@ -2723,10 +2792,13 @@ static int dline_deductions(solver_state *sstate)
     /* ------ Dot deductions ------ */
 
     for (i = 0; i < g->num_dots; i++) {
-        grid_dot *d = g->dots + i;
-        int N = d->order;
+        const int *edges = GRID_DOT_EDGES(g, i);
+        int N = GRID_DOT_ORDER(g, i);
         int yes, no, unknown;
         int j;
+        if (!(sstate->dot_todo[i] & TODO_DLINE))
+            continue;
+        sstate->dot_todo[i] &= ~TODO_DLINE;
         if (sstate->dot_solved[i])
             continue;
         yes = sstate->dot_yes_count[i];
@@ -2740,19 +2812,19 @@ static int dline_deductions(solver_state *sstate)
             enum line_state line1, line2;
             k = j + 1;
             if (k >= N) k = 0;
-            dline_index = dline_index_from_dot(g, d, j);
-            line1_index = d->edges[j] - g->edges;
-            line2_index = d->edges[k] - g->edges;
+            dline_index = dline_index_from_dot(g, i, j);
+            line1_index = edges[j];
+            line2_index = edges[k];
             line1 = state->lines[line1_index];
             line2 = state->lines[line2_index];
 
             /* Infer dline state from line state */
             if (line1 == LINE_NO || line2 == LINE_NO) {
-                if (set_atmostone(dlines, dline_index))
+                if (set_atmostone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
             }
             if (line1 == LINE_YES || line2 == LINE_YES) {
-                if (set_atleastone(dlines, dline_index))
+                if (set_atleastone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
             }
             /* Infer line state from dline state */
@@ -2798,10 +2870,10 @@ static int dline_deductions(solver_state *sstate)
                 }
             }
             if (yes == 1) {
-                if (set_atmostone(dlines, dline_index))
+                if (set_atmostone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
                 if (unknown == 2) {
-                    if (set_atleastone(dlines, dline_index))
+                    if (set_atleastone(sstate, dline_index))
                         diff = min(diff, DIFF_NORMAL);
                 }
             }
@@ -2826,8 +2898,8 @@ static int dline_deductions(solver_state *sstate)
                             continue;
                         if (j == N-1 && opp == 0)
                             continue;
-                        opp_dline_index = dline_index_from_dot(g, d, opp);
-                        if (set_atmostone(dlines, opp_dline_index))
+                        opp_dline_index = dline_index_from_dot(g, i, opp);
+                        if (set_atmostone(sstate, opp_dline_index))
                             diff = min(diff, DIFF_NORMAL);
                     }
                     if (yes == 0 && is_atmostone(dlines, dline_index)) {
@@ -2839,7 +2911,7 @@ static int dline_deductions(solver_state *sstate)
                                 int opp_index;
                                 if (opp == j || opp == k)
                                     continue;
-                                opp_index = d->edges[opp] - g->edges;
+                                opp_index = edges[opp];
                                 if (state->lines[opp_index] == LINE_UNKNOWN) {
                                     solver_set_line(sstate, opp_index,
                                                     LINE_YES);
@@ -2851,7 +2923,7 @@ static int dline_deductions(solver_state *sstate)
                              * already set atmostone, so set atleastone as
                              * well.
                              */
-                            if (dline_set_opp_atleastone(sstate, d, j))
+                            if (dline_set_opp_atleastone(sstate, i, j))
                                 diff = min(diff, DIFF_NORMAL);
                         }
                     }
@@ -2890,7 +2962,7 @@ static int linedsf_deductions(solver_state *sstate)
         if (clue < 0)
             continue;
 
-        N = g->faces[i].order;
+        N = GRID_FACE_ORDER(g, i);
         yes = sstate->face_yes_count[i];
         if (yes + 1 == clue) {
             if (face_setall_identical(sstate, i, LINE_NO))
@@ -2908,31 +2980,31 @@ static int linedsf_deductions(solver_state *sstate)
 
         /* Deductions with small number of LINE_UNKNOWNs, based on overall
          * parity of lines. */
-        diff_tmp = parity_deductions(sstate, g->faces[i].edges,
+        diff_tmp = parity_deductions(sstate, GRID_FACE_EDGES(g, i),
                                      (clue - yes) % 2, unknown);
         diff = min(diff, diff_tmp);
     }
 
     /* ------ Dot deductions ------ */
     for (i = 0; i < g->num_dots; i++) {
-        grid_dot *d = g->dots + i;
-        int N = d->order;
+        const int *edges = GRID_DOT_EDGES(g, i);
+        int N = GRID_DOT_ORDER(g, i);
         int j;
         int yes, no, unknown;
         /* Go through dlines, and do any dline<->linedsf deductions wherever
          * we find two UNKNOWNS. */
         for (j = 0; j < N; j++) {
-            int dline_index = dline_index_from_dot(g, d, j);
+            int dline_index = dline_index_from_dot(g, i, j);
             int line1_index;
             int line2_index;
             int can1, can2, inv1, inv2;
             int j2;
-            line1_index = d->edges[j] - g->edges;
+            line1_index = edges[j];
             if (state->lines[line1_index] != LINE_UNKNOWN)
                 continue;
             j2 = j + 1;
             if (j2 == N) j2 = 0;
-            line2_index = d->edges[j2] - g->edges;
+            line2_index = edges[j2];
             if (state->lines[line2_index] != LINE_UNKNOWN)
                 continue;
             /* Infer dline flags from linedsf */
@@ -2940,9 +3012,9 @@ static int linedsf_deductions(solver_state *sstate)
             can2 = edsf_canonify(sstate->linedsf, line2_index, &inv2);
             if (can1 == can2 && inv1 != inv2) {
                 /* These are opposites, so set dline atmostone/atleastone */
-                if (set_atmostone(dlines, dline_index))
+                if (set_atmostone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
-                if (set_atleastone(dlines, dline_index))
+                if (set_atleastone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
                 continue;
             }
@@ -2959,7 +3031,7 @@ static int linedsf_deductions(solver_state *sstate)
         yes = sstate->dot_yes_count[i];
         no = sstate->dot_no_count[i];
         unknown = N - yes - no;
-        diff_tmp = parity_deductions(sstate, d->edges,
+        diff_tmp = parity_deductions(sstate, edges,
                                      yes % 2, unknown);
         diff = min(diff, diff_tmp);
     }
@@ -3054,9 +3126,8 @@ static int loop_deductions(solver_state *sstate)
      * loop it would create is a solution.
      */
     for (i = 0; i < g->num_edges; i++) {
-        grid_edge *e = g->edges + i;
-        int d1 = e->dot1 - g->dots;
-        int d2 = e->dot2 - g->dots;
+        int d1 = GRID_EDGE_DOT1(g, i);
+        int d2 = GRID_EDGE_DOT2(g, i);
         int eqclass, val;
         if (state->lines[i] != LINE_UNKNOWN)
             continue;
@@ -3092,14 +3163,14 @@ static int loop_deductions(solver_state *sstate)
              * side of this edge.
              */
             sm1_nearby = 0;
-            if (e->face1) {
-                int f = e->face1 - g->faces;
+            if (GRID_EDGE_FACE1(g, i) >= 0) {
+                int f = GRID_EDGE_FACE1(g, i);
                 int c = state->clues[f];
                 if (c >= 0 && sstate->face_yes_count[f] == c - 1)
                     sm1_nearby++;
             }
-            if (e->face2) {
-                int f = e->face2 - g->faces;
+            if (GRID_EDGE_FACE2(g, i) >= 0) {
+                int f = GRID_EDGE_FACE2(g, i);
                 int c = state->clues[f];
                 if (c >= 0 && sstate->face_yes_count[f] == c - 1)
                     sm1_nearby++;
@@ -3146,8 +3217,15 @@ static int loop_deductions(solver_state *sstate)
  * solved grid */
 static solver_state *solve_game_rec(const solver_state *sstate_start)
 {
-    solver_state *sstate;
+    solver_state *sstate = dup_solver_state(sstate_start);
+
+    solve_game_in_place(sstate);
+    return sstate;
+}
 
+/* As solve_game_rec, but does its work directly on the given solver_state */
+static void solve_game_in_place(solver_state *sstate)
+{
     /* Index of the solver we should call next. */
     int i = 0;
     
@@ -3166,14 +3244,12 @@ static solver_state *solve_game_rec(const solver_state *sstate_start)
      */
     int threshold_diff = 0;
     int threshold_index = 0;
-    
-    sstate = dup_solver_state(sstate_start);
 
     check_caches(sstate);
 
     while (i < NUM_SOLVERS) {
         if (sstate->solver_status == SOLVER_MISTAKE)
-            return sstate;
+            return;
         if (sstate->solver_status == SOLVER_SOLVED ||
             sstate->solver_status == SOLVER_AMBIGUOUS) {
             /* solver finished */
@@ -3203,10 +3279,7 @@ static solver_state *solve_game_rec(const solver_state *sstate_start)
         /* s/LINE_UNKNOWN/LINE_NO/g */
         array_setall(sstate->state->lines, LINE_UNKNOWN, LINE_NO,
                      sstate->state->game_grid->num_edges);
-        return sstate;
     }
-
-    return sstate;
 }
 
 static char *solve_game(game_state *state, game_state *currstate,
@@ -3796,3 +3869,111 @@ const struct game thegame = {
     FALSE, game_timing_state,
     0,                                       /* mouse_priorities */
 };
+
+#ifdef STANDALONE_LOOPY_BENCHMARK
+
+#include <time.h>
+
+/*
+ * Time puzzle generation on each type of grid in GRIDLIST, at the
+ * size and difficulty given on the command line (the grid type in
+ * it is ignored). Puzzles come from the seeds "0", "1", ... so that
+ * runs can be compared; -v prints them. The solver is then timed on
+ * its own, solving each of the generated puzzles -r times over.
+ */
+int main(int argc, char **argv)
+{
+    const char *quis = argv[0];
+    game_params *params = default_params();
+    int n = 10, reps = 10, verbose = FALSE;
+    int type, i, r;
+    double total = 0.0, stotal = 0.0;
+
+    while (--argc > 0) {
+        char *p = *++argv;
+        if (!strcmp(p, "-n") && argc > 1) {
+            n = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(p, "-r") && argc > 1) {
+            reps = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(p, "-v")) {
+            verbose = TRUE;
+        } else if (*p == '-') {
+            fprintf(stderr, "usage: %s [-v] [-n count] [-r reps] [params]\n",
+                    quis);
+            return 1;
+        } else {
+            decode_params(params, p);
+        }
+    }
+
+    for (type = 0; type < NUM_GRID_TYPES; type++) {
+        game_params *p = dup_params(params);
+        char *err, *encoded, **descs;
+        clock_t start;
+        double t, st;
+
+        if (p->game_grid) {
+            grid_free(p->game_grid);
+            p->game_grid = NULL;
+        }
+        p->type = type;
+        if ((err = validate_params(p, TRUE)) != NULL) {
+            printf("%-16s %s\n", gridnames[type], err);
+            free_params(p);
+            continue;
+        }
+        params_generate_grid(p);       /* not part of what we're timing */
+        encoded = encode_params(p, TRUE);
+        descs = snewn(n, char *);
+
+        start = clock();
+        for (i = 0; i < n; i++) {
+            char seed[32], *desc, *aux = NULL;
+            random_state *rs;
+
+            sprintf(seed, "%d", i);
+            rs = random_new(seed, strlen(seed));
+            desc = new_game_desc(p, rs, &aux, FALSE);
+            if (verbose)
+                printf("%s:%s\n", encoded, desc);
+            random_free(rs);
+            descs[i] = desc;
+            sfree(aux);
+        }
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        total += t;
+
+        start = clock();
+        for (r = 0; r < reps; r++) {
+            for (i = 0; i < n; i++) {
+                game_state *state = new_game(NULL, p, descs[i]);
+                solver_state *sstate = new_solver_state(state, p->diff);
+                solve_game_in_place(sstate);
+                assert(sstate->solver_status == SOLVER_SOLVED);
+                free_solver_state(sstate);
+                free_game(state);
+            }
+        }
+        st = (double)(clock() - start) / CLOCKS_PER_SEC;
+        stotal += st;
+
+        printf("%-16s %-10s %10.2f ms per puzzle %8.3f ms per solve\n",
+               gridnames[type], encoded, t * 1000.0 / n,
+               st * 1000.0 / (n * reps));
+        for (i = 0; i < n; i++)
+            sfree(descs[i]);
+        sfree(descs);
+        sfree(encoded);
+        free_params(p);
+    }
+    printf("%-16s %-10s %10.2f ms per puzzle %8.3f ms per solve\n", "all", "",
+           total * 1000.0 / (n * NUM_GRID_TYPES),
+           stotal * 1000.0 / (n * reps * NUM_GRID_TYPES));
+
+    free_params(params);
+    return 0;
+}
+
+#endif
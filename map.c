@@ -84,6 +84,7 @@ struct map {
     int *graph;
     int n;
     int ngraph;
+    int *vstart;		       /* where each region's edges start */
     int *immutable;
     int *edgex, *edgey;		       /* position of a point on each edge */
     int *regionx, *regiony;            /* position of a point in each region */
@@ -602,9 +603,13 @@ static void genmap(int w, int h, int n, int *map, random_state *rs)
 
 /*
  * Having got a map in a square grid, convert it into a graph
- * representation.
+ * representation: a sorted list of i*n+j for every ordered pair of
+ * adjacent regions i,j. Since it's sorted, region i's neighbours
+ * are all together, and we also fill in vstart so that they can be
+ * found without searching: they're graph[vstart[i]] up to, but not
+ * including, graph[vstart[i+1]] (each minus i*n).
  */
-static int gengraph(int w, int h, int n, int *map, int *graph)
+static int gengraph(int w, int h, int n, int *map, int *graph, int *vstart)
 {
     int i, j, x, y;
 
@@ -631,20 +636,28 @@ static int gengraph(int w, int h, int n, int *map, int *graph)
     /*
      * Turn the matrix into a list.
      */
-    for (i = j = 0; i < n*n; i++)
+    for (i = j = 0; i < n*n; i++) {
+	if (i % n == 0)
+	    vstart[i / n] = j;
 	if (graph[i])
 	    graph[j++] = i;
+    }
+    vstart[n] = j;
 
     return j;
 }
 
-static int graph_edge_index(int *graph, int n, int ngraph, int i, int j)
+/*
+ * Find the index in the graph of the edge from i to j, or -1 if
+ * they're not adjacent. We need only search i's own neighbours.
+ */
+static int graph_edge_index(int *graph, int *vstart, int n, int i, int j)
 {
     int v = i*n+j;
     int top, bot, mid;
 
-    bot = -1;
-    top = ngraph;
+    bot = vstart[i] - 1;
+    top = vstart[i+1];
     while (top - bot > 1) {
 	mid = (top + bot) / 2;
 	if (graph[mid] == v)
@@ -657,25 +670,8 @@ static int graph_edge_index(int *graph, int n, int ngraph, int i, int j)
     return -1;
 }
 
-#define graph_adjacent(graph, n, ngraph, i, j) \
-    (graph_edge_index((graph), (n), (ngraph), (i), (j)) >= 0)
-
-static int graph_vertex_start(int *graph, int n, int ngraph, int i)
-{
-    int v = i*n;
-    int top, bot, mid;
-
-    bot = -1;
-    top = ngraph;
-    while (top - bot > 1) {
-	mid = (top + bot) / 2;
-	if (graph[mid] < v)
-	    bot = mid;
-	else
-	    top = mid;
-    }
-    return top;
-}
+#define graph_adjacent(graph, vstart, n, i, j) \
+    (graph_edge_index((graph), (vstart), (n), (i), (j)) >= 0)
 
 /* ----------------------------------------------------------------------
  * Generate a four-colouring of a graph.
@@ -685,10 +681,10 @@ static int graph_vertex_start(int *graph, int n, int ngraph, int i)
  * the sake of the Palm port and its limited stack.
  */
 
-static int fourcolour_recurse(int *graph, int n, int ngraph,
+static int fourcolour_recurse(int *graph, int *vstart, int n,
 			      int *colouring, int *scratch, random_state *rs)
 {
-    int nfree, nvert, start, i, j, k, c, ci;
+    int nfree, nvert, i, j, k, c, ci;
     int cs[FOUR];
 
     /*
@@ -722,7 +718,6 @@ static int fourcolour_recurse(int *graph, int n, int ngraph,
 	    if (j-- == 0)
 		break;
     assert(i < n);
-    start = graph_vertex_start(graph, n, ngraph, i);
 
     /*
      * Loop over the possible colours for i, and recurse for each
@@ -746,7 +741,7 @@ static int fourcolour_recurse(int *graph, int n, int ngraph,
 	 * Update the scratch space to reflect a new neighbour
 	 * of this colour for each neighbour of vertex i.
 	 */
-	for (j = start; j < ngraph && graph[j] < n*(i+1); j++) {
+	for (j = vstart[i]; j < vstart[i+1]; j++) {
 	    k = graph[j] - i*n;
 	    if (scratch[k*FIVE+c] == 0)
 		scratch[k*FIVE+FOUR]--;
@@ -756,14 +751,14 @@ static int fourcolour_recurse(int *graph, int n, int ngraph,
 	/*
 	 * Recurse.
 	 */
-	if (fourcolour_recurse(graph, n, ngraph, colouring, scratch, rs))
+	if (fourcolour_recurse(graph, vstart, n, colouring, scratch, rs))
 	    return TRUE;	       /* got one! */
 
 	/*
 	 * If that didn't work, clean up and try again with a
 	 * different colour.
 	 */
-	for (j = start; j < ngraph && graph[j] < n*(i+1); j++) {
+	for (j = vstart[i]; j < vstart[i+1]; j++) {
 	    k = graph[j] - i*n;
 	    scratch[k*FIVE+c]--;
 	    if (scratch[k*FIVE+c] == 0)
@@ -783,7 +778,7 @@ static int fourcolour_recurse(int *graph, int n, int ngraph,
     return FALSE;
 }
 
-static void fourcolour(int *graph, int n, int ngraph, int *colouring,
+static void fourcolour(int *graph, int *vstart, int n, int *colouring,
 		       random_state *rs)
 {
     int *scratch;
@@ -804,7 +799,7 @@ static void fourcolour(int *graph, int n, int ngraph, int *colouring,
     for (i = 0; i < n; i++)
 	colouring[i] = -1;
 
-    i = fourcolour_recurse(graph, n, ngraph, colouring, scratch, rs);
+    i = fourcolour_recurse(graph, vstart, n, colouring, scratch, rs);
     assert(i);			       /* by the Four Colour Theorem :-) */
 
     sfree(scratch);
@@ -818,9 +813,20 @@ struct solver_scratch {
     unsigned char *possible;	       /* bitmap of colours for each region */
 
     int *graph;
+    int *vstart;
     int n;
     int ngraph;
 
+    /*
+     * Regions which might be down to one possible colour (or none),
+     * waiting for the simplest deduction to look at them. Anything
+     * which rules out a colour puts the region on the end, if it
+     * isn't already there, so that we never have to search for
+     * them.
+     */
+    int *queue, qhead, qlen;
+    unsigned char *queued;
+
     int *bfsqueue;
     int *bfscolour;
 #ifdef SOLVER_DIAGNOSTICS
@@ -830,16 +836,22 @@ struct solver_scratch {
     int depth;
 };
 
-static struct solver_scratch *new_scratch(int *graph, int n, int ngraph)
+static struct solver_scratch *new_scratch(int *graph, int *vstart,
+                                          int n, int ngraph)
 {
     struct solver_scratch *sc;
 
     sc = snew(struct solver_scratch);
     sc->graph = graph;
+    sc->vstart = vstart;
     sc->n = n;
     sc->ngraph = ngraph;
     sc->possible = snewn(n, unsigned char);
     sc->depth = 0;
+    sc->queue = snewn(n, int);
+    sc->queued = snewn(n, unsigned char);
+    sc->qhead = sc->qlen = 0;
+    memset(sc->queued, 0, n);
     sc->bfsqueue = snewn(n, int);
     sc->bfscolour = snewn(n, int);
 #ifdef SOLVER_DIAGNOSTICS
@@ -852,6 +864,8 @@ static struct solver_scratch *new_scratch(int *graph, int n, int ngraph)
 static void free_scratch(struct solver_scratch *sc)
 {
     sfree(sc->possible);
+    sfree(sc->queue);
+    sfree(sc->queued);
     sfree(sc->bfsqueue);
     sfree(sc->bfscolour);
 #ifdef SOLVER_DIAGNOSTICS
@@ -875,6 +889,20 @@ static int bitcount(int word)
 static const char colnames[FOUR] = { 'R', 'Y', 'G', 'B' };
 #endif
 
+/*
+ * Rule out a set of colours in a region, and queue the region if
+ * that leaves it with at most one.
+ */
+static void rule_out(struct solver_scratch *sc, int index, int colours)
+{
+    int p = sc->possible[index] &= ~colours;
+
+    if ((p & (p-1)) == 0 && !sc->queued[index]) {
+        sc->queue[(sc->qhead + sc->qlen++) % sc->n] = index;
+        sc->queued[index] = TRUE;
+    }
+}
+
 static int place_colour(struct solver_scratch *sc,
 			int *colouring, int index, int colour
 #ifdef SOLVER_DIAGNOSTICS
@@ -882,7 +910,7 @@ static int place_colour(struct solver_scratch *sc,
 #endif
                         )
 {
-    int *graph = sc->graph, n = sc->n, ngraph = sc->ngraph;
+    int *graph = sc->graph, *vstart = sc->vstart, n = sc->n;
     int j, k;
 
     if (!(sc->possible[index] & (1 << colour))) {
@@ -906,15 +934,14 @@ static int place_colour(struct solver_scratch *sc,
     /*
      * Rule out this colour from all the region's neighbours.
      */
-    for (j = graph_vertex_start(graph, n, ngraph, index);
-	 j < ngraph && graph[j] < n*(index+1); j++) {
+    for (j = vstart[index]; j < vstart[index+1]; j++) {
 	k = graph[j] - index*n;
 #ifdef SOLVER_DIAGNOSTICS
         if (verbose && (sc->possible[k] & (1 << colour)))
             printf("%*s  ruling out %c in region %d\n", 2*sc->depth, "",
                    colnames[colour], k);
 #endif
-	sc->possible[k] &= ~(1 << colour);
+	rule_out(sc, k, 1 << colour);
     }
 
     return TRUE;
@@ -946,6 +973,7 @@ static int map_solver(struct solver_scratch *sc,
 		      int *graph, int n, int ngraph, int *colouring,
                       int difficulty)
 {
+    int *vstart = sc->vstart;
     int i;
 
     if (sc->depth == 0) {
@@ -975,6 +1003,21 @@ static int map_solver(struct solver_scratch *sc,
             }
     }
 
+    /*
+     * Start the queue off with every region which is already down
+     * to one colour, whether from clues or from a guess made by our
+     * caller.
+     */
+    sc->qhead = sc->qlen = 0;
+    for (i = 0; i < n; i++) {
+        int p = sc->possible[i];
+        sc->queued[i] = FALSE;
+        if (colouring[i] < 0 && (p & (p-1)) == 0) {
+            sc->queue[sc->qlen++] = i;
+            sc->queued[i] = TRUE;
+        }
+    }
+
     /*
      * Now repeatedly loop until we find nothing further to do.
      */
@@ -986,10 +1029,19 @@ static int map_solver(struct solver_scratch *sc,
 
 	/*
 	 * Simplest possible deduction: find a region with only one
-	 * possible colour.
+	 * possible colour. Those are exactly the ones on the queue
+	 * (placing each one can queue more).
 	 */
-	for (i = 0; i < n; i++) if (colouring[i] < 0) {
-	    int p = sc->possible[i];
+	while (sc->qlen > 0) {
+	    int p;
+
+	    i = sc->queue[sc->qhead];
+	    sc->qhead = (sc->qhead + 1) % n;
+	    sc->qlen--;
+	    sc->queued[i] = FALSE;
+	    if (colouring[i] >= 0)
+		continue;
+	    p = sc->possible[i];
 
 	    if (p == 0) {
 #ifdef SOLVER_DIAGNOSTICS
@@ -1077,10 +1129,9 @@ static int map_solver(struct solver_scratch *sc,
              * Go through the neighbours of j1 and see if any are
              * shared with j2.
              */
-            for (j = graph_vertex_start(graph, n, ngraph, j1);
-                 j < ngraph && graph[j] < n*(j1+1); j++) {
+            for (j = vstart[j1]; j < vstart[j1+1]; j++) {
                 k = graph[j] - j1*n;
-                if (graph_adjacent(graph, n, ngraph, k, j2) &&
+                if (graph_adjacent(graph, vstart, n, k, j2) &&
                     (sc->possible[k] & v)) {
 #ifdef SOLVER_DIAGNOSTICS
                     if (verbose) {
@@ -1094,7 +1145,7 @@ static int map_solver(struct solver_scratch *sc,
                                "", colourset(buf, sc->possible[k] & v), k);
                     }
 #endif
-                    sc->possible[k] &= ~v;
+                    rule_out(sc, k, v);
                     done_something = TRUE;
                 }
             }
@@ -1182,8 +1233,7 @@ static int map_solver(struct solver_scratch *sc,
                         /*
                          * Try neighbours of j.
                          */
-                        for (gi = graph_vertex_start(graph, n, ngraph, j);
-                             gi < ngraph && graph[gi] < n*(j+1); gi++) {
+                        for (gi = vstart[j]; gi < vstart[j+1]; gi++) {
                             k = graph[gi] - j*n;
 
                             /*
@@ -1215,7 +1265,7 @@ static int map_solver(struct solver_scratch *sc,
                              * the original colour we ruled out.
                              */
                             if (currc == origc &&
-                                graph_adjacent(graph, n, ngraph, k, i) &&
+                                graph_adjacent(graph, vstart, n, k, i) &&
                                 (sc->possible[k] & currc)) {
 #ifdef SOLVER_DIAGNOSTICS
                                 if (verbose) {
@@ -1234,7 +1284,7 @@ static int map_solver(struct solver_scratch *sc,
                                            colourset(buf, origc), k);
                                 }
 #endif
-                                sc->possible[k] &= ~origc;
+                                rule_out(sc, k, origc);
                                 done_something = TRUE;
                             }
                         }
@@ -1314,7 +1364,7 @@ static int map_solver(struct solver_scratch *sc,
         /*
          * Now iterate over the possible colours for this region.
          */
-        rsc = new_scratch(graph, n, ngraph);
+        rsc = new_scratch(graph, vstart, n, ngraph);
         rsc->depth = sc->depth + 1;
         origcolouring = snewn(n, int);
         memcpy(origcolouring, colouring, n * sizeof(int));
@@ -1397,7 +1447,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 			   char **aux, int interactive)
 {
     struct solver_scratch *sc = NULL;
-    int *map, *graph, ngraph, *colouring, *colouring2, *regions;
+    int *map, *graph, *vstart, ngraph, *colouring, *colouring2, *regions;
     int i, j, w, h, n, solveret, cfreq[FOUR];
     int wh;
     int mindiff, tries;
@@ -1416,6 +1466,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
     map = snewn(wh, int);
     graph = snewn(n*n, int);
+    vstart = snewn(n+1, int);
     colouring = snewn(n, int);
     colouring2 = snewn(n, int);
     regions = snewn(n, int);
@@ -1459,7 +1510,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
         /*
          * Convert the map into a graph.
          */
-        ngraph = gengraph(w, h, n, map, graph);
+        ngraph = gengraph(w, h, n, map, graph, vstart);
 
 #ifdef GENERATION_DIAGNOSTICS
         for (i = 0; i < ngraph; i++)
@@ -1469,7 +1520,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
         /*
          * Colour the map.
          */
-        fourcolour(graph, n, ngraph, colouring, rs);
+        fourcolour(graph, vstart, n, colouring, rs);
 
 #ifdef GENERATION_DIAGNOSTICS
         for (i = 0; i < n; i++)
@@ -1531,7 +1582,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
         shuffle(regions, n, sizeof(*regions), rs);
 
         if (sc) free_scratch(sc);
-        sc = new_scratch(graph, n, ngraph);
+        sc = new_scratch(graph, vstart, n, ngraph);
 
         for (i = 0; i < n; i++) {
             j = regions[i];
@@ -1698,6 +1749,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
     sfree(regions);
     sfree(colouring2);
     sfree(colouring);
+    sfree(vstart);
     sfree(graph);
     sfree(map);
 
@@ -1707,7 +1759,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 static char *parse_edge_list(game_params *params, char **desc, int *map)
 {
     int w = params->w, h = params->h, wh = w*h, n = params->n;
-    int i, k, pos, state;
+    int k, pos, state;
     char *p = *desc;
 
     dsf_init(map+wh, wh);
@@ -1763,15 +1815,7 @@ static char *parse_edge_list(game_params *params, char **desc, int *map)
     /*
      * Now go through again and allocate region numbers.
      */
-    pos = 0;
-    for (i = 0; i < wh; i++)
-	map[i] = -1;
-    for (i = 0; i < wh; i++) {
-	k = dsf_canonify(map+wh, i);
-	if (map[k] < 0)
-	    map[k] = pos++;
-	map[i] = map[k];
-    }
+    pos = dsf_components(map+wh, wh, map, NULL);
     if (pos != n)
 	return "Edge list defines the wrong number of regions";
 
@@ -1836,6 +1880,7 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     state->map->refcount = 1;
     state->map->map = snewn(wh*4, int);
     state->map->graph = snewn(n*n, int);
+    state->map->vstart = snewn(n+1, int);
     state->map->n = n;
     state->map->immutable = snewn(n, int);
     for (i = 0; i < n; i++)
@@ -1875,7 +1920,8 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     }
     assert(pos == n);
 
-    state->map->ngraph = gengraph(w, h, n, state->map->map, state->map->graph);
+    state->map->ngraph = gengraph(w, h, n, state->map->map,
+                                  state->map->graph, state->map->vstart);
 
     /*
      * Attempt to smooth out some of the more jagged region
@@ -2073,9 +2119,9 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
                         if (emin != emax) {
                             /* Graph edge */
                             gindex =
-                                graph_edge_index(state->map->graph, n,
-                                                 state->map->ngraph, emin,
-                                                 emax);
+                                graph_edge_index(state->map->graph,
+                                                 state->map->vstart, n,
+                                                 emin, emax);
                         } else {
                             /* Region number */
                             gindex = state->map->ngraph + emin;
@@ -2136,8 +2182,8 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
 	    if (state->map->edgex[i] < 0) {
 		/* Find the other representation of this edge. */
 		int e = state->map->graph[i];
-		int iprime = graph_edge_index(state->map->graph, n,
-					      state->map->ngraph, e%n, e/n);
+		int iprime = graph_edge_index(state->map->graph,
+					      state->map->vstart, n, e%n, e/n);
 		assert(state->map->edgex[iprime] >= 0);
 		state->map->edgex[i] = state->map->edgex[iprime];
 		state->map->edgey[i] = state->map->edgey[iprime];
@@ -2176,6 +2222,7 @@ static void free_game(game_state *state)
     if (--state->map->refcount <= 0) {
 	sfree(state->map->map);
 	sfree(state->map->graph);
+	sfree(state->map->vstart);
 	sfree(state->map->immutable);
 	sfree(state->map->edgex);
 	sfree(state->map->edgey);
@@ -2205,7 +2252,8 @@ static char *solve_game(game_state *state, game_state *currstate,
 	colouring = snewn(state->map->n, int);
 	memcpy(colouring, state->colouring, state->map->n * sizeof(int));
 
-	sc = new_scratch(state->map->graph, state->map->n, state->map->ngraph);
+	sc = new_scratch(state->map->graph, state->map->vstart,
+			 state->map->n, state->map->ngraph);
 	sret = map_solver(sc, state->map->graph, state->map->n,
 			 state->map->ngraph, colouring, DIFFCOUNT-1);
 	free_scratch(sc);
@@ -3119,7 +3167,8 @@ int main(int argc, char **argv)
     }
     s = new_game(NULL, p, desc);
 
-    sc = new_scratch(s->map->graph, s->map->n, s->map->ngraph);
+    sc = new_scratch(s->map->graph, s->map->vstart,
+                     s->map->n, s->map->ngraph);
 
     /*
      * When solving an Easy puzzle, we don't want to bother the
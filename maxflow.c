@@ -13,26 +13,23 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "maxflow.h"
 
 #include "puzzles.h"		       /* for snewn/sfree */
 
-int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
-			 int ne, const int *edges, const int *backedges,
-			 const int *capacity, int *flow, int *cut)
+/*
+ * Scan the edges array to find the index of the first edge from
+ * each node, and the backedges array to find the index of the first
+ * edge _to_ each node.
+ */
+static void maxflow_setup_firstedges(int nv, int ne, const int *edges,
+				     const int *backedges,
+				     int *firstedge, int *firstbackedge)
 {
-    int *todo = (int *)scratch;
-    int *prev = todo + nv;
-    int *firstedge = todo + 2*nv;
-    int *firstbackedge = todo + 3*nv;
-    int i, j, head, tail, from, to;
-    int totalflow;
+    int i, j;
 
-    /*
-     * Scan the edges array to find the index of the first edge
-     * from each node.
-     */
     j = 0;
     for (i = 0; i < ne; i++)
 	while (j <= edges[2*i])
@@ -41,10 +38,6 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 	firstedge[j++] = ne;
     assert(j == nv);
 
-    /*
-     * Scan the backedges array to find the index of the first edge
-     * _to_ each node.
-     */
     j = 0;
     for (i = 0; i < ne; i++)
 	while (j <= edges[2*backedges[i]+1])
@@ -52,6 +45,21 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
     while (j < nv)
 	firstbackedge[j++] = ne;
     assert(j == nv);
+}
+
+/*
+ * Edmonds-Karp proper, once firstedge and firstbackedge are known.
+ * `scratch' needs room for 2*nv integers.
+ */
+static int maxflow_ek(int *scratch, int nv, int source, int sink,
+		      int ne, const int *edges, const int *backedges,
+		      const int *firstedge, const int *firstbackedge,
+		      const int *capacity, int *flow, int *cut)
+{
+    int *todo = scratch;
+    int *prev = todo + nv;
+    int i, j, head, tail, from, to;
+    int totalflow;
 
     /*
      * Start the flow off at zero on every edge.
@@ -107,7 +115,7 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 	     * currently greater than zero.
 	     */
 	    for (i = firstbackedge[from];
-		 j = backedges[i], i < ne && edges[2*j+1]==from; i++) {
+		 i < ne && (j = backedges[i], edges[2*j+1]==from); i++) {
 		to = edges[2*j];
 		if (to == source || prev[to] >= 0)
 		    continue;
@@ -218,9 +226,217 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
     }
 }
 
+/*
+ * Dinic's algorithm. Each phase does a BFS from the source over the
+ * edges with spare capacity (forwards) or with flow to give back
+ * (backwards), labelling each node with its distance from the
+ * source; then it repeatedly finds paths to the sink which go one
+ * level further at every step, by depth-first search, until no more
+ * flow can be added along such paths. Each node remembers how far
+ * through its edge list the DFS has got, so that no edge is tried
+ * twice in a phase after it has been found useless. The phases stop
+ * when the BFS can no longer reach the sink.
+ *
+ * On a unit-capacity bipartite matching network, such as the ones
+ * latin.c builds, this is the Hopcroft-Karp algorithm, which needs
+ * only about sqrt(nv) phases where Edmonds-Karp needs a BFS per unit
+ * of flow.
+ *
+ * Edges along a path are coded as in Edmonds-Karp above: 2*i for
+ * forward edge i, 2*i+1 for edge i traversed backwards. So edge
+ * code c leads from node edges[c] to node edges[c^1].
+ *
+ * `scratch' needs room for 4*nv integers.
+ */
+static int maxflow_dinic(int *scratch, int nv, int source, int sink,
+			 int ne, const int *edges, const int *backedges,
+			 const int *firstedge, const int *firstbackedge,
+			 const int *capacity, int *flow, int *cut)
+{
+    int *level = scratch;
+    int *todo = level + nv;
+    int *next = todo + nv;	       /* DFS position in each edge list */
+    int *path = next + nv;
+    int i, j, head, tail, from, to, depth;
+    int totalflow;
+
+#define NFWD(v) (((v)+1 < nv ? firstedge[(v)+1] : ne) - firstedge[v])
+#define NBACK(v) (((v)+1 < nv ? firstbackedge[(v)+1] : ne) - firstbackedge[v])
+#define SPARE(c) ( (c) & 1 ? flow[(c)/2] : \
+		   capacity[(c)/2] >= 0 ? capacity[(c)/2] - flow[(c)/2] : -1 )
+
+    for (i = 0; i < ne; i++)
+	flow[i] = 0;
+    totalflow = 0;
+
+    while (1) {
+	/*
+	 * Label the nodes by BFS.
+	 */
+	for (i = 0; i < nv; i++)
+	    level[i] = -1;
+	head = tail = 0;
+	todo[tail++] = source;
+	level[source] = 0;
+	while (head < tail) {
+	    from = todo[head++];
+	    for (i = firstedge[from]; i < ne && edges[2*i] == from; i++) {
+		to = edges[2*i+1];
+		if (level[to] >= 0)
+		    continue;
+		if (capacity[i] >= 0 && flow[i] >= capacity[i])
+		    continue;
+		level[to] = level[from] + 1;
+		todo[tail++] = to;
+	    }
+	    for (i = firstbackedge[from];
+		 i < ne && (j = backedges[i], edges[2*j+1]==from); i++) {
+		to = edges[2*j];
+		if (level[to] >= 0)
+		    continue;
+		if (flow[j] <= 0)
+		    continue;
+		level[to] = level[from] + 1;
+		todo[tail++] = to;
+	    }
+	}
+
+	if (level[sink] < 0)
+	    break;
+
+	/*
+	 * Find paths to the sink through the levels, and push as
+	 * much flow along each as it will take.
+	 */
+	for (i = 0; i < nv; i++)
+	    next[i] = 0;
+	from = source;
+	depth = 0;
+	while (1) {
+	    if (from == sink) {
+		int max = -1;
+
+		for (i = 0; i < depth; i++) {
+		    int spare = SPARE(path[i]);
+		    assert(spare != 0);
+		    if (max < 0 || (spare >= 0 && spare < max))
+			max = spare;
+		}
+		/* as in Edmonds-Karp, no unlimited paths allowed */
+		assert(max > 0);
+
+		for (i = 0; i < depth; i++) {
+		    if (path[i] & 1)
+			flow[path[i] / 2] -= max;
+		    else
+			flow[path[i] / 2] += max;
+		}
+		totalflow += max;
+
+		/*
+		 * Go back to the start of the first edge we've just
+		 * used up, and carry on searching from there.
+		 */
+		for (i = 0; i < depth; i++)
+		    if (SPARE(path[i]) == 0)
+			break;
+		assert(i < depth);
+		depth = i;
+		from = edges[path[depth]];
+		continue;
+	    }
+
+	    /*
+	     * Advance along the next usable edge out of `from', if
+	     * there is one.
+	     */
+	    to = -1;
+	    while (next[from] < NFWD(from) + NBACK(from)) {
+		int c, k = next[from];
+
+		if (k < NFWD(from))
+		    c = 2 * (firstedge[from] + k);
+		else
+		    c = 2 * backedges[firstbackedge[from] + k - NFWD(from)] + 1;
+		if (level[edges[c^1]] == level[from] + 1 && SPARE(c) != 0) {
+		    path[depth++] = c;
+		    to = edges[c^1];
+		    break;
+		}
+		next[from]++;
+	    }
+
+	    if (to >= 0) {
+		from = to;
+		continue;
+	    }
+
+	    /*
+	     * Dead end. Make sure we don't come here again this
+	     * phase, and retreat one step (or finish the phase, if
+	     * we can't get anywhere from the source).
+	     */
+	    level[from] = -1;
+	    if (depth == 0)
+		break;
+	    from = edges[path[--depth]];
+	    next[from]++;
+	}
+    }
+
+#undef NFWD
+#undef NBACK
+#undef SPARE
+
+    /*
+     * The last BFS failed to reach the sink, so the nodes it
+     * labelled form the source side of a minimum cut.
+     */
+    if (cut) {
+	for (i = 0; i < nv; i++)
+	    cut[i] = (level[i] >= 0 ? 0 : 1);
+    }
+    return totalflow;
+}
+
+static int maxflow_run(int algorithm, void *scratch, int nv, int source,
+		       int sink, int ne, const int *edges,
+		       const int *backedges, const int *capacity,
+		       int *flow, int *cut)
+{
+    int *firstedge = (int *)scratch;
+    int *firstbackedge = firstedge + nv;
+    int *rest = firstbackedge + nv;
+
+    maxflow_setup_firstedges(nv, ne, edges, backedges,
+			     firstedge, firstbackedge);
+    if (algorithm == MAXFLOW_DINIC)
+	return maxflow_dinic(rest, nv, source, sink, ne, edges, backedges,
+			     firstedge, firstbackedge, capacity, flow, cut);
+    else
+	return maxflow_ek(rest, nv, source, sink, ne, edges, backedges,
+			  firstedge, firstbackedge, capacity, flow, cut);
+}
+
+int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
+			 int ne, const int *edges, const int *backedges,
+			 const int *capacity, int *flow, int *cut)
+{
+    return maxflow_run(MAXFLOW_EDMONDS_KARP, scratch, nv, source, sink,
+		       ne, edges, backedges, capacity, flow, cut);
+}
+
+int maxflow_dinic_with_scratch(void *scratch, int nv, int source, int sink,
+			       int ne, const int *edges, const int *backedges,
+			       const int *capacity, int *flow, int *cut)
+{
+    return maxflow_run(MAXFLOW_DINIC, scratch, nv, source, sink,
+		       ne, edges, backedges, capacity, flow, cut);
+}
+
 int maxflow_scratch_size(int nv)
 {
-    return (nv * 4) * sizeof(int);
+    return (nv * 6) * sizeof(int);
 }
 
 void maxflow_setup_backedges(int ne, const int *edges, int *backedges)
@@ -383,6 +599,59 @@ int maxflow(int nv, int source, int sink,
     return ret;
 }
 
+struct maxflow_graph {
+    int nv, ne;
+    int *edges, *backedges;
+    int *firstedge, *firstbackedge;
+    int *scratch;
+};
+
+maxflow_graph *maxflow_graph_new(int nv, int ne, const int *edges)
+{
+    maxflow_graph *g = snew(maxflow_graph);
+    int i;
+
+    g->nv = nv;
+    g->ne = ne;
+    g->edges = snewn(2*ne, int);
+    for (i = 0; i < 2*ne; i++)
+	g->edges[i] = edges[i];
+    g->backedges = snewn(ne, int);
+    maxflow_setup_backedges(ne, g->edges, g->backedges);
+    g->firstedge = snewn(nv, int);
+    g->firstbackedge = snewn(nv, int);
+    maxflow_setup_firstedges(nv, ne, g->edges, g->backedges,
+			     g->firstedge, g->firstbackedge);
+    g->scratch = snewn(4*nv, int);
+
+    return g;
+}
+
+void maxflow_graph_free(maxflow_graph *g)
+{
+    sfree(g->edges);
+    sfree(g->backedges);
+    sfree(g->firstedge);
+    sfree(g->firstbackedge);
+    sfree(g->scratch);
+    sfree(g);
+}
+
+int maxflow_graph_run(maxflow_graph *g, int algorithm, int source, int sink,
+		      const int *capacity, int *flow, int *cut)
+{
+    if (algorithm == MAXFLOW_DINIC)
+	return maxflow_dinic(g->scratch, g->nv, source, sink, g->ne,
+			     g->edges, g->backedges,
+			     g->firstedge, g->firstbackedge,
+			     capacity, flow, cut);
+    else
+	return maxflow_ek(g->scratch, g->nv, source, sink, g->ne,
+			  g->edges, g->backedges,
+			  g->firstedge, g->firstbackedge,
+			  capacity, flow, cut);
+}
+
 #ifdef TESTMODE
 
 #define MAXEDGES 256
@@ -406,11 +675,12 @@ int compare_edge(const void *av, const void *bv)
 	return 0;
 }
 
-int main(void)
+static void test_matching(int algorithm)
 {
     int edges[MAXEDGES*2], ne, nv;
     int capacity[MAXEDGES], flow[MAXEDGES], cut[MAXVERTICES];
-    int source, sink, p, q, i, j, ret;
+    int source, sink, p, q, i, ret;
+    maxflow_graph *g;
 
     /*
      * Use this algorithm to find a maximal complete matching in a
@@ -432,7 +702,6 @@ int main(void)
 	capacity[ne] = 1;
 	ADDEDGE(q+i, sink);
     }
-    j = ne;
     capacity[ne] = 1; ADDEDGE(p+0,q+0);
     capacity[ne] = 1; ADDEDGE(p+1,q+0);
     capacity[ne] = 1; ADDEDGE(p+1,q+1);
@@ -444,9 +713,12 @@ int main(void)
     /* capacity[ne] = 1; ADDEDGE(p+2,q+4); */
     qsort(edges, ne, 2*sizeof(int), compare_edge);
 
-    ret = maxflow(nv, source, sink, ne, edges, capacity, flow, cut);
+    g = maxflow_graph_new(nv, ne, edges);
+    ret = maxflow_graph_run(g, algorithm, source, sink, capacity, flow, cut);
+    maxflow_graph_free(g);
 
-    printf("ret = %d\n", ret);
+    printf("%s: ret = %d\n",
+	   algorithm == MAXFLOW_DINIC ? "Dinic" : "Edmonds-Karp", ret);
 
     for (i = 0; i < ne; i++)
 	printf("flow %d: %d -> %d\n", flow[i], edges[2*i], edges[2*i+1]);
@@ -454,6 +726,188 @@ int main(void)
     for (i = 0; i < nv; i++)
 	if (cut[i] == 0)
 	    printf("difficult set includes %d\n", i);
+}
+
+/*
+ * Check that a flow is feasible, that it has the claimed total, and
+ * that the cut is saturated by it, which between them prove the
+ * flow maximal.
+ */
+static void check_flow(int nv, int source, int sink, int ne,
+		       const int *edges, const int *capacity,
+		       const int *flow, const int *cut, int total)
+{
+    int net[MAXVERTICES];
+    int i;
+
+    for (i = 0; i < nv; i++)
+	net[i] = 0;
+    for (i = 0; i < ne; i++) {
+	assert(flow[i] >= 0 && flow[i] <= capacity[i]);
+	net[edges[2*i]] -= flow[i];
+	net[edges[2*i+1]] += flow[i];
+	if (cut[edges[2*i]] == 0 && cut[edges[2*i+1]] == 1)
+	    assert(flow[i] == capacity[i]);
+	if (cut[edges[2*i]] == 1 && cut[edges[2*i+1]] == 0)
+	    assert(flow[i] == 0);
+    }
+    for (i = 0; i < nv; i++)
+	if (i != source && i != sink)
+	    assert(net[i] == 0);
+    assert(net[sink] == total && net[source] == -total);
+    assert(cut[source] == 0 && cut[sink] == 1);
+}
+
+/*
+ * Run both algorithms on random networks, and check they agree.
+ */
+static void test_random(int count)
+{
+    int edges[MAXEDGES*2], ne, nv;
+    int capacity[MAXEDGES], flow[MAXEDGES], cut[MAXVERTICES];
+    int t, i, j, k, ek, dinic;
+
+    srand(1);
+    for (t = 0; t < count; t++) {
+	maxflow_graph *g;
+
+	nv = 2 + rand() % 30;
+	ne = 0;
+	for (i = 0; i < nv; i++)
+	    for (j = 0; j < nv; j++)
+		if (i != j && ne < MAXEDGES && rand() % 4 == 0)
+		    ADDEDGE(i, j);      /* generated in sorted order */
+	for (k = 0; k < ne; k++)
+	    capacity[k] = rand() % 5;
+
+	g = maxflow_graph_new(nv, ne, edges);
+	ek = maxflow_graph_run(g, MAXFLOW_EDMONDS_KARP, 0, nv-1,
+			       capacity, flow, cut);
+	check_flow(nv, 0, nv-1, ne, edges, capacity, flow, cut, ek);
+	dinic = maxflow_graph_run(g, MAXFLOW_DINIC, 0, nv-1,
+				  capacity, flow, cut);
+	check_flow(nv, 0, nv-1, ne, edges, capacity, flow, cut, dinic);
+	maxflow_graph_free(g);
+
+	if (ek != dinic) {
+	    printf("random network %d: Edmonds-Karp %d, Dinic %d\n",
+		   t, ek, dinic);
+	    exit(1);
+	}
+    }
+    printf("%d random networks: both algorithms agree\n", count);
+}
+
+#include <time.h>
+
+/*
+ * Generate `count' latin squares of order o row by row, the way
+ * latin_generate() does, using the given algorithm. If g is NULL,
+ * use maxflow_with_scratch (which rebuilds its edge indices on every
+ * call) instead.
+ */
+static void bench_latin(int o, int count, int algorithm, int usegraph)
+{
+    int nv = 2*o + 2, ne = o*o + 2*o;
+    int *edges = snewn(2*ne, int), *backedges = snewn(ne, int);
+    int *capacity = snewn(ne, int), *flow = snewn(ne, int);
+    int *col = snewn(o, int), *num = snewn(o, int);
+    unsigned char *used = snewn(o*o, unsigned char);
+    void *scratch = smalloc(maxflow_scratch_size(nv));
+    maxflow_graph *g;
+    int i, j, k, n, sq;
+
+    /* Edges in sorted order: LHS to RHS, RHS to sink, source to LHS. */
+    ne = 0;
+    for (i = 0; i < o; i++)
+	for (j = 0; j < o; j++)
+	    ADDEDGE(i, o+j);
+    for (i = 0; i < o; i++) {
+	capacity[ne] = 1;
+	ADDEDGE(o+i, 2*o+1);
+    }
+    for (i = 0; i < o; i++) {
+	capacity[ne] = 1;
+	ADDEDGE(2*o, i);
+    }
+    maxflow_setup_backedges(ne, edges, backedges);
+    g = maxflow_graph_new(nv, ne, edges);
+
+    srand(o);
+    for (sq = 0; sq < count; sq++) {
+	memset(used, 0, o*o);
+	for (i = 0; i < o; i++) {
+	    /* Shuffle columns and digits, as latin_generate does. */
+	    for (j = 0; j < o; j++)
+		col[j] = num[j] = j;
+	    for (j = o; j > 1; j--) {
+		int t;
+		k = rand() % j;
+		t = col[k]; col[k] = col[j-1]; col[j-1] = t;
+		k = rand() % j;
+		t = num[k]; num[k] = num[j-1]; num[j-1] = t;
+	    }
+	    for (k = 0; k < o; k++)
+		for (n = 0; n < o; n++)
+		    capacity[k*o+n] = !used[col[k]*o + num[n]];
+
+	    if (usegraph)
+		j = maxflow_graph_run(g, algorithm, 2*o, 2*o+1,
+				      capacity, flow, NULL);
+	    else
+		j = maxflow_run(algorithm, scratch, nv, 2*o, 2*o+1, ne,
+				edges, backedges, capacity, flow, NULL);
+	    assert(j == o);
+
+	    for (k = 0; k < o; k++)
+		for (n = 0; n < o; n++)
+		    if (flow[k*o+n]) {
+			assert(!used[col[k]*o + num[n]]);
+			used[col[k]*o + num[n]] = 1;
+		    }
+	}
+    }
+
+    maxflow_graph_free(g);
+    sfree(scratch);
+    sfree(used);
+    sfree(num);
+    sfree(col);
+    sfree(flow);
+    sfree(capacity);
+    sfree(backedges);
+    sfree(edges);
+}
+
+static double bench_time(int o, int count, int algorithm, int usegraph)
+{
+    clock_t start = clock();
+    bench_latin(o, count, algorithm, usegraph);
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e6 / (count * o);
+}
+
+int main(int argc, char **argv)
+{
+    int o;
+
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+	int count = argc > 2 ? atoi(argv[2]) : 20;
+
+	printf("order   us per latin-square row\n"
+	       "        Edmonds-Karp  Edmonds-Karp  Dinic\n"
+	       "        (rebuilt)     (graph)       (graph)\n");
+	for (o = 9; o <= 32; o++) {
+	    double ekr = bench_time(o, count, MAXFLOW_EDMONDS_KARP, FALSE);
+	    double ekg = bench_time(o, count, MAXFLOW_EDMONDS_KARP, TRUE);
+	    double dg = bench_time(o, count, MAXFLOW_DINIC, TRUE);
+	    printf("%5d %12.2f %13.2f %8.2f\n", o, ekr, ekg, dg);
+	}
+	return 0;
+    }
+
+    test_matching(MAXFLOW_EDMONDS_KARP);
+    test_matching(MAXFLOW_DINIC);
+    test_random(10000);
 
     return 0;
 }
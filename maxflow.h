@@ -67,7 +67,20 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 			 const int *capacity, int *flow, int *cut);
 
 /*
- * The above function expects its `scratch' and `backedges'
+ * A second algorithm behind the same interface: Dinic's algorithm,
+ * which finds augmenting paths a whole level graph at a time rather
+ * than one BFS per path. It gives the same total flow (and a valid
+ * cut), but not necessarily the same flow on each edge, so callers
+ * whose output depends on exactly which flow is found will see
+ * different results from the two.
+ */
+enum { MAXFLOW_EDMONDS_KARP, MAXFLOW_DINIC };
+int maxflow_dinic_with_scratch(void *scratch, int nv, int source, int sink,
+			       int ne, const int *edges, const int *backedges,
+			       const int *capacity, int *flow, int *cut);
+
+/*
+ * The above functions expect their `scratch' and `backedges'
  * parameters to have already been set up. This allows you to set
  * them up once and use them in multiple invocates of the
  * algorithm. Now I provide functions to actually do the setting
@@ -92,4 +105,19 @@ int maxflow(int nv, int source, int sink,
 	    int ne, const int *edges, const int *capacity,
 	    int *flow, int *cut);
 
+/*
+ * For running the algorithm many times on one network with
+ * different capacities: a graph handle, made from `nv' and
+ * `edges' as above (the edges are copied), which keeps the
+ * backedges array, the per-node edge indices and the scratch space
+ * between runs. `algorithm' is MAXFLOW_EDMONDS_KARP or
+ * MAXFLOW_DINIC; the other parameters and the return value are as
+ * for maxflow_with_scratch.
+ */
+typedef struct maxflow_graph maxflow_graph;
+maxflow_graph *maxflow_graph_new(int nv, int ne, const int *edges);
+int maxflow_graph_run(maxflow_graph *g, int algorithm, int source, int sink,
+		      const int *capacity, int *flow, int *cut);
+void maxflow_graph_free(maxflow_graph *g);
+
 #endif /* MAXFLOW_MAXFLOW_H */
@@ -19,12 +19,114 @@ enum { NEWGAME, MOVE, SOLVE, RESTART };/* for midend_state_entry.movetype */
 
 #define special(type) ( (type) != MOVE )
 
+/*
+ * The undo chain doesn't keep every game_state it has seen. Only
+ * entries whose index is a multiple of `snapshot_interval', and
+ * entries which aren't ordinary moves (NEWGAME, SOLVE and RESTART,
+ * which are rare and not always cheap to redo), keep their state
+ * permanently; for the rest, `state' may be NULL and is rebuilt on
+ * demand by replaying the move strings forward from the nearest
+ * earlier state (see midend_state). The entries either side of the
+ * current position are always kept, since undo, redo and animation
+ * all look at them.
+ *
+ * Any other state which isn't a snapshot but is currently held lies
+ * in the range of indices from `trim_lo' up to (but not including)
+ * `trim_hi', so tidying up after a move only has to look there
+ * rather than along the whole chain.
+ *
+ * This relies on execute_move being deterministic, which
+ * serialisation already requires.
+ */
+#define DEFAULT_SNAPSHOT_INTERVAL 16
+
 struct midend_state_entry {
-    game_state *state;
+    game_state *state;		       /* may be NULL; see above */
     char *movestr;
     int movetype;
 };
 
+/*
+ * Background generation. While a game is being played, a worker
+ * thread generates the next few games for the same parameters, so
+ * that `New game' can usually just take one off the queue. The
+ * queue is bounded both in number of entries and (roughly) in the
+ * memory its strings take up.
+ *
+ * Everything below `lock' is shared with the worker thread, and
+ * only touched with the lock held. Once `stop' is set, the worker
+ * owns the queue: it throws away everything on it, including the
+ * game it was in the middle of, and sets `finished' just before it
+ * exits.
+ */
+struct pregen_entry {
+    char *seedstr, *desc, *aux_info;
+    int size;
+};
+
+struct pregen {
+    const game *ourgame;
+    game_params *params;	       /* the worker's own copy */
+    char *paramstr;		       /* encoded, to match against */
+    int interactive;
+    fe_thread *thread;
+
+    fe_mutex *lock;
+    fe_cond *cond;		       /* signalled on a pop or a stop */
+    random_state *rs;		       /* for making seeds */
+    int random_kind;		       /* ... and what kind they are */
+    struct pregen_entry *entries;
+    int nentries, maxentries;
+    int bytes, maxbytes, lastsize;
+    int stop, finished;
+
+    struct pregen *next;	       /* on the stale_pregens list */
+};
+
+/*
+ * Generation races. Generators which loop `generate, solve,
+ * reject' take wildly different times from one seed to the next,
+ * so on a machine with spare cores it pays to start several on
+ * different seeds and take whichever finishes first. Worker 0 uses
+ * the midend's own seed and worker k>0 uses that seed with `.k'
+ * appended; the winner's seed becomes the game's seed, so the game
+ * ID still regenerates the same puzzle.
+ *
+ * There's no way to interrupt a generator, so the losers are left
+ * to run to completion and are tidied up later by
+ * midend_reap_workers. `done', `desc' and `aux_info' are shared
+ * with the worker and only touched with the race's lock held.
+ */
+struct race_worker {
+    struct race *race;
+    fe_thread *thread;
+    game_params *params;	       /* the worker's own copy */
+    char *seedstr, *desc, *aux_info;
+    int done, joined;
+};
+
+struct race {
+    const game *ourgame;
+    int interactive;
+    fe_mutex *lock;
+    fe_cond *cond;		       /* signalled when a worker finishes */
+    struct race_worker *workers;
+    int nworkers, winner;
+    struct race *next;		       /* on the stale_races list */
+};
+
+/*
+ * Background generators which have been stopped, and races whose
+ * losers were still running when the winner came in. A generator
+ * can't be interrupted, so rather than wait for these to finish,
+ * we leave them to it and free them in midend_reap_workers once
+ * they have. They're not kept in the midend, because a midend may
+ * well be freed before its workers are done. Like everything else
+ * in the midend, they're only touched from the front end's thread.
+ */
+static struct pregen *stale_pregens = NULL;
+static struct race *stale_races = NULL;
+
 struct midend {
     frontend *frontend;
     random_state *random;
@@ -62,6 +164,14 @@ struct midend {
 
     int nstates, statesize, statepos;
     struct midend_state_entry *states;
+    int snapshot_interval;
+    int trim_lo, trim_hi;	       /* see midend_trim_states */
+
+    struct pregen *pregen;
+    int pregen_entries, pregen_bytes;
+
+    int race_workers;
+    int random_kind;		       /* for new random seeds */
 
     game_params *params, *curparams;
     game_drawstate *drawstate;
@@ -85,7 +195,7 @@ struct midend {
 
 #define ensure(me) do { \
     if ((me)->nstates >= (me)->statesize) { \
-	(me)->statesize = (me)->nstates + 128; \
+	(me)->statesize = (me)->nstates + (me)->nstates / 2 + 128; \
 	(me)->states = sresize((me)->states, (me)->statesize, \
                                struct midend_state_entry); \
     } \
@@ -105,6 +215,12 @@ midend *midend_new(frontend *fe, const game *ourgame,
     me->random = random_new(randseed, randseedsize);
     me->nstates = me->statesize = me->statepos = 0;
     me->states = NULL;
+    me->snapshot_interval = DEFAULT_SNAPSHOT_INTERVAL;
+    me->trim_lo = me->trim_hi = 0;
+    me->pregen = NULL;
+    me->pregen_entries = me->pregen_bytes = 0;
+    me->race_workers = 1;
+    me->random_kind = RANDOM_SHA1;
     me->params = ourgame->default_params();
     me->curparams = NULL;
     me->desc = me->privdesc = NULL;
@@ -156,13 +272,570 @@ midend *midend_new(frontend *fe, const game *ourgame,
     return me;
 }
 
-static void midend_free_game(midend *me)
+static int midend_is_snapshot(midend *me, int i)
 {
-    while (me->nstates > 0) {
-        me->nstates--;
-	me->ourgame->free_game(me->states[me->nstates].state);
+    return (i % me->snapshot_interval == 0 ||
+	    me->states[i].movetype != MOVE);
+}
+
+/*
+ * Returns the game state at position `i' in the undo chain,
+ * reconstructing it if it isn't currently held. Of the states
+ * replayed on the way, only the last two before `i' are kept (the
+ * caller usually wants those next); they and `i' itself stay
+ * around until the next call to midend_trim_states.
+ */
+static game_state *midend_state(midend *me, int i)
+{
+    int j, start;
+
+    assert(i >= 0 && i < me->nstates);
+    if (me->states[i].state)
+	return me->states[i].state;
+
+    for (start = i; !me->states[start].state; start--)
+	assert(start > 0);	       /* states[0] is always kept */
+    for (j = start+1; j <= i; j++) {
+	assert(me->states[j].movetype == MOVE);
+	me->states[j].state =
+	    me->ourgame->execute_move(me->states[j-1].state,
+				      me->states[j].movestr);
+	assert(me->states[j].state);
+	if (j-1 > start && j-1 < i-2 && !midend_is_snapshot(me, j-1)) {
+	    me->ourgame->free_game(me->states[j-1].state);
+	    me->states[j-1].state = NULL;
+	}
+    }
+
+    me->trim_lo = min(me->trim_lo, max(start+1, i-2));
+    me->trim_hi = max(me->trim_hi, i+1);
+
+    return me->states[i].state;
+}
+
+/*
+ * Throws away the game states we can rebuild from the move strings
+ * and don't expect to need soon. Only the range recorded in
+ * trim_lo and trim_hi (plus the positions either side of the
+ * current one, where new states turn up) is looked at, so this
+ * costs a few entries per move however long the chain is.
+ */
+static void midend_trim_states(midend *me)
+{
+    int i, lo, hi;
+
+    lo = max(min(me->trim_lo, me->statepos - 2), 0);
+    hi = min(max(me->trim_hi, me->statepos + 1), me->nstates);
+    for (i = lo; i < hi; i++) {
+	if (i >= me->statepos - 2 && i <= me->statepos)
+	    continue;
+	if (me->states[i].state && !midend_is_snapshot(me, i)) {
+	    me->ourgame->free_game(me->states[i].state);
+	    me->states[i].state = NULL;
+	}
+    }
+
+    me->trim_lo = max(me->statepos - 2, 0);
+    me->trim_hi = me->statepos + 1;
+}
+
+/*
+ * As midend_trim_states, but looks along the whole chain, for when
+ * every state may have changed.
+ */
+static void midend_trim_all_states(midend *me)
+{
+    me->trim_lo = 0;
+    me->trim_hi = me->nstates;
+    midend_trim_states(me);
+}
+
+/*
+ * Discards the end of the undo chain, from position `n' onwards.
+ */
+static void midend_truncate_states(midend *me, int n)
+{
+    while (me->nstates > n) {
+	me->nstates--;
+	if (me->states[me->nstates].state)
+	    me->ourgame->free_game(me->states[me->nstates].state);
 	sfree(me->states[me->nstates].movestr);
     }
+}
+
+void midend_set_undo_snapshot_interval(midend *me, int interval)
+{
+    int i;
+
+    me->snapshot_interval = max(interval, 1);
+
+    /*
+     * Make sure every entry which should now be a snapshot has its
+     * state, and drop the ones which no longer need to.
+     */
+    for (i = 0; i < me->nstates; i++)
+	if (midend_is_snapshot(me, i))
+	    midend_state(me, i);
+    midend_trim_all_states(me);
+}
+
+/*
+ * Makes a new random seed string. 15 digits comes to about 48
+ * bits, which should be more than enough.
+ *
+ * I'll avoid putting a leading zero on the number, just in case it
+ * confuses anybody who thinks it's processed as an integer rather
+ * than a string.
+ *
+ * A seed for the fast random number generator has a `~' in front,
+ * which is how random_new knows to use it; so the game ID still
+ * says everything needed to regenerate the game. So the full
+ * grammar of a seed the midend generates is an optional `~'
+ * followed by fifteen digits, and a seed typed by the user may be
+ * any string at all.
+ */
+static char *midend_new_seed(random_state *rs, int kind)
+{
+    char newseed[17], *p = newseed;
+    int i;
+
+    if (kind == RANDOM_FAST)
+	*p++ = '~';
+    p[15] = '\0';
+    p[0] = '1' + (char)random_upto(rs, 9);
+    for (i = 1; i < 15; i++)
+	p[i] = '0' + (char)random_upto(rs, 10);
+    assert(random_seed_kind(newseed, strlen(newseed)) == kind);
+    return dupstr(newseed);
+}
+
+/*
+ * Makes a copy of the current parameters for a generator thread.
+ * This goes via the encoded form rather than dup_params, because
+ * some games' dup_params share substructure between the copies
+ * (Loopy's grid, for instance) with unlocked reference counts.
+ */
+static game_params *midend_thread_params(midend *me)
+{
+    game_params *params = me->ourgame->default_params();
+    char *paramstr = me->ourgame->encode_params(me->params, TRUE);
+
+    me->ourgame->decode_params(params, paramstr);
+    sfree(paramstr);
+    return params;
+}
+
+static int pregen_full(struct pregen *pg)
+{
+    return (pg->nentries >= pg->maxentries ||
+	    (pg->nentries > 0 && pg->bytes + pg->lastsize > pg->maxbytes));
+}
+
+static int pregen_thread(void *ctx)
+{
+    struct pregen *pg = (struct pregen *)ctx;
+    struct pregen_entry *e;
+    char *seedstr, *desc, *aux_info;
+    random_state *rs;
+    int i;
+
+    fe_mutex_lock(pg->lock);
+    while (1) {
+	while (!pg->stop && pregen_full(pg))
+	    fe_cond_wait(pg->cond, pg->lock);
+	if (pg->stop)
+	    break;
+	seedstr = midend_new_seed(pg->rs, pg->random_kind);
+	fe_mutex_unlock(pg->lock);
+
+	/*
+	 * This is the slow bit, so it's done without the lock. It
+	 * uses nothing the main thread can change.
+	 */
+	rs = random_new(seedstr, strlen(seedstr));
+	aux_info = NULL;
+	desc = pg->ourgame->new_desc(pg->params, rs, &aux_info,
+				     pg->interactive);
+	random_free(rs);
+
+	fe_mutex_lock(pg->lock);
+	if (pg->stop) {
+	    sfree(seedstr);
+	    sfree(desc);
+	    sfree(aux_info);
+	    break;
+	}
+	e = &pg->entries[pg->nentries++];
+	e->seedstr = seedstr;
+	e->desc = desc;
+	e->aux_info = aux_info;
+	e->size = sizeof(*e) + strlen(seedstr) + strlen(desc) + 2 +
+	    (aux_info ? strlen(aux_info) + 1 : 0);
+	pg->bytes += e->size;
+	pg->lastsize = e->size;
+    }
+
+    debug(("pregen: stopped with %d games queued\n", pg->nentries));
+
+    for (i = 0; i < pg->nentries; i++) {
+	sfree(pg->entries[i].seedstr);
+	sfree(pg->entries[i].desc);
+	sfree(pg->entries[i].aux_info);
+    }
+    pg->nentries = 0;
+    pg->finished = TRUE;
+    fe_mutex_unlock(pg->lock);
+
+    return 0;
+}
+
+static void pregen_free(struct pregen *pg)
+{
+    sfree(pg->entries);
+    random_free(pg->rs);
+    fe_cond_free(pg->cond);
+    fe_mutex_free(pg->lock);
+    pg->ourgame->free_params(pg->params);
+    sfree(pg->paramstr);
+    sfree(pg);
+}
+
+/*
+ * Stops the background generator, if any, and throws away what it
+ * had generated. This doesn't wait: if the worker is in the middle
+ * of a game, it finishes it, throws it away and exits on its own,
+ * and midend_reap_workers tidies up after it.
+ */
+static void midend_pregen_stop(midend *me)
+{
+    struct pregen *pg = me->pregen;
+
+    if (!pg)
+	return;
+
+    fe_mutex_lock(pg->lock);
+    pg->stop = TRUE;
+    fe_cond_signal(pg->cond);
+    fe_mutex_unlock(pg->lock);
+
+    pg->next = stale_pregens;
+    stale_pregens = pg;
+    me->pregen = NULL;
+}
+
+/*
+ * Frees the stopped background generators and past races which
+ * have finished by now, without waiting for any which haven't.
+ * (fe_thread_wait only waits for a worker to return from the
+ * function that has just said it's done.) Returns the number of
+ * losing race workers still running.
+ */
+static int midend_reap_workers(void)
+{
+    struct pregen **pgprev = &stale_pregens, *pg;
+    struct race **prev = &stale_races, *race;
+    int i, done, running, total = 0;
+
+    while ((pg = *pgprev) != NULL) {
+	fe_mutex_lock(pg->lock);
+	done = pg->finished;
+	fe_mutex_unlock(pg->lock);
+	if (!done) {
+	    pgprev = &pg->next;
+	    continue;
+	}
+	*pgprev = pg->next;
+	fe_thread_wait(pg->thread);
+	pregen_free(pg);
+    }
+
+    while ((race = *prev) != NULL) {
+	running = 0;
+	for (i = 0; i < race->nworkers; i++) {
+	    struct race_worker *w = &race->workers[i];
+
+	    if (w->joined)
+		continue;
+	    fe_mutex_lock(race->lock);
+	    done = w->done;
+	    fe_mutex_unlock(race->lock);
+	    if (!done) {
+		running++;
+		continue;
+	    }
+	    fe_thread_wait(w->thread);
+	    w->joined = TRUE;
+	    sfree(w->seedstr);
+	    sfree(w->desc);
+	    sfree(w->aux_info);
+	    race->ourgame->free_params(w->params);
+	}
+
+	if (running) {
+	    total += running;
+	    prev = &race->next;
+	    continue;
+	}
+	*prev = race->next;
+	fe_cond_free(race->cond);
+	fe_mutex_free(race->lock);
+	sfree(race->workers);
+	sfree(race);
+    }
+
+    return total;
+}
+
+/*
+ * Stops the background generator if it's generating for anything
+ * other than the current parameters.
+ */
+static void midend_pregen_check_params(midend *me)
+{
+    char *paramstr;
+
+    if (!me->pregen)
+	return;
+
+    paramstr = me->ourgame->encode_params(me->params, TRUE);
+    if (strcmp(paramstr, me->pregen->paramstr))
+	midend_pregen_stop(me);
+    sfree(paramstr);
+}
+
+/*
+ * Makes sure the background generator is running for the current
+ * parameters, if it's been asked for at all.
+ */
+static void midend_pregen_start(midend *me)
+{
+    struct pregen *pg;
+    char *seedstr;
+
+    midend_reap_workers();
+    midend_pregen_check_params(me);
+    if (me->pregen || me->pregen_entries <= 0)
+	return;
+
+    pg = snew(struct pregen);
+    pg->ourgame = me->ourgame;
+    pg->params = midend_thread_params(me);
+    pg->paramstr = me->ourgame->encode_params(me->params, TRUE);
+    pg->interactive = (me->drawing != NULL);
+    seedstr = midend_new_seed(me->random, RANDOM_SHA1);
+    pg->rs = random_new(seedstr, strlen(seedstr));
+    pg->random_kind = me->random_kind;
+    sfree(seedstr);
+    pg->entries = snewn(me->pregen_entries, struct pregen_entry);
+    pg->nentries = 0;
+    pg->maxentries = me->pregen_entries;
+    pg->bytes = pg->lastsize = 0;
+    pg->maxbytes = me->pregen_bytes;
+    pg->stop = pg->finished = FALSE;
+    pg->lock = fe_mutex_new();
+    pg->cond = fe_cond_new();
+
+    pg->thread = fe_thread_start(pregen_thread, pg);
+    if (!pg->thread) {
+	/* No threads on this platform; never mind. */
+	pregen_free(pg);
+	return;
+    }
+
+    me->pregen = pg;
+}
+
+/*
+ * Takes the next pre-generated game off the queue, if there is one
+ * for the current parameters, and makes it the midend's new game
+ * description. Returns FALSE if the caller will have to generate
+ * one itself.
+ */
+static int midend_pregen_pop(midend *me)
+{
+    struct pregen *pg;
+    struct pregen_entry e;
+
+    midend_pregen_check_params(me);
+    if (!(pg = me->pregen))
+	return FALSE;
+
+    fe_mutex_lock(pg->lock);
+    if (pg->nentries == 0) {
+	fe_mutex_unlock(pg->lock);
+	return FALSE;
+    }
+    e = pg->entries[0];
+    pg->nentries--;
+    memmove(pg->entries, pg->entries + 1,
+	    pg->nentries * sizeof(struct pregen_entry));
+    pg->bytes -= e.size;
+    fe_cond_signal(pg->cond);
+    fe_mutex_unlock(pg->lock);
+
+    sfree(me->seedstr);
+    me->seedstr = e.seedstr;
+    sfree(me->desc);
+    me->desc = e.desc;
+    sfree(me->privdesc);
+    me->privdesc = NULL;
+    sfree(me->aux_info);
+    me->aux_info = e.aux_info;
+    if (me->curparams)
+	me->ourgame->free_params(me->curparams);
+    me->curparams = me->ourgame->dup_params(me->params);
+
+    return TRUE;
+}
+
+void midend_set_pregen(midend *me, int nentries, int maxbytes)
+{
+    midend_pregen_stop(me);
+    me->pregen_entries = nentries;
+    me->pregen_bytes = maxbytes;
+    if (me->nstates > 0)
+	midend_pregen_start(me);
+}
+
+static int race_thread(void *ctx)
+{
+    struct race_worker *w = (struct race_worker *)ctx;
+    struct race *race = w->race;
+    char *desc, *aux_info = NULL;
+    random_state *rs;
+
+    rs = random_new(w->seedstr, strlen(w->seedstr));
+    desc = race->ourgame->new_desc(w->params, rs, &aux_info,
+				   race->interactive);
+    random_free(rs);
+
+    fe_mutex_lock(race->lock);
+    w->desc = desc;
+    w->aux_info = aux_info;
+    w->done = TRUE;
+    if (race->winner < 0)
+	race->winner = w - race->workers;
+    fe_cond_signal(race->cond);
+    fe_mutex_unlock(race->lock);
+
+    return 0;
+}
+
+/*
+ * Generates a new game for the current parameters by racing
+ * several generators against each other, and makes the winner the
+ * midend's new game description. Returns FALSE, having done
+ * nothing, if racing isn't enabled or no threads could be started.
+ *
+ * Losers of earlier races which are still running count against
+ * the number of workers, so that however quickly the user asks for
+ * new games, there are never more than race_workers generators
+ * racing at once. If that leaves room for fewer than two, there's
+ * no point in racing.
+ */
+static int midend_race(midend *me)
+{
+    struct race *race;
+    struct race_worker *w;
+    char *seedstr;
+    int n, nworkers;
+
+    nworkers = me->race_workers - midend_reap_workers();
+    if (nworkers <= 1)
+	return FALSE;
+
+    seedstr = midend_new_seed(me->random, me->random_kind);
+    race = snew(struct race);
+    race->ourgame = me->ourgame;
+    race->interactive = (me->drawing != NULL);
+    race->lock = fe_mutex_new();
+    race->cond = fe_cond_new();
+    race->workers = snewn(nworkers, struct race_worker);
+    race->winner = -1;
+
+    fe_mutex_lock(race->lock);
+    for (n = 0; n < nworkers; n++) {
+	w = &race->workers[n];
+	w->race = race;
+	w->params = midend_thread_params(me);
+	if (n == 0) {
+	    w->seedstr = dupstr(seedstr);
+	} else {
+	    w->seedstr = snewn(strlen(seedstr) + 16, char);
+	    sprintf(w->seedstr, "%s.%d", seedstr, n);
+	}
+	w->desc = w->aux_info = NULL;
+	w->done = w->joined = FALSE;
+	w->thread = fe_thread_start(race_thread, w);
+	if (!w->thread) {
+	    sfree(w->seedstr);
+	    me->ourgame->free_params(w->params);
+	    break;
+	}
+    }
+    race->nworkers = n;
+    sfree(seedstr);
+
+    if (n == 0) {
+	/* No threads on this platform; never mind. */
+	fe_mutex_unlock(race->lock);
+	fe_cond_free(race->cond);
+	fe_mutex_free(race->lock);
+	sfree(race->workers);
+	sfree(race);
+	return FALSE;
+    }
+
+    while (race->winner < 0)
+	fe_cond_wait(race->cond, race->lock);
+    w = &race->workers[race->winner];
+
+    sfree(me->seedstr);
+    me->seedstr = w->seedstr;
+    sfree(me->desc);
+    me->desc = w->desc;
+    sfree(me->privdesc);
+    me->privdesc = NULL;
+    sfree(me->aux_info);
+    me->aux_info = w->aux_info;
+    w->seedstr = w->desc = w->aux_info = NULL;
+    fe_mutex_unlock(race->lock);
+
+    debug(("race: worker %d of %d won with seed %s\n",
+	   race->winner, race->nworkers, me->seedstr));
+
+    if (me->curparams)
+	me->ourgame->free_params(me->curparams);
+    me->curparams = me->ourgame->dup_params(me->params);
+
+    race->next = stale_races;
+    stale_races = race;
+    midend_reap_workers();
+
+    return TRUE;
+}
+
+void midend_set_race_workers(midend *me, int nworkers)
+{
+    me->race_workers = nworkers;
+}
+
+/*
+ * Chooses the random number generator for new random games. Games
+ * already queued by the background generator were made with the
+ * other one, so they're thrown away.
+ */
+void midend_set_random_kind(midend *me, int kind)
+{
+    assert(kind == RANDOM_SHA1 || kind == RANDOM_FAST);
+    if (kind != me->random_kind)
+	midend_pregen_stop(me);
+    me->random_kind = kind;
+}
+
+static void midend_free_game(midend *me)
+{
+    midend_truncate_states(me, 0);
 
     if (me->drawstate)
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
@@ -172,6 +845,8 @@ void midend_free(midend *me)
 {
     int i;
 
+    midend_pregen_stop(me);
+    midend_reap_workers();
     midend_free_game(me);
 
     if (me->drawing)
@@ -228,7 +903,7 @@ void midend_size(midend *me, int *x, int *y, int user_size)
     if (me->drawstate && me->tilesize > 0) {
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
         me->drawstate = me->ourgame->new_drawstate(me->drawing,
-                                                   me->states[0].state);
+                                                   midend_state(me, 0));
     }
 
     /*
@@ -284,6 +959,7 @@ void midend_set_params(midend *me, game_params *params)
 {
     me->ourgame->free_params(me->params);
     me->params = me->ourgame->dup_params(params);
+    midend_pregen_check_params(me);
 }
 
 game_params *midend_get_params(midend *me)
@@ -294,7 +970,7 @@ game_params *midend_get_params(midend *me)
 static void midend_set_timer(midend *me)
 {
     me->timing = (me->ourgame->is_timed &&
-		  me->ourgame->timing_state(me->states[me->statepos-1].state,
+		  me->ourgame->timing_state(midend_state(me, me->statepos-1),
 					    me->ui));
     if (me->timing || me->flash_time || me->anim_time)
 	activate_timer(me->frontend);
@@ -307,7 +983,7 @@ void midend_force_redraw(midend *me)
     if (me->drawstate)
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
     me->drawstate = me->ourgame->new_drawstate(me->drawing,
-					       me->states[0].state);
+					       midend_state(me, 0));
     midend_size_new_drawstate(me);
     midend_redraw(me);
 }
@@ -320,28 +996,22 @@ void midend_new_game(midend *me)
 
     if (me->genmode == GOT_DESC) {
 	me->genmode = GOT_NOTHING;
+    } else if (me->genmode != GOT_SEED && midend_pregen_pop(me)) {
+	/*
+	 * The background generator has already done the work.
+	 */
+    } else if (me->genmode != GOT_SEED && midend_race(me)) {
+	/*
+	 * So has the fastest of several racing generators.
+	 */
     } else {
         random_state *rs;
 
         if (me->genmode == GOT_SEED) {
             me->genmode = GOT_NOTHING;
         } else {
-            /*
-             * Generate a new random seed. 15 digits comes to about
-             * 48 bits, which should be more than enough.
-             * 
-             * I'll avoid putting a leading zero on the number,
-             * just in case it confuses anybody who thinks it's
-             * processed as an integer rather than a string.
-             */
-            char newseed[16];
-            int i;
-            newseed[15] = '\0';
-            newseed[0] = '1' + (char)random_upto(me->random, 9);
-            for (i = 1; i < 15; i++)
-                newseed[i] = '0' + (char)random_upto(me->random, 10);
             sfree(me->seedstr);
-            me->seedstr = dupstr(newseed);
+            me->seedstr = midend_new_seed(me->random, me->random_kind);
 
 	    if (me->curparams)
 		me->ourgame->free_params(me->curparams);
@@ -409,14 +1079,19 @@ void midend_new_game(midend *me)
     me->nstates++;
     me->statepos = 1;
     me->drawstate = me->ourgame->new_drawstate(me->drawing,
-					       me->states[0].state);
+					       midend_state(me, 0));
     midend_size_new_drawstate(me);
     me->elapsed = 0.0F;
     if (me->ui)
         me->ourgame->free_ui(me->ui);
-    me->ui = me->ourgame->new_ui(me->states[0].state);
+    me->ui = me->ourgame->new_ui(midend_state(me, 0));
     midend_set_timer(me);
     me->pressed_mouse_button = 0;
+
+    /*
+     * Now get on with the next one while this one's being played.
+     */
+    midend_pregen_start(me);
 }
 
 static int midend_undo(midend *me)
@@ -424,8 +1099,8 @@ static int midend_undo(midend *me)
     if (me->statepos > 1) {
         if (me->ui)
             me->ourgame->changed_state(me->ui,
-                                       me->states[me->statepos-1].state,
-                                       me->states[me->statepos-2].state);
+                                       midend_state(me, me->statepos-1),
+                                       midend_state(me, me->statepos-2));
 	me->statepos--;
         me->dir = -1;
         return 1;
@@ -438,8 +1113,8 @@ static int midend_redo(midend *me)
     if (me->statepos < me->nstates) {
         if (me->ui)
             me->ourgame->changed_state(me->ui,
-                                       me->states[me->statepos-1].state,
-                                       me->states[me->statepos].state);
+                                       midend_state(me, me->statepos-1),
+                                       midend_state(me, me->statepos));
 	me->statepos++;
         me->dir = +1;
         return 1;
@@ -447,6 +1122,16 @@ static int midend_redo(midend *me)
         return 0;
 }
 
+int midend_can_undo(midend *me)
+{
+    return (me->statepos > 1);
+}
+
+int midend_can_redo(midend *me)
+{
+    return (me->statepos < me->nstates);
+}
+
 static void midend_finish_move(midend *me)
 {
     float flashtime;
@@ -461,8 +1146,8 @@ static void midend_finish_move(midend *me)
          (me->dir < 0 && me->statepos < me->nstates &&
           !special(me->states[me->statepos].movetype)))) {
 	flashtime = me->ourgame->flash_length(me->oldstate ? me->oldstate :
-					      me->states[me->statepos-2].state,
-					      me->states[me->statepos-1].state,
+					      midend_state(me, me->statepos-2),
+					      midend_state(me, me->statepos-1),
 					      me->oldstate ? me->dir : +1,
 					      me->ui);
 	if (flashtime > 0) {
@@ -511,8 +1196,7 @@ void midend_restart_game(midend *me)
      * Now enter the restarted state as the next move.
      */
     midend_stop_anim(me);
-    while (me->nstates > me->statepos)
-	me->ourgame->free_game(me->states[--me->nstates].state);
+    midend_truncate_states(me, me->statepos);
     ensure(me);
     me->states[me->nstates].state = s;
     me->states[me->nstates].movestr = dupstr(me->desc);
@@ -520,25 +1204,26 @@ void midend_restart_game(midend *me)
     me->statepos = ++me->nstates;
     if (me->ui)
         me->ourgame->changed_state(me->ui,
-                                   me->states[me->statepos-2].state,
-                                   me->states[me->statepos-1].state);
+                                   midend_state(me, me->statepos-2),
+                                   midend_state(me, me->statepos-1));
     me->anim_time = 0.0;
     midend_finish_move(me);
     midend_redraw(me);
     midend_set_timer(me);
+    midend_trim_states(me);
 }
 
 static int midend_really_process_key(midend *me, int x, int y, int button)
 {
     game_state *oldstate =
-        me->ourgame->dup_game(me->states[me->statepos - 1].state);
+        me->ourgame->dup_game(midend_state(me, me->statepos-1));
     int type = MOVE, gottype = FALSE, ret = 1;
     float anim_time;
     game_state *s;
     char *movestr;
 	
     movestr =
-	me->ourgame->interpret_move(me->states[me->statepos-1].state,
+	me->ourgame->interpret_move(midend_state(me, me->statepos-1),
 				    me->ui, me->drawstate, x, y, button);
 
     if (!movestr) {
@@ -569,14 +1254,14 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
 	    goto done;
     } else {
 	if (!*movestr)
-	    s = me->states[me->statepos-1].state;
+	    s = midend_state(me, me->statepos-1);
 	else {
-	    s = me->ourgame->execute_move(me->states[me->statepos-1].state,
+	    s = me->ourgame->execute_move(midend_state(me, me->statepos-1),
 					  movestr);
 	    assert(s != NULL);
 	}
 
-        if (s == me->states[me->statepos-1].state) {
+        if (s == midend_state(me, me->statepos-1)) {
             /*
              * make_move() is allowed to return its input state to
              * indicate that although no move has been made, the UI
@@ -587,8 +1272,7 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
             goto done;
         } else if (s) {
 	    midend_stop_anim(me);
-            while (me->nstates > me->statepos)
-                me->ourgame->free_game(me->states[--me->nstates].state);
+            midend_truncate_states(me, me->statepos);
             ensure(me);
             assert(movestr != NULL);
             me->states[me->nstates].state = s;
@@ -598,8 +1282,8 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
             me->dir = +1;
 	    if (me->ui)
 		me->ourgame->changed_state(me->ui,
-					   me->states[me->statepos-2].state,
-					   me->states[me->statepos-1].state);
+					   midend_state(me, me->statepos-2),
+					   midend_state(me, me->statepos-1));
         } else {
             goto done;
         }
@@ -616,7 +1300,7 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
         anim_time = 0;
     } else {
         anim_time = me->ourgame->anim_length(oldstate,
-                                             me->states[me->statepos-1].state,
+                                             midend_state(me, me->statepos-1),
                                              me->dir, me->ui);
     }
 
@@ -635,6 +1319,7 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
 
     done:
     if (oldstate) me->ourgame->free_game(oldstate);
+    midend_trim_states(me);
     return ret;
 }
 
@@ -778,17 +1463,27 @@ void midend_redraw(midend *me)
             me->anim_pos < me->anim_time) {
             assert(me->dir != 0);
             me->ourgame->redraw(me->drawing, me->drawstate, me->oldstate,
-				me->states[me->statepos-1].state, me->dir,
+				midend_state(me, me->statepos-1), me->dir,
 				me->ui, me->anim_pos, me->flash_pos);
         } else {
             me->ourgame->redraw(me->drawing, me->drawstate, NULL,
-				me->states[me->statepos-1].state, +1 /*shrug*/,
+				midend_state(me, me->statepos-1), +1 /*shrug*/,
 				me->ui, 0.0, me->flash_pos);
         }
         end_draw(me->drawing);
     }
 }
 
+/*
+ * Switches the drawing layer between passing each drawing call
+ * straight to the front end and recording a whole frame to replay
+ * at end_draw. Takes effect from the next redraw.
+ */
+void midend_set_draw_batching(midend *me, int batching)
+{
+    drawing_set_batching(me->drawing, batching);
+}
+
 /*
  * Nasty hacky function used to implement the --redo option in
  * gtk.c. Only used for generating the puzzles' icons.
@@ -1225,6 +1920,7 @@ char *midend_set_config(midend *me, int which, config_item *cfg)
 
 	me->ourgame->free_params(me->params);
 	me->params = params;
+	midend_pregen_check_params(me);
 	break;
 
       case CFG_SEED:
@@ -1251,7 +1947,7 @@ char *midend_text_format(midend *me)
 {
     if (me->ourgame->can_format_as_text_ever && me->statepos > 0 &&
 	me->ourgame->can_format_as_text_now(me->params))
-	return me->ourgame->text_format(me->states[me->statepos-1].state);
+	return me->ourgame->text_format(midend_state(me, me->statepos-1));
     else
 	return NULL;
 }
@@ -1268,26 +1964,22 @@ char *midend_solve(midend *me)
 	return "No game set up to solve";   /* _shouldn't_ happen! */
 
     msg = NULL;
-    movestr = me->ourgame->solve(me->states[0].state,
-				 me->states[me->statepos-1].state,
+    movestr = me->ourgame->solve(midend_state(me, 0),
+				 midend_state(me, me->statepos-1),
 				 me->aux_info, &msg);
     if (!movestr) {
 	if (!msg)
 	    msg = "Solve operation failed";   /* _shouldn't_ happen, but can */
 	return msg;
     }
-    s = me->ourgame->execute_move(me->states[me->statepos-1].state, movestr);
+    s = me->ourgame->execute_move(midend_state(me, me->statepos-1), movestr);
     assert(s);
 
     /*
      * Now enter the solved state as the next move.
      */
     midend_stop_anim(me);
-    while (me->nstates > me->statepos) {
-	me->ourgame->free_game(me->states[--me->nstates].state);
-        if (me->states[me->nstates].movestr)
-            sfree(me->states[me->nstates].movestr);
-    }
+    midend_truncate_states(me, me->statepos);
     ensure(me);
     me->states[me->nstates].state = s;
     me->states[me->nstates].movestr = movestr;
@@ -1295,14 +1987,14 @@ char *midend_solve(midend *me)
     me->statepos = ++me->nstates;
     if (me->ui)
         me->ourgame->changed_state(me->ui,
-                                   me->states[me->statepos-2].state,
-                                   me->states[me->statepos-1].state);
+                                   midend_state(me, me->statepos-2),
+                                   midend_state(me, me->statepos-1));
     me->dir = +1;
     if (me->ourgame->flags & SOLVE_ANIMATES) {
-	me->oldstate = me->ourgame->dup_game(me->states[me->statepos-2].state);
+	me->oldstate = me->ourgame->dup_game(midend_state(me, me->statepos-2));
         me->anim_time =
-	    me->ourgame->anim_length(me->states[me->statepos-2].state,
-				     me->states[me->statepos-1].state,
+	    me->ourgame->anim_length(midend_state(me, me->statepos-2),
+				     midend_state(me, me->statepos-1),
 				     +1, me->ui);
         me->anim_pos = 0.0;
     } else {
@@ -1311,6 +2003,7 @@ char *midend_solve(midend *me)
     }
     midend_redraw(me);
     midend_set_timer(me);
+    midend_trim_states(me);
     return NULL;
 }
 
@@ -1810,8 +2503,9 @@ char *midend_deserialise(midend *me,
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
     me->drawstate =
         me->ourgame->new_drawstate(me->drawing,
-				   me->states[me->statepos-1].state);
+				   midend_state(me, me->statepos-1));
     midend_size_new_drawstate(me);
+    midend_trim_all_states(me);
 
     ret = NULL;                        /* success! */
 
@@ -14,7 +14,6 @@
 #include <ctype.h>
 #include <math.h>
 
-#include "tree234.h"
 #include "puzzles.h"
 
 enum {
@@ -296,50 +295,105 @@ static int bitcount16(int inword)
 }
 
 /*
- * We use a tree234 to store a large number of small localised
- * sets, each with a mine count. We also keep some of those sets
- * linked together into a to-do list.
+ * We store a large number of small localised sets, each with a mine
+ * count, in a hash table keyed on the set's top left square: since
+ * that is always a square of the grid, the table is simply an array
+ * of w*h buckets. Each bucket holds its sets in a list sorted by
+ * mask, so that walking the buckets in order visits the sets in the
+ * same (y, x, mask) order a sorted tree would. We also keep some of
+ * those sets linked together into a to-do list.
+ *
+ * The set structures themselves are carved out of slabs, and
+ * recycled through a free list, since the solver creates and
+ * destroys a great many of them. The slabs, like the rest of the
+ * store, come from the solver's arena.
  */
 struct set {
     short x, y, mask, mines;
     int todo;
-    struct set *prev, *next;
+    struct set *prev, *next;	       /* to-do list */
+    struct set *hnext;		       /* bucket list, or free list */
 };
 
-static int setcmp(void *av, void *bv)
-{
-    struct set *a = (struct set *)av;
-    struct set *b = (struct set *)bv;
-
-    if (a->y < b->y)
-	return -1;
-    else if (a->y > b->y)
-	return +1;
-    else if (a->x < b->x)
-	return -1;
-    else if (a->x > b->x)
-	return +1;
-    else if (a->mask < b->mask)
-	return -1;
-    else if (a->mask > b->mask)
-	return +1;
-    else
-	return 0;
-}
+#define SET_SLAB 256
 
 struct setstore {
-    tree234 *sets;
+    int w, h;
+    struct set **buckets;
+    int nsets;
+    struct set *freelist;
+    arena *arena;
+    struct set **overlap;	       /* result buffer for ss_overlap */
+    int overlapsize;
     struct set *todo_head, *todo_tail;
 };
 
-static struct setstore *ss_new(void)
+static struct setstore *ss_new(int w, int h, arena *a)
 {
-    struct setstore *ss = snew(struct setstore);
-    ss->sets = newtree234(setcmp);
+    struct setstore *ss = anew(a, struct setstore);
+    int i;
+
+    ss->w = w;
+    ss->h = h;
+    ss->buckets = anewn(a, w*h, struct set *);
+    for (i = 0; i < w*h; i++)
+	ss->buckets[i] = NULL;
+    ss->nsets = 0;
+    ss->freelist = NULL;
+    ss->arena = a;
+    ss->overlapsize = 32;
+    ss->overlap = snewn(ss->overlapsize, struct set *);
     ss->todo_head = ss->todo_tail = NULL;
     return ss;
 }
 
+/* This also releases everything allocated from the arena since ss_new. */
+static void ss_free(struct setstore *ss)
+{
+    sfree(ss->overlap);
+    arena_release(ss->arena, ss);
+}
+
+static struct set *ss_alloc(struct setstore *ss)
+{
+    struct set *s;
+
+    if (!ss->freelist) {
+	int i;
+
+	s = anewn(ss->arena, SET_SLAB, struct set);
+	for (i = 0; i < SET_SLAB; i++) {
+	    s[i].hnext = ss->freelist;
+	    ss->freelist = &s[i];
+	}
+    }
+
+    s = ss->freelist;
+    ss->freelist = s->hnext;
+    return s;
+}
+
+/*
+ * Return the set at a given position in (y, x, mask) order, as
+ * index234 would have done.
+ */
+static struct set *ss_index(struct setstore *ss, int index)
+{
+    int i;
+    struct set *s;
+
+    if (index < 0 || index >= ss->nsets)
+	return NULL;
+
+    for (i = 0; i < ss->w * ss->h; i++)
+	for (s = ss->buckets[i]; s; s = s->hnext)
+	    if (index-- == 0)
+		return s;
+
+    assert(!"set count out of step with buckets");
+    return NULL;
+}
+
 /*
  * Take two input sets, in the form (x,y,mask). Munge the first by
  * taking either its intersection with the second or its difference
@@ -412,7 +466,7 @@ static void ss_add_todo(struct setstore *ss, struct set *s)
 
 static void ss_add(struct setstore *ss, int x, int y, int mask, int mines)
 {
-    struct set *s;
+    struct set *s, **sp;
 
     assert(mask != 0);
 
@@ -426,24 +480,33 @@ static void ss_add(struct setstore *ss, int x, int y, int mask, int mines)
 	mask >>= 3, y++;
 
     /*
-     * Create a set structure and add it to the tree.
+     * Find where the set belongs in its bucket. If it's already
+     * there, there's nothing to do.
+     */
+    assert(x >= 0 && x < ss->w && y >= 0 && y < ss->h);
+    for (sp = &ss->buckets[y * ss->w + x]; *sp; sp = &(*sp)->hnext) {
+	if ((*sp)->mask == mask)
+	    return;
+	if ((*sp)->mask > mask)
+	    break;
+    }
+
+    /*
+     * Create a set structure and add it to the bucket.
      */
-    s = snew(struct set);
+    s = ss_alloc(ss);
     s->x = x;
     s->y = y;
     s->mask = mask;
     s->mines = mines;
     s->todo = FALSE;
-    if (add234(ss->sets, s) != s) {
-	/*
-	 * This set already existed! Free it and return.
-	 */
-	sfree(s);
-	return;
-    }
+    s->prev = s->next = NULL;
+    s->hnext = *sp;
+    *sp = s;
+    ss->nsets++;
 
     /*
-     * We've added a new set to the tree, so put it on the todo
+     * We've added a new set to the store, so put it on the todo
      * list.
      */
     ss_add_todo(ss, s);
@@ -451,7 +514,7 @@ static void ss_add(struct setstore *ss, int x, int y, int mask, int mines)
 
 static void ss_remove(struct setstore *ss, struct set *s)
 {
-    struct set *next = s->next, *prev = s->prev;
+    struct set *next = s->next, *prev = s->prev, **sp;
 
 #ifdef SOLVER_DIAGNOSTICS
     printf("removing set %d,%d %03x\n", s->x, s->y, s->mask);
@@ -472,67 +535,58 @@ static void ss_remove(struct setstore *ss, struct set *s)
     s->todo = FALSE;
 
     /*
-     * Remove s from the tree.
+     * Remove s from its bucket.
      */
-    del234(ss->sets, s);
+    for (sp = &ss->buckets[s->y * ss->w + s->x]; *sp != s;
+	 sp = &(*sp)->hnext)
+	assert(*sp);
+    *sp = s->hnext;
+    ss->nsets--;
 
     /*
-     * Destroy the actual set structure.
+     * Return the set structure to the free list.
      */
-    sfree(s);
+    s->hnext = ss->freelist;
+    ss->freelist = s;
 }
 
 /*
- * Return a dynamically allocated list of all the sets which
- * overlap a provided input set.
+ * Return a NULL-terminated list of all the sets which overlap a
+ * provided input set. The list belongs to the setstore, and is
+ * overwritten by the next call.
  */
 static struct set **ss_overlap(struct setstore *ss, int x, int y, int mask)
 {
-    struct set **ret = NULL;
-    int nret = 0, retsize = 0;
+    int nret = 0;
     int xx, yy;
 
-    for (xx = x-3; xx < x+3; xx++)
-	for (yy = y-3; yy < y+3; yy++) {
-	    struct set stmp, *s;
-	    int pos;
-
-	    /*
-	     * Find the first set with these top left coordinates.
-	     */
-	    stmp.x = xx;
-	    stmp.y = yy;
-	    stmp.mask = 0;
+    for (xx = max(x-3, 0); xx < x+3 && xx < ss->w; xx++)
+	for (yy = max(y-3, 0); yy < y+3 && yy < ss->h; yy++) {
+	    struct set *s;
 
-	    if (findrelpos234(ss->sets, &stmp, NULL, REL234_GE, &pos)) {
-		while ((s = index234(ss->sets, pos)) != NULL &&
-		       s->x == xx && s->y == yy) {
+	    for (s = ss->buckets[yy * ss->w + xx]; s; s = s->hnext) {
+		/*
+		 * This set potentially overlaps the input one.
+		 * Compute the intersection to see if they really
+		 * overlap, and add it to the list if so.
+		 */
+		if (setmunge(x, y, mask, s->x, s->y, s->mask, FALSE)) {
 		    /*
-		     * This set potentially overlaps the input one.
-		     * Compute the intersection to see if they
-		     * really overlap, and add it to the list if
-		     * so.
+		     * There's an overlap.
 		     */
-		    if (setmunge(x, y, mask, s->x, s->y, s->mask, FALSE)) {
-			/*
-			 * There's an overlap.
-			 */
-			if (nret >= retsize) {
-			    retsize = nret + 32;
-			    ret = sresize(ret, retsize, struct set *);
-			}
-			ret[nret++] = s;
+		    if (nret + 1 >= ss->overlapsize) {
+			ss->overlapsize = nret + 32;
+			ss->overlap = sresize(ss->overlap, ss->overlapsize,
+					      struct set *);
 		    }
-
-		    pos++;
+		    ss->overlap[nret++] = s;
 		}
 	    }
 	}
 
-    ret = sresize(ret, nret+1, struct set *);
-    ret[nret] = NULL;
+    ss->overlap[nret] = NULL;
 
-    return ret;
+    return ss->overlap;
 }
 
 /*
@@ -632,6 +686,12 @@ struct perturbations {
  * once you're confident of them. It fills in as much more of the
  * grid as it can.
  * 
+ * All the solver's working storage comes from the arena `a', and
+ * is handed back to it before returning. A perturb function must
+ * allocate the perturbations it returns from the same arena, and
+ * nothing else after them; the solver releases them once it has
+ * taken them into account.
+ *
  * Return value is:
  * 
  *  - -1 means deduction stalled and nothing could be done
@@ -646,9 +706,9 @@ typedef struct perturbations *(*perturb_cb) (void *, signed char *, int, int, in
 static int minesolve(int w, int h, int n, signed char *grid,
 		     open_cb open,
                      perturb_cb perturb,
-		     void *ctx, random_state *rs)
+		     void *ctx, random_state *rs, arena *a)
 {
-    struct setstore *ss = ss_new();
+    struct setstore *ss = ss_new(w, h, a);
     struct set **list;
     struct squaretodo astd, *std = &astd;
     int x, y, i, j;
@@ -658,7 +718,7 @@ static int minesolve(int w, int h, int n, signed char *grid,
      * Set up a linked list of squares with known contents, so that
      * we can process them one by one.
      */
-    std->next = snewn(w*h, int);
+    std->next = anewn(a, w*h, int);
     std->head = std->tail = -1;
 
     /*
@@ -766,8 +826,6 @@ static int minesolve(int w, int h, int n, signed char *grid,
 		     */
 		    ss_remove(ss, s);
 		}
-
-		sfree(list);
 	    }
 
 	    /*
@@ -873,8 +931,6 @@ static int minesolve(int w, int h, int n, signed char *grid,
 		}
 	    }
 
-	    sfree(list);
-
 	    /*
 	     * In this situation we have definitely done
 	     * _something_, even if it's only reducing the size of
@@ -968,7 +1024,7 @@ static int minesolve(int w, int h, int n, signed char *grid,
 	     * a bit slow for large n, so I artificially cap this
 	     * recursion at n=10 to avoid too much pain.
 	     */
-	    nsets = count234(ss->sets);
+	    nsets = ss->nsets;
 	    if (nsets <= lenof(setused)) {
 		/*
 		 * Doing this with actual recursive function calls
@@ -1015,7 +1071,7 @@ static int minesolve(int w, int h, int n, signed char *grid,
 		 */
 		struct set *sets[lenof(setused)];
 		for (i = 0; i < nsets; i++)
-		    sets[i] = index234(ss->sets, i);
+		    sets[i] = ss_index(ss, i);
 
 		cursor = 0;
 		while (1) {
@@ -1154,7 +1210,7 @@ static int minesolve(int w, int h, int n, signed char *grid,
 	{
 	    struct set *s;
 
-	    for (i = 0; (s = index234(ss->sets, i)) != NULL; i++)
+	    for (i = 0; (s = ss_index(ss, i)) != NULL; i++)
 		printf("remaining set: %d,%d %03x %d\n", s->x, s->y, s->mask, s->mines);
 	}
 #endif
@@ -1178,13 +1234,13 @@ static int minesolve(int w, int h, int n, signed char *grid,
 	     * 
 	     * If we have no sets at all, we must give up.
 	     */
-	    if (count234(ss->sets) == 0) {
+	    if (ss->nsets == 0) {
 #ifdef SOLVER_DIAGNOSTICS
 		printf("perturbing on entire unknown set\n");
 #endif
 		ret = perturb(ctx, grid, 0, 0, 0);
 	    } else {
-		s = index234(ss->sets, random_upto(rs, count234(ss->sets)));
+		s = ss_index(ss, random_upto(rs, ss->nsets));
 #ifdef SOLVER_DIAGNOSTICS
 		printf("perturbing on set %d,%d %03x\n", s->x, s->y, s->mask);
 #endif
@@ -1222,15 +1278,12 @@ static int minesolve(int w, int h, int n, signed char *grid,
 			list[j]->mines += ret->changes[i].delta;
 			ss_add_todo(ss, list[j]);
 		    }
-
-		    sfree(list);
 		}
 
 		/*
 		 * Now free the returned data.
 		 */
-		sfree(ret->changes);
-		sfree(ret);
+		arena_release(a, ret);
 
 #ifdef SOLVER_DIAGNOSTICS
 		/*
@@ -1255,7 +1308,7 @@ static int minesolve(int w, int h, int n, signed char *grid,
 		{
 		    struct set *s;
 
-		    for (i = 0; (s = index234(ss->sets, i)) != NULL; i++)
+		    for (i = 0; (s = ss_index(ss, i)) != NULL; i++)
 			printf("remaining set: %d,%d %03x %d\n", s->x, s->y, s->mask, s->mines);
 		}
 #endif
@@ -1288,14 +1341,7 @@ static int minesolve(int w, int h, int n, signed char *grid,
     /*
      * Free the set list and square-todo list.
      */
-    {
-	struct set *s;
-	while ((s = delpos234(ss->sets, 0)) != NULL)
-	    sfree(s);
-	freetree234(ss->sets);
-	sfree(ss);
-	sfree(std->next);
-    }
+    ss_free(ss);
 
     return nperturbs;
 }
@@ -1310,6 +1356,7 @@ struct minectx {
     int sx, sy;
     int allow_big_perturbs;
     random_state *rs;
+    arena *arena;		       /* the solver's, for perturbations */
 };
 
 static int mineopen(void *vctx, int x, int y)
@@ -1409,7 +1456,14 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
      * We do this by preparing list of all squares and then sorting
      * it with a random secondary key.
      */
-    sqlist = snewn(ctx->w * ctx->h, struct square);
+    /*
+     * The perturbations we return have to be the first thing we
+     * allocate from the arena, since the solver releases everything
+     * from there on once it has used them.
+     */
+    ret = anew(ctx->arena, struct perturbations);
+
+    sqlist = anewn(ctx->arena, ctx->w * ctx->h, struct square);
     n = 0;
     for (y = 0; y < ctx->h; y++)
 	for (x = 0; x < ctx->w; x++) {
@@ -1501,11 +1555,11 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
      */
     ntofill = ntoempty = 0;
     if (mask) {
-	tofill = snewn(9, struct square *);
-	toempty = snewn(9, struct square *);
+	tofill = anewn(ctx->arena, 9, struct square *);
+	toempty = anewn(ctx->arena, 9, struct square *);
     } else {
-	tofill = snewn(ctx->w * ctx->h, struct square *);
-	toempty = snewn(ctx->w * ctx->h, struct square *);
+	tofill = anewn(ctx->arena, ctx->w * ctx->h, struct square *);
+	toempty = anewn(ctx->arena, ctx->w * ctx->h, struct square *);
     }
     for (i = 0; i < n; i++) {
 	struct square *sq = &sqlist[i];
@@ -1534,7 +1588,7 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
 
 	assert(ntoempty != 0);
 
-	setlist = snewn(ctx->w * ctx->h, int);
+	setlist = anewn(ctx->arena, ctx->w * ctx->h, int);
 	i = 0;
 	if (mask) {
 	    for (dy = 0; dy < 3; dy++)
@@ -1580,13 +1634,11 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
      * the solver, so that it can update its data structures
      * efficiently rather than having to rescan the whole grid.
      */
-    ret = snew(struct perturbations);
     if (ntofill == nfull) {
 	todo = tofill;
 	ntodo = ntofill;
 	dtodo = +1;
 	dset = -1;
-	sfree(toempty);
     } else {
 	/*
 	 * (We also fall into this case if we've constructed a
@@ -1596,10 +1648,9 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
 	ntodo = ntoempty;
 	dtodo = -1;
 	dset = +1;
-	sfree(tofill);
     }
     ret->n = 2 * ntodo;
-    ret->changes = snewn(ret->n, struct perturbation);
+    ret->changes = anewn(ctx->arena, ret->n, struct perturbation);
     for (i = 0; i < ntodo; i++) {
 	ret->changes[i].x = todo[i]->x;
 	ret->changes[i].y = todo[i]->y;
@@ -1615,7 +1666,6 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
 	    ret->changes[i].delta = dset;
 	    i++;
 	}
-	sfree(setlist);
     } else if (mask) {
 	for (dy = 0; dy < 3; dy++)
 	    for (dx = 0; dx < 3; dx++)
@@ -1643,9 +1693,6 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
     }
     assert(i == ret->n);
 
-    sfree(sqlist);
-    sfree(todo);
-
     /*
      * Having set up the precise list of changes we're going to
      * make, we now simply make them and return.
@@ -1730,9 +1777,16 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 		     random_state *rs)
 {
     char *ret = snewn(w*h, char);
+    int *tmp = snewn(w*h, int);
+    signed char *solvegrid = unique ? snewn(w*h, signed char) : NULL;
+    arena *scratch = unique ? arena_new(w*h * 64) : NULL;
     int success;
     int ntries = 0;
 
+    /*
+     * Everything the tries below need is allocated once, up here;
+     * the solver gives back what it takes from the arena each time.
+     */
     do {
 	success = FALSE;
 	ntries++;
@@ -1744,7 +1798,6 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 	 * one square of it.
 	 */
 	{
-	    int *tmp = snewn(w*h, int);
 	    int i, j, k, nn;
 
 	    /*
@@ -1765,8 +1818,6 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 		ret[tmp[i]] = 1;
 		tmp[i] = tmp[--k];
 	    }
-
-	    sfree(tmp);
 	}
 
 #ifdef GENERATION_DIAGNOSTICS
@@ -1800,7 +1851,6 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 	 * We bypass this bit if we're not after a unique grid.
          */
 	if (unique) {
-	    signed char *solvegrid = snewn(w*h, signed char);
 	    struct minectx actx, *ctx = &actx;
 	    int solveret, prevret = -2;
 
@@ -1811,6 +1861,7 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 	    ctx->sy = y;
 	    ctx->rs = rs;
 	    ctx->allow_big_perturbs = (ntries > 100);
+	    ctx->arena = scratch;
 
 	    while (1) {
                 int i;
@@ -1822,7 +1873,8 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 		assert(solvegrid[y*w+x] == 0); /* by deliberate arrangement */
 
 		solveret =
-		    minesolve(w, h, n, solvegrid, mineopen, mineperturb, ctx, rs);
+		    minesolve(w, h, n, solvegrid, mineopen, mineperturb, ctx, rs,
+			      scratch);
 		if (solveret < 0 || (prevret >= 0 && solveret >= prevret)) {
 		    success = FALSE;
 		    break;
@@ -1831,14 +1883,16 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 		    break;
 		}
 	    }
-
-	    sfree(solvegrid);
 	} else {
 	    success = TRUE;
 	}
 
     } while (!success);
 
+    sfree(tmp);
+    sfree(solvegrid);
+    arena_free(scratch);
+
     return ret;
 }
 
@@ -3211,3 +3265,70 @@ int main(int argc, char **argv)
 }
 
 #endif
+
+#ifdef STANDALONE_MINES_BENCHMARK
+
+#include <time.h>
+
+/*
+ * Time the generation of unique boards at the three classic sizes,
+ * with the first click in the middle. Boards come from the seeds
+ * "0", "1", ... so that runs can be compared; -v prints them.
+ */
+int main(int argc, char **argv)
+{
+    static const struct {
+	const char *name;
+	int w, h, n;
+    } sizes[] = {
+	{"Beginner", 9, 9, 10},
+	{"Intermediate", 16, 16, 40},
+	{"Expert", 30, 16, 99},
+    };
+    const char *quis = argv[0];
+    int count = 1000, verbose = FALSE;
+    int i, k;
+
+    while (--argc > 0) {
+        char *p = *++argv;
+	if (!strcmp(p, "-n") && argc > 1) {
+	    count = atoi(*++argv);
+	    argc--;
+	} else if (!strcmp(p, "-v")) {
+	    verbose = TRUE;
+	} else {
+            fprintf(stderr, "usage: %s [-v] [-n count]\n", quis);
+            return 1;
+        }
+    }
+
+    for (k = 0; k < lenof(sizes); k++) {
+	int w = sizes[k].w, h = sizes[k].h, n = sizes[k].n;
+	clock_t start = clock();
+	double t;
+
+	for (i = 0; i < count; i++) {
+	    char seed[32], *grid;
+	    random_state *rs;
+
+	    sprintf(seed, "%d", i);
+	    rs = random_new(seed, strlen(seed));
+	    grid = minegen(w, h, n, w/2, h/2, TRUE, rs);
+	    if (verbose) {
+		char *desc = describe_layout(grid, w*h, w/2, h/2, FALSE);
+		printf("%dx%dn%d:%s\n", w, h, n, desc);
+		sfree(desc);
+	    }
+	    sfree(grid);
+	    random_free(rs);
+	}
+	t = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%-12s %2dx%-2d %3d mines %10.3f ms per board\n",
+	       sizes[k].name, w, h, n, t * 1000.0 / count);
+    }
+
+    return 0;
+}
+
+#endif
@@ -139,9 +139,10 @@ static int xyd_cmp(const void *av, const void *bv) {
 
 static int xyd_cmp_nc(void *av, void *bv) { return xyd_cmp(av, bv); }
 
-static struct xyd *new_xyd(int x, int y, int direction)
+/* If an arena is given, the xyd comes from there and mustn't be sfreed. */
+static struct xyd *new_xyd(int x, int y, int direction, arena *a)
 {
-    struct xyd *xyd = snew(struct xyd);
+    struct xyd *xyd = a ? anew(a, struct xyd) : snew(struct xyd);
     xyd->x = x;
     xyd->y = y;
     xyd->direction = direction;
@@ -412,24 +413,17 @@ struct todo {
     int head, tail;
 };
 
-static struct todo *todo_new(int maxsize)
+static struct todo *todo_new(int maxsize, arena *a)
 {
-    struct todo *todo = snew(struct todo);
-    todo->marked = snewn(maxsize, unsigned char);
+    struct todo *todo = anew(a, struct todo);
+    todo->marked = anewn(a, maxsize, unsigned char);
     memset(todo->marked, 0, maxsize);
     todo->buflen = maxsize + 1;
-    todo->buffer = snewn(todo->buflen, int);
+    todo->buffer = anewn(a, todo->buflen, int);
     todo->head = todo->tail = 0;
     return todo;
 }
 
-static void todo_free(struct todo *todo)
-{
-    sfree(todo->marked);
-    sfree(todo->buffer);
-    sfree(todo);
-}
-
 static void todo_add(struct todo *todo, int index)
 {
     if (todo->marked[index])
@@ -453,9 +447,16 @@ static int todo_get(struct todo *todo) {
     return ret;
 }
 
+/*
+ * The solver's working storage comes from `scratch', and is released
+ * there again when it returns; if scratch is NULL it makes an arena
+ * of its own.
+ */
 static int net_solver(int w, int h, unsigned char *tiles,
-		      unsigned char *barriers, int wrapping)
+		      unsigned char *barriers, int wrapping, arena *scratch)
 {
+    arena *a = scratch ? scratch :
+        arena_new(w * h * (5 + 5 * sizeof(int) + 2 + 2 * sizeof(int)) + 256);
     unsigned char *tilestate;
     unsigned char *edgestate;
     int *deadends;
@@ -482,7 +483,7 @@ static int net_solver(int w, int h, unsigned char *tiles,
      * grid generated _by_ this program, but it's worth keeping the
      * solver as general as possible.)
      */
-    tilestate = snewn(w * h * 4, unsigned char);
+    tilestate = anewn(a, w * h * 4, unsigned char);
     area = 0;
     for (i = 0; i < w*h; i++) {
 	tilestate[i * 4] = tiles[i] & 0xF;
@@ -509,7 +510,7 @@ static int net_solver(int w, int h, unsigned char *tiles,
      * obvious four, so that I can index edgestate[(y*w+x) * 5 + d]
      * where d is 1,2,4,8 and they never overlap.
      */
-    edgestate = snewn((w * h - 1) * 5 + 9, unsigned char);
+    edgestate = anewn(a, (w * h - 1) * 5 + 9, unsigned char);
     memset(edgestate, 0, (w * h - 1) * 5 + 9);
 
     /*
@@ -520,7 +521,7 @@ static int net_solver(int w, int h, unsigned char *tiles,
      * (no dead end known) or less than that (can reach _at most_
      * this many other tiles by heading this way out of this tile).
      */
-    deadends = snewn((w * h - 1) * 5 + 9, int);
+    deadends = anewn(a, (w * h - 1) * 5 + 9, int);
     for (i = 0; i < (w * h - 1) * 5 + 9; i++)
 	deadends[i] = area+1;
 
@@ -544,7 +545,8 @@ static int net_solver(int w, int h, unsigned char *tiles,
      * classes) by finding the representative of each tile and
      * setting equivalence[one]=the_other.
      */
-    equivalence = snew_dsf(w * h);
+    equivalence = anewn(a, w * h, int);
+    dsf_init(equivalence, w * h);
 
     /*
      * On a non-wrapping grid, we instantly know that all the edges
@@ -591,7 +593,7 @@ static int net_solver(int w, int h, unsigned char *tiles,
      * problem inherent in iterating repeatedly over the entire
      * grid by instead working with a to-do list.
      */
-    todo = todo_new(w * h);
+    todo = todo_new(w * h, a);
 
     /*
      * Main deductive loop.
@@ -821,11 +823,10 @@ static int net_solver(int w, int h, unsigned char *tiles,
     /*
      * Free up working space.
      */
-    todo_free(todo);
-    sfree(tilestate);
-    sfree(edgestate);
-    sfree(deadends);
-    sfree(equivalence);
+    if (scratch)
+        arena_release(scratch, tilestate);
+    else
+        arena_free(a);
 
     return j;
 }
@@ -1133,6 +1134,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
     int w, h, x, y, cx, cy, nbarriers;
     unsigned char *tiles, *barriers;
     char *desc, *p;
+    arena *scratch;
 
     w = params->width;
     h = params->height;
@@ -1143,8 +1145,16 @@ static char *new_game_desc(game_params *params, random_state *rs,
     tiles = snewn(w * h, unsigned char);
     barriers = snewn(w * h, unsigned char);
 
+    /*
+     * The possibility and barrier lists' xyds, and the solver's
+     * working storage, all come from this arena, which is emptied
+     * rather than freed each time we start again.
+     */
+    scratch = arena_new(w * h * (4 * sizeof(struct xyd) + 16 * sizeof(int)));
+
     begin_generation:
 
+    arena_reset(scratch);
     memset(tiles, 0, w * h);
     memset(barriers, 0, w * h);
 
@@ -1193,13 +1203,13 @@ static char *new_game_desc(game_params *params, random_state *rs,
     possibilities = newtree234(xyd_cmp_nc);
 
     if (cx+1 < w)
-	add234(possibilities, new_xyd(cx, cy, R));
+	add234(possibilities, new_xyd(cx, cy, R, scratch));
     if (cy-1 >= 0)
-	add234(possibilities, new_xyd(cx, cy, U));
+	add234(possibilities, new_xyd(cx, cy, U, scratch));
     if (cx-1 >= 0)
-	add234(possibilities, new_xyd(cx, cy, L));
+	add234(possibilities, new_xyd(cx, cy, L, scratch));
     if (cy+1 < h)
-	add234(possibilities, new_xyd(cx, cy, D));
+	add234(possibilities, new_xyd(cx, cy, D, scratch));
 
     while (count234(possibilities) > 0) {
 	int i;
@@ -1214,7 +1224,6 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	x1 = xyd->x;
 	y1 = xyd->y;
 	d1 = xyd->direction;
-	sfree(xyd);
 
 	OFFSET(x2, y2, x1, y1, d1, params);
 	d2 = F(d1);
@@ -1250,7 +1259,6 @@ static char *new_game_desc(game_params *params, random_state *rs,
 		       xydp->x, xydp->y, "0RU3L567D9abcdef"[xydp->direction]);
 #endif
 		del234(possibilities, xydp);
-		sfree(xydp);
 	    }
 	}
 
@@ -1277,7 +1285,6 @@ static char *new_game_desc(game_params *params, random_state *rs,
 		       xydp->x, xydp->y, "0RU3L567D9abcdef"[xydp->direction]);
 #endif
 		del234(possibilities, xydp);
-		sfree(xydp);
 	    }
 	}
 
@@ -1311,7 +1318,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	    printf("New frontier; adding (%d,%d,%c)\n",
 		   x2, y2, "0RU3L567D9abcdef"[d]);
 #endif
-	    add234(possibilities, new_xyd(x2, y2, d));
+	    add234(possibilities, new_xyd(x2, y2, d, scratch));
 	}
     }
     /* Having done that, we should have no possibilities remaining. */
@@ -1324,7 +1331,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	/*
 	 * Run the solver to check unique solubility.
 	 */
-	while (!net_solver(w, h, tiles, NULL, params->wrapping)) {
+	while (!net_solver(w, h, tiles, NULL, params->wrapping, scratch)) {
 	    int n = 0;
 
 	    /*
@@ -1381,10 +1388,10 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
 	    if (!(index(params, tiles, x, y) & R) &&
                 (params->wrapping || x < w-1))
-		add234(barriertree, new_xyd(x, y, R));
+		add234(barriertree, new_xyd(x, y, R, scratch));
 	    if (!(index(params, tiles, x, y) & D) &&
                 (params->wrapping || y < h-1))
-		add234(barriertree, new_xyd(x, y, D));
+		add234(barriertree, new_xyd(x, y, D, scratch));
 	}
     }
 
@@ -1489,7 +1496,6 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	x1 = xyd->x;
 	y1 = xyd->y;
 	d1 = xyd->direction;
-	sfree(xyd);
 
 	OFFSET(x2, y2, x1, y1, d1, params);
 	d2 = F(d1);
@@ -1501,16 +1507,10 @@ static char *new_game_desc(game_params *params, random_state *rs,
     }
 
     /*
-     * Clean up the rest of the barrier list.
+     * Clean up the barrier list. (The xyds themselves were all
+     * allocated from the arena, which goes below.)
      */
-    {
-	struct xyd *xyd;
-
-	while ( (xyd = delpos234(barriertree, 0)) != NULL)
-	    sfree(xyd);
-
-	freetree234(barriertree);
-    }
+    freetree234(barriertree);
 
     /*
      * Finally, encode the grid into a string game description.
@@ -1541,6 +1541,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
     sfree(tiles);
     sfree(barriers);
+    arena_free(scratch);
 
     return desc;
 }
@@ -1706,7 +1707,7 @@ static char *solve_game(game_state *state, game_state *currstate,
 	 */
 	memcpy(tiles, state->tiles, state->width * state->height);
 	net_solver(state->width, state->height, tiles,
-		   state->barriers, state->wrapping);
+		   state->barriers, state->wrapping, NULL);
     } else {
         for (i = 0; i < state->width * state->height; i++) {
             int c = aux[i];
@@ -1820,7 +1821,7 @@ static unsigned char *compute_active(game_state *state, int cx, int cy)
      */
     todo = newtree234(xyd_cmp_nc);
     index(state, active, cx, cy) = ACTIVE;
-    add234(todo, new_xyd(cx, cy, 0));
+    add234(todo, new_xyd(cx, cy, 0, NULL));
 
     while ( (xyd = delpos234(todo, 0)) != NULL) {
 	int x1, y1, d1, x2, y2, d2;
@@ -1844,7 +1845,7 @@ static unsigned char *compute_active(game_state *state, int cx, int cy)
 		!(barrier(state, x1, y1) & d1) &&
 		!index(state, active, x2, y2)) {
 		index(state, active, x2, y2) = ACTIVE;
-		add234(todo, new_xyd(x2, y2, 0));
+		add234(todo, new_xyd(x2, y2, 0, NULL));
 	    }
 	}
     }
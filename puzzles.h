@@ -9,6 +9,11 @@
 #include <stdlib.h> /* for size_t */
 #include <limits.h> /* for UINT_MAX */
 
+/*
+ * The games themselves don't need any of the platform headers, so
+ * host-side tools (see headless.c) can be built without them.
+ */
+#ifndef HEADLESS
 #include <SDL/SDL.h>
 #include <SDL/SDL_mixer.h>
 
@@ -16,6 +21,7 @@
 #include <wiiuse/wpad.h>
 #include <gccore.h>
 #include <fat.h>
+#endif
 
 #define COMBINED
 
@@ -185,11 +191,32 @@ void deactivate_timer(frontend *fe);
 void activate_timer(frontend *fe);
 void get_random_seed(void **randseed, int *randseedsize);
 
+/*
+ * Threads, used by the midend to generate puzzles in the background.
+ * A front end without threads can just return NULL from
+ * fe_thread_start, and the midend will do everything inline.
+ */
+typedef struct fe_thread fe_thread;
+typedef struct fe_mutex fe_mutex;
+typedef struct fe_cond fe_cond;
+fe_thread *fe_thread_start(int (*fn)(void *ctx), void *ctx);
+void fe_thread_wait(fe_thread *thread);
+fe_mutex *fe_mutex_new(void);
+void fe_mutex_free(fe_mutex *mutex);
+void fe_mutex_lock(fe_mutex *mutex);
+void fe_mutex_unlock(fe_mutex *mutex);
+fe_cond *fe_cond_new(void);
+void fe_cond_free(fe_cond *cond);
+void fe_cond_wait(fe_cond *cond, fe_mutex *mutex);
+void fe_cond_signal(fe_cond *cond);
+
 /*
  * drawing.c
  */
 drawing *drawing_new(const drawing_api *api, midend *me, void *handle);
 void drawing_free(drawing *dr);
+void drawing_set_batching(drawing *dr, int batching);
+int drawing_get_batching(drawing *dr);
 void draw_text(drawing *dr, int x, int y, int fonttype, int fontsize,
                int align, int colour, char *text);
 void draw_rect(drawing *dr, int x, int y, int w, int h, int colour);
@@ -245,8 +272,15 @@ void midend_new_game(midend *me);
 void midend_restart_game(midend *me);
 void midend_stop_anim(midend *me);
 int midend_process_key(midend *me, int x, int y, int button);
+int midend_can_undo(midend *me);
+int midend_can_redo(midend *me);
 void midend_force_redraw(midend *me);
 void midend_redraw(midend *me);
+void midend_set_draw_batching(midend *me, int batching);
+void midend_set_undo_snapshot_interval(midend *me, int interval);
+void midend_set_pregen(midend *me, int nentries, int maxbytes);
+void midend_set_race_workers(midend *me, int nworkers);
+void midend_set_random_kind(midend *me, int kind);
 float *midend_colours(midend *me, int *ncolours);
 void midend_freeze_timer(midend *me, float tprop);
 void midend_timer(midend *me, float tplus);
@@ -289,6 +323,59 @@ char *dupstr(const char *s);
 #define sresize(array, number, type) \
     ( (type *) srealloc ((array), (number) * sizeof (type)) )
 
+/*
+ * Counts of calls to the above since the program started, or since
+ * the last smalloc_reset_stats(). srealloc(NULL, n) counts as a
+ * malloc, and sfree(NULL) isn't counted at all. The counts are only
+ * kept when smalloc.c is built with SMALLOC_STATS (or SMALLOC_PROFILE,
+ * below); otherwise they always read as zero.
+ */
+struct smalloc_stats {
+    unsigned long mallocs, reallocs, frees;
+    unsigned long bytes;	       /* total size passed to smalloc */
+};
+void smalloc_get_stats(struct smalloc_stats *stats);
+void smalloc_reset_stats(void);
+
+/*
+ * Built with SMALLOC_PROFILE defined, every smalloc, srealloc and
+ * dupstr (and therefore snew, snewn and sresize) records where it
+ * was called from, and a table of allocations by call site, with
+ * the peak bytes each site had live at once and a histogram of the
+ * sizes asked for, is written to stderr at exit (or to the file
+ * named by the SMALLOC_PROFILE environment variable). Without it,
+ * smalloc_profile_report just prints the totals above.
+ */
+void smalloc_profile_report(FILE *fp);
+void smalloc_profile_reset(void);
+#ifdef SMALLOC_PROFILE
+void *smalloc_at(size_t size, const char *file, int line);
+void *srealloc_at(void *p, size_t size, const char *file, int line);
+char *dupstr_at(const char *s, const char *file, int line);
+#define smalloc(size) smalloc_at((size), __FILE__, __LINE__)
+#define srealloc(p, size) srealloc_at((p), (size), __FILE__, __LINE__)
+#define dupstr(s) dupstr_at((s), __FILE__, __LINE__)
+#endif
+
+/*
+ * Scratch arenas, for code (typically a generator) which allocates
+ * and frees the same working storage over and over. arena_new's size
+ * is only a first guess; the arena grows to whatever is needed.
+ * arena_release(a, p) frees p and everything allocated after it;
+ * arena_reset frees everything. Nothing allocated from an arena may
+ * be passed to sfree.
+ */
+typedef struct arena arena;
+arena *arena_new(size_t size);
+void *arena_alloc(arena *a, size_t size);
+void arena_release(arena *a, void *p);
+void arena_reset(arena *a);
+void arena_free(arena *a);
+#define anew(a, type) \
+    ( (type *) arena_alloc ((a), sizeof (type)) )
+#define anewn(a, number, type) \
+    ( (type *) arena_alloc ((a), (number) * sizeof (type)) )
+
 /*
  * misc.c
  */
@@ -351,6 +438,15 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse);
 void dsf_merge(int *dsf, int v1, int v2);
 void dsf_init(int *dsf, int len);
 
+/* Flatten the whole forest in one pass, so that every element points
+ * directly at its canonical element. */
+void dsf_canonify_all(int *dsf, int len);
+/* Number the equivalence classes 0,1,... in order of their first
+ * element, filling in classes[i] for each element and (if 'sizes' is
+ * non-NULL, with room for up to 'len' entries) sizes[c] for each
+ * class. Returns the number of classes. Flattens the forest too. */
+int dsf_components(int *dsf, int len, int *classes, int *sizes);
+
 /*
  * laydomino.c
  */
@@ -365,6 +461,10 @@ extern char ver[];
 /*
  * random.c
  */
+enum { RANDOM_SHA1, RANDOM_FAST };
+/* Which generator random_new() will use for a seed: RANDOM_FAST if
+ * it starts with `~', RANDOM_SHA1 otherwise. */
+int random_seed_kind(const char *seed, int len);
 random_state *random_new(char *seed, int len);
 random_state *random_copy(random_state *tocopy);
 unsigned long random_bits(random_state *state, int bits);
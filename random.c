@@ -8,6 +8,15 @@
  * The generator is based on SHA-1. This is almost certainly
  * overkill, but I had the SHA-1 code kicking around and it was
  * easier to reuse it than to do anything else!
+ *
+ * On slow machines the SHA-1 rehash every 20 bytes shows up in
+ * generation time, so there is also a much cheaper generator
+ * (xoshiro128**) seeded from the same SHA-1 output. The two give
+ * different puzzles from the same seed, so which one to use is part
+ * of the seed itself: random_new() uses the fast one for a seed
+ * which starts with a `~' (see random_seed_kind), and SHA-1 for
+ * everything else. The midend's own seeds are all digits, so no
+ * seed it made before the fast generator existed starts that way.
  */
 
 #include <assert.h>
@@ -202,21 +211,70 @@ void SHA_Simple(void *p, int len, unsigned char *output)
  */
 
 struct random_state {
+    int kind;
     unsigned char seedbuf[40];
     unsigned char databuf[20];
     int pos;
+    uint32 xs[4];		       /* RANDOM_FAST only */
 };
 
+int random_seed_kind(const char *seed, int len)
+{
+    if (len >= 1 && seed[0] == '~')
+	return RANDOM_FAST;
+    return RANDOM_SHA1;
+}
+
+/*
+ * xoshiro128** (Blackman and Vigna). The masking is only there for
+ * platforms where uint32 is wider than 32 bits.
+ */
+#define XS_MASK(x) ((x) & 0xFFFFFFFFUL)
+#define XS_ROL(x,y) XS_MASK(((x) << (y)) | ((x) >> (32-(y))))
+
+static uint32 xs_next(uint32 *s)
+{
+    uint32 ret = XS_MASK(XS_ROL(XS_MASK(s[1] * 5), 7) * 9);
+    uint32 t = XS_MASK(s[1] << 9);
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = XS_ROL(s[3], 11);
+
+    return ret;
+}
+
+/*
+ * Load the xoshiro state from 16 bytes, most significant first so
+ * that the sequence doesn't depend on the host's byte order.
+ */
+static void xs_load(uint32 *s, const unsigned char *bytes)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+	s[i] = ((uint32)bytes[4*i] << 24) | ((uint32)bytes[4*i+1] << 16) |
+	    ((uint32)bytes[4*i+2] << 8) | (uint32)bytes[4*i+3];
+    if (!s[0] && !s[1] && !s[2] && !s[3])
+	s[0] = 1;		       /* all zeroes is a fixed point */
+}
+
 random_state *random_new(char *seed, int len)
 {
     random_state *state;
 
     state = snew(random_state);
 
+    state->kind = random_seed_kind(seed, len);
     SHA_Simple(seed, len, state->seedbuf);
     SHA_Simple(state->seedbuf, 20, state->seedbuf + 20);
     SHA_Simple(state->seedbuf, 40, state->databuf);
     state->pos = 0;
+    if (state->kind == RANDOM_FAST)
+	xs_load(state->xs, state->databuf);
 
     return state;
 }
@@ -225,9 +283,7 @@ random_state *random_copy(random_state *tocopy)
 {
     random_state *result;
     result = snew(random_state);
-    memcpy(result->seedbuf, tocopy->seedbuf, sizeof(result->seedbuf));
-    memcpy(result->databuf, tocopy->databuf, sizeof(result->databuf));
-    result->pos = tocopy->pos;
+    *result = *tocopy;
     return result;
 }
 
@@ -236,6 +292,21 @@ unsigned long random_bits(random_state *state, int bits)
     unsigned long ret = 0;
     int n;
 
+    if (state->kind == RANDOM_FAST) {
+	/*
+	 * Take the top bits of each output word, which are the
+	 * better ones.
+	 */
+	for (n = bits; n > 0; n -= 32) {
+	    uint32 word = xs_next(state->xs);
+	    if (n < 32)
+		ret = (ret << n) | (unsigned long)(word >> (32 - n));
+	    else
+		ret = ((ret << 16) << 16) | (unsigned long)word;
+	}
+	return ret;
+    }
+
     for (n = 0; n < bits; n += 8) {
 	if (state->pos >= 20) {
 	    int i;
@@ -274,6 +345,22 @@ unsigned long random_upto(random_state *state, unsigned long limit)
     bits += 3;
     assert(bits < 32);
 
+    if (state->kind == RANDOM_FAST) {
+	/*
+	 * One output word always has far more bits than we need, so
+	 * use all 32 of them rather than making random_bits throw
+	 * most away: then a retry happens with probability under
+	 * 2^-29 instead of up to 1/8. The SHA-1 generator has to keep
+	 * the old method below, or every existing seed would change.
+	 */
+	divisor = 0xFFFFFFFFUL / limit;
+	max = limit * divisor;
+	do {
+	    data = xs_next(state->xs);
+	} while (data >= max);
+	return data / divisor;
+    }
+
     max = 1L << bits;
     divisor = max / limit;
     max = limit * divisor;
@@ -290,11 +377,26 @@ void random_free(random_state *state)
     sfree(state);
 }
 
+/*
+ * A SHA-1 state encodes as 41 bytes of hex, exactly as it always
+ * has, so that descriptions saved by older versions (Mines keeps
+ * one in its game IDs) still decode. A fast state is tagged with a
+ * leading 'x', which can never start the old format, followed by
+ * its 16 bytes of state.
+ */
 char *random_state_encode(random_state *state)
 {
     char retbuf[256];
     int len = 0, i;
 
+    if (state->kind == RANDOM_FAST) {
+	retbuf[len++] = 'x';
+	for (i = 0; i < 4; i++)
+	    len += sprintf(retbuf+len, "%08lx",
+			   (unsigned long)XS_MASK(state->xs[i]));
+	return dupstr(retbuf);
+    }
+
     for (i = 0; i < lenof(state->seedbuf); i++)
 	len += sprintf(retbuf+len, "%02x", state->seedbuf[i]);
     for (i = 0; i < lenof(state->databuf); i++)
@@ -307,7 +409,7 @@ char *random_state_encode(random_state *state)
 random_state *random_state_decode(char *input)
 {
     random_state *state;
-    int pos, byte, digits;
+    int pos, byte, digits, fast;
 
     state = snew(random_state);
 
@@ -315,6 +417,11 @@ random_state *random_state_decode(char *input)
     memset(state->databuf, 0, sizeof(state->databuf));
     state->pos = 0;
 
+    fast = (*input == 'x');
+    if (fast)
+	input++;
+    state->kind = fast ? RANDOM_FAST : RANDOM_SHA1;
+
     byte = digits = 0;
     pos = 0;
     while (*input) {
@@ -334,9 +441,13 @@ random_state *random_state_decode(char *input)
 
 	if (digits == 2) {
 	    /*
-	     * We have a byte. Put it somewhere.
+	     * We have a byte. Put it somewhere. A fast state borrows
+	     * databuf to hold its 16 bytes until we've read them all.
 	     */
-	    if (pos < lenof(state->seedbuf))
+	    if (fast) {
+		if (pos < 16)
+		    state->databuf[pos++] = byte;
+	    } else if (pos < lenof(state->seedbuf))
 		state->seedbuf[pos++] = byte;
 	    else if (pos < lenof(state->seedbuf) + lenof(state->databuf))
 		state->databuf[pos++ - lenof(state->seedbuf)] = byte;
@@ -347,5 +458,8 @@ random_state *random_state_decode(char *input)
 	}
     }
 
+    if (fast)
+	xs_load(state->xs, state->databuf);
+
     return state;
 }
@@ -24,6 +24,7 @@
 // #define DEBUG_TIMER         // Timers, etc.
 // #define DEBUG_MISC          // Config options, etc.
 // #define DEBUG_FUNCTIONS     // Function calls
+// #define DEBUG_SCREEN_UPDATES // Dirty rectangles and pixels pushed to the display per frame
 
 //#define SCALELARGESCREEN
 #define BACKGROUND_MUSIC
@@ -47,6 +48,11 @@
 // using.  Pretty useless for now, but might come in handy for, e.g. The Wiz.
 // #define OPTION_CHECK_HARDWARE
 
+// Define this to time the text drawing of a full 9x9 Solo redraw, both with and
+// without the glyph atlas, whenever Solo is started.  The results go to stdout
+// and to the debug log.
+// #define BENCHMARK_TEXT_DRAWING
+
 
 // VIDEO STORAGE AND ACCELERATION
 // ==============================
@@ -61,6 +67,28 @@
 // Not working with this code (but trivial to get working).
 // #define SDL_SURFACE_FLAGS SDL_HWSURFACE|SDL_DOUBLEBUF
 
+// Maximum number of seperate dirty rectangles tracked during a game frame.  Any more than this
+// and we just update the whole screen.
+#define MAX_DIRTY_RECTS (64)
+
+// If the dirty rectangles of a frame cover at least this percentage of the screen, it's cheaper
+// to update the whole screen in one go than to push them individually.
+#define DIRTY_RECTS_FULL_UPDATE_PERCENT (50)
+
+// BACKGROUND GENERATION
+// =====================
+
+// How many games to generate in advance, on a background thread, while the current one is
+// being played.  Set to 0 to always generate games when they're asked for.
+#define PREGEN_QUEUE_LENGTH (3)
+
+// Rough limit on the memory used by games generated in advance.
+#define PREGEN_QUEUE_BYTES (32 * 1024)
+
+// How many generators to race against each other when a game isn't ready in advance.  The
+// Wii and GP2X only have one core each, so racing just makes every generator slower.
+#define RACE_WORKERS (1)
+
 // EVENT MODEL
 // ===========
  
@@ -384,6 +412,40 @@ struct font
     uint size;		// size (in pixels, points@72dpi) of the font.
 };
 
+// The glyph atlas holds the printable ASCII range.  Anything outside it (e.g. the
+// UNICODE_* symbols used by the menus) goes through the old render-per-call path.
+#define GLYPH_ATLAS_FIRST_CHAR	(32)
+#define GLYPH_ATLAS_LAST_CHAR	(126)
+#define GLYPH_ATLAS_NCHARS	(GLYPH_ATLAS_LAST_CHAR - GLYPH_ATLAS_FIRST_CHAR + 1)
+#define GLYPH_ATLAS_MAX_WIDTH	(512)
+
+// Pair kerning lookups by glyph (rather than by font index) only appeared in
+// SDL_ttf 2.0.14.  On older libraries we just use the glyph advances.
+#if defined(SDL_TTF_PATCHLEVEL) && (SDL_VERSIONNUM(SDL_TTF_MAJOR_VERSION, SDL_TTF_MINOR_VERSION, SDL_TTF_PATCHLEVEL) >= SDL_VERSIONNUM(2, 0, 14))
+    #define GLYPH_ATLAS_KERNING
+#endif
+
+// Position and metrics of a single pre-rendered glyph.
+struct glyph
+{
+    SDL_Rect rect;	// Where the glyph lives in the atlas surface (w=h=0 for blank glyphs)
+    int xoffset;	// Offset of the glyph image from the pen position
+    int yoffset;	// Offset of the glyph image from the top of the line
+    int advance;	// How far to move the pen after drawing this glyph
+};
+
+// Every printable glyph of one cached font, rendered once in one colour.
+struct glyph_atlas
+{
+    uint font_index;	// Index of the font in the frontend font cache
+    Uint8 r, g, b;	// Colour the glyphs were rendered in
+    SDL_Surface *surface;	// All the glyphs, packed in rows
+    int ascent;		// Font ascent, used to place glyphs relative to the baseline
+    int height;		// Font height, as TTF_SizeText would report it
+    signed char *kerning;	// NCHARS x NCHARS pair adjustments, or NULL if the font has none
+    struct glyph glyphs[GLYPH_ATLAS_NCHARS];
+};
+
 // Used as a temporary area by the games to save/load portions of the screen.
 struct blitter
 {
@@ -438,6 +500,8 @@ struct global_configuration
     uint screenshots_include_cursor;
     uint screenshots_include_statusbar;
     uint control_system;
+    uint batched_drawing;
+    uint fast_random;
     uint tracks_to_play[10];
     uint music_volume;
 };
@@ -470,6 +534,8 @@ struct frontend
     SDL_TimerID sdl_second_timer_id;	// Once per second utility timer
     struct font *fonts;			// A cache of loaded fonts at particular fontsizes
     uint nfonts;			// Number of cached fonts
+    struct glyph_atlas *glyph_atlases;	// A cache of pre-rendered glyphs per font and colour
+    uint nglyph_atlases;		// Number of cached glyph atlases
     uint paused;			// True if paused (menu showing)
     SDL_Rect clipping_rectangle;	// Clipping rectangle in use by the game.
     char *configure_window_title;	// The window title for the configure window
@@ -480,6 +546,12 @@ struct frontend
     char* sanitised_game_name;          // A copy of the game name suitable for use in filenames
     uint first_preset_showing;          // The preset currently at the top of the preset menu.
     struct timeval last_statusbar_update;		// Last time the status bar was updated.    
+    uint in_game_frame;			// True between the midend's start_draw and end_draw
+    SDL_Rect dirty_rects[MAX_DIRTY_RECTS];	// Areas drawn on during the current game frame
+    uint ndirty_rects;			// Number of dirty rectangles
+    uint dirty_rects_overflowed;	// Too many dirty rectangles to track - update everything
+    uint pixels_pushed;			// Number of pixels sent to the display by the last frame
+    uint surface_lock_deferred;		// Screen left unlocked after a blit until the next primitive
 };
 
 struct button_status *bs;
@@ -543,6 +615,15 @@ int hardware_type=UNKNOWN;
 
 uint first_run=TRUE;
 
+// Whether text is drawn from the cached glyph atlases (TRUE) or rendered afresh
+// on every call (FALSE).
+uint use_glyph_atlas=TRUE;
+
+#ifdef BENCHMARK_TEXT_DRAWING
+// Microseconds spent inside sdl_actual_draw_text since the last reset.
+double text_drawing_time=0;
+#endif
+
 #ifdef BACKGROUND_MUSIC
 Mix_Music *music = NULL;
 #else
@@ -602,9 +683,37 @@ void Lock_SDL_Surface(frontend *fe)
 #ifdef DEBUG_DRAWING
     debug_printf("Locking Screen Surface.\n");
 #endif
+    fe->surface_lock_deferred = FALSE;
     actual_lock_surface(fe->screen);
 };
 
+// Called instead of Lock_SDL_Surface after a blit.  During a game frame the surface is left
+// unlocked until something needs it locked again, so a run of blits (which is what the
+// batched drawing layer produces for text) costs a single unlock/lock pair.
+void Defer_Lock_SDL_Surface(frontend *fe)
+{
+#ifdef DEBUG_FUNCTIONS
+    //debug_printf("Defer_Lock_SDL_Surface()\n");
+#endif
+
+    if(fe->in_game_frame)
+        fe->surface_lock_deferred = TRUE;
+    else
+        Lock_SDL_Surface(fe);
+};
+
+// Re-locks the surface if a lock was deferred.  Called before drawing any SDL_gfx primitive,
+// as those would otherwise lock and unlock the surface themselves on every call.
+void Lock_Deferred_SDL_Surface(frontend *fe)
+{
+#ifdef DEBUG_FUNCTIONS
+    //debug_printf("Lock_Deferred_SDL_Surface()\n");
+#endif
+
+    if(fe->surface_lock_deferred)
+        Lock_SDL_Surface(fe);
+};
+
 void actual_lock_surface(SDL_Surface *surface)
 {
 #ifdef DEBUG_FUNCTIONS
@@ -633,6 +742,12 @@ void Unlock_SDL_Surface(frontend *fe)
 #ifdef DEBUG_DRAWING
     debug_printf("Unlocking SDL Surface.\n");
 #endif
+    // Already unlocked if we were waiting to lock it again.
+    if(fe->surface_lock_deferred)
+    {
+        fe->surface_lock_deferred = FALSE;
+        return;
+    };
     actual_unlock_surface(fe->screen);
 }
 
@@ -684,6 +799,18 @@ void cleanup(frontend *fe)
     if(fe->configure_window_title != NULL)
         sfree(fe->configure_window_title);
 
+    // The glyph atlases refer to fonts by index, so they go with the font cache.
+    for(i=0;i<fe->nglyph_atlases;i++)
+    {
+        SDL_FreeSurface(fe->glyph_atlases[i].surface);
+        sfree(fe->glyph_atlases[i].kerning);
+    };
+
+    if(fe->glyph_atlases != NULL)
+        sfree(fe->glyph_atlases);
+    fe->glyph_atlases=NULL;
+    fe->nglyph_atlases=0;
+
     for(i=0;i<fe->nfonts;i++)
     {
         TTF_CloseFont(fe->fonts[i].font);
@@ -775,6 +902,73 @@ void frontend_default_colour(frontend *fe, float *output)
 #endif
 }
 
+// Threading primitives for the midend's background game generation, mapped straight on to SDL's.
+fe_thread *fe_thread_start(int (*fn)(void *ctx), void *ctx)
+{
+#ifdef DEBUG_FUNCTIONS
+    debug_printf("fe_thread_start()\n");
+#endif
+
+    return (fe_thread *) SDL_CreateThread(fn, ctx);
+}
+
+void fe_thread_wait(fe_thread *thread)
+{
+#ifdef DEBUG_FUNCTIONS
+    debug_printf("fe_thread_wait()\n");
+#endif
+
+    SDL_WaitThread((SDL_Thread *) thread, NULL);
+}
+
+fe_mutex *fe_mutex_new(void)
+{
+    SDL_mutex *mutex = SDL_CreateMutex();
+
+    if(!mutex)
+        fatal("Unable to create mutex: %s", SDL_GetError());
+    return (fe_mutex *) mutex;
+}
+
+void fe_mutex_free(fe_mutex *mutex)
+{
+    SDL_DestroyMutex((SDL_mutex *) mutex);
+}
+
+void fe_mutex_lock(fe_mutex *mutex)
+{
+    SDL_mutexP((SDL_mutex *) mutex);
+}
+
+void fe_mutex_unlock(fe_mutex *mutex)
+{
+    SDL_mutexV((SDL_mutex *) mutex);
+}
+
+fe_cond *fe_cond_new(void)
+{
+    SDL_cond *cond = SDL_CreateCond();
+
+    if(!cond)
+        fatal("Unable to create condition variable: %s", SDL_GetError());
+    return (fe_cond *) cond;
+}
+
+void fe_cond_free(fe_cond *cond)
+{
+    SDL_DestroyCond((SDL_cond *) cond);
+}
+
+void fe_cond_wait(fe_cond *cond, fe_mutex *mutex)
+{
+    SDL_CondWait((SDL_cond *) cond, (SDL_mutex *) mutex);
+}
+
+void fe_cond_signal(fe_cond *cond)
+{
+    SDL_CondSignal((SDL_cond *) cond);
+}
+
 // Searches through the font cache for a particular font.
 // If found, returns index, if not, loads, caches and returns index
 int find_and_cache_font(void *handle, int fonttype, int fontsize)
@@ -837,6 +1031,225 @@ int find_and_cache_font(void *handle, int fonttype, int fontsize)
     return(i);
 };
 
+// Searches through the glyph atlas cache for the given cached font in the given colour.
+// If found, returns index, if not, renders every printable glyph once, caches and returns index.
+int find_and_cache_glyph_atlas(void *handle, int font_index, SDL_Color colour)
+{
+#ifdef DEBUG_FUNCTIONS
+    debug_printf("find_and_cache_glyph_atlas()\n");
+#endif
+
+    frontend *fe = (frontend *)handle;
+    TTF_Font *font = fe->fonts[font_index].font;
+    SDL_Surface *glyph_surfaces[GLYPH_ATLAS_NCHARS];
+    SDL_Surface *atlas_surface, *display_surface;
+    struct glyph_atlas *atlas;
+    int minx, maxx, miny, maxy, advance;
+    int pen_x, pen_y, row_h, atlas_w;
+    uint i, c;
+
+    // TTF_RenderUTF8_Blended is the expensive part of drawing text: it allocates a surface,
+    // rasterises every glyph of the string and then we throw it all away after a single blit.
+    // The games draw the same handful of digits and letters in the same few colours over and
+    // over, so instead we rasterise each glyph once per font and colour, pack them all into
+    // one surface and compose strings by blitting rectangles out of it.
+
+    for (i = 0; i < fe->nglyph_atlases; i++)
+        if((fe->glyph_atlases[i].font_index == (uint) font_index) &&
+           (fe->glyph_atlases[i].r == colour.r) && (fe->glyph_atlases[i].g == colour.g) && (fe->glyph_atlases[i].b == colour.b))
+            return(i);
+
+#ifdef DEBUG_DRAWING
+    debug_printf("Building glyph atlas for font %u (size %u) in colour %u, %u, %u\n", font_index, fe->fonts[font_index].size, colour.r, colour.g, colour.b);
+#endif
+
+    // Dynamically increase the atlas array by 1
+    fe->nglyph_atlases++;
+    fe->glyph_atlases = sresize(fe->glyph_atlases, fe->nglyph_atlases, struct glyph_atlas);
+    atlas = &fe->glyph_atlases[i];
+    memset(atlas, 0, sizeof(struct glyph_atlas));
+
+    atlas->font_index = font_index;
+    atlas->r = colour.r;
+    atlas->g = colour.g;
+    atlas->b = colour.b;
+    atlas->ascent = TTF_FontAscent(font);
+    atlas->height = TTF_FontHeight(font);
+
+    // Render each glyph and work out where it will go, packing them into rows no wider
+    // than GLYPH_ATLAS_MAX_WIDTH.
+    pen_x = pen_y = row_h = atlas_w = 0;
+    for (c = 0; c < GLYPH_ATLAS_NCHARS; c++)
+    {
+        glyph_surfaces[c] = NULL;
+        if(TTF_GlyphMetrics(font, (Uint16) (c + GLYPH_ATLAS_FIRST_CHAR), &minx, &maxx, &miny, &maxy, &advance))
+            continue;
+
+        atlas->glyphs[c].advance = advance;
+
+        // Spaces and the like have nothing to draw.
+        if(maxx <= minx)
+            continue;
+
+        if(!(glyph_surfaces[c] = TTF_RenderGlyph_Blended(font, (Uint16) (c + GLYPH_ATLAS_FIRST_CHAR), colour)))
+            continue;
+
+        // Older SDL_ttf hands back just the glyph's bounding box, newer versions render it
+        // in a full-height line as TTF_RenderUTF8_Blended would.
+        if(glyph_surfaces[c]->h == atlas->height)
+        {
+            atlas->glyphs[c].xoffset = min(minx, 0);
+            atlas->glyphs[c].yoffset = 0;
+        }
+        else
+        {
+            atlas->glyphs[c].xoffset = minx;
+            atlas->glyphs[c].yoffset = atlas->ascent - maxy;
+        };
+
+        if(pen_x + glyph_surfaces[c]->w > GLYPH_ATLAS_MAX_WIDTH)
+        {
+            pen_x = 0;
+            pen_y += row_h;
+            row_h = 0;
+        };
+
+        atlas->glyphs[c].rect.x = (Sint16) pen_x;
+        atlas->glyphs[c].rect.y = (Sint16) pen_y;
+        atlas->glyphs[c].rect.w = (Uint16) glyph_surfaces[c]->w;
+        atlas->glyphs[c].rect.h = (Uint16) glyph_surfaces[c]->h;
+
+        pen_x += glyph_surfaces[c]->w;
+        row_h = max(row_h, glyph_surfaces[c]->h);
+        atlas_w = max(atlas_w, pen_x);
+    };
+
+    // Same pixel layout as SDL_ttf uses for its blended surfaces.
+    atlas_surface = SDL_CreateRGBSurface(SDL_SWSURFACE, max(atlas_w, 1), max(pen_y + row_h, 1), 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    if(!atlas_surface)
+    {
+#ifdef DEBUGGING
+        debug_printf("Error creating glyph atlas surface: %s\n", SDL_GetError());
+#endif
+        cleanup_and_exit(fe, EXIT_FAILURE);
+    };
+
+    // Copy each glyph in, alpha channel and all, rather than blending it onto the
+    // (fully transparent) atlas.
+    for (c = 0; c < GLYPH_ATLAS_NCHARS; c++)
+    {
+        if(glyph_surfaces[c] == NULL)
+            continue;
+
+        SDL_SetAlpha(glyph_surfaces[c], 0, SDL_ALPHA_OPAQUE);
+        SDL_BlitSurface(glyph_surfaces[c], NULL, atlas_surface, &atlas->glyphs[c].rect);
+        SDL_FreeSurface(glyph_surfaces[c]);
+    };
+
+    // Convert to whatever per-pixel-alpha format blits fastest onto the screen.
+    if((display_surface = SDL_DisplayFormatAlpha(atlas_surface)) != NULL)
+    {
+        SDL_FreeSurface(atlas_surface);
+        atlas_surface = display_surface;
+    };
+    SDL_SetAlpha(atlas_surface, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+    atlas->surface = atlas_surface;
+
+#ifdef GLYPH_ATLAS_KERNING
+    // Cache the pair kerning too, so that strings are spaced just as TTF_SizeText would space them.
+    if(TTF_GetFontKerning(font))
+    {
+        uint prev;
+        int kern, any_kerning = FALSE;
+
+        atlas->kerning = snewn(GLYPH_ATLAS_NCHARS * GLYPH_ATLAS_NCHARS, signed char);
+        for (prev = 0; prev < GLYPH_ATLAS_NCHARS; prev++)
+            for (c = 0; c < GLYPH_ATLAS_NCHARS; c++)
+            {
+                kern = TTF_GetFontKerningSizeGlyphs(font, (Uint16) (prev + GLYPH_ATLAS_FIRST_CHAR), (Uint16) (c + GLYPH_ATLAS_FIRST_CHAR));
+                atlas->kerning[prev * GLYPH_ATLAS_NCHARS + c] = (signed char) kern;
+                if(kern)
+                    any_kerning = TRUE;
+            };
+
+        if(!any_kerning)
+        {
+            sfree(atlas->kerning);
+            atlas->kerning = NULL;
+        };
+    };
+#endif
+
+    return(i);
+}
+
+// Returns TRUE if every character of the text is in the glyph atlas.
+int text_fits_glyph_atlas(char *text)
+{
+    for (; *text; text++)
+        if(((unsigned char) *text < GLYPH_ATLAS_FIRST_CHAR) || ((unsigned char) *text > GLYPH_ATLAS_LAST_CHAR))
+            return(FALSE);
+
+    return(TRUE);
+}
+
+// Works out the width of some text from the cached glyph metrics alone.
+static int glyph_atlas_text_width(struct glyph_atlas *atlas, char *text)
+{
+    int pen_x = 0, right = 0;
+    int c, prev = -1;
+    struct glyph *glyph;
+
+    for (; *text; text++)
+    {
+        c = (unsigned char) *text - GLYPH_ATLAS_FIRST_CHAR;
+        glyph = &atlas->glyphs[c];
+
+        if(atlas->kerning && (prev >= 0))
+            pen_x += atlas->kerning[prev * GLYPH_ATLAS_NCHARS + c];
+
+        right = max(right, pen_x + glyph->xoffset + glyph->rect.w);
+        pen_x += glyph->advance;
+        prev = c;
+    };
+
+    return(max(right, pen_x));
+}
+
+// Composes some text onto the screen from the glyph atlas with (x, y) as the top-left corner.
+static void glyph_atlas_draw_text(frontend *fe, struct glyph_atlas *atlas, int x, int y, char *text)
+{
+    int pen_x = x;
+    int c, prev = -1;
+    struct glyph *glyph;
+    SDL_Rect srcrect, destrect;
+
+    Unlock_SDL_Surface(fe);
+    for (; *text; text++)
+    {
+        c = (unsigned char) *text - GLYPH_ATLAS_FIRST_CHAR;
+        glyph = &atlas->glyphs[c];
+
+        if(atlas->kerning && (prev >= 0))
+            pen_x += atlas->kerning[prev * GLYPH_ATLAS_NCHARS + c];
+
+        if(glyph->rect.w)
+        {
+            // SDL_BlitSurface clips both rectangles, so they need resetting for every glyph.
+            srcrect = glyph->rect;
+            destrect.x = (Sint16) (pen_x + glyph->xoffset);
+            destrect.y = (Sint16) (y + glyph->yoffset);
+            destrect.w = 0;
+            destrect.h = 0;
+            SDL_BlitSurface(atlas->surface, &srcrect, fe->screen, &destrect);
+        };
+
+        pen_x += glyph->advance;
+        prev = c;
+    };
+    Defer_Lock_SDL_Surface(fe);
+}
+
 // This function is called at the start of "drawing" (i.e a frame).
 void sdl_start_draw(void *handle)
 {
@@ -844,13 +1257,18 @@ void sdl_start_draw(void *handle)
     debug_printf("sdl_start_draw()\n");
 #endif
 
-    // I don't think that there's anything special that needs doing at the start of a game 
-    // frame - maybe if we were double-buffering?
+    frontend *fe = (frontend *)handle;
 
 #ifdef DEBUG_DRAWING
     debug_printf("Start of a frame.\n");
 #endif
 
+    // Start collecting the areas that the game says it has drawn on, so that
+    // sdl_end_draw only has to push those to the display.
+    fe->in_game_frame = TRUE;
+    fe->ndirty_rects = 0;
+    fe->dirty_rects_overflowed = FALSE;
+
 	SDL_ShowCursor(SDL_DISABLE);
 
 }
@@ -960,7 +1378,11 @@ void sdl_actual_draw_text(void *handle, int x, int y, int fonttype, int fontsize
     SDL_Surface *text_surface;
     SDL_Rect blit_rectangle;
     int font_w,font_h;
-    int font_index;
+    int font_index, atlas_index=-1;
+#ifdef BENCHMARK_TEXT_DRAWING
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+#endif
 
     // Only if we're being asked to actually draw some text...
     // Sometimes the midend does this to us.
@@ -968,8 +1390,15 @@ void sdl_actual_draw_text(void *handle, int x, int y, int fonttype, int fontsize
     {
         font_index=find_and_cache_font(fe, fonttype, fontsize);
 
+        if(use_glyph_atlas && text_fits_glyph_atlas(text))
+        {
+            // Everything we need is already cached, so we don't have to go near SDL_ttf.
+            atlas_index=find_and_cache_glyph_atlas(fe, font_index, fe->sdlcolours[colour]);
+            font_w=glyph_atlas_text_width(&fe->glyph_atlases[atlas_index], text);
+            font_h=fe->glyph_atlases[atlas_index].height;
+        }
         // Retrieve the actual size of the rendered text for that particular font
-        if(TTF_SizeText(fe->fonts[font_index].font,text,&font_w,&font_h))
+        else if(TTF_SizeText(fe->fonts[font_index].font,text,&font_w,&font_h))
         {
 #ifdef DEBUGGING            
 			debug_printf("Error getting size of font text: %s\n", TTF_GetError());
@@ -995,8 +1424,13 @@ void sdl_actual_draw_text(void *handle, int x, int y, int fonttype, int fontsize
         blit_rectangle.w = 0;
         blit_rectangle.h = 0;
 
+        if(atlas_index >= 0)
+        {
+            // Compose the text from the pre-rendered glyphs.
+            glyph_atlas_draw_text(fe, &fe->glyph_atlases[atlas_index], blit_rectangle.x, blit_rectangle.y, text);
+        }
         // Draw the text to a temporary SDL surface.
-        if(!(text_surface=TTF_RenderUTF8_Blended(fe->fonts[font_index].font,text,fe->sdlcolours[colour])))
+        else if(!(text_surface=TTF_RenderUTF8_Blended(fe->fonts[font_index].font,text,fe->sdlcolours[colour])))
         {
 #ifdef DEBUGGING            
 			debug_printf("Error rendering font text: %s\n", TTF_GetError());
@@ -1008,12 +1442,17 @@ void sdl_actual_draw_text(void *handle, int x, int y, int fonttype, int fontsize
             // Blit the text surface onto the screen at the right position.
             Unlock_SDL_Surface(fe);
             SDL_BlitSurface(text_surface,NULL,fe->screen,&blit_rectangle);
-            Lock_SDL_Surface(fe);
+            Defer_Lock_SDL_Surface(fe);
 
             // Remove the temporary text surface from memory.
             SDL_FreeSurface(text_surface);
         };
     };
+
+#ifdef BENCHMARK_TEXT_DRAWING
+    gettimeofday(&end_time, NULL);
+    text_drawing_time += (end_time.tv_sec - start_time.tv_sec) * 1000000.0 + (end_time.tv_usec - start_time.tv_usec);
+#endif
 }
 
 // Wrapper function for the games to call.
@@ -1037,6 +1476,7 @@ void sdl_actual_draw_rect(void *handle, int x, int y, int w, int h, int colour)
 #endif
 
     frontend *fe = (frontend *)handle;
+    Lock_Deferred_SDL_Surface(fe);
     if( !(x < 0) && !(y < 0) && !(x > (int) screen_width) && !(y > (int) screen_height))
         boxRGBA(fe->screen, (Sint16) x, (Sint16) y, (Sint16) (x+w-1), (Sint16) (y+h-1), fe->sdlcolours[colour].r, fe->sdlcolours[colour].g, fe->sdlcolours[colour].b, (Uint8) 255);
 }
@@ -1063,6 +1503,7 @@ void sdl_actual_draw_line(void *handle, int x1, int y1, int x2, int y2, int colo
 #endif
 
     frontend *fe = (frontend *)handle;
+    Lock_Deferred_SDL_Surface(fe);
 
     // Draw an anti-aliased line.
     if( !(x1 < 0) && !(y1 < 0) && !(x1 > (int) screen_width) && !(y1 > (int) screen_height))
@@ -1099,6 +1540,8 @@ void sdl_draw_poly(void *handle, int *coords, int npoints, int fillcolour, int o
     debug_printf(" Colours: %u, %u\n", fillcolour, outlinecolour);
 #endif
 
+    Lock_Deferred_SDL_Surface(fe);
+
     // Draw a filled polygon (without outline).
     if (fillcolour >= 0)
         filledPolygonRGBA(fe->screen, xpoints, ypoints, npoints, fe->sdlcolours[fillcolour].r, fe->sdlcolours[fillcolour].g, fe->sdlcolours[fillcolour].b, 255);
@@ -1134,6 +1577,7 @@ void sdl_draw_circle(void *handle, int cx, int cy, int radius, int fillcolour, i
 #endif
 
     frontend *fe = (frontend *)handle;
+    Lock_Deferred_SDL_Surface(fe);
 
     // Draw a filled circle with no outline
     // We don't anti-alias because it looks ugly when things try to draw circles over circles
@@ -1277,8 +1721,11 @@ void sdl_status_bar(void *handle, char *text)
             };
             Lock_SDL_Surface(fe);
 
-            // Cause a screen update over the relevant area.
-            sdl_actual_draw_update(fe, 0, 0, text_surface->w, text_surface->h);
+            // Cause a screen update over the relevant area, which includes
+            // whatever of the last message was blanked out above.
+            sdl_actual_draw_update(fe, 0, 0,
+                                   max(text_surface->w, fe->last_status_bar_w),
+                                   max(text_surface->h, fe->last_status_bar_h));
 #ifdef SCALELARGESCREEN
   sdl_end_draw(fe);
 #endif
@@ -1370,7 +1817,7 @@ void sdl_blitter_save(void *handle, blitter *bl, int x, int y)
     destrect.h = bl->h;
     Unlock_SDL_Surface(fe);
     SDL_BlitSurface(fe->screen, &srcrect, bl->pixmap, &destrect);
-    Lock_SDL_Surface(fe);
+    Defer_Lock_SDL_Surface(fe);
 }
 
 // Load the contents of the screen starting at X, Y from a "blitter" with size bl->w, bl->h
@@ -1407,7 +1854,7 @@ void sdl_blitter_load(void *handle, blitter *bl, int x, int y)
     destrect.h = bl->h;
     Unlock_SDL_Surface(fe);
     SDL_BlitSurface(bl->pixmap, &srcrect, fe->screen, &destrect);
-    Lock_SDL_Surface(fe);
+    Defer_Lock_SDL_Surface(fe);
 }
 
 // Informs the front end that a rectangular portion of the puzzle window 
@@ -1447,12 +1894,85 @@ void sdl_actual_draw_update(void *handle, int x, int y, int w, int h)
     debug_printf("Partial screen update: %i, %i, %i, %i.\n", x+fe->ox, y+fe->oy, w, h);
 #endif
 
+    // During a game frame, just remember the area and update it at the end of the frame.
+    if(fe->in_game_frame)
+    {
+        add_dirty_rect(fe, x, y, w, h);
+        return;
+    };
+
     // Request a partial screen update of the relevant rectangle.
     Unlock_SDL_Surface(fe);
     SDL_UpdateRect(fe->screen, (Sint32) x, (Sint32) y, (Sint32) w, (Sint32) h);
     Lock_SDL_Surface(fe);
 }
 
+// Adds an area to the list of areas to update at the end of the current game frame, merging
+// it with any areas that it overlaps or touches.
+void add_dirty_rect(frontend *fe, int x, int y, int w, int h)
+{
+    int x2 = x + w, y2 = y + h;
+    uint i;
+    SDL_Rect *r;
+
+    if((w <= 0) || (h <= 0) || fe->dirty_rects_overflowed)
+        return;
+
+    // Games tend to update a tile at a time, so neighbouring updates mostly merge into rows
+    // and blocks.  Each merge can make the new rectangle reach others, so start again after one.
+    i = 0;
+    while(i < fe->ndirty_rects)
+    {
+        r = &fe->dirty_rects[i];
+        if((r->x <= x2) && (x <= r->x + r->w) && (r->y <= y2) && (y <= r->y + r->h))
+        {
+            x = min(x, r->x);
+            y = min(y, r->y);
+            x2 = max(x2, r->x + r->w);
+            y2 = max(y2, r->y + r->h);
+            fe->dirty_rects[i] = fe->dirty_rects[--fe->ndirty_rects];
+            i = 0;
+        }
+        else
+            i++;
+    };
+
+    if(fe->ndirty_rects == MAX_DIRTY_RECTS)
+    {
+        fe->dirty_rects_overflowed = TRUE;
+        return;
+    };
+
+    r = &fe->dirty_rects[fe->ndirty_rects++];
+    r->x = (Sint16) x;
+    r->y = (Sint16) y;
+    r->w = (Uint16) (x2 - x);
+    r->h = (Uint16) (y2 - y);
+}
+
+// Pushes the areas drawn on during the game frame to the display, or the whole screen if
+// that's going to be cheaper.  Returns the number of pixels pushed.
+uint push_dirty_rects(frontend *fe)
+{
+    uint i, covered = 0;
+    uint screen_area = fe->screen->w * fe->screen->h;
+
+    // The dirty rectangles never overlap, because overlapping ones were merged.
+    for(i = 0; i < fe->ndirty_rects; i++)
+        covered += fe->dirty_rects[i].w * fe->dirty_rects[i].h;
+
+    if(fe->dirty_rects_overflowed || (covered * 100 >= screen_area * DIRTY_RECTS_FULL_UPDATE_PERCENT))
+    {
+        SDL_UpdateRect(fe->screen, 0, 0, fe->screen->w, fe->screen->h);
+        return(screen_area);
+    };
+
+    if(fe->ndirty_rects)
+        SDL_UpdateRects(fe->screen, fe->ndirty_rects, fe->dirty_rects);
+
+    return(covered);
+}
+
 // This function is called at the end of drawing (i.e. a frame).
 void sdl_end_draw(void *handle)
 {
@@ -1486,12 +2006,31 @@ void sdl_end_draw(void *handle)
     };
 #endif
 
+    // At the end of a game frame we know exactly which parts of the screen changed, so only
+    // those are pushed (unless we're double-buffered, where the whole screen has to flip).
+    // The frontend also calls us after drawing its menus, which don't track their updates.
     Unlock_SDL_Surface(fe);
-    if(SDL_SURFACE_FLAGS & SDL_DOUBLEBUF)
-        SDL_UpdateRect(fe->screen, 0, 0, fe->screen->w, fe->screen->h);
+    if(fe->in_game_frame && !(SDL_SURFACE_FLAGS & SDL_DOUBLEBUF))
+    {
+        fe->pixels_pushed = push_dirty_rects(fe);
+    }
     else
-        SDL_Flip(fe->screen);
+    {
+        if(SDL_SURFACE_FLAGS & SDL_DOUBLEBUF)
+            SDL_UpdateRect(fe->screen, 0, 0, fe->screen->w, fe->screen->h);
+        else
+            SDL_Flip(fe->screen);
+        fe->pixels_pushed = fe->screen->w * fe->screen->h;
+    };
     Lock_SDL_Surface(fe);   
+
+#ifdef DEBUG_SCREEN_UPDATES
+    debug_printf("Frame pushed %u pixels (%u rectangles%s).\n", fe->pixels_pushed, fe->ndirty_rects, fe->dirty_rects_overflowed ? ", overflowed" : "");
+#endif
+
+    fe->in_game_frame = FALSE;
+    fe->ndirty_rects = 0;
+    fe->dirty_rects_overflowed = FALSE;
 	
 	SDL_ShowCursor(SDL_ENABLE);
 }
@@ -2259,6 +2798,8 @@ void draw_menu(frontend *fe, uint menu_index)
             sdl_actual_draw_text(fe, 10, 14*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, "Control System");
             sdl_actual_draw_text(fe, 20, 15*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, "Mouse Emulation");
             sdl_actual_draw_text(fe, 20, 16*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, "Cursor Keys Emulation");
+            sdl_actual_draw_text(fe, 10, 17*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, "Batched Drawing");
+            sdl_actual_draw_text(fe, 10, 18*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, "Fast Random Numbers");
 
             sdl_actual_draw_text(fe, screen_width * 7 / 10, 7*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, global_config->play_music?UNICODE_TICK_CHAR:UNICODE_CROSS_CHAR);
             sdl_actual_draw_text(fe, screen_width * 7 / 10, 9*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, global_config->screenshots_enabled?UNICODE_TICK_CHAR:UNICODE_CROSS_CHAR);
@@ -2268,6 +2809,8 @@ void draw_menu(frontend *fe, uint menu_index)
             sdl_actual_draw_text(fe, screen_width * 7 / 10, 13*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, global_config->always_load_autosave?UNICODE_TICK_CHAR:UNICODE_CROSS_CHAR);
             sdl_actual_draw_text(fe, screen_width * 7 / 10, 15*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, (global_config->control_system == MOUSE_EMULATION)?UNICODE_TICK_CHAR:UNICODE_CROSS_CHAR);
             sdl_actual_draw_text(fe, screen_width * 7 / 10, 16*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, (global_config->control_system == CURSOR_KEYS_EMULATION)?UNICODE_TICK_CHAR:UNICODE_CROSS_CHAR);
+            sdl_actual_draw_text(fe, screen_width * 7 / 10, 17*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, global_config->batched_drawing?UNICODE_TICK_CHAR:UNICODE_CROSS_CHAR);
+            sdl_actual_draw_text(fe, screen_width * 7 / 10, 18*(MENU_FONT_SIZE+2), FONT_VARIABLE, MENU_FONT_SIZE, ALIGN_VNORMAL | ALIGN_HLEFT, fe->white_colour, global_config->fast_random?UNICODE_TICK_CHAR:UNICODE_CROSS_CHAR);
 
             SDL_ShowCursor(SDL_ENABLE);
 			
@@ -3918,6 +4461,20 @@ void Main_SDL_Loop(void *handle)
                                     global_config->control_system=CURSOR_KEYS_EMULATION;
                                     draw_menu(fe, SETTINGSMENU);
                                     break;
+
+                                case 17:
+                                    global_config->batched_drawing=1-global_config->batched_drawing;
+                                    if(fe->me)
+                                        midend_set_draw_batching(fe->me, global_config->batched_drawing);
+                                    draw_menu(fe, SETTINGSMENU);
+                                    break;
+
+                                case 18:
+                                    // Takes effect from the next puzzle started, since the current
+                                    // one may have a generator thread running.
+                                    global_config->fast_random=1-global_config->fast_random;
+                                    draw_menu(fe, SETTINGSMENU);
+                                    break;
                               };
                               break;
 
@@ -4628,6 +5185,32 @@ void load_global_config_from_INI()
             global_config->control_system=CURSOR_KEYS_EMULATION;
     };
 
+    boolean_value=iniparser_getboolean(global_ini_dict, "Configuration:batched_drawing",-1);
+    if(boolean_value==-1)
+    {
+        // Do nothing.  The INI key was not found, so use the normal default.
+    }
+    else
+    {
+        if(boolean_value==0)
+            global_config->batched_drawing=FALSE;
+        else
+            global_config->batched_drawing=TRUE;
+    };
+
+    boolean_value=iniparser_getboolean(global_ini_dict, "Configuration:fast_random",-1);
+    if(boolean_value==-1)
+    {
+        // Do nothing.  The INI key was not found, so use the normal default.
+    }
+    else
+    {
+        if(boolean_value==0)
+            global_config->fast_random=FALSE;
+        else
+            global_config->fast_random=TRUE;
+    };
+
     int_value=iniparser_getint(global_ini_dict, "Configuration:music_volume",-1);
     if(int_value==-1)
     {
@@ -4701,6 +5284,8 @@ uint save_global_config_to_INI(uint save_music_config)
         iniparser_setstring(global_ini_dict, "Configuration:screenshots_include_cursor", global_config->screenshots_include_cursor?"T":"F");
         iniparser_setstring(global_ini_dict, "Configuration:screenshots_include_statusbar", global_config->screenshots_include_statusbar?"T":"F");
         iniparser_setstring(global_ini_dict, "Configuration:control_system", (global_config->control_system==CURSOR_KEYS_EMULATION)?"T":"F");
+        iniparser_setstring(global_ini_dict, "Configuration:batched_drawing", global_config->batched_drawing?"T":"F");
+        iniparser_setstring(global_ini_dict, "Configuration:fast_random", global_config->fast_random?"T":"F");
     }
     else
     {
@@ -5553,6 +6138,8 @@ int main(int argc, char **argv)
     global_config->screenshots_include_cursor=FALSE;
     global_config->screenshots_include_statusbar=FALSE;
     global_config->control_system=FALSE;
+    global_config->batched_drawing=TRUE;
+    global_config->fast_random=FALSE;
     global_config->music_volume=MIX_MAX_VOLUME;
     for(i=0;i<10;i++)
         global_config->tracks_to_play[i]=FALSE;
@@ -5928,6 +6515,52 @@ void redraw_gamelist_menu(frontend *fe)
     sdl_end_draw(fe);
 }
 
+#ifdef BENCHMARK_TEXT_DRAWING
+#define TEXT_BENCHMARK_FRAMES	(50)
+
+// Fills in the whole of the current (9x9 Solo) grid, redraws it repeatedly with and without
+// the glyph atlas and reports how long was spent drawing text per frame in each case.
+void benchmark_text_drawing(frontend *fe)
+{
+    uint saved_use_glyph_atlas = use_glyph_atlas;
+    double first_frame[2], per_frame[2];
+    int pass, frame;
+
+    // Solve the puzzle so that all 81 cells have a digit in them.
+    if(midend_solve(fe->me) != NULL)
+        return;
+
+    // Pass 0 is the old render-per-call path, pass 1 uses the glyph atlas.
+    for(pass = 0; pass < 2; pass++)
+    {
+        use_glyph_atlas = pass;
+
+        // The first frame of the atlas pass includes building the atlases.
+        text_drawing_time = 0;
+        midend_force_redraw(fe->me);
+        first_frame[pass] = text_drawing_time;
+
+        text_drawing_time = 0;
+        for(frame = 0; frame < TEXT_BENCHMARK_FRAMES; frame++)
+            midend_force_redraw(fe->me);
+        per_frame[pass] = text_drawing_time / TEXT_BENCHMARK_FRAMES;
+    };
+
+    use_glyph_atlas = saved_use_glyph_atlas;
+
+    printf("Text drawing, full 9x9 Solo grid, %u frames:\n", TEXT_BENCHMARK_FRAMES);
+    printf("  TTF_RenderUTF8_Blended: %.0fus first frame, %.0fus per frame\n", first_frame[0], per_frame[0]);
+    printf("  Glyph atlas:            %.0fus first frame, %.0fus per frame\n", first_frame[1], per_frame[1]);
+#ifdef DEBUGGING
+    debug_printf("Text drawing benchmark: %.0fus per frame before, %.0fus per frame with glyph atlas (%.0fus to build).\n", per_frame[0], per_frame[1], first_frame[1]);
+#endif
+
+    // Put the puzzle back the way the player found it.
+    midend_process_key(fe->me, 0, 0, 'u');
+    midend_force_redraw(fe->me);
+}
+#endif
+
 void start_game(frontend *fe, int game_index, uint skip_config)
 {
 #ifdef DEBUG_FUNCTIONS
@@ -6002,6 +6635,7 @@ void start_game(frontend *fe, int game_index, uint skip_config)
     start_loading_animation(fe);
 
     fe->me = midend_new(fe, &this_game, &sdl_drawing, fe);
+    midend_set_draw_batching(fe->me, global_config->batched_drawing);
 
     // Get the colours that the midend thinks it needs.
     colours = midend_colours(fe->me, &ncolours);
@@ -6092,7 +6726,14 @@ void start_game(frontend *fe, int game_index, uint skip_config)
 
     sfree(colours);
 
-    // Generate a new game.
+    // Generate a new game.  Once it's ready, the midend starts generating the next few in the
+    // background; they're thrown away when the midend is freed by the next start_game.
+    // The fast random number generator makes different puzzles from the same seed as
+    // every other build of the puzzles, so it's off unless asked for. Its seeds start
+    // with a '~', so their game IDs still work anywhere with this random.c.
+    midend_set_random_kind(fe->me, global_config->fast_random ? RANDOM_FAST : RANDOM_SHA1);
+    midend_set_pregen(fe->me, PREGEN_QUEUE_LENGTH, PREGEN_QUEUE_BYTES);
+    midend_set_race_workers(fe->me, RACE_WORKERS);
     midend_new_game(fe->me);
 
     // Get the size of the game.
@@ -6155,6 +6796,11 @@ void start_game(frontend *fe, int game_index, uint skip_config)
 
     draw_menu(fe, INGAME);
 
+#ifdef BENCHMARK_TEXT_DRAWING
+    if(!strcmp(this_game.name, "Solo"))
+        benchmark_text_drawing(fe);
+#endif
+
     // Turn on the cursor.
     if(global_config->control_system != CURSOR_KEYS_EMULATION)
         ;//SDL_ShowCursor(SDL_ENABLE);
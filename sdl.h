@@ -9,8 +9,12 @@ void sdl_actual_draw_text(void *handle, int x, int y, int fonttype, int fontsize
 void fatal(char *fmt, ...);
 void Lock_SDL_Surface(frontend *fe);
 void Unlock_SDL_Surface(frontend *fe);
+void Defer_Lock_SDL_Surface(frontend *fe);
+void Lock_Deferred_SDL_Surface(frontend *fe);
 void get_random_seed(void **randseed, int *randseedsize);
 void frontend_default_colour(frontend *fe, float *output);
+int find_and_cache_glyph_atlas(void *handle, int font_index, SDL_Color colour);
+int text_fits_glyph_atlas(char *text);
 void sdl_start_draw(void *handle);
 void sdl_no_clip(void *handle);
 void sdl_clip(void *handle, int x, int y, int w, int h);
@@ -31,6 +35,8 @@ void sdl_blitter_save(void *handle, blitter *bl, int x, int y);
 void sdl_blitter_load(void *handle, blitter *bl, int x, int y);
 void sdl_draw_update(void *handle, int x, int y, int w, int h);
 void sdl_actual_draw_update(void *handle, int x, int y, int w, int h);
+void add_dirty_rect(frontend *fe, int x, int y, int w, int h);
+uint push_dirty_rects(frontend *fe);
 void sdl_end_draw(void *handle);
 static void configure_area(int x, int y, void *data);
 Uint32 sdl_timer_func(Uint32 interval, void *data);
@@ -61,6 +67,9 @@ int splashscreen_thread_func(void *data);
 void menu_loop(frontend *fe);
 void redraw_gamelist_menu(frontend *fe);
 void start_game(frontend *fe, int game_index, uint skip_config);
+#ifdef BENCHMARK_TEXT_DRAWING
+void benchmark_text_drawing(frontend *fe);
+#endif
 void change_clockspeed(frontend *fe, uint new_clock_speed);
 uint savefile_exists(char *game_name, uint saveslot_number);
 char *generate_save_filename(char *game_name, uint saveslot_number);
@@ -35,7 +35,6 @@
 #include <math.h>
 
 #include "puzzles.h"
-#include "tree234.h"
 
 /*
  * The implementation of this game revolves around the insight
@@ -70,7 +69,8 @@
  * pointing back through all the other squares in the same block.
  *
  * So the solver simply does a bfs over all reachable positions,
- * encoding them in this format and storing them in a tree234 to
+ * encoding them in this format (or rather a packed form of it; see
+ * struct boardset below) and storing them in a hash table to
  * ensure it doesn't ever revisit an already-analysed position.
  */
 
@@ -365,40 +365,274 @@ static char *board_text_format(int w, int h, unsigned char *data,
  */
 
 /*
- * During solver execution, the set of visited board positions is
- * stored as a tree234 of the following structures. `w', `h' and
- * `data' are obvious in meaning; `dist' represents the minimum
- * distance to reach this position from the starting point.
- * 
- * `prev' links each board to the board position from which it was
- * most efficiently derived.
+ * During solver execution, the visited board positions are kept in
+ * a flat array in the order in which they were reached. Since the
+ * search is breadth-first, that is also the order in which they are
+ * to be expanded, so the array doubles as the BFS queue. A hash
+ * table of indices into the array spots positions already seen.
+ *
+ * Positions are stored packed. Walls never move, and a block is
+ * determined by where its anchor is and what shape it is, so a
+ * position is just a list, over the non-wall squares in order, of
+ * which shape of block (if any) is anchored on each one. Each entry
+ * takes `bits' bits, and a whole position takes `keylen' bytes.
+ *
+ * Alongside each position we keep the index of the position it
+ * was most efficiently derived from, or -1 for the starting one.
  */
-struct board {
+struct boardset {
     int w, h;
-    int dist;
-    struct board *prev;
-    unsigned char *data;
+    unsigned char *base;	       /* the walls, and EMPTY elsewhere */
+    int ncells, *cellidx, *cellpos;    /* non-wall squares */
+
+    /*
+     * Shape s is anchored by shapeanchor[s] (ANCHOR or MAINANCHOR),
+     * and its other squares are at offsets shapeoff[] from the
+     * anchor, containing shapeval[], for indices from shapestart[s]
+     * up to but not including shapestart[s+1].
+     */
+    int nshapes, *shapestart, *shapeoff;
+    unsigned char *shapeanchor, *shapeval;
+
+    int bits, keylen;
+    int npos, posalloc;
+    unsigned char *keys;
+    int *prev;
+    int *hash, hashsize;	       /* -1 for an empty slot */
 };
 
-static int boardcmp(void *av, void *bv)
+static int boardset_get(const unsigned char *key, int bits, int cell)
 {
-    struct board *a = (struct board *)av;
-    struct board *b = (struct board *)bv;
-    return memcmp(a->data, b->data, a->w * a->h);
+    int bit = cell * bits, v = 0, i;
+
+    for (i = 0; i < bits; i++, bit++)
+	v |= ((key[bit >> 3] >> (bit & 7)) & 1) << i;
+    return v;
+}
+
+static void boardset_set(unsigned char *key, int bits, int cell, int v)
+{
+    int bit = cell * bits, i;
+
+    for (i = 0; i < bits; i++, bit++) {
+	if (v & (1 << i))
+	    key[bit >> 3] |= 1 << (bit & 7);
+	else
+	    key[bit >> 3] &= ~(1 << (bit & 7));
+    }
+}
+
+static unsigned boardset_hashkey(const unsigned char *key, int keylen)
+{
+    unsigned h = 2166136261U;
+    int i;
+
+    for (i = 0; i < keylen; i++)
+	h = (h ^ key[i]) * 16777619U;
+    return h;
+}
+
+/*
+ * Unpack position `index' into a full board.
+ */
+static void boardset_unpack(struct boardset *bs, int index,
+			    unsigned char *data)
+{
+    const unsigned char *key = bs->keys + index * bs->keylen;
+    int c, k;
+
+    memcpy(data, bs->base, bs->w * bs->h);
+    for (c = 0; c < bs->ncells; c++) {
+	int s = boardset_get(key, bs->bits, c) - 1;
+	int pos = bs->cellpos[c];
+	if (s < 0)
+	    continue;
+	data[pos] = bs->shapeanchor[s];
+	for (k = bs->shapestart[s]; k < bs->shapestart[s+1]; k++)
+	    data[pos + bs->shapeoff[k]] = bs->shapeval[k];
+    }
+}
+
+/*
+ * Add the packed position `key' to the set, unless it's already
+ * there. Returns its index, or -1 if it was already present.
+ */
+static int boardset_add(struct boardset *bs, const unsigned char *key,
+			int prev)
+{
+    unsigned mask = bs->hashsize - 1;
+    unsigned h = boardset_hashkey(key, bs->keylen) & mask;
+    int index;
+
+    while (bs->hash[h] >= 0) {
+	if (!memcmp(bs->keys + bs->hash[h] * bs->keylen, key, bs->keylen))
+	    return -1;
+	h = (h + 1) & mask;
+    }
+
+    if (bs->npos >= bs->posalloc) {
+	bs->posalloc = bs->posalloc * 2;
+	bs->keys = sresize(bs->keys, bs->posalloc * bs->keylen,
+			   unsigned char);
+	bs->prev = sresize(bs->prev, bs->posalloc, int);
+    }
+    index = bs->npos++;
+    memcpy(bs->keys + index * bs->keylen, key, bs->keylen);
+    bs->prev[index] = prev;
+    bs->hash[h] = index;
+
+    /* Keep the table at most half full. */
+    if (bs->npos * 2 > bs->hashsize) {
+	int i;
+
+	sfree(bs->hash);
+	bs->hashsize *= 2;
+	mask = bs->hashsize - 1;
+	bs->hash = snewn(bs->hashsize, int);
+	for (i = 0; i < bs->hashsize; i++)
+	    bs->hash[i] = -1;
+	for (i = 0; i < bs->npos; i++) {
+	    h = boardset_hashkey(bs->keys + i * bs->keylen,
+				 bs->keylen) & mask;
+	    while (bs->hash[h] >= 0)
+		h = (h + 1) & mask;
+	    bs->hash[h] = i;
+	}
+    }
+
+    return index;
+}
+
+/*
+ * Set up a boardset for searching from the given board, and add the
+ * board to it as position 0.
+ */
+static void boardset_init(struct boardset *bs, int w, int h,
+			  unsigned char *board)
+{
+    int wh = w*h;
+    int *which = snewn(wh, int);
+    int *anchorshape = snewn(wh, int);
+    unsigned char *key;
+    int i, j, k, s, noff;
+
+    bs->w = w;
+    bs->h = h;
+    bs->base = snewn(wh, unsigned char);
+    bs->cellidx = snewn(wh, int);
+    bs->cellpos = snewn(wh, int);
+    bs->ncells = 0;
+    for (i = 0; i < wh; i++) {
+	if (board[i] == WALL) {
+	    bs->base[i] = WALL;
+	    bs->cellidx[i] = -1;
+	} else {
+	    bs->base[i] = EMPTY;
+	    bs->cellidx[i] = bs->ncells;
+	    bs->cellpos[bs->ncells++] = i;
+	}
+    }
+
+    /*
+     * Find the blocks, and collect their distinct shapes. A block
+     * has at most wh squares, so there's room for wh offsets in
+     * total, counting each shape only once.
+     */
+    for (i = 0; i < wh; i++) {
+	which[i] = -1;
+	if (ISANCHOR(board[i]))
+	    which[i] = i;
+	else if (ISDIST(board[i]))
+	    which[i] = which[i - board[i]];
+    }
+    bs->shapestart = snewn(wh+1, int);
+    bs->shapeoff = snewn(wh, int);
+    bs->shapeval = snewn(wh, unsigned char);
+    bs->shapeanchor = snewn(wh, unsigned char);
+    bs->nshapes = 0;
+    bs->shapestart[0] = noff = 0;
+    for (i = 0; i < wh; i++) {
+	anchorshape[i] = -1;
+	if (!ISANCHOR(board[i]))
+	    continue;
+
+	/* Write this block's shape down as a new shape... */
+	s = bs->nshapes;
+	bs->shapeanchor[s] = board[i];
+	for (j = i+1; j < wh; j++)
+	    if (which[j] == i) {
+		bs->shapeoff[noff] = j - i;
+		bs->shapeval[noff] = board[j];
+		noff++;
+	    }
+
+	/* ... and take it back again if we've seen it before. */
+	for (k = 0; k < s; k++)
+	    if (bs->shapeanchor[k] == board[i] &&
+		bs->shapestart[k+1] - bs->shapestart[k] ==
+		noff - bs->shapestart[s] &&
+		!memcmp(bs->shapeoff + bs->shapestart[k],
+			bs->shapeoff + bs->shapestart[s],
+			(noff - bs->shapestart[s]) * sizeof(int)) &&
+		!memcmp(bs->shapeval + bs->shapestart[k],
+			bs->shapeval + bs->shapestart[s],
+			noff - bs->shapestart[s]))
+		break;
+	if (k < s) {
+	    noff = bs->shapestart[s];
+	} else {
+	    bs->nshapes++;
+	    bs->shapestart[bs->nshapes] = noff;
+	}
+	anchorshape[i] = k;
+    }
+
+    for (bs->bits = 1; (1 << bs->bits) <= bs->nshapes; bs->bits++);
+    bs->keylen = (bs->ncells * bs->bits + 7) / 8;
+    if (bs->keylen == 0)
+	bs->keylen = 1;
+
+    bs->npos = 0;
+    bs->posalloc = 256;
+    bs->keys = snewn(bs->posalloc * bs->keylen, unsigned char);
+    bs->prev = snewn(bs->posalloc, int);
+    bs->hashsize = 512;
+    bs->hash = snewn(bs->hashsize, int);
+    for (i = 0; i < bs->hashsize; i++)
+	bs->hash[i] = -1;
+
+    key = snewn(bs->keylen, unsigned char);
+    memset(key, 0, bs->keylen);
+    for (i = 0; i < wh; i++)
+	if (anchorshape[i] >= 0)
+	    boardset_set(key, bs->bits, bs->cellidx[i], anchorshape[i] + 1);
+    boardset_add(bs, key, -1);
+
+    sfree(key);
+    sfree(anchorshape);
+    sfree(which);
 }
 
-static struct board *newboard(int w, int h, unsigned char *data)
+static void boardset_free(struct boardset *bs)
 {
-    struct board *b = smalloc(sizeof(struct board) + w*h);
-    b->data = (unsigned char *)b + sizeof(struct board);
-    memcpy(b->data, data, w*h);
-    b->w = w;
-    b->h = h;
-    b->dist = -1;
-    b->prev = NULL;
-    return b;
+    sfree(bs->hash);
+    sfree(bs->prev);
+    sfree(bs->keys);
+    sfree(bs->shapeanchor);
+    sfree(bs->shapeval);
+    sfree(bs->shapeoff);
+    sfree(bs->shapestart);
+    sfree(bs->cellpos);
+    sfree(bs->cellidx);
+    sfree(bs->base);
 }
 
+#ifdef STANDALONE_SOLVER
+/* Totals over all calls to solve_board, for the benchmark. */
+static long solver_positions = 0;
+static long solver_peak_bytes = 0;
+#endif
+
 /*
  * The actual solver. Given a board, attempt to find the minimum
  * length of move sequence which moves MAINANCHOR to (tx,ty), or
@@ -416,12 +650,12 @@ static int solve_board(int w, int h, unsigned char *board,
 		       int movelimit, int **moveout)
 {
     int wh = w*h;
-    struct board *b, *b2, *b3;
+    struct boardset bs;
+    unsigned char *data, *data2, *key;
     int *next, *anchors, *which;
     int *movereached, *movequeue, mqhead, mqtail;
-    tree234 *sorted, *queue;
     int i, j, dir;
-    int qlen, lastdist;
+    int index, found, dist, distend, mainpos;
     int ret;
 
 #ifdef SOLVER_DIAGNOSTICS
@@ -449,38 +683,47 @@ static int solve_board(int w, int h, unsigned char *board,
     }
 #endif
 
-    sorted = newtree234(boardcmp);
-    queue = newtree234(NULL);
-
-    b = newboard(w, h, board);
-    b->dist = 0;
-    add234(sorted, b);
-    addpos234(queue, b, 0);
-    qlen = 1;
+    boardset_init(&bs, w, h, board);
 
+    data = snewn(wh, unsigned char);
+    data2 = snewn(wh, unsigned char);
+    key = snewn(bs.keylen, unsigned char);
     next = snewn(wh, int);
     anchors = snewn(wh, int);
     which = snewn(wh, int);
     movereached = snewn(wh, int);
     movequeue = snewn(wh, int);
-    lastdist = -1;
 
-    while ((b = delpos234(queue, 0)) != NULL) {
-	qlen--;
-	if (movelimit >= 0 && b->dist >= movelimit) {
+    /*
+     * Positions [0,distend) are at distance at most `dist' from the
+     * start; the ones from distend onwards are one move further.
+     */
+    found = -1;
+    dist = 0;
+    distend = 1;
+
+    for (index = 0; index < bs.npos; index++) {
+	unsigned char *bkey = bs.keys + index * bs.keylen;
+
+	if (index == distend) {
+	    dist++;
+	    distend = bs.npos;
+	}
+#ifdef SOLVER_DIAGNOSTICS
+	if (index == 0 || index == distend)
+	    printf("dist %d (%d)\n", dist, bs.npos);
+#endif
+	if (movelimit >= 0 && dist >= movelimit) {
 	    /*
 	     * The problem is not soluble in under `movelimit'
 	     * moves, so we can quit right now.
 	     */
-	    b2 = NULL;
 	    goto done;
 	}
-	if (b->dist != lastdist) {
-#ifdef SOLVER_DIAGNOSTICS
-	    printf("dist %d (%d)\n", b->dist, count234(sorted));
-#endif
-	    lastdist = b->dist;
-	}
+
+	boardset_unpack(&bs, index, data);
+	mainpos = -1;
+
 	/*
 	 * Find all the anchors and form a linked list of the
 	 * squares within each block.
@@ -489,11 +732,13 @@ static int solve_board(int w, int h, unsigned char *board,
 	    next[i] = -1;
 	    anchors[i] = FALSE;
 	    which[i] = -1;
-	    if (ISANCHOR(b->data[i])) {
+	    if (ISANCHOR(data[i])) {
 		anchors[i] = TRUE;
 		which[i] = i;
-	    } else if (ISDIST(b->data[i])) {
-		j = i - b->data[i];
+		if (data[i] == MAINANCHOR)
+		    mainpos = i;
+	    } else if (ISDIST(data[i])) {
+		j = i - data[i];
 		next[j] = i;
 		which[i] = which[j];
 	    }
@@ -504,8 +749,11 @@ static int solve_board(int w, int h, unsigned char *board,
 	 * places we can slide it to.
 	 */
 	for (i = 0; i < wh; i++) {
+	    int shape;
+
 	    if (!anchors[i])
 		continue;
+	    shape = boardset_get(bkey, bs.bits, bs.cellidx[i]);
 
 	    mqhead = mqtail = 0;
 	    for (j = 0; j < wh; j++)
@@ -533,8 +781,8 @@ static int solve_board(int w, int h, unsigned char *board,
 		    for (j = i; j >= 0; j = next[j]) {
 			int jy = (pos+j-i) / w + dy, jx = (pos+j-i) % w + dx;
 			if (jy >= 0 && jy < h && jx >= 0 && jx < w &&
-			    ((b->data[j+d] == EMPTY || which[j+d] == i) &&
-			     (b->data[i] == MAINANCHOR || !forcefield[j+d])))
+			    ((data[j+d] == EMPTY || which[j+d] == i) &&
+			     (data[i] == MAINANCHOR || !forcefield[j+d])))
 			    /* ok */;
 			else
 			    break;
@@ -552,56 +800,63 @@ static int solve_board(int w, int h, unsigned char *board,
 		    movequeue[mqtail++] = newpos;
 
 		    /*
-		     * We have a viable move. Make it.
+		     * We have a viable move. Make it, which only
+		     * moves the block's anchor in the packed form.
 		     */
-		    b2 = newboard(w, h, b->data);
-		    for (j = i; j >= 0; j = next[j])
-			b2->data[j] = EMPTY;
-		    for (j = i; j >= 0; j = next[j])
-			b2->data[j+d] = b->data[j];
-
-		    b3 = add234(sorted, b2);
-		    if (b3 != b2) {
-			sfree(b2);	       /* we already got one */
-		    } else {
-			b2->dist = b->dist + 1;
-			b2->prev = b;
-			addpos234(queue, b2, qlen++);
-			if (b2->data[ty*w+tx] == MAINANCHOR)
-			    goto done;     /* search completed! */
+		    memcpy(key, bkey, bs.keylen);
+		    boardset_set(key, bs.bits, bs.cellidx[i], 0);
+		    boardset_set(key, bs.bits, bs.cellidx[newpos], shape);
+
+		    j = boardset_add(&bs, key, index);
+		    bkey = bs.keys + index * bs.keylen;   /* may have moved */
+		    if (j >= 0 && (data[i] == MAINANCHOR ? newpos : mainpos) ==
+			ty*w+tx) {
+			found = j;
+			goto done;     /* search completed! */
 		    }
 		}
 	    }
 	}
     }
-    b2 = NULL;
 
     done:
 
-    if (b2) {
-	ret = b2->dist;
+#ifdef STANDALONE_SOLVER
+    solver_positions += bs.npos;
+    {
+	long bytes = (long)bs.posalloc * (bs.keylen + sizeof(int)) +
+	    (long)bs.hashsize * sizeof(int);
+	if (solver_peak_bytes < bytes)
+	    solver_peak_bytes = bytes;
+    }
+#endif
+
+    if (found >= 0) {
+	ret = dist + 1;
 	if (moveout) {
 	    /*
-	     * Now b2 represents the solved position. Backtrack to
+	     * Now `found' is the solved position. Backtrack to
 	     * output the solution.
 	     */
 	    *moveout = snewn(ret * 2, int);
 	    j = ret * 2;
 
-	    while (b2->prev) {
+	    boardset_unpack(&bs, found, data2);
+	    while (bs.prev[found] >= 0) {
 		int from = -1, to = -1;
 
-		b = b2->prev;
+		found = bs.prev[found];
+		boardset_unpack(&bs, found, data);
 
 		/*
-		 * Scan b and b2 to find out which piece has
-		 * moved.
+		 * Scan the two positions to find out which piece
+		 * has moved.
 		 */
 		for (i = 0; i < wh; i++) {
-		    if (ISANCHOR(b->data[i]) && !ISANCHOR(b2->data[i])) {
+		    if (ISANCHOR(data[i]) && !ISANCHOR(data2[i])) {
 			assert(from == -1);
 			from = i;
-		    } else if (!ISANCHOR(b->data[i]) && ISANCHOR(b2->data[i])){
+		    } else if (!ISANCHOR(data[i]) && ISANCHOR(data2[i])){
 			assert(to == -1);
 			to = i;
 		    }
@@ -612,7 +867,7 @@ static int solve_board(int w, int h, unsigned char *board,
 		(*moveout)[--j] = to;
 		(*moveout)[--j] = from;
 
-		b2 = b;
+		memcpy(data2, data, wh);
 	    }
 	    assert(j == 0);
 	}
@@ -622,12 +877,11 @@ static int solve_board(int w, int h, unsigned char *board,
 	    *moveout = NULL;
     }
 
-    freetree234(queue);
-
-    while ((b = delpos234(sorted, 0)) != NULL)
-	sfree(b);
-    freetree234(sorted);
+    boardset_free(&bs);
 
+    sfree(data);
+    sfree(data2);
+    sfree(key);
     sfree(next);
     sfree(anchors);
     sfree(movereached);
@@ -2419,13 +2673,39 @@ const struct game thegame = {
 #ifdef STANDALONE_SOLVER
 
 #include <stdarg.h>
+#include <time.h>
+
+/*
+ * Generate `n' puzzles with the given parameters, and report how
+ * hard the solver worked.
+ */
+static void benchmark(game_params *p, int n)
+{
+    random_state *rs = random_new("slide", 5);
+    clock_t start = clock();
+    double secs;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	char *aux = NULL;
+	char *desc = new_game_desc(p, rs, &aux, FALSE);
+	sfree(desc);
+	sfree(aux);
+    }
+    secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%d puzzles in %.2f s: %ld positions, %.0f positions/s, "
+	   "peak solver memory %ld KB\n", n, secs, solver_positions,
+	   solver_positions / secs, solver_peak_bytes / 1024);
+    random_free(rs);
+}
 
 int main(int argc, char **argv)
 {
     game_params *p;
     game_state *s;
     char *id = NULL, *desc, *err;
-    int count = FALSE;
+    int count = FALSE, generate = 0;
     int ret, really_verbose = FALSE;
     int *moves;
 
@@ -2435,6 +2715,9 @@ int main(int argc, char **argv)
             really_verbose = TRUE;
         } else if (!strcmp(p, "-c")) {
             count = TRUE;
+        } else if (!strcmp(p, "-g") && argc > 1) {
+            generate = atoi(*++argv);
+            argc--;
         } else if (*p == '-') {
             fprintf(stderr, "%s: unrecognised option `%s'\n", argv[0], p);
             return 1;
@@ -2444,10 +2727,18 @@ int main(int argc, char **argv)
     }
 
     if (!id) {
-        fprintf(stderr, "usage: %s [-c | -v] <game_id>\n", argv[0]);
+        fprintf(stderr, "usage: %s [-c | -v] <game_id>\n"
+                "       %s -g <count> <params>\n", argv[0], argv[0]);
         return 1;
     }
 
+    if (generate > 0) {
+        p = default_params();
+        decode_params(p, id);
+        benchmark(p, generate);
+        return 0;
+    }
+
     desc = strchr(id, ':');
     if (!desc) {
         fprintf(stderr, "%s: game id expects a colon in it\n", argv[0]);
@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <assert.h>
 #include "puzzles.h"
 #include "smalloc.h"
 #include <malloc.h>
@@ -36,11 +37,22 @@ int TakenSize[0x2000000 / BLOCKSIZE];
 
 #define SetTaken(Start, Size) TakenSize[(Start - 0x2000000) / BLOCKSIZE] = (Size - 1) / BLOCKSIZE + 1
 
+/* Round sizes up to a multiple of this, to keep every result aligned. */
+union smalloc_align { long l; double d; void *p; };
+#define SMALLOC_ALIGN(n) \
+    (((n) + sizeof(union smalloc_align) - 1) & ~(sizeof(union smalloc_align) - 1))
+
+/*
+ * The functions the rest of the program calls (smalloc, sfree,
+ * srealloc and friends) are further down; they do their bookkeeping
+ * and then call these to get or release the actual memory.
+ */
+
 /*
  * smalloc should guarantee to return a useful pointer - Halibut
  * can do nothing except die when it's out of memory anyway.
  */
-void *smalloc(size_t size)
+static void *smalloc_raw(size_t size)
 {
     void *p=NULL;
 #ifndef DEBUG_PRETEND_MEMORY_FULL
@@ -65,7 +77,7 @@ void *smalloc(size_t size)
 /*
  * sfree should guaranteeably deal gracefully with freeing NULL
  */
-void sfree(void *p) {
+static void sfree_raw(void *p) {
     if (p)
     {
 #ifdef OPTION_USE_UPPER_MEMORY
@@ -90,7 +102,7 @@ void sfree(void *p) {
 /*
  * srealloc should guaranteeably be able to realloc NULL
  */
-void *srealloc(void *p, size_t size)
+static void *srealloc_raw(void *p, size_t size)
 {
     void *q=NULL;
 
@@ -116,21 +128,548 @@ void *srealloc(void *p, size_t size)
     }
     else
     {
-	q = smalloc(size);
+	q = smalloc_raw(size);
     };
 
     return q;
 }
 
+/*
+ * Running totals of calls to the functions below, for measuring how
+ * much a piece of code allocates. See smalloc_get_stats(). They're
+ * only kept in builds which ask for them (the profiler below always
+ * does), since several threads may be allocating at once and that
+ * makes every count an atomic operation. Nobody should be counting
+ * on a machine without GCC's __sync builtins.
+ */
+#if defined SMALLOC_PROFILE && !defined SMALLOC_STATS
+#define SMALLOC_STATS
+#endif
+
+#ifdef SMALLOC_STATS
+static struct smalloc_stats stats;
+#define STATS_ADD(field, n) ((void)__sync_fetch_and_add(&stats.field, (n)))
+#define STATS_GET(field) __sync_fetch_and_add(&stats.field, 0)
+#define STATS_CLEAR(field) ((void)__sync_fetch_and_and(&stats.field, 0))
+#else
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_GET(field) 0UL
+#define STATS_CLEAR(field) ((void)0)
+#endif
+
+void smalloc_get_stats(struct smalloc_stats *ret)
+{
+    ret->mallocs = STATS_GET(mallocs);
+    ret->reallocs = STATS_GET(reallocs);
+    ret->frees = STATS_GET(frees);
+    ret->bytes = STATS_GET(bytes);
+}
+
+void smalloc_reset_stats(void)
+{
+    STATS_CLEAR(mallocs);
+    STATS_CLEAR(reallocs);
+    STATS_CLEAR(frees);
+    STATS_CLEAR(bytes);
+}
+
+#ifndef SMALLOC_PROFILE
+
+void *smalloc(size_t size)
+{
+    STATS_ADD(mallocs, 1);
+    STATS_ADD(bytes, size);
+    return smalloc_raw(size);
+}
+
+void sfree(void *p)
+{
+    if (p) {
+        STATS_ADD(frees, 1);
+        sfree_raw(p);
+    }
+}
+
+void *srealloc(void *p, size_t size)
+{
+    if (p) {
+        STATS_ADD(reallocs, 1);
+        return srealloc_raw(p, size);
+    }
+    return smalloc(size);
+}
+
+/*
+ * Without SMALLOC_PROFILE there's nothing per call site to report,
+ * so just give the running totals, if there are any.
+ */
+void smalloc_profile_report(FILE *fp)
+{
+#ifdef SMALLOC_STATS
+    struct smalloc_stats s;
+
+    smalloc_get_stats(&s);
+    fprintf(fp, "smalloc: %lu mallocs, %lu reallocs, %lu frees, "
+            "%lu bytes (build with SMALLOC_PROFILE for more)\n",
+            s.mallocs, s.reallocs, s.frees, s.bytes);
+#else
+    fprintf(fp, "smalloc: build with SMALLOC_STATS or SMALLOC_PROFILE "
+            "to count allocations\n");
+#endif
+}
+
+void smalloc_profile_reset(void)
+{
+    smalloc_reset_stats();
+}
+
+#else /* SMALLOC_PROFILE */
+
+/*
+ * Allocation profiling. puzzles.h turns every smalloc, srealloc and
+ * dupstr (and so every snew, snewn and sresize) into a call to the
+ * _at functions below, passing __FILE__ and __LINE__. Each block
+ * then carries a small header saying how big it is and which call
+ * site it belongs to, and each call site keeps counts, bytes, bytes
+ * still live (and the most there have ever been) and a histogram of
+ * the sizes it asked for. The report is written at exit, to stderr
+ * or to the file named by the SMALLOC_PROFILE environment variable,
+ * or whenever smalloc_profile_report is called.
+ *
+ * Everything must then be freed with sfree, including memory from
+ * code which calls smalloc without having included puzzles.h (it
+ * gets the header too, and is filed under an unknown call site).
+ */
+
+/* Size classes: up to 16 bytes, up to 32, ..., up to 16K, and more. */
+#define NSIZECLASSES 12
+
+struct prof_site {
+    const char *file;		       /* NULL for an empty slot */
+    int line;
+    unsigned long allocs, reallocs, frees;
+    unsigned long bytes;	       /* total ever asked for */
+    unsigned long live, peak;	       /* bytes in blocks it owns */
+    unsigned long sizes[NSIZECLASSES];
+};
+
+struct prof_hdr {
+    struct prof_site *site;
+    size_t size;
+    unsigned long magic;
+};
+
+#define PROF_MAGIC 0x5A110C8DUL
+#define PROF_HDR SMALLOC_ALIGN(sizeof(struct prof_hdr))
+
+/*
+ * The call sites live in a fixed open-addressed hash table, keyed on
+ * the __FILE__ pointer and line number, so that the profiler never
+ * has to allocate anything itself. (A file whose name string the
+ * compiler didn't merge can end up with more than one entry per line;
+ * the report merges them.) Once the table is three-quarters full,
+ * further sites are all counted together.
+ */
+#define NPROFSITES 4096
+static struct prof_site prof_sites[NPROFSITES];
+static int prof_nsites;
+static struct prof_site prof_overflow = { "(other sites)", 0 };
+static unsigned long prof_live, prof_peak;
+static int prof_started;
+
+/*
+ * The background generator (see midend.c) allocates from another
+ * thread, so the tables are guarded by a spin lock. Nobody should
+ * be profiling on a machine without GCC's __sync builtins.
+ */
+static volatile int prof_lock;
+#define PROF_LOCK() while (__sync_lock_test_and_set(&prof_lock, 1))
+#define PROF_UNLOCK() __sync_lock_release(&prof_lock)
+
+static void prof_atexit(void);
+
+static struct prof_site *prof_site(const char *file, int line)
+{
+    unsigned h;
+    struct prof_site *site;
+
+    if (!file)
+        file = "(unknown)";
+    h = ((unsigned)((size_t)file >> 2) * 31 + line) & (NPROFSITES-1);
+    while (1) {
+        site = &prof_sites[h];
+        if (site->file == file && site->line == line)
+            return site;
+        if (!site->file)
+            break;
+        h = (h + 1) & (NPROFSITES-1);
+    }
+
+    if (prof_nsites >= NPROFSITES / 4 * 3)
+        return &prof_overflow;
+    prof_nsites++;
+    site->file = file;
+    site->line = line;
+    return site;
+}
+
+static int prof_sizeclass(size_t size)
+{
+    int c = 0;
+    while (c < NSIZECLASSES-1 && size > ((size_t)16 << c))
+        c++;
+    return c;
+}
+
+/* Record `size' more bytes being asked for at a site. Call locked. */
+static void prof_add(struct prof_site *site, size_t size)
+{
+    site->bytes += size;
+    site->sizes[prof_sizeclass(size)]++;
+    site->live += size;
+    if (site->peak < site->live)
+        site->peak = site->live;
+    prof_live += size;
+    if (prof_peak < prof_live)
+        prof_peak = prof_live;
+}
+
+/* And record a block of `size' bytes going away. Call locked. */
+static void prof_remove(struct prof_site *site, size_t size)
+{
+    site->live -= size;
+    prof_live -= size;
+}
+
+void *smalloc_at(size_t size, const char *file, int line)
+{
+    struct prof_hdr *hdr = smalloc_raw(PROF_HDR + size);
+    struct prof_site *site;
+
+    PROF_LOCK();
+    if (!prof_started) {
+        prof_started = 1;
+        atexit(prof_atexit);
+    }
+    site = prof_site(file, line);
+    site->allocs++;
+    prof_add(site, size);
+    STATS_ADD(mallocs, 1);
+    STATS_ADD(bytes, size);
+    PROF_UNLOCK();
+
+    hdr->site = site;
+    hdr->size = size;
+    hdr->magic = PROF_MAGIC;
+    return (char *)hdr + PROF_HDR;
+}
+
+/*
+ * A block which is resized changes hands: its bytes count against
+ * the site which last resized it.
+ */
+void *srealloc_at(void *p, size_t size, const char *file, int line)
+{
+    struct prof_hdr *hdr;
+    struct prof_site *site;
+
+    if (!p)
+        return smalloc_at(size, file, line);
+
+    hdr = (struct prof_hdr *)((char *)p - PROF_HDR);
+    assert(hdr->magic == PROF_MAGIC);  /* not from smalloc? */
+    PROF_LOCK();
+    prof_remove(hdr->site, hdr->size);
+    site = prof_site(file, line);
+    site->reallocs++;
+    prof_add(site, size);
+    STATS_ADD(reallocs, 1);
+    PROF_UNLOCK();
+
+    hdr = srealloc_raw(hdr, PROF_HDR + size);
+    hdr->site = site;
+    hdr->size = size;
+    return (char *)hdr + PROF_HDR;
+}
+
+void sfree(void *p)
+{
+    struct prof_hdr *hdr;
+
+    if (!p)
+        return;
+
+    hdr = (struct prof_hdr *)((char *)p - PROF_HDR);
+    assert(hdr->magic == PROF_MAGIC);  /* not from smalloc, or freed twice */
+    PROF_LOCK();
+    hdr->site->frees++;
+    prof_remove(hdr->site, hdr->size);
+    STATS_ADD(frees, 1);
+    PROF_UNLOCK();
+
+    hdr->magic = 0;
+    sfree_raw(hdr);
+}
+
+static int prof_cmp_site(const void *av, const void *bv)
+{
+    const struct prof_site *a = (const struct prof_site *)av;
+    const struct prof_site *b = (const struct prof_site *)bv;
+    int c = strcmp(a->file, b->file);
+    if (c)
+        return c;
+    return a->line < b->line ? -1 : a->line > b->line ? +1 : 0;
+}
+
+static int prof_cmp_bytes(const void *av, const void *bv)
+{
+    const struct prof_site *a = (const struct prof_site *)av;
+    const struct prof_site *b = (const struct prof_site *)bv;
+    if (a->bytes != b->bytes)
+        return a->bytes > b->bytes ? -1 : +1;
+    return prof_cmp_site(av, bv);
+}
+
+/*
+ * Write out every call site that has done anything, biggest total
+ * first. The copy of the table is made with plain malloc, so that
+ * reporting doesn't disturb the figures.
+ */
+void smalloc_profile_report(FILE *fp)
+{
+    struct prof_site *sites, total;
+    unsigned long live, peak;
+    int i, j, n;
+
+    sites = malloc((NPROFSITES + 1) * sizeof(struct prof_site));
+    if (!sites)
+        return;
+
+    PROF_LOCK();
+    n = 0;
+    for (i = 0; i < NPROFSITES; i++)
+        if (prof_sites[i].file)
+            sites[n++] = prof_sites[i];
+    if (prof_overflow.allocs || prof_overflow.reallocs || prof_overflow.live)
+        sites[n++] = prof_overflow;
+    live = prof_live;
+    peak = prof_peak;
+    PROF_UNLOCK();
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < n; i++) {
+        total.allocs += sites[i].allocs;
+        total.reallocs += sites[i].reallocs;
+        total.frees += sites[i].frees;
+        total.bytes += sites[i].bytes;
+    }
+    fprintf(fp, "smalloc: %lu mallocs, %lu reallocs, %lu frees, "
+            "%lu bytes; %lu bytes live, peak %lu\n", total.allocs,
+            total.reallocs, total.frees, total.bytes, live, peak);
+
+    /* Merge any sites that are really the same file and line. */
+    qsort(sites, n, sizeof(*sites), prof_cmp_site);
+    for (i = j = 0; i < n; i++) {
+        if (j > 0 && !prof_cmp_site(&sites[j-1], &sites[i])) {
+            struct prof_site *t = &sites[j-1], *s = &sites[i];
+            int c;
+            t->allocs += s->allocs;
+            t->reallocs += s->reallocs;
+            t->frees += s->frees;
+            t->bytes += s->bytes;
+            t->live += s->live;
+            t->peak += s->peak;	       /* (an upper bound) */
+            for (c = 0; c < NSIZECLASSES; c++)
+                t->sizes[c] += s->sizes[c];
+        } else
+            sites[j++] = sites[i];
+    }
+    n = j;
+    qsort(sites, n, sizeof(*sites), prof_cmp_bytes);
+
+    fprintf(fp, "%-24s %9s %9s %9s %11s %9s %9s\n", "site", "allocs",
+            "reallocs", "frees", "bytes", "live", "peak");
+    for (i = 0; i < n; i++) {
+        struct prof_site *s = &sites[i];
+        char name[64];
+        int c;
+
+        if (!s->allocs && !s->reallocs && !s->frees && !s->live)
+            continue;
+        sprintf(name, "%.50s:%d", s->file, s->line);
+        fprintf(fp, "%-24s %9lu %9lu %9lu %11lu %9lu %9lu\n", name,
+                s->allocs, s->reallocs, s->frees, s->bytes, s->live,
+                s->peak);
+        fprintf(fp, "%24s", "sizes:");
+        for (c = 0; c < NSIZECLASSES; c++)
+            if (s->sizes[c]) {
+                if (c < NSIZECLASSES-1)
+                    fprintf(fp, " <=%lu:%lu", 16UL << c, s->sizes[c]);
+                else
+                    fprintf(fp, " more:%lu", s->sizes[c]);
+            }
+        fprintf(fp, "\n");
+    }
+
+    free(sites);
+}
+
+/*
+ * Start counting afresh. Bytes still live stay where they are (they
+ * will be freed against their sites later), and become the peak.
+ */
+void smalloc_profile_reset(void)
+{
+    int i;
+
+    PROF_LOCK();
+    for (i = 0; i <= NPROFSITES; i++) {
+        struct prof_site *s = (i < NPROFSITES ? &prof_sites[i] :
+                               &prof_overflow);
+        s->allocs = s->reallocs = s->frees = s->bytes = 0;
+        s->peak = s->live;
+        memset(s->sizes, 0, sizeof(s->sizes));
+    }
+    prof_peak = prof_live;
+    smalloc_reset_stats();
+    PROF_UNLOCK();
+}
+
+static void prof_atexit(void)
+{
+    const char *name = getenv("SMALLOC_PROFILE");
+    FILE *fp = name && *name ? fopen(name, "w") : NULL;
+
+    smalloc_profile_report(fp ? fp : stderr);
+    if (fp)
+        fclose(fp);
+}
+
+#endif /* SMALLOC_PROFILE */
+
 /*
  * dupstr is like strdup, but with the never-return-NULL property
  * of smalloc (and also reliably defined in all environments :-)
  */
+#ifdef SMALLOC_PROFILE
+char *dupstr_at(const char *s, const char *file, int line) {
+    char *r = smalloc_at(1+strlen(s), file, line);
+    strcpy(r,s);
+    return r;
+}
+#else
 char *dupstr(const char *s) {
     char *r = smalloc(1+strlen(s));
     strcpy(r,s);
     return r;
 }
+#endif
+
+/*
+ * Scratch arenas. An arena is a stack of blocks, of which only the
+ * last has room left; arena_alloc just bumps a pointer through it,
+ * and starts a new, bigger block when it runs out. Releasing a
+ * pointer pops everything allocated since it. Whenever the arena is
+ * emptied (by a reset, or by releasing its first allocation) after
+ * more than one block was needed, the blocks are replaced by a
+ * single block as big as all of them put together, so that an arena
+ * which is emptied between tries soon stops allocating anything.
+ */
+struct arena_block {
+    struct arena_block *prev;
+    size_t size, used;
+};
+
+struct arena {
+    struct arena_block *top;
+};
+
+#define ARENA_ALIGN SMALLOC_ALIGN
+#define ARENA_HDR ARENA_ALIGN(sizeof(struct arena_block))
+#define ARENA_DATA(b) ((char *)(b) + ARENA_HDR)
+
+static struct arena_block *arena_block_new(struct arena_block *prev,
+                                           size_t size)
+{
+    struct arena_block *b = smalloc(ARENA_HDR + size);
+    b->prev = prev;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+arena *arena_new(size_t size)
+{
+    arena *a = snew(arena);
+    a->top = arena_block_new(NULL, ARENA_ALIGN(size ? size : 1024));
+    return a;
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+    struct arena_block *b = a->top;
+    void *ret;
+
+    size = ARENA_ALIGN(size ? size : 1);
+    if (b->size - b->used < size) {
+        size_t newsize = b->size * 2;
+        if (newsize < size)
+            newsize = size;
+        b = a->top = arena_block_new(b, newsize);
+    }
+    ret = ARENA_DATA(b) + b->used;
+    b->used += size;
+    return ret;
+}
+
+void arena_release(arena *a, void *p)
+{
+    struct arena_block *b = a->top;
+    size_t popped = 0;
+
+    while ((char *)p < ARENA_DATA(b) || (char *)p > ARENA_DATA(b) + b->used) {
+        a->top = b->prev;
+        popped += b->size;
+        sfree(b);
+        b = a->top;
+        assert(b);		       /* p must have come from this arena */
+    }
+    if (popped && !b->prev && (char *)p == ARENA_DATA(b)) {
+        a->top = arena_block_new(NULL, b->size + popped);
+        sfree(b);
+    } else
+        b->used = (char *)p - ARENA_DATA(b);
+}
+
+static size_t arena_free_blocks(arena *a)
+{
+    struct arena_block *b, *prev;
+    size_t total = 0;
+
+    for (b = a->top; b; b = prev) {
+        prev = b->prev;
+        total += b->size;
+        sfree(b);
+    }
+    a->top = NULL;
+    return total;
+}
+
+void arena_reset(arena *a)
+{
+    if (a->top->prev)
+        a->top = arena_block_new(NULL, arena_free_blocks(a));
+    else
+        a->top->used = 0;
+}
+
+void arena_free(arena *a)
+{
+    if (a) {
+        arena_free_blocks(a);
+        sfree(a);
+    }
+}
 
 void * UpperMalloc(size_t size)
 {
@@ -234,3 +773,28 @@ void DestroyMemPool()
     UpperMem = NULL;
 #endif
 }
+
+#ifdef SMALLOC_PROFILE
+/*
+ * The plain versions, for callers which didn't include puzzles.h.
+ * They have to come last, since the macros they replace are still
+ * wanted by everything above.
+ */
+#undef smalloc
+#undef srealloc
+#undef dupstr
+void *smalloc(size_t size)
+{
+    return smalloc_at(size, NULL, 0);
+}
+
+void *srealloc(void *p, size_t size)
+{
+    return srealloc_at(p, size, NULL, 0);
+}
+
+char *dupstr(const char *s)
+{
+    return dupstr_at(s, NULL, 0);
+}
+#endif
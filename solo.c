@@ -91,6 +91,7 @@
 
 #ifdef STANDALONE_SOLVER
 #include <stdarg.h>
+#include <time.h>
 int solver_show_working, solver_recurse_depth;
 #endif
 
@@ -178,7 +179,17 @@ static int find_sum_bits(unsigned long *array, int idx, int value_left,
 
 static void precompute_sum_bits(void)
 {
+    /*
+     * The tables only need filling in once. default_params does it,
+     * and the midend always calls that before starting any
+     * generator thread, so by the time generators can be running
+     * concurrently they only ever read `done' and the tables.
+     */
+    static int done = FALSE;
     int i;
+
+    if (done)
+	return;
     for (i = 3; i < 31; i++) {
 	int j;
 	if (i < 18) {
@@ -198,6 +209,7 @@ static void precompute_sum_bits(void)
 	if (j < MAX_4SUMS)
 	    sum_bits4[i][j] = 0;
     }
+    done = TRUE;
 }
 
 struct game_params {
@@ -274,6 +286,8 @@ static game_params *default_params(void)
 {
     game_params *ret = snew(game_params);
 
+    precompute_sum_bits();
+
     ret->c = ret->r = 3;
     ret->xtype = FALSE;
     ret->killer = FALSE;
@@ -700,24 +714,29 @@ static void remove_from_block(struct block_structure *blocks, int b, int n)
  * 
  *  - Forcing chains (see comment for solver_forcing().)
  * 
- *  - Recursion. If all else fails, we pick one of the currently
- *    most constrained empty squares and take a random guess at its
- *    contents, then continue solving on that basis and see if we
- *    get any further.
+ *  - Recursion. If all else fails, we search exhaustively (see the
+ *    exact-cover code below) for every way of finishing the grid,
+ *    and see whether there is exactly one. Killer puzzles instead
+ *    guess at one of the most constrained empty squares, and run
+ *    the whole solver again on each guess.
  */
 
 struct solver_usage {
     int cr;
     struct block_structure *blocks, *kblocks, *extra_cages;
     /*
-     * We set up a cubic array, indexed by x, y and digit; each
-     * element of this array is TRUE or FALSE according to whether
-     * or not that digit _could_ in principle go in that position.
+     * We keep a cubic array of booleans, indexed by x, y and digit,
+     * each saying whether or not that digit _could_ in principle go
+     * in that position. It's stored as one word per square, with
+     * bit n-1 of cube[y*cr+x] set if digit n is still possible
+     * there, so that a whole square's candidates can be tested at
+     * once.
      *
-     * The way to index this array is cube[(y*cr+x)*cr+n-1]; there
-     * are macros below to help with this.
+     * The generic deduction routines below still name individual
+     * elements by `cube position' (y*cr+x)*cr+n-1; there are macros
+     * below to help with both ways of looking at it.
      */
-    unsigned char *cube;
+    unsigned int *cube;
     /*
      * This is the grid in which we write down our final
      * deductions. y-coordinates in here are _not_ transformed.
@@ -733,14 +752,14 @@ struct solver_usage {
      * have yet to work out, to prevent doing the same deduction
      * many times.
      */
-    /* row[y*cr+n-1] TRUE if digit n has been placed in row y */
-    unsigned char *row;
-    /* col[x*cr+n-1] TRUE if digit n has been placed in row x */
-    unsigned char *col;
-    /* blk[i*cr+n-1] TRUE if digit n has been placed in block i */
-    unsigned char *blk;
-    /* diag[i*cr+n-1] TRUE if digit n has been placed in diagonal i */
-    unsigned char *diag;	       /* diag 0 is \, 1 is / */
+    /* bit n-1 of row[y] set if digit n has been placed in row y */
+    unsigned int *row;
+    /* bit n-1 of col[x] set if digit n has been placed in column x */
+    unsigned int *col;
+    /* bit n-1 of blk[i] set if digit n has been placed in block i */
+    unsigned int *blk;
+    /* bit n-1 of diag[i] set if digit n has been placed in diagonal i */
+    unsigned int *diag;	       /* diag 0 is \, 1 is / */
 
     int *regions;
     int nr_regions;
@@ -748,8 +767,14 @@ struct solver_usage {
 };
 #define cubepos2(xy,n) ((xy)*usage->cr+(n)-1)
 #define cubepos(x,y,n) cubepos2((y)*usage->cr+(x),n)
-#define cube(x,y,n) (usage->cube[cubepos(x,y,n)])
-#define cube2(xy,n) (usage->cube[cubepos2(xy,n)])
+#define digitbit(n) (1U << ((n)-1))
+#define cube2(xy,n) ((usage->cube[xy] & digitbit(n)) != 0)
+#define cube(x,y,n) cube2((y)*usage->cr+(x),n)
+#define cube2_clear(xy,n) (usage->cube[xy] &= ~digitbit(n))
+#define cube_clear(x,y,n) cube2_clear((y)*usage->cr+(x),n)
+#define cubeat(pos) cube2((pos) / usage->cr, (pos) % usage->cr + 1)
+#define cubeat_clear(pos) cube2_clear((pos) / usage->cr, (pos) % usage->cr + 1)
+#define ALL_DIGITS(cr) ((1U << (cr)) - 1)     /* cr is at most 31 */
 
 #define ondiag0(xy) ((xy) % (cr+1) == 0)
 #define ondiag1(xy) ((xy) % (cr-1) == 0 && (xy) > 0 && (xy) < cr*cr-1)
@@ -772,23 +797,21 @@ static void solver_place(struct solver_usage *usage, int x, int y, int n)
     /*
      * Rule out all other numbers in this square.
      */
-    for (i = 1; i <= cr; i++)
-	if (i != n)
-	    cube(x,y,i) = FALSE;
+    usage->cube[sqindex] = digitbit(n);
 
     /*
      * Rule out this number in all other positions in the row.
      */
     for (i = 0; i < cr; i++)
 	if (i != y)
-	    cube(x,i,n) = FALSE;
+	    cube_clear(x,i,n);
 
     /*
      * Rule out this number in all other positions in the column.
      */
     for (i = 0; i < cr; i++)
 	if (i != x)
-	    cube(i,y,n) = FALSE;
+	    cube_clear(i,y,n);
 
     /*
      * Rule out this number in all other positions in the block.
@@ -797,7 +820,7 @@ static void solver_place(struct solver_usage *usage, int x, int y, int n)
     for (i = 0; i < cr; i++) {
 	int bp = usage->blocks->blocks[bi][i];
 	if (bp != sqindex)
-	    cube2(bp,n) = FALSE;
+	    cube2_clear(bp,n);
     }
 
     /*
@@ -809,21 +832,22 @@ static void solver_place(struct solver_usage *usage, int x, int y, int n)
      * Cross out this number from the list of numbers left to place
      * in its row, its column and its block.
      */
-    usage->row[y*cr+n-1] = usage->col[x*cr+n-1] =
-	usage->blk[bi*cr+n-1] = TRUE;
+    usage->row[y] |= digitbit(n);
+    usage->col[x] |= digitbit(n);
+    usage->blk[bi] |= digitbit(n);
 
     if (usage->diag) {
 	if (ondiag0(sqindex)) {
 	    for (i = 0; i < cr; i++)
 		if (diag0(i) != sqindex)
-		    cube2(diag0(i),n) = FALSE;
-	    usage->diag[n-1] = TRUE;
+		    cube2_clear(diag0(i),n);
+	    usage->diag[0] |= digitbit(n);
 	}
 	if (ondiag1(sqindex)) {
 	    for (i = 0; i < cr; i++)
 		if (diag1(i) != sqindex)
-		    cube2(diag1(i),n) = FALSE;
-	    usage->diag[cr+n-1] = TRUE;
+		    cube2_clear(diag1(i),n);
+	    usage->diag[1] |= digitbit(n);
 	}
     }
 }
@@ -844,7 +868,7 @@ static int solver_elim(struct solver_usage *usage, int *indices
     m = 0;
     fpos = -1;
     for (i = 0; i < cr; i++)
-	if (usage->cube[indices[i]]) {
+	if (cubeat(indices[i])) {
 	    fpos = indices[i];
 	    m++;
 	}
@@ -909,7 +933,7 @@ static int solver_intersect(struct solver_usage *usage,
         int p = indices1[i];
 	while (j < cr && indices2[j] < p)
 	    j++;
-        if (usage->cube[p]) {
+        if (cubeat(p)) {
 	    if (j < cr && indices2[j] == p)
 		continue;	       /* both domains contain this index */
 	    else
@@ -928,7 +952,7 @@ static int solver_intersect(struct solver_usage *usage,
         int p = indices2[i];
 	while (j < cr && indices1[j] < p)
 	    j++;
-        if (usage->cube[p] && (j >= cr || indices1[j] != p)) {
+        if (cubeat(p) && (j >= cr || indices1[j] != p)) {
 #ifdef STANDALONE_SOLVER
             if (solver_show_working) {
                 int px, py, pn;
@@ -952,17 +976,78 @@ static int solver_intersect(struct solver_usage *usage,
             }
 #endif
             ret = +1;		       /* we did something */
-            usage->cube[p] = 0;
+            cubeat_clear(p);
         }
     }
 
     return ret;
 }
 
+static int bitcount(unsigned int x)
+{
+    int count = 0;
+
+    while (x) {
+	x &= x - 1;
+	count++;
+    }
+    return count;
+}
+
+/*
+ * Quick tests on whole squares' candidate words, which let the main
+ * solver loop skip the calls to solver_elim and solver_intersect
+ * which couldn't possibly find anything. Both take lists of cr
+ * square indices in increasing order.
+ *
+ * solver_elim on a digit's positions in a region only does
+ * something if the digit is possible in fewer than two of them.
+ */
+static unsigned int solver_rare_digits(struct solver_usage *usage,
+				       int *squares)
+{
+    unsigned int once = 0, twice = 0;
+    int i;
+
+    for (i = 0; i < usage->cr; i++) {
+	twice |= once & usage->cube[squares[i]];
+	once |= usage->cube[squares[i]];
+    }
+    return ALL_DIGITS(usage->cr) & ~twice;
+}
+
+/*
+ * solver_intersect between two regions, in either order, only does
+ * something for a digit which is possible somewhere in one region
+ * outside the other, but nowhere in the other outside the first.
+ */
+static unsigned int solver_intersect_digits(struct solver_usage *usage,
+					    int *squares1, int *squares2)
+{
+    unsigned int only1 = 0, only2 = 0;
+    int cr = usage->cr, i, j;
+
+    for (i = j = 0; i < cr; i++) {
+	while (j < cr && squares2[j] < squares1[i])
+	    j++;
+	if (j >= cr || squares2[j] != squares1[i])
+	    only1 |= usage->cube[squares1[i]];
+    }
+    for (i = j = 0; i < cr; i++) {
+	while (j < cr && squares1[j] < squares2[i])
+	    j++;
+	if (j >= cr || squares1[j] != squares2[i])
+	    only2 |= usage->cube[squares2[i]];
+    }
+    return only1 ^ only2;
+}
+
 struct solver_scratch {
-    unsigned char *grid, *rowidx, *colidx, *set;
+    unsigned char *grid, *rowidx, *colidx;
+    unsigned int *rowbits;
     int *neighbours, *bfsqueue;
     int *indexlist, *indexlist2;
+    int *squarelist;
 #ifdef STANDALONE_SOLVER
     int *bfsprev;
 #endif
@@ -978,10 +1063,9 @@ static int solver_set(struct solver_usage *usage,
 {
     int cr = usage->cr;
     int i, j, n, count;
-    unsigned char *grid = scratch->grid;
+    unsigned int set, *rowbits = scratch->rowbits;
     unsigned char *rowidx = scratch->rowidx;
     unsigned char *colidx = scratch->colidx;
-    unsigned char *set = scratch->set;
 
     /*
      * We are passed a cr-by-cr matrix of booleans. Our first job
@@ -994,7 +1078,7 @@ static int solver_set(struct solver_usage *usage,
     for (i = 0; i < cr; i++) {
         int count = 0, first = -1;
         for (j = 0; j < cr; j++)
-            if (usage->cube[indices[i*cr+j]])
+            if (cubeat(indices[i*cr+j]))
                 first = j, count++;
 
 	/*
@@ -1023,11 +1107,17 @@ static int solver_set(struct solver_usage *usage,
     assert(n == j);
 
     /*
-     * And create the smaller matrix.
+     * And create the smaller matrix, one word per row. Column j of
+     * the matrix is bit n-1-j, so that counting `set' upwards below
+     * tries the column subsets in the same order as always.
      */
-    for (i = 0; i < n; i++)
+#define COLBIT(j) (1U << (n-1-(j)))
+    for (i = 0; i < n; i++) {
+        rowbits[i] = 0;
         for (j = 0; j < n; j++)
-            grid[i*cr+j] = usage->cube[indices[rowidx[i]*cr+colidx[j]]];
+            if (cubeat(indices[rowidx[i]*cr+colidx[j]]))
+                rowbits[i] |= COLBIT(j);
+    }
 
     /*
      * Having done that, we now have a matrix in which every row
@@ -1037,13 +1127,12 @@ static int solver_set(struct solver_usage *usage,
      * columns) whose width and height add up to n.
      */
 
-    memset(set, 0, n);
-    count = 0;
-    while (1) {
+    for (set = 0; ; set++) {
         /*
          * We have a candidate set. If its size is <=1 or >=n-1
          * then we move on immediately.
          */
+        count = bitcount(set);
         if (count > 1 && count < n-1) {
             /*
              * The number of rows we need is n-count. See if we can
@@ -1051,16 +1140,9 @@ static int solver_set(struct solver_usage *usage,
              * the positions listed in `set'.
              */
             int rows = 0;
-            for (i = 0; i < n; i++) {
-                int ok = TRUE;
-                for (j = 0; j < n; j++)
-                    if (set[j] && grid[i*cr+j]) {
-                        ok = FALSE;
-                        break;
-                    }
-                if (ok)
+            for (i = 0; i < n; i++)
+                if (!(rowbits[i] & set))
                     rows++;
-            }
 
             /*
              * We expect never to be able to get _more_ than
@@ -1101,15 +1183,9 @@ static int solver_set(struct solver_usage *usage,
                  * positions in the cube to meddle with.
                  */
                 for (i = 0; i < n; i++) {
-                    int ok = TRUE;
-                    for (j = 0; j < n; j++)
-                        if (set[j] && grid[i*cr+j]) {
-                            ok = FALSE;
-                            break;
-                        }
-                    if (!ok) {
+                    if (rowbits[i] & set) {
                         for (j = 0; j < n; j++)
-                            if (!set[j] && grid[i*cr+j]) {
+                            if (rowbits[i] & ~set & COLBIT(j)) {
                                 int fpos = indices[rowidx[i]*cr+colidx[j]];
 #ifdef STANDALONE_SOLVER
                                 if (solver_show_working) {
@@ -1136,7 +1212,7 @@ static int solver_set(struct solver_usage *usage,
                                 }
 #endif
                                 progress = TRUE;
-                                usage->cube[fpos] = FALSE;
+                                cubeat_clear(fpos);
                             }
                     }
                 }
@@ -1147,18 +1223,10 @@ static int solver_set(struct solver_usage *usage,
             }
         }
 
-        /*
-         * Binary increment: change the rightmost 0 to a 1, and
-         * change all 1s to the right of it to 0s.
-         */
-        i = n;
-        while (i > 0 && set[i-1])
-            set[--i] = 0, count--;
-        if (i > 0)
-            set[--i] = 1, count++;
-        else
+        if (set == ALL_DIGITS(n))
             break;                     /* done */
     }
+#undef COLBIT
 
     return 0;
 }
@@ -1359,7 +1427,7 @@ static int solver_forcing(struct solver_usage *usage,
                                            orign, 1+xt, 1+yt);
                                 }
 #endif
-                                cube(xt, yt, orign) = FALSE;
+                                cube_clear(xt, yt, orign);
                                 return 1;
                             }
                         }
@@ -1410,7 +1478,7 @@ static int solver_killer_minmax(struct solver_usage *usage,
 			}
 		}
 		if (maxval + n < clues[b]) {
-		    cube2(x, n) = FALSE;
+		    cube2_clear(x, n);
 		    ret = 1;
 #ifdef STANDALONE_SOLVER
 		    if (solver_show_working)
@@ -1420,7 +1488,7 @@ static int solver_killer_minmax(struct solver_usage *usage,
 #endif
 		}
 		if (minval + n > clues[b]) {
-		    cube2(x, n) = FALSE;
+		    cube2_clear(x, n);
 		    ret = 1;
 #ifdef STANDALONE_SOLVER
 		    if (solver_show_working)
@@ -1546,7 +1614,7 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
 	    if (!cube2(x, n))
 		continue;
 	    if ((possible_addends & (1 << n)) == 0) {
-		cube2(x, n) = FALSE;
+		cube2_clear(x, n);
 		ret = 1;
 #ifdef STANDALONE_SOLVER
 		if (solver_show_working) {
@@ -1627,7 +1695,7 @@ static struct solver_scratch *solver_new_scratch(struct solver_usage *usage)
     scratch->grid = snewn(cr*cr, unsigned char);
     scratch->rowidx = snewn(cr, unsigned char);
     scratch->colidx = snewn(cr, unsigned char);
-    scratch->set = snewn(cr, unsigned char);
+    scratch->rowbits = snewn(cr, unsigned int);
     scratch->neighbours = snewn(5*cr, int);
     scratch->bfsqueue = snewn(cr*cr, int);
 #ifdef STANDALONE_SOLVER
@@ -1635,6 +1703,7 @@ static struct solver_scratch *solver_new_scratch(struct solver_usage *usage)
 #endif
     scratch->indexlist = snewn(cr*cr, int);   /* used for set elimination */
     scratch->indexlist2 = snewn(cr, int);   /* only used for intersect() */
+    scratch->squarelist = snewn(cr, int);   /* a diagonal's squares */
     return scratch;
 }
 
@@ -1645,15 +1714,293 @@ static void solver_free_scratch(struct solver_scratch *scratch)
 #endif
     sfree(scratch->bfsqueue);
     sfree(scratch->neighbours);
-    sfree(scratch->set);
+    sfree(scratch->rowbits);
     sfree(scratch->colidx);
     sfree(scratch->rowidx);
     sfree(scratch->grid);
     sfree(scratch->indexlist);
     sfree(scratch->indexlist2);
+    sfree(scratch->squarelist);
     sfree(scratch);
 }
 
+/* ----------------------------------------------------------------------
+ * Exact-cover search.
+ *
+ * Filling in a Solo grid means choosing one (square, digit) pair
+ * for every square such that each row, column and block - and each
+ * diagonal, in X mode - contains each digit exactly once. That is
+ * an exact cover problem, which this section solves with Knuth's
+ * `dancing links'. Every candidate (square, digit) pair is a row
+ * of a sparse 0-1 matrix, with an entry in the column for its
+ * square and in the column for its digit in each region it is in.
+ * Killer cage sums are not an exact cover constraint, so killer
+ * puzzles don't use this.
+ *
+ * Each search builds the matrix afresh for just the part of the
+ * grid that is still empty, leaving out digits which are already
+ * placed in a region; that is much cheaper than covering every
+ * clue in the full matrix and uncovering them all afterwards.
+ *
+ * Always branching on the column with fewest rows left means the
+ * search fills in every square with only one possible digit, and
+ * every digit with only one possible place in some region, before
+ * it ever has to guess. It is used as a solution counter which
+ * stops at two, for the solver's recursive mode and for the
+ * generator's clue removal.
+ */
+
+struct dlx {
+    int cr, xtype;
+    struct block_structure *blocks;
+
+    /*
+     * Regions are numbered with the rows first, then the columns,
+     * the blocks, and the two diagonals in X mode. used[] has the
+     * bits for the digits already in each.
+     */
+    int nregions;
+    unsigned int *used;
+
+    /*
+     * The matrix, as circular doubly linked lists of nodes in both
+     * directions. Node 0 heads the list of column headers: node
+     * 1+sq for square sq, and 1+area+g*cr+n-1 for digit n in region
+     * g. Rows follow, and cand[] gives the candidate (sq*cr + n-1)
+     * each of their nodes is for.
+     */
+    int ncols;
+    int *left, *right, *up, *down, *col, *cand;
+    int *size;			       /* number of rows left in a column */
+
+    /*
+     * Search state.
+     */
+    int *choice;		       /* candidate chosen at each depth */
+    digit *soln;
+    int nsols, maxsols;
+};
+
+static struct dlx *dlx_new(int cr, struct block_structure *blocks, int xtype)
+{
+    struct dlx *dx = snew(struct dlx);
+    int area = cr*cr;
+    int nnodes;
+
+    dx->cr = cr;
+    dx->xtype = xtype;
+    dx->blocks = blocks;
+
+    dx->nregions = 3*cr + (xtype ? 2 : 0);
+    dx->used = snewn(dx->nregions, unsigned int);
+
+    dx->ncols = area + dx->nregions * cr;
+
+    /* A square is in at most five regions. */
+    nnodes = dx->ncols + 1 + 6*area*cr;
+    dx->left = snewn(6*nnodes, int);
+    dx->right = dx->left + nnodes;
+    dx->up = dx->right + nnodes;
+    dx->down = dx->up + nnodes;
+    dx->col = dx->down + nnodes;
+    dx->cand = dx->col + nnodes;
+    dx->size = snewn(dx->ncols + 1, int);
+
+    dx->choice = snewn(area, int);
+
+    return dx;
+}
+
+static void dlx_free(struct dlx *dx)
+{
+    sfree(dx->used);
+    sfree(dx->left);
+    sfree(dx->size);
+    sfree(dx->choice);
+    sfree(dx);
+}
+
+/*
+ * List the regions square sq is in, returning how many.
+ */
+static int dlx_regions(struct dlx *dx, int sq, int *regions)
+{
+    int cr = dx->cr, n = 0;
+
+    regions[n++] = sq / cr;
+    regions[n++] = cr + sq % cr;
+    regions[n++] = 2*cr + dx->blocks->whichblock[sq];
+    if (dx->xtype && ondiag0(sq))
+	regions[n++] = 3*cr;
+    if (dx->xtype && ondiag1(sq))
+	regions[n++] = 3*cr + 1;
+    return n;
+}
+
+static void dlx_add_column(struct dlx *dx, int c)
+{
+    dx->up[c] = dx->down[c] = c;
+    dx->col[c] = c;
+    dx->size[c] = 0;
+    dx->left[c] = dx->left[0];
+    dx->right[c] = 0;
+    dx->right[dx->left[0]] = c;
+    dx->left[0] = c;
+}
+
+static void dlx_cover(struct dlx *dx, int c)
+{
+    int i, j;
+
+    dx->right[dx->left[c]] = dx->right[c];
+    dx->left[dx->right[c]] = dx->left[c];
+    for (i = dx->down[c]; i != c; i = dx->down[i])
+	for (j = dx->right[i]; j != i; j = dx->right[j]) {
+	    dx->down[dx->up[j]] = dx->down[j];
+	    dx->up[dx->down[j]] = dx->up[j];
+	    dx->size[dx->col[j]]--;
+	}
+}
+
+static void dlx_uncover(struct dlx *dx, int c)
+{
+    int i, j;
+
+    for (i = dx->up[c]; i != c; i = dx->up[i])
+	for (j = dx->left[i]; j != i; j = dx->left[j]) {
+	    dx->size[dx->col[j]]++;
+	    dx->down[dx->up[j]] = j;
+	    dx->up[dx->down[j]] = j;
+	}
+    dx->right[dx->left[c]] = c;
+    dx->left[dx->right[c]] = c;
+}
+
+static int dlx_search(struct dlx *dx, int depth)
+{
+    int cr = dx->cr;
+    int c, best, i, j, ret;
+
+    if (dx->right[0] == 0) {
+	if (dx->soln && dx->nsols == 0)
+	    for (i = 0; i < depth; i++)
+		dx->soln[dx->choice[i] / cr] = dx->choice[i] % cr + 1;
+	return ++dx->nsols >= dx->maxsols;
+    }
+
+    best = dx->right[0];
+    for (c = dx->right[best]; c != 0 && dx->size[best] > 1; c = dx->right[c])
+	if (dx->size[c] < dx->size[best])
+	    best = c;
+    if (dx->size[best] == 0)
+	return FALSE;
+
+    dlx_cover(dx, best);
+    ret = FALSE;
+    for (i = dx->down[best]; i != best && !ret; i = dx->down[i]) {
+	dx->choice[depth] = dx->cand[i];
+	for (j = dx->right[i]; j != i; j = dx->right[j])
+	    dlx_cover(dx, dx->col[j]);
+	ret = dlx_search(dx, depth+1);
+	for (j = dx->left[i]; j != i; j = dx->left[j])
+	    dlx_uncover(dx, dx->col[j]);
+    }
+    dlx_uncover(dx, best);
+
+    return ret;
+}
+
+/*
+ * Count the ways of completing `grid' (in which 0 is an empty
+ * square), stopping as soon as we reach maxsols.
+ *
+ * If cube is non-NULL, digit n is only considered for an empty
+ * square sq if bit n-1 of cube[sq] is set (this is the solver's
+ * record of what it has not yet ruled out). If soln is non-NULL,
+ * the first solution found is written to it; it may be the same
+ * array as grid.
+ */
+static int dlx_solve(struct dlx *dx, digit *grid, unsigned int *cube,
+		     digit *soln, int maxsols)
+{
+    int cr = dx->cr, area = cr*cr;
+    int regions[5], nregions;
+    int sq, g, i, n, node;
+
+    if (soln && soln != grid)
+	memcpy(soln, grid, area);
+
+    /*
+     * See what's already placed, and check that it's consistent.
+     */
+    memset(dx->used, 0, dx->nregions * sizeof(*dx->used));
+    for (sq = 0; sq < area; sq++)
+	if (grid[sq]) {
+	    nregions = dlx_regions(dx, sq, regions);
+	    for (i = 0; i < nregions; i++) {
+		if (dx->used[regions[i]] & digitbit(grid[sq]))
+		    return 0;
+		dx->used[regions[i]] |= digitbit(grid[sq]);
+	    }
+	}
+
+    /*
+     * Set up a column for each empty square, and for each digit
+     * still to be placed in each region.
+     */
+    dx->left[0] = dx->right[0] = 0;
+    for (sq = 0; sq < area; sq++)
+	if (!grid[sq])
+	    dlx_add_column(dx, 1 + sq);
+    for (g = 0; g < dx->nregions; g++)
+	for (n = 1; n <= cr; n++)
+	    if (!(dx->used[g] & digitbit(n)))
+		dlx_add_column(dx, 1 + area + g*cr + n-1);
+
+    /*
+     * And a row for each digit that could go in each empty square.
+     */
+    node = dx->ncols + 1;
+    for (sq = 0; sq < area; sq++) {
+	unsigned int possible;
+
+	if (grid[sq])
+	    continue;
+
+	nregions = dlx_regions(dx, sq, regions);
+	possible = cube ? cube[sq] : ALL_DIGITS(cr);
+	for (i = 0; i < nregions; i++)
+	    possible &= ~dx->used[regions[i]];
+
+	for (n = 1; n <= cr; n++)
+	    if (possible & digitbit(n)) {
+		int first = node;
+
+		for (i = -1; i < nregions; i++) {
+		    int c = (i < 0 ? 1 + sq : 1 + area + regions[i]*cr + n-1);
+
+		    dx->col[node] = c;
+		    dx->cand[node] = sq*cr + n-1;
+		    dx->down[node] = c;
+		    dx->up[node] = dx->up[c];
+		    dx->down[dx->up[c]] = node;
+		    dx->up[c] = node;
+		    dx->size[c]++;
+		    dx->left[node] = (i < 0 ? first + nregions : node - 1);
+		    dx->right[node] = (i == nregions-1 ? first : node + 1);
+		    node++;
+		}
+	    }
+    }
+
+    dx->nsols = 0;
+    dx->maxsols = maxsols;
+    dx->soln = soln;
+    dlx_search(dx, 0);
+
+    return dx->nsols;
+}
+
 /*
  * Used for passing information about difficulty levels between the solver
  * and its callers.
@@ -1691,7 +2038,7 @@ static void solver(int cr, struct block_structure *blocks,
 	usage->kblocks = usage->extra_cages = NULL;
 	usage->extra_clues = NULL;
     }
-    usage->cube = snewn(cr*cr*cr, unsigned char);
+    usage->cube = snewn(cr*cr, unsigned int);
     usage->grid = grid;		       /* write straight back to the input */
     if (kgrid) {
 	int nclues;
@@ -1714,18 +2061,19 @@ static void solver(int cr, struct block_structure *blocks,
 	usage->kclues = NULL;
     }
 
-    memset(usage->cube, TRUE, cr*cr*cr);
+    for (i = 0; i < cr*cr; i++)
+	usage->cube[i] = ALL_DIGITS(cr);
 
-    usage->row = snewn(cr * cr, unsigned char);
-    usage->col = snewn(cr * cr, unsigned char);
-    usage->blk = snewn(cr * cr, unsigned char);
-    memset(usage->row, FALSE, cr * cr);
-    memset(usage->col, FALSE, cr * cr);
-    memset(usage->blk, FALSE, cr * cr);
+    usage->row = snewn(cr, unsigned int);
+    usage->col = snewn(cr, unsigned int);
+    usage->blk = snewn(cr, unsigned int);
+    memset(usage->row, 0, cr * sizeof(unsigned int));
+    memset(usage->col, 0, cr * sizeof(unsigned int));
+    memset(usage->blk, 0, cr * sizeof(unsigned int));
 
     if (xtype) {
-	usage->diag = snewn(cr * 2, unsigned char);
-	memset(usage->diag, FALSE, cr * 2);
+	usage->diag = snewn(2, unsigned int);
+	memset(usage->diag, 0, 2 * sizeof(unsigned int));
     } else
 	usage->diag = NULL; 
 
@@ -1777,9 +2125,11 @@ static void solver(int cr, struct block_structure *blocks,
 	/*
 	 * Blockwise positional elimination.
 	 */
-	for (b = 0; b < cr; b++)
+	for (b = 0; b < cr; b++) {
+	    unsigned int todo = solver_rare_digits(usage,
+						   usage->blocks->blocks[b]);
 	    for (n = 1; n <= cr; n++)
-		if (!usage->blk[b*cr+n-1]) {
+		if (!(usage->blk[b] & digitbit(n)) && (todo & digitbit(n))) {
 		    for (i = 0; i < cr; i++)
 			scratch->indexlist[i] = cubepos2(usage->blocks->blocks[b][i],n);
 		    ret = solver_elim(usage, scratch->indexlist
@@ -1797,6 +2147,7 @@ static void solver(int cr, struct block_structure *blocks,
 			goto cont;
 		    }
 		}
+	}
 
 	if (usage->kclues != NULL) {
 	    int changed = FALSE;
@@ -1825,7 +2176,7 @@ static void solver(int cr, struct block_structure *blocks,
 		     * about the other squares in the cage.
 		     */
 		    for (n = 0; n < usage->kblocks->nr_squares[b]; n++) {
-			cube2(usage->kblocks->blocks[b][n], t) = FALSE;
+			cube2_clear(usage->kblocks->blocks[b][n], t);
 		    }
 		}
 
@@ -2038,9 +2389,11 @@ static void solver(int cr, struct block_structure *blocks,
 	/*
 	 * Row-wise positional elimination.
 	 */
-	for (y = 0; y < cr; y++)
+	for (y = 0; y < cr; y++) {
+	    unsigned int todo = solver_rare_digits(usage,
+						   usage->regions + cr*y*3);
 	    for (n = 1; n <= cr; n++)
-		if (!usage->row[y*cr+n-1]) {
+		if (!(usage->row[y] & digitbit(n)) && (todo & digitbit(n))) {
 		    for (x = 0; x < cr; x++)
 			scratch->indexlist[x] = cubepos(x, y, n);
 		    ret = solver_elim(usage, scratch->indexlist
@@ -2057,12 +2410,15 @@ static void solver(int cr, struct block_structure *blocks,
 			goto cont;
 		    }
                 }
+	}
 	/*
 	 * Column-wise positional elimination.
 	 */
-	for (x = 0; x < cr; x++)
+	for (x = 0; x < cr; x++) {
+	    unsigned int todo = solver_rare_digits(usage,
+						   usage->regions + cr*x*3 + cr);
 	    for (n = 1; n <= cr; n++)
-		if (!usage->col[x*cr+n-1]) {
+		if (!(usage->col[x] & digitbit(n)) && (todo & digitbit(n))) {
 		    for (y = 0; y < cr; y++)
 			scratch->indexlist[y] = cubepos(x, y, n);
 		    ret = solver_elim(usage, scratch->indexlist
@@ -2079,13 +2435,19 @@ static void solver(int cr, struct block_structure *blocks,
 			goto cont;
 		    }
                 }
+	}
 
 	/*
 	 * X-diagonal positional elimination.
 	 */
 	if (usage->diag) {
+	    unsigned int todo;
+
+	    for (i = 0; i < cr; i++)
+		scratch->squarelist[i] = diag0(i);
+	    todo = solver_rare_digits(usage, scratch->squarelist);
 	    for (n = 1; n <= cr; n++)
-		if (!usage->diag[n-1]) {
+		if (!(usage->diag[0] & digitbit(n)) && (todo & digitbit(n))) {
 		    for (i = 0; i < cr; i++)
 			scratch->indexlist[i] = cubepos2(diag0(i), n);
 		    ret = solver_elim(usage, scratch->indexlist
@@ -2102,8 +2464,11 @@ static void solver(int cr, struct block_structure *blocks,
 			goto cont;
 		    }
                 }
+	    for (i = 0; i < cr; i++)
+		scratch->squarelist[i] = diag1(i);
+	    todo = solver_rare_digits(usage, scratch->squarelist);
 	    for (n = 1; n <= cr; n++)
-		if (!usage->diag[cr+n-1]) {
+		if (!(usage->diag[1] & digitbit(n)) && (todo & digitbit(n))) {
 		    for (i = 0; i < cr; i++)
 			scratch->indexlist[i] = cubepos2(diag1(i), n);
 		    ret = solver_elim(usage, scratch->indexlist
@@ -2127,7 +2492,9 @@ static void solver(int cr, struct block_structure *blocks,
 	 */
 	for (x = 0; x < cr; x++)
 	    for (y = 0; y < cr; y++)
-		if (!usage->grid[y*cr+x]) {
+		if (!usage->grid[y*cr+x] &&
+		    !(usage->cube[y*cr+x] & (usage->cube[y*cr+x] - 1))) {
+		    /* at most one candidate left here */
 		    for (n = 1; n <= cr; n++)
 			scratch->indexlist[n-1] = cubepos(x, y, n);
 		    ret = solver_elim(usage, scratch->indexlist
@@ -2152,10 +2519,13 @@ static void solver(int cr, struct block_structure *blocks,
          * Intersectional analysis, rows vs blocks.
          */
         for (y = 0; y < cr; y++)
-            for (b = 0; b < cr; b++)
+            for (b = 0; b < cr; b++) {
+		unsigned int todo = solver_intersect_digits
+		    (usage, usage->regions + cr*y*3, usage->blocks->blocks[b]);
                 for (n = 1; n <= cr; n++) {
-                    if (usage->row[y*cr+n-1] ||
-                        usage->blk[b*cr+n-1])
+                    if ((usage->row[y] & digitbit(n)) ||
+                        (usage->blk[b] & digitbit(n)) ||
+			!(todo & digitbit(n)))
 			continue;
 		    for (i = 0; i < cr; i++) {
 			scratch->indexlist[i] = cubepos(i, y, n);
@@ -2184,15 +2554,19 @@ static void solver(int cr, struct block_structure *blocks,
                         goto cont;
                     }
 		}
+	    }
 
         /*
          * Intersectional analysis, columns vs blocks.
          */
         for (x = 0; x < cr; x++)
-            for (b = 0; b < cr; b++)
+            for (b = 0; b < cr; b++) {
+		unsigned int todo = solver_intersect_digits
+		    (usage, usage->regions + cr*x*3 + cr, usage->blocks->blocks[b]);
                 for (n = 1; n <= cr; n++) {
-                    if (usage->col[x*cr+n-1] ||
-                        usage->blk[b*cr+n-1])
+                    if ((usage->col[x] & digitbit(n)) ||
+                        (usage->blk[b] & digitbit(n)) ||
+			!(todo & digitbit(n)))
 			continue;
 		    for (i = 0; i < cr; i++) {
 			scratch->indexlist[i] = cubepos(x, i, n);
@@ -2218,15 +2592,21 @@ static void solver(int cr, struct block_structure *blocks,
                         goto cont;
                     }
 		}
+	    }
 
 	if (usage->diag) {
 	    /*
 	     * Intersectional analysis, \-diagonal vs blocks.
 	     */
-            for (b = 0; b < cr; b++)
+	    for (i = 0; i < cr; i++)
+		scratch->squarelist[i] = diag0(i);
+            for (b = 0; b < cr; b++) {
+		unsigned int todo = solver_intersect_digits
+		    (usage, scratch->squarelist, usage->blocks->blocks[b]);
                 for (n = 1; n <= cr; n++) {
-                    if (usage->diag[n-1] ||
-                        usage->blk[b*cr+n-1])
+                    if ((usage->diag[0] & digitbit(n)) ||
+                        (usage->blk[b] & digitbit(n)) ||
+			!(todo & digitbit(n)))
 			continue;
 		    for (i = 0; i < cr; i++) {
 			scratch->indexlist[i] = cubepos2(diag0(i), n);
@@ -2252,14 +2632,20 @@ static void solver(int cr, struct block_structure *blocks,
                         goto cont;
                     }
 		}
+	    }
 
 	    /*
 	     * Intersectional analysis, /-diagonal vs blocks.
 	     */
-            for (b = 0; b < cr; b++)
+	    for (i = 0; i < cr; i++)
+		scratch->squarelist[i] = diag1(i);
+            for (b = 0; b < cr; b++) {
+		unsigned int todo = solver_intersect_digits
+		    (usage, scratch->squarelist, usage->blocks->blocks[b]);
                 for (n = 1; n <= cr; n++) {
-                    if (usage->diag[cr+n-1] ||
-                        usage->blk[b*cr+n-1])
+                    if ((usage->diag[1] & digitbit(n)) ||
+                        (usage->blk[b] & digitbit(n)) ||
+			!(todo & digitbit(n)))
 			continue;
 		    for (i = 0; i < cr; i++) {
 			scratch->indexlist[i] = cubepos2(diag1(i), n);
@@ -2285,6 +2671,7 @@ static void solver(int cr, struct block_structure *blocks,
                         goto cont;
                     }
 		}
+	    }
 	}
 
 	if (dlev->maxdiff <= DIFF_INTERSECT)
@@ -2434,13 +2821,53 @@ static void solver(int cr, struct block_structure *blocks,
     }
 
     /*
-     * Last chance: if we haven't fully solved the puzzle yet, try
-     * recursing based on guesses for a particular square. We pick
-     * one of the most constrained empty squares we can find, which
-     * has the effect of pruning the search tree as much as
-     * possible.
+     * Last chance: if we haven't fully solved the puzzle yet, hand
+     * what we have - including everything we have ruled out - to
+     * the exact-cover search, and see how many ways there are of
+     * finishing it off.
      */
-    if (dlev->maxdiff >= DIFF_RECURSIVE) {
+    if (dlev->maxdiff >= DIFF_RECURSIVE && !kgrid) {
+	for (i = 0; i < cr*cr; i++)
+	    if (!grid[i])
+		break;
+
+	if (i < cr*cr) {
+	    struct dlx *dx = dlx_new(cr, blocks, xtype);
+	    digit *soln = snewn(cr * cr, digit);
+
+	    n = dlx_solve(dx, grid, usage->cube, soln, 2);
+	    if (n == 0)
+		diff = DIFF_IMPOSSIBLE;
+	    else {
+		/*
+		 * Return the first solution we found, even if it
+		 * wasn't the only one.
+		 */
+		memcpy(grid, soln, cr * cr);
+		diff = (n == 1 ? DIFF_RECURSIVE : DIFF_AMBIGUOUS);
+	    }
+
+#ifdef STANDALONE_SOLVER
+	    if (solver_show_working)
+		printf("%*sexhaustive search: %s\n",
+		       solver_recurse_depth*4, "",
+		       n == 0 ? "no solution" : n == 1 ? "one solution" :
+		       "multiple solutions");
+#endif
+
+	    sfree(soln);
+	    dlx_free(dx);
+	}
+
+    } else if (dlev->maxdiff >= DIFF_RECURSIVE) {
+	/*
+	 * Killer cage sums aren't an exact cover constraint, and the
+	 * search above would have to check them after the fact,
+	 * which prunes far less than the killer deductions in this
+	 * solver do. So for killer puzzles we recurse the old way,
+	 * by guessing at one of the most constrained empty squares
+	 * and running the whole solver again on each guess.
+	 */
 	int best, bestcount;
 
 	best = -1;
@@ -3136,16 +3563,9 @@ static void dsf_to_blocks(int *dsf, struct block_structure *blocks,
 			  int min_expected, int max_expected)
 {
     int cr = blocks->c * blocks->r, area = cr * cr;
-    int i, nb = 0;
+    int nb;
 
-    for (i = 0; i < area; i++)
-	blocks->whichblock[i] = -1;
-    for (i = 0; i < area; i++) {
-	int j = dsf_canonify(dsf, i);
-	if (blocks->whichblock[j] < 0)
-	    blocks->whichblock[j] = nb++;
-	blocks->whichblock[i] = blocks->whichblock[j];
-    }
+    nb = dsf_components(dsf, area, blocks->whichblock, NULL);
     assert(nb >= min_expected && nb <= max_expected);
     blocks->nr_blocks = nb;
 }
@@ -3528,6 +3948,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
     int c = params->c, r = params->r, cr = c*r;
     int area = cr*cr;
     struct block_structure *blocks, *kblocks;
+    struct dlx *dx;
     digit *grid, *grid2, *kgrid;
     struct xy { int x, y; } *locs;
     int nlocs;
@@ -3536,11 +3957,6 @@ static char *new_game_desc(game_params *params, random_state *rs,
     int x, y, i, j;
     struct difficulty dlev;
 
-    extern int max_digit_to_input;
-    extern int min_digit_to_input;
-    max_digit_to_input=cr;
-    min_digit_to_input=1;
-
     precompute_sum_bits();
 
     /*
@@ -3564,7 +3980,11 @@ static char *new_game_desc(game_params *params, random_state *rs,
     kgrid = (params->killer) ? snewn(area, digit) : NULL;
 
 #ifdef STANDALONE_SOLVER
-    assert(!"This should never happen, so we don't need to create blocknames");
+    /*
+     * We don't create blocknames here, so the solver had better
+     * not try to print them. (Only the -b benchmark generates.)
+     */
+    assert(!solver_show_working);
 #endif
 
     /*
@@ -3722,7 +4142,15 @@ static char *new_game_desc(game_params *params, random_state *rs,
          * Now loop over the shuffled list and, for each element,
          * see whether removing that element (and its reflections)
          * from the grid will still leave the grid soluble.
+         *
+         * Many removals fail because they leave more than one
+         * solution. From set elimination upwards the solver can take
+         * a long time to give up on those, and counting solutions
+         * with the exact-cover search finds them much faster; so at
+         * those levels, only the removals which pass that go to the
+         * solver for grading.
          */
+        dx = dlx_new(cr, blocks, params->xtype);
         for (i = 0; i < nlocs; i++) {
             x = locs[i].x;
             y = locs[i].y;
@@ -3732,6 +4160,10 @@ static char *new_game_desc(game_params *params, random_state *rs,
             for (j = 0; j < ncoords; j++)
                 grid2[coords[2*j+1]*cr+coords[2*j]] = 0;
 
+            if (dlev.maxdiff >= DIFF_SET &&
+                dlx_solve(dx, grid2, NULL, NULL, 2) != 1)
+                continue;
+
             solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
             if (dlev.diff <= dlev.maxdiff &&
 		(!params->killer || dlev.kdiff <= dlev.maxkdiff)) {
@@ -3739,6 +4171,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
                     grid[coords[2*j+1]*cr+coords[2*j]] = 0;
             }
         }
+        dlx_free(dx);
 
         memcpy(grid2, grid, area);
 
@@ -4018,6 +4451,15 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     int c = params->c, r = params->r, cr = c*r, area = cr * cr;
     int i;
 
+    /*
+     * Set the on-screen keyboard's range here rather than in
+     * new_game_desc, which may be running on another thread.
+     */
+    extern int max_digit_to_input;
+    extern int min_digit_to_input;
+    max_digit_to_input=cr;
+    min_digit_to_input=1;
+
     precompute_sum_bits();
 
     state->cr = cr;
@@ -5223,12 +5665,77 @@ const struct game thegame = {
 
 #ifdef STANDALONE_SOLVER
 
+/*
+ * Generate `n' puzzles with the given parameters from the seeds
+ * "0", "1", ..., timing that, and then time the solver over the lot.
+ */
+static int benchmark(char *quis, char *id, int n)
+{
+    game_params *p;
+    game_state **states;
+    struct difficulty dlev;
+    digit *grid;
+    char seed[32], *err;
+    clock_t start;
+    double elapsed;
+    int i, cr;
+
+    p = default_params();
+    decode_params(p, id);
+    err = validate_params(p, TRUE);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", quis, err);
+        return 1;
+    }
+
+    states = snewn(n, game_state *);
+    start = clock();
+    for (i = 0; i < n; i++) {
+        random_state *rs;
+        char *desc, *aux = NULL;
+
+        sprintf(seed, "%d", i);
+        rs = random_new(seed, strlen(seed));
+        desc = new_game_desc(p, rs, &aux, FALSE);
+        states[i] = new_game(NULL, p, desc);
+        random_free(rs);
+        sfree(desc);
+        sfree(aux);
+    }
+    elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%d puzzles generated in %.3f seconds: %.1f per second\n",
+           n, elapsed, elapsed > 0 ? n / elapsed : 0.0);
+
+    cr = states[0]->cr;
+    grid = snewn(cr * cr, digit);
+    start = clock();
+    for (i = 0; i < n; i++) {
+        memcpy(grid, states[i]->grid, cr * cr * sizeof(digit));
+        dlev.maxdiff = DIFF_RECURSIVE;
+        dlev.maxkdiff = DIFF_KINTERSECT;
+        solver(cr, states[i]->blocks, states[i]->kblocks, states[i]->xtype,
+               grid, states[i]->kgrid, &dlev);
+    }
+    elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%d puzzles in %.3f seconds: %.1f solves per second\n",
+           n, elapsed, elapsed > 0 ? n / elapsed : 0.0);
+
+    for (i = 0; i < n; i++)
+        free_game(states[i]);
+    sfree(states);
+    sfree(grid);
+    free_params(p);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     game_params *p;
     game_state *s;
     char *id = NULL, *desc, *err;
-    int grade = FALSE;
+    int grade = FALSE, bench = 0;
     struct difficulty dlev;
 
     while (--argc > 0) {
@@ -5237,6 +5744,9 @@ int main(int argc, char **argv)
             solver_show_working = TRUE;
         } else if (!strcmp(p, "-g")) {
             grade = TRUE;
+        } else if (!strcmp(p, "-b") && argc > 1) {
+            bench = atoi(*++argv);
+            argc--;
         } else if (*p == '-') {
             fprintf(stderr, "%s: unrecognised option `%s'\n", argv[0], p);
             return 1;
@@ -5246,10 +5756,14 @@ int main(int argc, char **argv)
     }
 
     if (!id) {
-        fprintf(stderr, "usage: %s [-g | -v] <game_id>\n", argv[0]);
+        fprintf(stderr, "usage: %s [-g | -v] <game_id>\n"
+                "       %s -b <count> <params>\n", argv[0], argv[0]);
         return 1;
     }
 
+    if (bench > 0)
+        return benchmark(argv[0], id, bench);
+
     desc = strchr(id, ':');
     if (!desc) {
         fprintf(stderr, "%s: game id expects a colon in it\n", argv[0]);
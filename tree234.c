@@ -34,19 +34,29 @@
 #include "puzzles.h"		       /* for smalloc/sfree */
 
 #ifdef TEST
-#define LOG(x) (printf x)
+/* The benchmark turns off logging, and can switch back to one malloc
+ * per node to compare against. */
+static int quiet234 = 0, nopool234 = 0;
+#define LOG(x) ((void)(quiet234 || printf x))
+#undef smalloc
+#undef srealloc
 #define smalloc malloc
 #define srealloc realloc
 #define sfree free
+#define NOPOOL nopool234
 #else
 #define LOG(x)
+#define NOPOOL 0
 #endif
 
 typedef struct node234_Tag node234;
+typedef struct nodeslab234_Tag nodeslab234;
+typedef struct nodepool234_Tag nodepool234;
 
 struct tree234_Tag {
     node234 *root;
     cmpfn234 cmp;
+    nodepool234 *pool;
 };
 
 struct node234_Tag {
@@ -56,31 +66,191 @@ struct node234_Tag {
     void *elems[3];
 };
 
+/*
+ * Nodes are not allocated one by one, but carved out of slabs
+ * belonging to a pool, which start small and double in size up to
+ * NODESLAB_MAX nodes. Nodes removed from the tree go on the pool's
+ * free list (linked through their parent pointers) to be reused,
+ * and freeing the tree frees the slabs without visiting the nodes.
+ *
+ * Each tree normally has a pool to itself. But split234 leaves
+ * nodes from one pool in two trees, so those trees share the pool;
+ * and join234 moves one tree's nodes into another, so it merges the
+ * second tree's pool into the first. A merged pool hands over its
+ * slabs and free nodes and then just forwards to the pool it was
+ * merged into, which it holds a reference to; trees still pointing
+ * at it move across the next time they need their pool.
+ */
+#define NODESLAB_MIN 8
+#define NODESLAB_MAX 256
+
+struct nodeslab234_Tag {
+    nodeslab234 *next;
+    node234 nodes[1];		       /* actually longer */
+};
+
+struct nodepool234_Tag {
+    nodepool234 *merged;	       /* non-NULL once merged elsewhere */
+    int refcount;		       /* trees and merged pools using it */
+    nodeslab234 *slabs, *lastslab;
+    node234 *freelist, *lastfree;
+    node234 *fresh;		       /* never-used nodes in newest slab */
+    int nfresh, slabsize;
+};
+
+static nodepool234 *newpool234(void) {
+    nodepool234 *p = snew(nodepool234);
+    p->merged = NULL;
+    p->refcount = 1;
+    p->slabs = p->lastslab = NULL;
+    p->freelist = p->lastfree = NULL;
+    p->fresh = NULL;
+    p->nfresh = 0;
+    p->slabsize = NODESLAB_MIN;
+    return p;
+}
+
+static void freepool234(nodepool234 *p) {
+    nodeslab234 *slab, *next;
+
+    if (--p->refcount > 0)
+	return;
+    for (slab = p->slabs; slab; slab = next) {
+	next = slab->next;
+	sfree(slab);
+    }
+    if (p->merged)
+	freepool234(p->merged);
+    sfree(p);
+}
+
+/*
+ * Find the pool a tree's nodes currently come from, following (and
+ * then short-cutting) any merges.
+ */
+static nodepool234 *pool234(tree234 *t) {
+    nodepool234 *p = t->pool;
+
+    if (p->merged) {
+	while (p->merged)
+	    p = p->merged;
+	p->refcount++;
+	freepool234(t->pool);
+	t->pool = p;
+    }
+    return p;
+}
+
+static node234 *newnode234(nodepool234 *p) {
+    node234 *n;
+
+    if (NOPOOL)
+	return snew(node234);
+    if (p->freelist) {
+	n = p->freelist;
+	p->freelist = n->parent;
+	if (!p->freelist)
+	    p->lastfree = NULL;
+	return n;
+    }
+    if (!p->nfresh) {
+	nodeslab234 *slab = smalloc(sizeof(nodeslab234) +
+				    (p->slabsize - 1) * sizeof(node234));
+	slab->next = p->slabs;
+	p->slabs = slab;
+	if (!p->lastslab)
+	    p->lastslab = slab;
+	p->fresh = slab->nodes;
+	p->nfresh = p->slabsize;
+	if (p->slabsize < NODESLAB_MAX)
+	    p->slabsize *= 2;
+    }
+    p->nfresh--;
+    return p->fresh++;
+}
+
+static void freenode234(nodepool234 *p, node234 *n) {
+    if (NOPOOL) {
+	sfree(n);
+	return;
+    }
+    n->parent = p->freelist;
+    p->freelist = n;
+    if (!p->lastfree)
+	p->lastfree = n;
+}
+
+/*
+ * Merge the pool of tree t2 into that of tree t1, so that nodes can
+ * move freely from t2 to t1.
+ */
+static void mergepools234(tree234 *t1, tree234 *t2) {
+    nodepool234 *p1 = pool234(t1), *p2 = pool234(t2);
+
+    if (p1 == p2)
+	return;
+
+    /* p2's never-used nodes become ordinary free nodes. */
+    while (p2->nfresh > 0) {
+	p2->nfresh--;
+	freenode234(p2, p2->fresh++);
+    }
+    if (p2->freelist) {
+	p2->lastfree->parent = p1->freelist;
+	if (!p1->freelist)
+	    p1->lastfree = p2->lastfree;
+	p1->freelist = p2->freelist;
+    }
+    if (p2->slabs) {
+	p2->lastslab->next = p1->slabs;
+	if (!p1->slabs)
+	    p1->lastslab = p2->lastslab;
+	p1->slabs = p2->slabs;
+    }
+    p2->slabs = p2->lastslab = NULL;
+    p2->freelist = p2->lastfree = NULL;
+    p2->merged = p1;
+    p1->refcount++;
+    pool234(t2);
+}
+
 /*
  * Create a 2-3-4 tree.
  */
-tree234 *newtree234(cmpfn234 cmp) {
+static tree234 *newtree234_pool(cmpfn234 cmp, nodepool234 *pool) {
     tree234 *ret = snew(tree234);
     LOG(("created tree %p\n", ret));
     ret->root = NULL;
     ret->cmp = cmp;
+    ret->pool = pool;
     return ret;
 }
+tree234 *newtree234(cmpfn234 cmp) {
+    return newtree234_pool(cmp, newpool234());
+}
 
 /*
  * Free a 2-3-4 tree (not including freeing the elements).
  */
-static void freenode234(node234 *n) {
+static void freesubtree234(nodepool234 *p, node234 *n) {
     if (!n)
 	return;
-    freenode234(n->kids[0]);
-    freenode234(n->kids[1]);
-    freenode234(n->kids[2]);
-    freenode234(n->kids[3]);
-    sfree(n);
+    freesubtree234(p, n->kids[0]);
+    freesubtree234(p, n->kids[1]);
+    freesubtree234(p, n->kids[2]);
+    freesubtree234(p, n->kids[3]);
+    freenode234(p, n);
 }
 void freetree234(tree234 *t) {
-    freenode234(t->root);
+    nodepool234 *p = pool234(t);
+
+    /*
+     * If no other tree shares the pool, its slabs are about to be
+     * freed wholesale and there's no need to visit the nodes.
+     */
+    if (p->refcount > 1 || NOPOOL)
+	freesubtree234(p, t->root);
+    freepool234(p);
     sfree(t);
 }
 
@@ -114,7 +284,8 @@ int count234(tree234 *t) {
  * Propagate a node overflow up a tree until it stops. Returns 0 or
  * 1, depending on whether the root had to be split or not.
  */
-static int add234_insert(node234 *left, void *e, node234 *right,
+static int add234_insert(nodepool234 *pool,
+			 node234 *left, void *e, node234 *right,
 			 node234 **root, node234 *n, int ki) {
     int lcount, rcount;
     /*
@@ -187,7 +358,7 @@ static int add234_insert(node234 *left, void *e, node234 *right,
 	    LOG(("  done\n"));
 	    break;
 	} else {
-	    node234 *m = snew(node234);
+	    node234 *m = newnode234(pool);
 	    m->parent = n->parent;
 	    LOG(("  splitting a 4-node; created new node %p\n", m));
 	    /*
@@ -283,7 +454,7 @@ static int add234_insert(node234 *left, void *e, node234 *right,
 	return 0;		       /* root unchanged */
     } else {
 	LOG(("  root is overloaded, split into two\n"));
-	(*root) = snew(node234);
+	(*root) = newnode234(pool);
 	(*root)->kids[0] = left;     (*root)->counts[0] = lcount;
 	(*root)->elems[0] = e;
 	(*root)->kids[1] = right;    (*root)->counts[1] = rcount;
@@ -314,7 +485,7 @@ static void *add234_internal(tree234 *t, void *e, int index) {
 
     LOG(("adding element \"%s\" to tree %p\n", e, t));
     if (t->root == NULL) {
-	t->root = snew(node234);
+	t->root = newnode234(pool234(t));
 	t->root->elems[1] = t->root->elems[2] = NULL;
 	t->root->kids[0] = t->root->kids[1] = NULL;
 	t->root->kids[2] = t->root->kids[3] = NULL;
@@ -382,7 +553,7 @@ static void *add234_internal(tree234 *t, void *e, int index) {
 	n = n->kids[ki];
     }
 
-    add234_insert(NULL, e, NULL, &t->root, n, ki);
+    add234_insert(pool234(t), NULL, e, NULL, &t->root, n, ki);
 
     return orig_e;
 }
@@ -779,7 +950,8 @@ static void trans234_subtree_left(node234 *n, int ki, int *k, int *index) {
  *   /     \       ->        |
  *  a   b B c C d      a A b B c C d
  */
-static void trans234_subtree_merge(node234 *n, int ki, int *k, int *index) {
+static void trans234_subtree_merge(nodepool234 *pool,
+				   node234 *n, int ki, int *k, int *index) {
     node234 *left, *right;
     int i, leftlen, rightlen, lsize, rsize;
 
@@ -823,7 +995,7 @@ static void trans234_subtree_merge(node234 *n, int ki, int *k, int *index) {
 
     n->counts[ki] += rightlen + 1;
 
-    sfree(right);
+    freenode234(pool, right);
 
     /*
      * Move the rest of n up by one.
@@ -950,7 +1122,8 @@ static void *delpos234_internal(tree234 *t, int index) {
 		 * ki is small with only small neighbours. Pick a
 		 * neighbour and merge with it.
 		 */
-		trans234_subtree_merge(n, ki>0 ? ki-1 : ki, &ki, &index);
+		trans234_subtree_merge(pool234(t), n, ki>0 ? ki-1 : ki,
+				       &ki, &index);
 		sub = n->kids[ki];
 
 		if (!n->elems[0]) {
@@ -961,7 +1134,7 @@ static void *delpos234_internal(tree234 *t, int index) {
 		    LOG(("  shifting root!\n"));
 		    t->root = sub;
 		    sub->parent = NULL;
-		    sfree(n);
+		    freenode234(pool234(t), n);
 		    n = NULL;
 		}
 	    }
@@ -993,7 +1166,7 @@ static void *delpos234_internal(tree234 *t, int index) {
     if (!n->elems[0]) {
 	LOG(("  removed last element in tree, destroying empty root\n"));
 	assert(n == t->root);
-	sfree(n);
+	freenode234(pool234(t), n);
 	t->root = NULL;
     }
 
@@ -1025,7 +1198,8 @@ void *del234(tree234 *t, void *e) {
  * resulting tree is the same height as the original larger one, or
  * one higher.
  */
-static node234 *join234_internal(node234 *left, void *sep,
+static node234 *join234_internal(nodepool234 *pool,
+				 node234 *left, void *sep,
 				 node234 *right, int *height) {
     node234 *root, *node;
     int relht = *height;
@@ -1040,7 +1214,7 @@ static node234 *join234_internal(node234 *left, void *sep,
 	 * nodes.
 	 */
 	node234 *newroot;
-	newroot = snew(node234);
+	newroot = newnode234(pool);
 	newroot->kids[0] = left;     newroot->counts[0] = countnode234(left);
 	newroot->elems[0] = sep;
 	newroot->kids[1] = right;    newroot->counts[1] = countnode234(right);
@@ -1100,7 +1274,7 @@ static node234 *join234_internal(node234 *left, void *sep,
     /*
      * Now proceed as for addition.
      */
-    *height = add234_insert(left, sep, right, &root, node, ki);
+    *height = add234_insert(pool, left, sep, right, &root, node, ki);
 
     return root;
 }
@@ -1128,7 +1302,9 @@ tree234 *join234(tree234 *t1, tree234 *t2) {
 
 	element = delpos234(t2, 0);
 	relht = height234(t1) - height234(t2);
-	t1->root = join234_internal(t1->root, element, t2->root, &relht);
+	mergepools234(t1, t2);
+	t1->root = join234_internal(pool234(t1), t1->root, element,
+				    t2->root, &relht);
 	t2->root = NULL;
     }
     return t1;
@@ -1148,7 +1324,9 @@ tree234 *join234r(tree234 *t1, tree234 *t2) {
 
 	element = delpos234(t1, size1-1);
 	relht = height234(t1) - height234(t2);
-	t2->root = join234_internal(t1->root, element, t2->root, &relht);
+	mergepools234(t2, t1);
+	t2->root = join234_internal(pool234(t2), t1->root, element,
+				    t2->root, &relht);
 	t1->root = NULL;
     }
     return t2;
@@ -1217,7 +1395,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 	 * new node pointers in halves[0] and halves[1], and go up
 	 * a level.
 	 */
-	sib = snew(node234);
+	sib = newnode234(pool234(t));
 	for (i = 0; i < 3; i++) {
 	    if (i+ki < 3 && n->elems[i+ki]) {
 		sib->elems[i] = n->elems[i+ki];
@@ -1292,7 +1470,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 	while (halves[half] && !halves[half]->elems[0]) {
 	    LOG(("  root %p is undersize, throwing away\n", halves[half]));
 	    halves[half] = halves[half]->kids[0];
-	    sfree(halves[half]->parent);
+	    freenode234(pool234(t), halves[half]->parent);
 	    halves[half]->parent = NULL;
 	    LOG(("  new root is %p\n", halves[half]));
 	}
@@ -1349,7 +1527,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 		     * Neighbour is small, or possibly neighbour is
 		     * medium and we are undersize.
 		     */
-		    trans234_subtree_merge(n, merge, NULL, NULL);
+		    trans234_subtree_merge(pool234(t), n, merge, NULL, NULL);
 		    sub = n->kids[merge];
 		    if (!n->elems[0]) {
 			/*
@@ -1360,7 +1538,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 			LOG(("  shifting root!\n"));
 			halves[half] = sub;
 			halves[half]->parent = NULL;
-			sfree(n);
+			freenode234(pool234(t), n);
 		    }
 		} else {
 		    /* Neighbour is big enough to move trees over. */
@@ -1384,7 +1562,9 @@ tree234 *splitpos234(tree234 *t, int index, int before) {
     count = countnode234(t->root);
     if (index < 0 || index > count)
 	return NULL;		       /* error */
-    ret = newtree234(t->cmp);
+    /* The two halves will share t's nodes, so share its pool. */
+    ret = newtree234_pool(t->cmp, pool234(t));
+    ret->pool->refcount++;
     n = split234_internal(t, index);
     if (before) {
 	/* We want to return the ones before the index. */
@@ -1417,9 +1597,10 @@ tree234 *split234(tree234 *t, void *e, cmpfn234 cmp, int rel) {
     return splitpos234(t, index+1, before);
 }
 
-static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
+static node234 *copynode234(nodepool234 *pool, node234 *n,
+			    copyfn234 copyfn, void *copyfnstate) {
     int i;
-    node234 *n2 = snew(node234);
+    node234 *n2 = newnode234(pool);
 
     for (i = 0; i < 3; i++) {
 	if (n->elems[i] && copyfn)
@@ -1430,7 +1611,7 @@ static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
 
     for (i = 0; i < 4; i++) {
 	if (n->kids[i]) {
-	    n2->kids[i] = copynode234(n->kids[i], copyfn, copyfnstate);
+	    n2->kids[i] = copynode234(pool, n->kids[i], copyfn, copyfnstate);
 	    n2->kids[i]->parent = n2;
 	} else {
 	    n2->kids[i] = NULL;
@@ -1445,7 +1626,7 @@ tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate) {
 
     t2 = newtree234(t->cmp);
     if (t->root) {
-	t2->root = copynode234(t->root, copyfn, copyfnstate);
+	t2->root = copynode234(t2->pool, t->root, copyfn, copyfnstate);
 	t2->root->parent = NULL;
     } else
 	t2->root = NULL;
@@ -1453,6 +1634,71 @@ tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate) {
     return t2;
 }
 
+static node234 *buildnode234(nodepool234 *pool, void **array, int n,
+			     unsigned kidmax) {
+    node234 *node = newnode234(pool);
+    int i;
+
+    node->parent = NULL;
+    for (i = 0; i < 4; i++) {
+	node->kids[i] = NULL;
+	node->counts[i] = 0;
+    }
+    for (i = 0; i < 3; i++)
+	node->elems[i] = NULL;
+
+    if (kidmax == 0) {
+	/* A leaf. */
+	assert(n >= 1 && n <= 3);
+	for (i = 0; i < n; i++)
+	    node->elems[i] = array[i];
+    } else {
+	/*
+	 * Use as few children as will hold the elements, and share
+	 * the elements out between them as evenly as possible. Each
+	 * child then has at least half of kidmax elements, which is
+	 * plenty to fill a subtree of that height.
+	 */
+	int k, rest;
+
+	for (k = 2; (unsigned)(n - (k-1)) > k * kidmax; k++);
+	assert(k <= 4);
+	rest = n - (k-1);
+	for (i = 0; i < k; i++) {
+	    int size = rest / k + (i < rest % k);
+	    node->kids[i] = buildnode234(pool, array, size, (kidmax - 3) / 4);
+	    node->kids[i]->parent = node;
+	    node->counts[i] = size;
+	    array += size;
+	    if (i < k-1)
+		node->elems[i] = *array++;
+	}
+    }
+
+    return node;
+}
+tree234 *buildtree234(cmpfn234 cmp, void **array, int n) {
+    tree234 *t = newtree234(cmp);
+    unsigned max;
+    int i;
+
+    if (cmp)
+	for (i = 1; i < n; i++)
+	    assert(cmp(array[i-1], array[i]) < 0);
+
+    if (n > 0) {
+	/*
+	 * A tree of height h holds at most 4^h-1 elements; pick the
+	 * lowest tree that will do, and pass down the maximum size
+	 * of each of its root's subtrees.
+	 */
+	for (max = 3; max < (unsigned)n; max = max * 4 + 3);
+	t->root = buildnode234(t->pool, array, n, (max - 3) / 4);
+    }
+
+    return t;
+}
+
 #ifdef TEST
 
 /*
@@ -1481,6 +1727,7 @@ tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate) {
 #include <string.h>
 #include <stdarg.h>
 
+#undef srealloc
 #define srealloc realloc
 
 /*
@@ -2022,14 +2269,110 @@ void splittest(tree234 *tree, void **array, int arraylen) {
     }
 }
 
-int main(void) {
+int sortcmp(const void *av, const void *bv) {
+    return mycmp(*(void *const *)av, *(void *const *)bv);
+}
+
+/*
+ * Benchmark: time the basic operations on trees of integers, with
+ * nodes from the pool and with one malloc per node as it used to
+ * be. Invoke as `tree234 --bench'.
+ */
+
+#include <time.h>
+
+int intcmp(void *av, void *bv) {
+    int a = *(int *)av, b = *(int *)bv;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+double nsper(clock_t start, long ops) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / ops;
+}
+
+void benchmark(void) {
+    int n, i, r, reps;
+    unsigned seed = 1;
+
+    printf("                   ns per element:\n"
+	   "   size  nodes    insert  delete    copy    free   build\n");
+    for (n = 1000; n <= 1000000; n *= 10) {
+	int *ints = smalloc(n * sizeof(int));
+	void **sorted = smalloc(n * sizeof(void *));
+	void **shuffled = smalloc(n * sizeof(void *));
+
+	for (i = 0; i < n; i++) {
+	    ints[i] = i;
+	    sorted[i] = shuffled[i] = &ints[i];
+	}
+	for (i = n; i > 1; i--) {
+	    int j = ((randomnumber(&seed) << 15) | randomnumber(&seed)) % i;
+	    void *tmp = shuffled[j];
+	    shuffled[j] = shuffled[i-1];
+	    shuffled[i-1] = tmp;
+	}
+	reps = 2000000 / n;
+
+	for (nopool234 = 1; nopool234 >= 0; nopool234--) {
+	    double tins = 0, tdel = 0, tcopy = 0, tfree = 0, tbuild = 0;
+
+	    for (r = 0; r < reps; r++) {
+		tree234 *t, *t2;
+		clock_t start;
+
+		start = clock();
+		t = newtree234(intcmp);
+		for (i = 0; i < n; i++)
+		    add234(t, shuffled[i]);
+		tins += nsper(start, n);
+
+		start = clock();
+		t2 = copytree234(t, NULL, NULL);
+		tcopy += nsper(start, n);
+
+		start = clock();
+		for (i = 0; i < n; i++)
+		    del234(t, shuffled[n-1-i]);
+		freetree234(t);
+		tdel += nsper(start, n);
+
+		start = clock();
+		freetree234(t2);
+		tfree += nsper(start, n);
+
+		start = clock();
+		t = buildtree234(intcmp, sorted, n);
+		tbuild += nsper(start, n);
+		freetree234(t);
+	    }
+
+	    printf("%7d %6s %9.1f %7.1f %7.1f %7.1f %7.1f\n", n,
+		   nopool234 ? "malloc" : "pool", tins / reps, tdel / reps,
+		   tcopy / reps, tfree / reps, tbuild / reps);
+	}
+	nopool234 = 0;
+
+	sfree(shuffled);
+	sfree(sorted);
+	sfree(ints);
+    }
+}
+
+int main(int argc, char **argv) {
     int in[NSTR];
     int i, j, k;
     int tworoot, tmplen;
     unsigned seed = 0;
     tree234 *tree2, *tree3, *tree4;
+    void **sorted;
     int c;
 
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+	quiet234 = 1;
+	benchmark();
+	return 0;
+    }
+
     setvbuf(stdout, NULL, _IOLBF, 0);
 
     for (i = 0; i < (int)NSTR; i++) in[i] = 0;
@@ -2187,6 +2530,52 @@ int main(void) {
     assert(tree3 == join234(tree3, tree));
     verifytree(tree3, array, 2);
     verifytree(tree, array, 0);
+    freetree234(tree);
+    freetree234(tree2);
+    freetree234(tree3);
+    freetree234(tree4);
+
+    /*
+     * Test buildtree234 at every size up to the number of strings
+     * we have, both unsorted and sorted.
+     */
+    sorted = smalloc(NSTR * sizeof(*sorted));
+    for (i = 0; i < (int)NSTR; i++)
+	sorted[i] = strings[i];
+    qsort(sorted, NSTR, sizeof(*sorted), sortcmp);
+    for (i = 0; i <= (int)NSTR; i++) {
+	printf("building trees of size %d\n", i);
+	cmp = NULL;
+	tree = buildtree234(NULL, (void **)strings, i);
+	verifytree(tree, (void **)strings, i);
+	freetree234(tree);
+	cmp = mycmp;
+	tree = buildtree234(mycmp, sorted, i);
+	verifytree(tree, sorted, i);
+	freetree234(tree);
+    }
+
+    /*
+     * And check that a built tree works normally afterwards, by
+     * deleting from it until it's empty.
+     */
+    tree = buildtree234(mycmp, sorted, NSTR);
+    arraylen = 0;
+    for (i = 0; i < (int)NSTR; i++) {
+	if (arraysize < arraylen+1) {
+	    arraysize = arraylen+1+256;
+	    array = srealloc(array, arraysize*sizeof(*array));
+	}
+	array[arraylen++] = sorted[i];
+    }
+    verify();
+    while (arraylen > 0) {
+        j = randomnumber(&seed);
+        j %= arraylen;
+        deltest(array[j]);
+    }
+    freetree234(tree);
+    sfree(sorted);
 
     return 0;
 }
@@ -199,4 +199,13 @@ tree234 *join234r(tree234 *t1, tree234 *t2);
  */
 tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate);
 
+/*
+ * Build a tree234 from an array of n elements in one go, in time
+ * linear in n rather than the n log n of adding them one by one.
+ * If `cmp' is non-NULL, the elements must already be sorted by it,
+ * with no two comparing equal; if it's NULL, the tree is unsorted
+ * and holds the elements in array order.
+ */
+tree234 *buildtree234(cmpfn234 cmp, void **array, int n);
+
 #endif /* TREE234_H */
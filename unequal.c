@@ -551,21 +551,21 @@ static void free_solver(game_solver *solver)
 
 static void solver_nminmax(game_solver *usolver,
                            int x, int y, int *min_r, int *max_r,
-                           unsigned char **ns_r)
+                           unsigned int **ns_r)
 {
     struct latin_solver *solver = &usolver->latin;
     int o = usolver->latin.o, min = o, max = 0, n;
-    unsigned char *ns;
+    unsigned int *ns;
 
     assert(x >= 0 && y >= 0 && x < o && y < o);
 
-    ns = solver->cube + cubepos(x,y,1);
+    ns = &cubeword(x,y);
 
     if (grid(x,y) > 0) {
         min = max = grid(x,y)-1;
     } else {
         for (n = 0; n < o; n++) {
-            if (ns[n]) {
+            if (*ns & digitbit(n+1)) {
                 if (n > max) max = n;
                 if (n < min) min = n;
             }
@@ -579,7 +579,7 @@ static void solver_nminmax(game_solver *usolver,
 static int solver_links(game_solver *usolver)
 {
     int i, j, lmin, gmax, nchanged = 0;
-    unsigned char *gns, *lns;
+    unsigned int *gns, *lns;
     struct solver_link *link;
     struct latin_solver *solver = &usolver->latin;
 
@@ -591,7 +591,7 @@ static int solver_links(game_solver *usolver)
         for (j = 0; j < solver->o; j++) {
             /* For the 'greater' end of the link, discount all numbers
              * too small to satisfy the inequality. */
-            if (gns[j]) {
+            if (*gns & digitbit(j+1)) {
                 if (j < (lmin+link->len)) {
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working) {
@@ -603,13 +603,13 @@ static int solver_links(game_solver *usolver)
                                j+1, link->gx, link->gy);
                     }
 #endif
-                    cube(link->gx, link->gy, j+1) = FALSE;
+                    cube_clear(link->gx, link->gy, j+1);
                     nchanged++;
                 }
             }
             /* For the 'lesser' end of the link, discount all numbers
              * too large to satisfy inequality. */
-            if (lns[j]) {
+            if (*lns & digitbit(j+1)) {
                 if (j > (gmax-link->len)) {
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working) {
@@ -621,7 +621,7 @@ static int solver_links(game_solver *usolver)
                                j+1, link->lx, link->ly);
                     }
 #endif
-                    cube(link->lx, link->ly, j+1) = FALSE;
+                    cube_clear(link->lx, link->ly, j+1);
                     nchanged++;
                 }
             }
@@ -742,7 +742,7 @@ got_result:
 #endif
 
     latin_solver_free_scratch(scratch);
-    memcpy(state->hints, solver->latin.cube, o*o*o);
+    latin_solver_get_cube(&solver->latin, state->hints);
     free_solver(solver);
 
     return diff;
@@ -917,7 +917,13 @@ int maxtries;
 #else
 #define MAXTRIES 50
 #endif
+
+#ifdef STANDALONE_SOLVER
+/* Solver calls made by the generator, for its progress reports. Not
+ * kept otherwise, since new_game_desc may be running on several
+ * threads at once. */
 int gg_solved;
+#endif
 
 static int game_assemble(game_state *new, int *scratch, digit *latin,
                          int difficulty)
@@ -942,7 +948,9 @@ static int game_assemble(game_state *new, int *scratch, digit *latin,
 #endif
 
     while(1) {
+#ifdef STANDALONE_SOLVER
         gg_solved++;
+#endif
         if (solver_state(copy, difficulty) == 1) break;
 
         best = gg_best_clue(copy, scratch, latin);
@@ -973,7 +981,9 @@ static void game_strip(game_state *new, int *scratch, digit *latin,
 
         memcpy(copy->nums,  new->nums,  o2 * sizeof(digit));
         memcpy(copy->flags, new->flags, o2 * sizeof(unsigned int));
+#ifdef STANDALONE_SOLVER
         gg_solved++;
+#endif
         if (solver_state(copy, difficulty) != 1) {
             /* put clue back, we can't solve without it. */
             int ret = gg_place_clue(new, scratch[i], latin, 0);
@@ -1005,18 +1015,6 @@ static char *new_game_desc(game_params *params, random_state *rs,
     int *scratch, lscratch = o2*5;
     char *ret, buf[80];
     game_state *state = blank_game(params->order);
-    extern int max_digit_to_input;
-    extern int min_digit_to_input;
-    if(params->order > 9)
-    {
-        max_digit_to_input = params->order - 1;
-        min_digit_to_input = 0;
-    }
-    else
-    {
-        max_digit_to_input = params->order;
-        min_digit_to_input = 1;
-    };
 
     /* Generate a list of 'things to strip' (randomised later) */
     scratch = snewn(lscratch, int);
@@ -1039,7 +1037,9 @@ generate:
     memset(state->nums, 0, o2 * sizeof(digit));
     memset(state->flags, 0, o2 * sizeof(unsigned int));
 
+#ifdef STANDALONE_SOLVER
     gg_solved = 0;
+#endif
     if (game_assemble(state, scratch, sq, params->diff) < 0)
         goto generate;
     game_strip(state, scratch, sq, params->diff);
@@ -1191,6 +1191,21 @@ fail:
 static game_state *new_game(midend *me, game_params *params, char *desc)
 {
     game_state *state = load_game(params, desc, NULL);
+
+    /* Not in new_game_desc, which may run on a generator thread. */
+    extern int max_digit_to_input;
+    extern int min_digit_to_input;
+    if(params->order > 9)
+    {
+        max_digit_to_input = params->order - 1;
+        min_digit_to_input = 0;
+    }
+    else
+    {
+        max_digit_to_input = params->order;
+        min_digit_to_input = 1;
+    };
+
     if (!state) {
         assert("Unable to load ?validated game.");
         return NULL;
@@ -78,6 +78,15 @@ struct game_params {
 struct graph {
     int refcount;		       /* for deallocation */
     tree234 *edges;		       /* stores `edge' structures */
+    /*
+     * The same edges as a flat array, in the order index234 would
+     * return them, and for each point p the indices of the edges
+     * touching it: vedges[vstart[p]] up to, but not including,
+     * vedges[vstart[p+1]]. These are what the crossing checks walk.
+     */
+    int nedges;
+    edge *elist;
+    int *vstart, *vedges;
 };
 
 struct game_state {
@@ -85,8 +94,9 @@ struct game_state {
     int w, h;			       /* extent of coordinate system only */
     point *pts;
 #ifdef SHOW_CROSSINGS
-    int *crosses;		       /* mark edges which are crossed */
+    int *crosses;		       /* how many edges cross each edge */
 #endif
+    int ncrossings;		       /* number of crossing pairs of edges */
     struct graph *graph;
     int completed, cheated, just_solved;
 };
@@ -377,6 +387,185 @@ static int cross(point a1, point a2, point b1, point b2)
     return TRUE;
 }
 
+/*
+ * Count the pairs of edges in `elist' which cross, given the point
+ * positions in `pts' (of which there are n). If `crosses' is not
+ * NULL, crosses[i] is set to the number of edges crossing edge i.
+ * If `stopearly' is set, we return 1 as soon as we find any
+ * crossing at all.
+ *
+ * Rather than try every pair of edges, we lay a grid of about one
+ * cell per edge over the points and file each edge under every
+ * cell its bounding box touches. Edges whose bounding boxes don't
+ * overlap can't cross, so only edges sharing a cell need checking
+ * with cross(); and to check each pair only once, we do it in the
+ * cell at the top left corner of the overlap of their boxes. The
+ * cells are worked out in floating point, but that's safe: all we
+ * need is for the mapping from coordinates to cells to be
+ * monotonic, and the exact test is still cross().
+ */
+static int find_crossings(const point *pts, int n,
+			  const edge *elist, int nedges,
+			  int *crosses, int stopearly)
+{
+    double minx, maxx, miny, maxy, sx, sy;
+    int *cx, *cy, *start, *list;
+    int g, i, j, k, x, y, c, count = 0;
+
+    if (crosses)
+	for (i = 0; i < nedges; i++)
+	    crosses[i] = 0;
+    if (nedges < 2)
+	return 0;
+
+    for (g = 1; (g+1) * (g+1) <= nedges; g++);
+
+    minx = maxx = (double)pts[0].x / pts[0].d;
+    miny = maxy = (double)pts[0].y / pts[0].d;
+    for (i = 1; i < n; i++) {
+	double px = (double)pts[i].x / pts[i].d;
+	double py = (double)pts[i].y / pts[i].d;
+	if (minx > px) minx = px;
+	if (maxx < px) maxx = px;
+	if (miny > py) miny = py;
+	if (maxy < py) maxy = py;
+    }
+    sx = maxx > minx ? g / (maxx - minx) : 0;
+    sy = maxy > miny ? g / (maxy - miny) : 0;
+
+    cx = snewn(n, int);
+    cy = snewn(n, int);
+    for (i = 0; i < n; i++) {
+	cx[i] = (int)(((double)pts[i].x / pts[i].d - minx) * sx);
+	cy[i] = (int)(((double)pts[i].y / pts[i].d - miny) * sy);
+	if (cx[i] >= g) cx[i] = g-1;
+	if (cy[i] >= g) cy[i] = g-1;
+    }
+
+    /*
+     * File the edges under their cells, by counting sort: the edges
+     * in cell c are list[start[c]] up to list[start[c+1]], in
+     * increasing order.
+     */
+    start = snewn(g*g+1, int);
+    for (c = 0; c <= g*g; c++)
+	start[c] = 0;
+    for (i = 0; i < nedges; i++) {
+	int a = elist[i].a, b = elist[i].b;
+	for (y = min(cy[a], cy[b]); y <= max(cy[a], cy[b]); y++)
+	    for (x = min(cx[a], cx[b]); x <= max(cx[a], cx[b]); x++)
+		start[y*g+x+1]++;
+    }
+    for (c = 0; c < g*g; c++)
+	start[c+1] += start[c];
+    list = snewn(start[g*g], int);
+    for (i = 0; i < nedges; i++) {
+	int a = elist[i].a, b = elist[i].b;
+	for (y = min(cy[a], cy[b]); y <= max(cy[a], cy[b]); y++)
+	    for (x = min(cx[a], cx[b]); x <= max(cx[a], cx[b]); x++)
+		list[start[y*g+x]++] = i;
+    }
+    for (c = g*g; c > 0; c--)
+	start[c] = start[c-1];
+    start[0] = 0;
+
+    for (c = 0; c < g*g; c++) {
+	x = c % g;
+	y = c / g;
+	for (j = start[c]; j < start[c+1]; j++) {
+	    const edge *e = &elist[list[j]];
+	    int ex = min(cx[e->a], cx[e->b]), ey = min(cy[e->a], cy[e->b]);
+	    for (k = j+1; k < start[c+1]; k++) {
+		const edge *e2 = &elist[list[k]];
+		if (e2->a == e->a || e2->a == e->b ||
+		    e2->b == e->a || e2->b == e->b)
+		    continue;
+		if (max(ex, min(cx[e2->a], cx[e2->b])) != x ||
+		    max(ey, min(cy[e2->a], cy[e2->b])) != y)
+		    continue;	       /* this pair is checked elsewhere */
+		if (cross(pts[e2->a], pts[e2->b], pts[e->a], pts[e->b])) {
+		    count++;
+		    if (crosses) {
+			crosses[list[j]]++;
+			crosses[list[k]]++;
+		    }
+		    if (stopearly)
+			goto done;     /* multi-level break - sorry */
+		}
+	    }
+	}
+    }
+
+    done:
+    sfree(list);
+    sfree(start);
+    sfree(cy);
+    sfree(cx);
+    return count;
+}
+
+/*
+ * Count the crossings involving any edge marked in `affected', using
+ * the point positions in `pts'. Pairs of edges which are both marked
+ * are counted once. If `crosses' is not NULL, `delta' is added to the
+ * count of each edge in each crossing found.
+ *
+ * Most pairs of edges are nowhere near each other, so before calling
+ * cross() we reject any pair whose bounding boxes are apart. As in
+ * find_crossings, floating point is good enough for that as long as
+ * we only reject boxes which are strictly apart.
+ */
+static int affected_crossings(const point *pts, int n,
+			      const struct graph *graph,
+			      const unsigned char *affected,
+			      int *crosses, int delta)
+{
+    double *px, *py;
+    int i, j, count = 0;
+
+    px = snewn(n, double);
+    py = snewn(n, double);
+    for (i = 0; i < n; i++) {
+	px[i] = (double)pts[i].x / pts[i].d;
+	py[i] = (double)pts[i].y / pts[i].d;
+    }
+
+    for (i = 0; i < graph->nedges; i++) {
+	const edge *e = &graph->elist[i];
+	double x0, x1, y0, y1;
+	if (!affected[i])
+	    continue;
+	x0 = min(px[e->a], px[e->b]);
+	x1 = max(px[e->a], px[e->b]);
+	y0 = min(py[e->a], py[e->b]);
+	y1 = max(py[e->a], py[e->b]);
+	for (j = 0; j < graph->nedges; j++) {
+	    const edge *e2 = &graph->elist[j];
+	    if (affected[j] && j <= i)
+		continue;
+	    if (e2->a == e->a || e2->a == e->b ||
+		e2->b == e->a || e2->b == e->b)
+		continue;
+	    if ((px[e2->a] < x0 && px[e2->b] < x0) ||
+		(px[e2->a] > x1 && px[e2->b] > x1) ||
+		(py[e2->a] < y0 && py[e2->b] < y0) ||
+		(py[e2->a] > y1 && py[e2->b] > y1))
+		continue;
+	    if (cross(pts[e2->a], pts[e2->b], pts[e->a], pts[e->b])) {
+		count++;
+		if (crosses) {
+		    crosses[i] += delta;
+		    crosses[j] += delta;
+		}
+	    }
+	}
+    }
+
+    sfree(py);
+    sfree(px);
+    return count;
+}
+
 static unsigned long squarert(unsigned long n) {
     unsigned long d, a, b, di;
 
@@ -489,10 +678,10 @@ static char *new_game_desc(game_params *params, random_state *rs,
 {
     int n = params->n, i;
     long w, h, j, k, m;
-    point *pts, *pts2;
+    point *pts, *pts2, *pts3;
     long *tmp;
     tree234 *edges, *vertices;
-    edge *e, *e2;
+    edge *e, *elist;
     vertex *v, *vs, *vlist;
     char *ret;
 
@@ -626,23 +815,20 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	tmp[i] = i;
     pts2 = snewn(n, point);
     make_circle(pts2, n, w);
+    m = count234(edges);
+    elist = snewn(m, edge);
+    for (i = 0; (e = index234(edges, i)) != NULL; i++)
+	elist[i] = *e;
+    pts3 = snewn(n, point);
     while (1) {
 	shuffle(tmp, n, sizeof(*tmp), rs);
-	for (i = 0; (e = index234(edges, i)) != NULL; i++) {
-	    for (j = i+1; (e2 = index234(edges, j)) != NULL; j++) {
-		if (e2->a == e->a || e2->a == e->b ||
-		    e2->b == e->a || e2->b == e->b)
-		    continue;
-		if (cross(pts2[tmp[e2->a]], pts2[tmp[e2->b]],
-			  pts2[tmp[e->a]], pts2[tmp[e->b]]))
-		    break;
-	    }
-	    if (e2)
-		break;
-	}
-	if (e)
+	for (i = 0; i < n; i++)
+	    pts3[i] = pts2[tmp[i]];
+	if (find_crossings(pts3, n, elist, m, NULL, TRUE))
 	    break;		       /* we've found a crossing */
     }
+    sfree(pts3);
+    sfree(elist);
 
     /*
      * We're done. Now encode the graph in a string format. Let's
@@ -753,49 +939,99 @@ static char *validate_desc(game_params *params, char *desc)
     return NULL;
 }
 
-static void mark_crossings(game_state *state)
+/*
+ * Bring `ncrossings' (and `crosses') up to date in a state whose
+ * points have just moved, and see whether the puzzle is solved.
+ *
+ * If `prev' is not NULL, it's the state we moved from and `moved'
+ * marks the points which have moved since. If only a few edges touch
+ * those, we needn't look at the whole graph: a crossing changes only
+ * if one of its edges moves, so we subtract the crossings those
+ * edges were in before and add the ones they're in now. Otherwise
+ * we count everything from scratch.
+ */
+static void mark_crossings(game_state *state, const game_state *prev,
+			   const unsigned char *moved)
 {
-    int ok = TRUE;
-    int i, j;
-    edge *e, *e2;
-
-#ifdef SHOW_CROSSINGS
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++)
-	state->crosses[i] = FALSE;
-#endif
+    struct graph *graph = state->graph;
+    unsigned char *affected;
+    int *crosses;
+    int i, j, naffected;
 
-    /*
-     * Check correctness: for every pair of edges, see whether they
-     * cross.
-     */
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++) {
-	for (j = i+1; (e2 = index234(state->graph->edges, j)) != NULL; j++) {
-	    if (e2->a == e->a || e2->a == e->b ||
-		e2->b == e->a || e2->b == e->b)
-		continue;
-	    if (cross(state->pts[e2->a], state->pts[e2->b],
-		      state->pts[e->a], state->pts[e->b])) {
-		ok = FALSE;
 #ifdef SHOW_CROSSINGS
-		state->crosses[i] = state->crosses[j] = TRUE;
+    crosses = state->crosses;
 #else
-		goto done;	       /* multi-level break - sorry */
+    crosses = NULL;
 #endif
-	    }
+
+    if (!prev) {
+	state->ncrossings = find_crossings(state->pts, state->params.n,
+					   graph->elist, graph->nedges,
+					   crosses, FALSE);
+    } else {
+	affected = snewn(graph->nedges, unsigned char);
+	memset(affected, 0, graph->nedges);
+	naffected = 0;
+	for (i = 0; i < state->params.n; i++)
+	    if (moved[i])
+		for (j = graph->vstart[i]; j < graph->vstart[i+1]; j++)
+		    if (!affected[graph->vedges[j]]) {
+			affected[graph->vedges[j]] = 1;
+			naffected++;
+		    }
+
+	if (naffected * 4 > graph->nedges) {
+	    state->ncrossings = find_crossings(state->pts, state->params.n,
+					       graph->elist, graph->nedges,
+					       crosses, FALSE);
+	} else {
+	    state->ncrossings = prev->ncrossings;
+	    state->ncrossings -= affected_crossings(prev->pts, state->params.n,
+						    graph, affected,
+						    crosses, -1);
+	    state->ncrossings += affected_crossings(state->pts, state->params.n,
+						    graph, affected,
+						    crosses, +1);
 	}
+
+	sfree(affected);
     }
 
-    /*
-     * e == NULL if we've gone through all the edge pairs
-     * without finding a crossing.
-     */
-#ifndef SHOW_CROSSINGS
-    done:
-#endif
-    if (ok)
+    if (state->ncrossings == 0)
 	state->completed = TRUE;
 }
 
+/*
+ * Fill in the flat copies of the edge list in a newly built graph.
+ */
+static void make_edge_lists(struct graph *graph, int n)
+{
+    edge *e;
+    int i;
+
+    graph->nedges = count234(graph->edges);
+    graph->elist = snewn(graph->nedges, edge);
+    graph->vstart = snewn(n+1, int);
+    graph->vedges = snewn(2 * graph->nedges, int);
+
+    for (i = 0; i <= n; i++)
+	graph->vstart[i] = 0;
+    for (i = 0; (e = index234(graph->edges, i)) != NULL; i++) {
+	graph->elist[i] = *e;
+	graph->vstart[e->a+1]++;
+	graph->vstart[e->b+1]++;
+    }
+    for (i = 0; i < n; i++)
+	graph->vstart[i+1] += graph->vstart[i];
+    for (i = 0; i < graph->nedges; i++) {
+	graph->vedges[graph->vstart[graph->elist[i].a]++] = i;
+	graph->vedges[graph->vstart[graph->elist[i].b]++] = i;
+    }
+    for (i = n; i > 0; i--)
+	graph->vstart[i] = graph->vstart[i-1];
+    graph->vstart[0] = 0;
+}
+
 static game_state *new_game(midend *me, game_params *params, char *desc)
 {
     int n = params->n;
@@ -827,9 +1063,14 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
 	addedge(state->graph->edges, a, b);
     }
 
+    make_edge_lists(state->graph, n);
+
 #ifdef SHOW_CROSSINGS
-    state->crosses = snewn(count234(state->graph->edges), int);
-    mark_crossings(state);	       /* sets up `crosses' and `completed' */
+    state->crosses = snewn(state->graph->nedges, int);
+    mark_crossings(state, NULL, NULL);	/* sets up `crosses' and `completed' */
+#else
+    state->ncrossings = find_crossings(state->pts, n, state->graph->elist,
+				       state->graph->nedges, NULL, FALSE);
 #endif
 
     return state;
@@ -850,10 +1091,10 @@ static game_state *dup_game(game_state *state)
     ret->completed = state->completed;
     ret->cheated = state->cheated;
     ret->just_solved = state->just_solved;
+    ret->ncrossings = state->ncrossings;
 #ifdef SHOW_CROSSINGS
-    ret->crosses = snewn(count234(ret->graph->edges), int);
-    memcpy(ret->crosses, state->crosses,
-	   count234(ret->graph->edges) * sizeof(int));
+    ret->crosses = snewn(ret->graph->nedges, int);
+    memcpy(ret->crosses, state->crosses, ret->graph->nedges * sizeof(int));
 #endif
 
     return ret;
@@ -866,6 +1107,9 @@ static void free_game(game_state *state)
 	while ((e = delpos234(state->graph->edges, 0)) != NULL)
 	    sfree(e);
 	freetree234(state->graph->edges);
+	sfree(state->graph->elist);
+	sfree(state->graph->vstart);
+	sfree(state->graph->vedges);
 	sfree(state->graph);
     }
     sfree(state->pts);
@@ -1202,9 +1446,12 @@ static game_state *execute_move(game_state *state, char *move)
     int n = state->params.n;
     int p, k;
     long x, y, d;
+    unsigned char *moved;
     game_state *ret = dup_game(state);
 
     ret->just_solved = FALSE;
+    moved = snewn(n, unsigned char);
+    memset(moved, 0, n);
 
     while (*move) {
 	if (*move == 'S') {
@@ -1218,16 +1465,19 @@ static game_state *execute_move(game_state *state, char *move)
 	    ret->pts[p].x = x;
 	    ret->pts[p].y = y;
 	    ret->pts[p].d = d;
+	    moved[p] = 1;
 
 	    move += k+1;
 	    if (*move == ';') move++;
 	} else {
+	    sfree(moved);
 	    free_game(ret);
 	    return NULL;
 	}
     }
 
-    mark_crossings(ret);
+    mark_crossings(ret, state, moved);
+    sfree(moved);
 
     return ret;
 }
@@ -1512,3 +1762,150 @@ const struct game thegame = {
     FALSE, game_timing_state,
     SOLVE_ANIMATES,		       /* flags */
 };
+
+#ifdef STANDALONE_UNTANGLE_BENCHMARK
+
+/*
+ * Drag latency: generate a puzzle of each size, then make a run of
+ * random single-point drags through execute_move, and compare the
+ * time it takes with recounting every crossing after each drag, both
+ * with the grid and by trying every pair of edges as we used to.
+ * Each size is tried twice: dragging points anywhere in the tangled
+ * starting position, and nudging points by up to a tile from the
+ * solution, which is what the end of a game looks like.
+ * Usage: untangle [-d drags] [n...]
+ */
+
+#include <time.h>
+
+static double elapsed(clock_t start, long ops)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e6 / ops;
+}
+
+/* The old all-pairs check, counting rather than stopping early. */
+static int allpairs_crossings(game_state *state)
+{
+    int i, j, count = 0;
+    edge *e, *e2;
+
+    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++)
+	for (j = i+1; (e2 = index234(state->graph->edges, j)) != NULL; j++) {
+	    if (e2->a == e->a || e2->a == e->b ||
+		e2->b == e->a || e2->b == e->b)
+		continue;
+	    if (cross(state->pts[e2->a], state->pts[e2->b],
+		      state->pts[e->a], state->pts[e->b]))
+		count++;
+	}
+
+    return count;
+}
+
+static void benchmark(int n, int ndrags, int solved)
+{
+    game_params params;
+    random_state *rs = random_new("untangle", 8);
+    game_state **states;
+    char *desc, *aux = NULL, **moves, buf[80];
+    double tmove, tgrid, tpairs;
+    clock_t start;
+    long limit;
+    int i, check = 0;
+
+    params.n = n;
+    desc = new_game_desc(&params, rs, &aux, FALSE);
+    states = snewn(ndrags+1, game_state *);
+    states[0] = new_game(NULL, &params, desc);
+    if (solved) {
+	game_state *s = execute_move(states[0], aux);
+	free_game(states[0]);
+	states[0] = s;
+    }
+    limit = states[0]->w * (long)PREFERRED_TILESIZE;
+
+    /*
+     * Choose the drags in advance, so that only execute_move is
+     * inside the timing loop. Nudges are worked out from where the
+     * point was in the solution, so they don't wander off.
+     */
+    moves = snewn(ndrags, char *);
+    for (i = 0; i < ndrags; i++) {
+	int p = random_upto(rs, n);
+	long x = random_upto(rs, limit), y = random_upto(rs, limit);
+	if (solved) {
+	    point pt = states[0]->pts[p];
+	    x = pt.x * PREFERRED_TILESIZE / pt.d - PREFERRED_TILESIZE +
+		random_upto(rs, 2 * PREFERRED_TILESIZE);
+	    y = pt.y * PREFERRED_TILESIZE / pt.d - PREFERRED_TILESIZE +
+		random_upto(rs, 2 * PREFERRED_TILESIZE);
+	    x = max(0, min(x, limit-1));
+	    y = max(0, min(y, limit-1));
+	}
+	sprintf(buf, "P%d:%ld,%ld/%d", p, x, y, PREFERRED_TILESIZE);
+	moves[i] = dupstr(buf);
+    }
+
+    start = clock();
+    for (i = 0; i < ndrags; i++)
+	states[i+1] = execute_move(states[i], moves[i]);
+    tmove = elapsed(start, ndrags);
+
+    start = clock();
+    for (i = 1; i <= ndrags; i++)
+	check += find_crossings(states[i]->pts, n, states[i]->graph->elist,
+				states[i]->graph->nedges, NULL, FALSE);
+    tgrid = elapsed(start, ndrags);
+
+    start = clock();
+    for (i = 1; i <= ndrags; i++)
+	check -= allpairs_crossings(states[i]);
+    tpairs = elapsed(start, ndrags);
+
+    for (i = 1; i <= ndrags; i++)
+	if (states[i]->ncrossings != allpairs_crossings(states[i]))
+	    check = 1;
+
+    printf("%5d %6d %-8s %13.2f %11.2f %10.2f   %s\n", n,
+	   states[0]->graph->nedges, solved ? "solved" : "tangled",
+	   tmove, tgrid, tpairs, check ? "MISMATCH" : "ok");
+
+    for (i = 0; i < ndrags; i++)
+	sfree(moves[i]);
+    sfree(moves);
+    for (i = 0; i <= ndrags; i++)
+	free_game(states[i]);
+    sfree(states);
+    sfree(desc);
+    sfree(aux);
+    random_free(rs);
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[] = { 10, 25, 50, 100 };
+    int ndrags = 2000, nsizes = 0, i;
+
+    printf("    n  edges start     us per drag:  move  full grid"
+	   "  all pairs\n");
+    while (--argc > 0) {
+	char *p = *++argv;
+	if (!strcmp(p, "-d") && argc > 1) {
+	    ndrags = atoi(*++argv);
+	    argc--;
+	} else {
+	    benchmark(atoi(p), ndrags, FALSE);
+	    benchmark(atoi(p), ndrags, TRUE);
+	    nsizes++;
+	}
+    }
+    if (!nsizes)
+	for (i = 0; i < lenof(sizes); i++) {
+	    benchmark(sizes[i], ndrags, FALSE);
+	    benchmark(sizes[i], ndrags, TRUE);
+	}
+
+    return 0;
+}
+
+#endif